@@ -0,0 +1,305 @@
+// Micro-benchmark da API do database.c: carrega uma base sintética de N turmas
+// e M alunos num diretório próprio e mede cada função exportada, com
+// percentis de latência e bytes gravados por operação.
+//
+// Compilar (a partir desta pasta):
+//   gcc -O2 -pthread -o benchmark_database benchmark_database.c ../database.c
+//   cl /O2 benchmark_database.c ..\database.c
+//
+// Uso: benchmark_database [-t turmas] [-a alunos] [-s semente]
+//                         [-d imediata|agrupada|manual] [-m] [-o diretório]
+// O diretório (padrão bench_dados) tem os .dat e o log apagados antes de começar.
+
+#include "../database.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#define criar_diretorio(d) _mkdir(d)
+#define mudar_diretorio(d) _chdir(d)
+#else
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#define criar_diretorio(d) mkdir(d, 0755)
+#define mudar_diretorio(d) chdir(d)
+#endif
+
+#define AULAS_BENCH 20           // datas de presença lançadas por aluno
+#define MAX_PRESENCAS_BENCH 50   // mesmo limite de Aluno.presencas
+
+static const char* ARQUIVOS_BASE[] = {
+    "turmas.dat", "alunos.dat", "frequencia.dat", "registros.dat", "database.log", NULL
+};
+
+// --- Relógio e bytes gravados ---
+
+#ifdef _WIN32
+static double agora_ns() {
+    static LARGE_INTEGER frequencia;
+    LARGE_INTEGER t;
+    if (!frequencia.QuadPart) QueryPerformanceFrequency(&frequencia);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart * 1e9 / (double)frequencia.QuadPart;
+}
+
+static long long bytes_escritos() {
+    IO_COUNTERS io;
+    return GetProcessIoCounters(GetCurrentProcess(), &io) ? (long long)io.WriteTransferCount : -1;
+}
+#else
+static double agora_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+// wchar de /proc/self/io conta todo write() do processo, inclusive a
+// compactação; fora do Linux, cai para o tamanho dos arquivos da base
+static long long bytes_escritos() {
+    FILE* f = fopen("/proc/self/io", "r");
+    if (f) {
+        char linha[128];
+        long long valor = -1;
+        while (fgets(linha, sizeof(linha), f))
+            if (sscanf(linha, "wchar: %lld", &valor) == 1) break;
+        fclose(f);
+        if (valor >= 0) return valor;
+    }
+    long long total = 0;
+    struct stat st;
+    for (int i = 0; ARQUIVOS_BASE[i]; i++)
+        if (stat(ARQUIVOS_BASE[i], &st) == 0) total += (long long)st.st_size;
+    return total;
+}
+#endif
+
+// --- Medição ---
+
+typedef struct {
+    const char* nome;
+    int operacoes;
+    int falhas;
+    double* latencias;  // ns por operação
+    double inicio_total;
+    long long bytes_inicio;
+} Medicao;
+
+static double* latencias;
+static int capacidade_latencias;
+
+static void iniciar(Medicao* m, const char* nome, int operacoes) {
+    if (operacoes > capacidade_latencias) {
+        free(latencias);
+        latencias = malloc((size_t)operacoes * sizeof(double));
+        if (!latencias) { fprintf(stderr, "sem memória\n"); exit(1); }
+        capacidade_latencias = operacoes;
+    }
+    m->nome = nome;
+    m->operacoes = 0;
+    m->falhas = 0;
+    m->latencias = latencias;
+    db_flush();
+    m->bytes_inicio = bytes_escritos();
+    m->inicio_total = agora_ns();
+}
+
+#define MEDIR(m, chamada, sucesso) do { \
+    double t0_ = agora_ns(); \
+    int r_ = (chamada); \
+    (m)->latencias[(m)->operacoes++] = agora_ns() - t0_; \
+    if (!(sucesso)) (m)->falhas++; \
+    (void)r_; \
+} while (0)
+
+static int comparar_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const double* ordenados, int n, double p) {
+    int i = (int)(p * (n - 1) + 0.5);
+    return ordenados[i];
+}
+
+static void cabecalho() {
+    printf("%-28s %8s %10s %10s %10s %10s %10s %10s %12s\n",
+           "operação", "ops", "ops/s", "p50 us", "p90 us", "p99 us", "max us", "B/op", "falhas");
+}
+
+static void finalizar(Medicao* m) {
+    double total = agora_ns() - m->inicio_total;
+    db_flush();  // nos modos adiados, os bytes da operação só saem aqui
+    long long bytes = bytes_escritos() - m->bytes_inicio;
+    int n = m->operacoes;
+    if (n == 0) return;
+    qsort(m->latencias, (size_t)n, sizeof(double), comparar_double);
+    printf("%-28s %8d %10.0f %10.2f %10.2f %10.2f %10.2f %10.1f %12d\n",
+           m->nome, n, n / (total / 1e9),
+           percentil(m->latencias, n, 0.50) / 1e3, percentil(m->latencias, n, 0.90) / 1e3,
+           percentil(m->latencias, n, 0.99) / 1e3, m->latencias[n - 1] / 1e3,
+           (double)bytes / n, m->falhas);
+}
+
+// xorshift32, para a ordem das consultas ser reproduzível com a mesma semente
+static unsigned int semente = 12345;
+static unsigned int aleatorio() {
+    semente ^= semente << 13;
+    semente ^= semente >> 17;
+    semente ^= semente << 5;
+    return semente;
+}
+
+static void data_aula(int aula, char* destino) {
+    snprintf(destino, 11, "%02d/%02d/2025", 1 + aula % 28, 2 + (aula / 28) % 11);
+}
+
+static void uso(const char* programa) {
+    fprintf(stderr, "uso: %s [-t turmas] [-a alunos] [-s semente] [-d imediata|agrupada|manual] [-m] [-o diretório]\n",
+            programa);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int num_turmas = 50, num_alunos = 5000, durabilidade = -1, mmap_ativo = 0;
+    const char* diretorio = "bench_dados";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-m")) { mmap_ativo = 1; continue; }
+        if (i + 1 >= argc) uso(argv[0]);
+        const char* valor = argv[++i];
+        if (!strcmp(argv[i - 1], "-t")) num_turmas = atoi(valor);
+        else if (!strcmp(argv[i - 1], "-a")) num_alunos = atoi(valor);
+        else if (!strcmp(argv[i - 1], "-s")) semente = (unsigned int)strtoul(valor, NULL, 10) | 1;
+        else if (!strcmp(argv[i - 1], "-o")) diretorio = valor;
+        else if (!strcmp(argv[i - 1], "-d")) {
+            if (!strcmp(valor, "imediata")) durabilidade = DB_DURABILIDADE_IMEDIATA;
+            else if (!strcmp(valor, "agrupada")) durabilidade = DB_DURABILIDADE_AGRUPADA;
+            else if (!strcmp(valor, "manual")) durabilidade = DB_DURABILIDADE_MANUAL;
+            else uso(argv[0]);
+        } else uso(argv[0]);
+    }
+    if (num_turmas <= 0 || num_alunos <= 0) uso(argv[0]);
+
+    criar_diretorio(diretorio);
+    if (mudar_diretorio(diretorio) != 0) { fprintf(stderr, "não foi possível usar %s\n", diretorio); return 1; }
+    for (int i = 0; ARQUIVOS_BASE[i]; i++) remove(ARQUIVOS_BASE[i]);
+
+    if (mmap_ativo) db_usar_mmap(1);
+    if (durabilidade >= 0) db_set_durability(durabilidade, 10);
+    turma_existe(0);  // carrega a base (vazia) fora das medições
+
+    printf("base: %d turmas, %d alunos (%d por turma), durabilidade %s%s\n\n", num_turmas, num_alunos,
+           (num_alunos + num_turmas - 1) / num_turmas,
+           durabilidade == DB_DURABILIDADE_AGRUPADA ? "agrupada" :
+           durabilidade == DB_DURABILIDADE_MANUAL ? "manual" : "imediata",
+           mmap_ativo ? ", mmap" : "");
+    cabecalho();
+
+    int maior_turma = (num_alunos + num_turmas - 1) / num_turmas;
+    Aluno* lista = malloc((size_t)maior_turma * sizeof(Aluno));
+    Presenca* presencas = malloc(MAX_PRESENCAS_BENCH * sizeof(Presenca));
+    if (!lista || !presencas) { fprintf(stderr, "sem memória\n"); return 1; }
+    Medicao m;
+
+    iniciar(&m, "salvar_turma", num_turmas);
+    for (int i = 0; i < num_turmas; i++) {
+        Turma t;
+        memset(&t, 0, sizeof(t));
+        t.id = i + 1;
+        snprintf(t.nome_disciplina, sizeof(t.nome_disciplina), "Disciplina %d", t.id);
+        snprintf(t.nome_professor, sizeof(t.nome_professor), "Professor %d", t.id % 17);
+        MEDIR(&m, salvar_turma(&t), r_ == 1);
+    }
+    finalizar(&m);
+
+    iniciar(&m, "salvar_aluno", num_alunos);
+    for (int i = 0; i < num_alunos; i++) {
+        Aluno a;
+        memset(&a, 0, sizeof(a));
+        a.matricula = 100000 + i;
+        a.id_turma = 1 + i % num_turmas;
+        snprintf(a.nome, sizeof(a.nome), "Aluno Sintetico %d", a.matricula);
+        MEDIR(&m, salvar_aluno(&a), r_ == 1);
+    }
+    finalizar(&m);
+
+    iniciar(&m, "buscar_aluno_por_matricula", num_alunos);
+    for (int i = 0; i < num_alunos; i++) {
+        Aluno a;
+        int matricula = 100000 + (int)(aleatorio() % (unsigned int)num_alunos);
+        MEDIR(&m, buscar_aluno_por_matricula(matricula, &a), r_ == 1);
+    }
+    finalizar(&m);
+
+    iniciar(&m, "listar_alunos_por_turma", num_turmas);
+    for (int i = 0; i < num_turmas; i++)
+        MEDIR(&m, listar_alunos_por_turma(1 + i, lista, maior_turma), r_ > 0);
+    finalizar(&m);
+
+    iniciar(&m, "salvar_notas", num_alunos);
+    for (int i = 0; i < num_alunos; i++) {
+        Notas n;
+        n.np1 = (float)(aleatorio() % 101) / 10.0f;
+        n.np2 = (float)(aleatorio() % 101) / 10.0f;
+        n.pim = (float)(aleatorio() % 101) / 10.0f;
+        n.media = (n.np1 * 4 + n.np2 * 4 + n.pim * 2) / 10;
+        MEDIR(&m, salvar_notas(100000 + i, &n), r_ == 1);
+    }
+    finalizar(&m);
+
+    iniciar(&m, "buscar_notas", num_alunos);
+    for (int i = 0; i < num_alunos; i++) {
+        Notas n;
+        MEDIR(&m, buscar_notas(100000 + (int)(aleatorio() % (unsigned int)num_alunos), &n), r_ == 1);
+    }
+    finalizar(&m);
+
+    // Uma chamada por aula: AULAS_BENCH datas para cada aluno
+    iniciar(&m, "adicionar_presenca", num_alunos * AULAS_BENCH);
+    for (int aula = 0; aula < AULAS_BENCH; aula++)
+        for (int i = 0; i < num_alunos; i++) {
+            Presenca p;
+            memset(&p, 0, sizeof(p));
+            data_aula(aula, p.data);
+            p.presente = (aleatorio() % 10) != 0;
+            MEDIR(&m, adicionar_presenca(100000 + i, &p), r_ == 1);
+        }
+    finalizar(&m);
+
+    iniciar(&m, "listar_presencas", num_alunos);
+    for (int i = 0; i < num_alunos; i++)
+        MEDIR(&m, listar_presencas(100000 + (int)(aleatorio() % (unsigned int)num_alunos), presencas,
+                                   MAX_PRESENCAS_BENCH), r_ == AULAS_BENCH);
+    finalizar(&m);
+
+    iniciar(&m, "buscar_presenca_por_data", num_alunos);
+    for (int i = 0; i < num_alunos; i++) {
+        Presenca p;
+        char data[11];
+        data_aula((int)(aleatorio() % AULAS_BENCH), data);
+        MEDIR(&m, buscar_presenca_por_data(100000 + (int)(aleatorio() % (unsigned int)num_alunos), data, &p), r_ == 1);
+    }
+    finalizar(&m);
+
+    iniciar(&m, "alterar_id_turma", num_turmas);
+    for (int i = 0; i < num_turmas; i++)
+        MEDIR(&m, alterar_id_turma(1 + i, 1 + i + num_turmas), r_ == 1);
+    finalizar(&m);
+
+    iniciar(&m, "deletar_turma", num_turmas);
+    for (int i = 0; i < num_turmas; i++)
+        MEDIR(&m, deletar_turma(1 + i + num_turmas), r_ == 1);
+    finalizar(&m);
+
+    iniciar(&m, "db_compactar", 1);
+    MEDIR(&m, db_compactar(), r_ == 1);
+    finalizar(&m);
+
+    free(lista);
+    free(presencas);
+    free(latencias);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,250 @@
+"""Gerador de carga para o servidor do sistema acadêmico.
+
+Simula vários clientes falando o protocolo do handle_client (quadros binários
+depois do PROTOCOLO_MAGIC; uploads numa conexão de texto, como o cliente) com
+uma mistura de comandos de semana de provas, e mostra vazão, latência por
+percentil e taxa de erros por comando.
+
+Uso (com o servidor já rodando):
+    python3 carga_servidor.py --clientes 50 --duracao 30
+    python3 carga_servidor.py --mix "UPDATE_NOTAS=50,LIST_ALUNOS_POR_TURMA=50"
+
+Antes de medir, cria --turmas turmas e --alunos alunos de teste (ids a partir
+de --base); os já existentes são reaproveitados.
+"""
+import argparse
+import os
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+# Mesmo enquadramento de cliente_gui.py (sem importá-lo, para não depender do tkinter)
+PROTOCOLO_MAGIC = b"\x00SAB"
+QUADRO = struct.Struct('<IIB')
+
+# Semana de provas: muita consulta de turma e lançamento de notas, alguns
+# envios de atividade e pouca criação de alunos
+MIX_PADRAO = {
+    "LIST_ALUNOS_POR_TURMA": 25,
+    "UPDATE_NOTAS": 20,
+    "GET_PROVAS": 12,
+    "GET_PROVAS_TURMA": 10,
+    "GET_ALUNO_DATA": 10,
+    "GET_EXAME": 5,
+    "SET_EXAME": 3,
+    "GET_TURNO": 5,
+    "LIST_FILES": 4,
+    "ADD_ALUNO": 3,
+    "UPLOAD_FILE": 3,
+}
+
+
+def receber_exato(sock, tamanho):
+    dados = bytearray()
+    while len(dados) < tamanho:
+        parte = sock.recv(min(tamanho - len(dados), 1 << 20))
+        if not parte: raise ConnectionError("o servidor encerrou a conexão")
+        dados += parte
+    return bytes(dados)
+
+
+class Cliente:
+    """Uma conexão binária persistente; um pedido por vez, como um usuário"""
+
+    def __init__(self, host, porta):
+        self.host, self.porta = host, porta
+        self.sock = None
+        self.proximo_id = 1
+
+    def conectar(self):
+        s = socket.create_connection((self.host, self.porta), timeout=30)
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        s.sendall(PROTOCOLO_MAGIC)
+        if receber_exato(s, len(PROTOCOLO_MAGIC)) != PROTOCOLO_MAGIC:
+            s.close()
+            raise ConnectionError("o servidor não fala o protocolo binário")
+        self.sock = s
+
+    def fechar(self):
+        if self.sock:
+            try: self.sock.close()
+            except OSError: pass
+        self.sock = None
+
+    def pedir(self, comando):
+        if self.sock is None: self.conectar()
+        id_pedido = self.proximo_id
+        self.proximo_id = id_pedido % 0xFFFFFFFF + 1
+        corpo = comando.encode('utf-8')
+        self.sock.sendall(QUADRO.pack(len(corpo), id_pedido, 0) + corpo)
+        tamanho, id_resposta, tipo = QUADRO.unpack(receber_exato(self.sock, QUADRO.size))
+        corpo = receber_exato(self.sock, tamanho)
+        if id_resposta != id_pedido: raise ConnectionError("resposta fora de ordem")
+        return corpo if tipo == 1 else corpo.decode('utf-8')
+
+    def enviar_arquivo(self, id_turma, nome, conteudo):
+        """UPLOAD_FILE numa conexão de texto própria (transferências não usam quadros)"""
+        with socket.create_connection((self.host, self.porta), timeout=30) as s:
+            s.sendall(f"UPLOAD_FILE|{id_turma}|{nome}|{len(conteudo)}".encode('utf-8'))
+            resposta = s.recv(1024)
+            if resposta != b"OK_SEND_DATA": return resposta.decode('utf-8', errors='replace')
+            s.sendall(conteudo)
+            return s.recv(1024).decode('utf-8', errors='replace')
+
+
+class Estatisticas:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencias = {}   # comando -> [segundos]
+        self.erros = {}       # comando -> quantidade
+        self.exemplos = {}    # comando -> primeira mensagem de erro
+
+    def registrar(self, comando, latencia, erro):
+        with self.lock:
+            self.latencias.setdefault(comando, []).append(latencia)
+            if erro:
+                self.erros[comando] = self.erros.get(comando, 0) + 1
+                self.exemplos.setdefault(comando, erro)
+
+
+def percentil(ordenados, p):
+    return ordenados[min(len(ordenados) - 1, int(p * (len(ordenados) - 1) + 0.5))]
+
+
+class Carga:
+    def __init__(self, args):
+        self.args = args
+        self.turmas = [args.base + i for i in range(args.turmas)]
+        self.matriculas = [args.base * 100 + i for i in range(args.alunos)]
+        self.proxima_matricula = args.base * 100 + args.alunos + random.randrange(1 << 20) * 1000
+        self.lock = threading.Lock()
+        self.conteudo_upload = os.urandom(args.upload_kb * 1024)
+        comandos, pesos = zip(*args.mix.items())
+        self.comandos, self.pesos = list(comandos), list(pesos)
+
+    def preparar(self):
+        """Cria a base de teste (pipeline de um cliente só, fora da medição)"""
+        c = Cliente(self.args.host, self.args.porta)
+        for id_turma in self.turmas:
+            c.pedir(f"ADD_TURMA|{id_turma}|Carga {id_turma}|Prof Carga")
+        for i, matricula in enumerate(self.matriculas):
+            c.pedir(f"ADD_ALUNO|{self.turmas[i % len(self.turmas)]}|{matricula}|Aluno Carga {matricula}")
+        c.fechar()
+
+    def nova_matricula(self):
+        with self.lock:
+            self.proxima_matricula += 1
+            return self.proxima_matricula
+
+    def comando(self, nome, rnd):
+        """Monta o comando com argumentos sorteados da base de teste"""
+        turma, matricula = rnd.choice(self.turmas), rnd.choice(self.matriculas)
+        if nome == "LIST_ALUNOS_POR_TURMA": return f"LIST_ALUNOS_POR_TURMA|{turma}"
+        if nome == "UPDATE_NOTAS":
+            np1, np2, pim = (round(rnd.uniform(0, 10), 1) for _ in range(3))
+            return f"UPDATE_NOTAS|{matricula}|{np1}|{np2}|{pim}|{(np1 * 4 + np2 * 4 + pim * 2) / 10:.2f}"
+        if nome == "GET_PROVAS_TURMA": return f"GET_PROVAS_TURMA|{turma}"
+        if nome == "GET_ALUNO_DATA": return f"GET_ALUNO_DATA|{matricula}"
+        if nome == "GET_EXAME": return f"GET_EXAME|{matricula}"
+        if nome == "SET_EXAME": return f"SET_EXAME|{matricula}|{round(rnd.uniform(0, 10), 1)}"
+        if nome == "GET_TURNO": return f"GET_TURNO|{turma}"
+        if nome == "LIST_FILES": return f"LIST_FILES|{turma}"
+        if nome == "ADD_ALUNO":
+            nova = self.nova_matricula()
+            return f"ADD_ALUNO|{turma}|{nova}|Aluno Carga {nova}"
+        return nome  # comandos sem argumentos (GET_PROVAS, LIST_TURMAS, ...)
+
+    def cliente(self, numero, fim, estat):
+        rnd = random.Random(self.args.semente * 1000 + numero)
+        c = Cliente(self.args.host, self.args.porta)
+        while time.perf_counter() < fim:
+            nome = rnd.choices(self.comandos, self.pesos)[0]
+            inicio = time.perf_counter()
+            erro = None
+            try:
+                if nome == "UPLOAD_FILE":
+                    resposta = c.enviar_arquivo(rnd.choice(self.turmas), f"carga_{numero}.bin", self.conteudo_upload)
+                else:
+                    resposta = c.pedir(self.comando(nome, rnd))
+                if isinstance(resposta, str) and resposta.startswith("ERRO"): erro = resposta
+            except (OSError, ConnectionError) as e:
+                erro = f"conexão: {e}"
+                c.fechar()
+            estat.registrar(nome, time.perf_counter() - inicio, erro)
+            if self.args.pausa: time.sleep(rnd.expovariate(1000.0 / self.args.pausa))
+        c.fechar()
+
+    def executar(self):
+        estat = Estatisticas()
+        fim = time.perf_counter() + self.args.duracao
+        threads = [threading.Thread(target=self.cliente, args=(i, fim, estat), daemon=True)
+                   for i in range(self.args.clientes)]
+        inicio = time.perf_counter()
+        for t in threads: t.start()
+        for t in threads: t.join()
+        return estat, time.perf_counter() - inicio
+
+
+def relatorio(estat, duracao):
+    print(f"{'comando':<24} {'pedidos':>8} {'ped/s':>8} {'p50 ms':>8} {'p95 ms':>8} {'p99 ms':>8} {'max ms':>8} {'erros':>7}")
+    total = erros = 0
+    todas = []
+    for nome in sorted(estat.latencias, key=lambda n: -len(estat.latencias[n])):
+        lat = sorted(estat.latencias[nome])
+        n, e = len(lat), estat.erros.get(nome, 0)
+        total += n; erros += e; todas += lat
+        print(f"{nome:<24} {n:>8} {n / duracao:>8.1f} {percentil(lat, .5) * 1e3:>8.2f} {percentil(lat, .95) * 1e3:>8.2f} "
+              f"{percentil(lat, .99) * 1e3:>8.2f} {lat[-1] * 1e3:>8.2f} {100.0 * e / n:>6.1f}%")
+    if not total:
+        print("nenhum pedido concluído"); return
+    todas.sort()
+    print(f"{'TOTAL':<24} {total:>8} {total / duracao:>8.1f} {percentil(todas, .5) * 1e3:>8.2f} {percentil(todas, .95) * 1e3:>8.2f} "
+          f"{percentil(todas, .99) * 1e3:>8.2f} {todas[-1] * 1e3:>8.2f} {100.0 * erros / total:>6.1f}%")
+    for nome, msg in estat.exemplos.items():
+        print(f"  erro em {nome}: {msg.strip()[:100]}")
+
+
+def ler_mix(texto):
+    mix = {}
+    for item in texto.split(','):
+        nome, _, peso = item.partition('=')
+        mix[nome.strip().upper()] = float(peso or 1)
+    return mix
+
+
+def main():
+    p = argparse.ArgumentParser(description="Gerador de carga para o servidor do sistema acadêmico")
+    p.add_argument("--host", default="127.0.0.1")
+    p.add_argument("--porta", type=int, default=65432)
+    p.add_argument("--clientes", type=int, default=20, help="conexões simultâneas")
+    p.add_argument("--duracao", type=float, default=20, help="segundos de medição")
+    p.add_argument("--pausa", type=float, default=0, help="pausa média entre pedidos de um cliente (ms)")
+    p.add_argument("--turmas", type=int, default=20)
+    p.add_argument("--alunos", type=int, default=2000)
+    p.add_argument("--base", type=int, default=9000, help="primeiro id de turma de teste (matrículas a partir de base*100)")
+    p.add_argument("--upload-kb", type=int, default=256, help="tamanho de cada UPLOAD_FILE")
+    p.add_argument("--mix", type=ler_mix, default=MIX_PADRAO, help="COMANDO=peso,... (padrão: semana de provas)")
+    p.add_argument("--semente", type=int, default=1)
+    p.add_argument("--sem-preparo", action="store_true", help="não cria a base de teste")
+    args = p.parse_args()
+
+    carga = Carga(args)
+    try:
+        if not args.sem_preparo:
+            inicio = time.perf_counter()
+            carga.preparar()
+            print(f"base de teste: {args.turmas} turmas, {args.alunos} alunos ({time.perf_counter() - inicio:.1f} s)")
+    except (OSError, ConnectionError) as e:
+        print(f"não foi possível preparar a base em {args.host}:{args.porta}: {e}", file=sys.stderr)
+        return 1
+    print(f"{args.clientes} clientes por {args.duracao:g} s\n")
+    estat, duracao = carga.executar()
+    relatorio(estat, duracao)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -54,9 +54,15 @@ import threading
 import multiprocessing
 import time
 import struct
+import sys
+import queue
 import calendar
+import math
 import re
 import json
+import contextlib
+import csv
+import io
 from datetime import datetime
 
 # ==============================================================================
@@ -351,8 +357,73 @@ def set_provas_turma(id_turma, np1=None, np2=None, pim=None, exame=None):
     return set_provas_turma_server(id_turma, np1, np2, pim, exame)
 
 
-def run_server():
-    """Encapsula toda a lógica do servidor para ser executada em um processo."""
+# ==============================================================================
+# PROTOCOLO BINÁRIO (QUADROS COM TAMANHO)
+# ==============================================================================
+# A conexão começa com PROTOCOLO_MAGIC (nenhum comando de texto começa com \x00)
+# e o servidor responde o mesmo MAGIC. Depois, cada pedido e cada resposta é um
+# quadro: cabeçalho QUADRO (tamanho do corpo, id do pedido, tipo) + corpo. O corpo
+# do pedido é o comando de texto de sempre ("CMD|arg|..."); o da resposta é texto
+# UTF-8 ou, nos comandos *_BIN, os structs C empacotados como na biblioteca.
+# A conexão fica aberta e o cliente pode enviar vários pedidos antes de ler as
+# respostas, que voltam com o id do pedido.
+PROTOCOLO_MAGIC = b"\x00SAB"
+QUADRO = struct.Struct('<IIB')
+QUADRO_TEXTO, QUADRO_BINARIO = 0, 1
+QUADRO_MAXIMO = 256 * 1024 * 1024
+
+def receber_exato(sock, tamanho):
+    """Lê exatamente 'tamanho' bytes; None se a conexão fechar antes"""
+    dados = bytearray()
+    while len(dados) < tamanho:
+        parte = sock.recv(min(tamanho - len(dados), 1 << 20))
+        if not parte: return None
+        dados += parte
+    return bytes(dados)
+
+def ler_quadro(sock):
+    """Retorna (id, tipo, corpo) ou None se a conexão fechou"""
+    cabecalho = receber_exato(sock, QUADRO.size)
+    if cabecalho is None: return None
+    tamanho, id_pedido, tipo = QUADRO.unpack(cabecalho)
+    if tamanho > QUADRO_MAXIMO: raise ValueError(f"quadro de {tamanho} bytes")
+    corpo = receber_exato(sock, tamanho)
+    if corpo is None: return None
+    return id_pedido, tipo, corpo
+
+def enviar_quadro(sock, id_pedido, corpo, tipo=QUADRO_TEXTO):
+    sock.sendall(QUADRO.pack(len(corpo), id_pedido, tipo) + corpo)
+
+# Resposta de DOWNLOAD_FILE/EXPORT_NOTAS: "OK_DOWNLOAD|tamanho\n" e os bytes do
+# arquivo, que podem chegar no mesmo recv (servidores antigos não mandam o '\n')
+CABECALHO_DOWNLOAD = re.compile(rb'OK_DOWNLOAD\|(\d+)\n?')
+
+def receber_download(sock, caminho):
+    """Grava o arquivo pedido em 'caminho'. Retorna None ou a mensagem de erro do servidor"""
+    inicio = sock.recv(1024)
+    m = CABECALHO_DOWNLOAD.match(inicio)
+    if not m:
+        return inicio.decode('utf-8', errors='replace') or "ERRO: Conexão encerrada pelo servidor."
+    tamanho = int(m.group(1))
+    with open(caminho, "wb") as f:
+        f.write(inicio[m.end():m.end() + tamanho])
+        recebidos = min(len(inicio) - m.end(), tamanho)
+        bloco = memoryview(bytearray(65536))
+        while recebidos < tamanho:
+            n = sock.recv_into(bloco, min(len(bloco), tamanho - recebidos))
+            if not n: break
+            f.write(bloco[:n]); recebidos += n
+    return None if recebidos == tamanho else "ERRO: Transferência incompleta."
+
+
+# Replicação (REPLICA_LOG): status (1 = registros a seguir, 0 = a réplica precisa de
+# REPLICA_COPIA), instância, sequência seguinte aos registros e a atual do primário
+CABECALHO_REPLICA = struct.Struct('<iQQQ')
+INTERVALO_REPLICA = 0.2  # segundos entre as consultas da réplica ao primário
+
+def run_server(porta=65432, primario=None):
+    """Encapsula toda a lógica do servidor para ser executada em um processo.
+    primario = "host:porta": réplica de leitura daquele servidor (ver seguir_primario)"""
     
     # Match the C structures declared in database.h exactly to avoid memory/layout issues
     class Turma(ctypes.Structure):
@@ -379,13 +450,42 @@ def run_server():
             ("num_presencas", ctypes.c_int)
         ]
 
+    class AlunoResumo(ctypes.Structure):
+        _fields_ = [("matricula", ctypes.c_int), ("nome", ctypes.c_char * 100), ("notas", Notas)]
+
+    class EstatTurma(ctypes.Structure):
+        _fields_ = [("total", ctypes.c_int), ("com_notas", ctypes.c_int), ("aprovados", ctypes.c_int), ("abaixo_da_media", ctypes.c_int),
+                    ("soma", Notas), ("minimo", Notas), ("maximo", Notas), ("media", Notas), ("variancia", Notas),
+                    ("faixas", (ctypes.c_int * 10) * 4)]
+
+    class FrequenciaData(ctypes.Structure):
+        _fields_ = [("data", ctypes.c_char * 11), ("presentes", ctypes.c_int), ("registrados", ctypes.c_int)]
+
+    METRICA_FAIXAS = 20  # DB_METRICA_FAIXAS: faixa 0 = abaixo de 1 us; faixa k = [2^(k-1), 2^k) us
+
+    class DbMetrica(ctypes.Structure):
+        _fields_ = [("nome", ctypes.c_char * 48), ("chamadas", ctypes.c_longlong), ("tempo_ns", ctypes.c_longlong),
+                    ("espera_ns", ctypes.c_longlong), ("faixas", ctypes.c_longlong * METRICA_FAIXAS)]
+
+    class DbMetricasIO(ctypes.Structure):
+        _fields_ = [(nome, ctypes.c_longlong) for nome in ("bytes_log", "bytes_turmas", "bytes_alunos", "bytes_frequencia", "bytes_registros",
+                                                           "compactacoes", "tempo_compactacao_ns", "descargas_log", "tamanho_log",
+                                                           "leituras_frios", "acertos_frios")]
+
+    class ServidorMetricas(ctypes.Structure):
+        _fields_ = [(nome, ctypes.c_longlong) for nome in ("conexoes", "acertos_cache", "faltas_cache", "repassados")]
+
+    class DbAlteracao(ctypes.Structure):
+        _fields_ = [("seq", ctypes.c_ulonglong), ("entidade", ctypes.c_int), ("acao", ctypes.c_int), ("chave", ctypes.c_int),
+                    ("valor", ctypes.c_int), ("turma", ctypes.c_int), ("registro", ctypes.c_char * 256)]
+
     try:
         lib_path = "./libdatabase.so" if os.name != 'nt' else "./database.dll"
         lib = ctypes.CDLL(lib_path)
         
         # As definições de 'salvar' devem esperar ponteiros
-        lib.salvar_turma.argtypes = [ctypes.POINTER(Turma)]
-        lib.salvar_aluno.argtypes = [ctypes.POINTER(Aluno)]
+        lib.salvar_turma.argtypes = [ctypes.POINTER(Turma)]; lib.salvar_turma.restype = ctypes.c_int
+        lib.salvar_aluno.argtypes = [ctypes.POINTER(Aluno)]; lib.salvar_aluno.restype = ctypes.c_int
 
         lib.turma_existe.argtypes = [ctypes.c_int]; lib.turma_existe.restype = ctypes.c_int
         lib.matricula_existe.argtypes = [ctypes.c_int]; lib.matricula_existe.restype = ctypes.c_int
@@ -400,6 +500,87 @@ def run_server():
         lib.alterar_id_turma.argtypes = [ctypes.c_int, ctypes.c_int]; lib.alterar_id_turma.restype = ctypes.c_int
         lib.alterar_matricula_aluno.argtypes = [ctypes.c_int, ctypes.c_int]; lib.alterar_matricula_aluno.restype = ctypes.c_int
 
+        # Funções opcionais (ausentes em builds antigas da DLL)
+        if hasattr(lib, 'db_usar_mmap'):
+            # Lê turmas.dat/alunos.dat por mapeamento de memória (deve vir antes do primeiro acesso)
+            lib.db_usar_mmap.argtypes = [ctypes.c_int]; lib.db_usar_mmap.restype = ctypes.c_int
+            lib.db_usar_mmap(1)
+        if hasattr(lib, 'db_set_durability'):
+            # Commit agrupado: alterações simultâneas (picos de lançamento de notas) viram
+            # uma escrita a cada 10 ms em vez de uma por chamada
+            lib.db_set_durability.argtypes = [ctypes.c_int, ctypes.c_int]; lib.db_set_durability.restype = ctypes.c_int
+            lib.db_flush.argtypes = []; lib.db_flush.restype = ctypes.c_int
+            lib.db_set_durability(1, 10)
+        if hasattr(lib, 'listar_resumos_por_turma'):
+            lib.contar_alunos_por_turma.argtypes = [ctypes.c_int]; lib.contar_alunos_por_turma.restype = ctypes.c_int
+            lib.listar_resumos_por_turma.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.POINTER(AlunoResumo), ctypes.c_int]; lib.listar_resumos_por_turma.restype = ctypes.c_int
+            lib.buscar_resumo_aluno.argtypes = [ctypes.c_int, ctypes.POINTER(AlunoResumo)]; lib.buscar_resumo_aluno.restype = ctypes.c_int
+        if hasattr(lib, 'buscar_alunos_por_nome'):
+            lib.buscar_alunos_por_nome.argtypes = [ctypes.c_char_p, ctypes.POINTER(AlunoResumo), ctypes.c_int]; lib.buscar_alunos_por_nome.restype = ctypes.c_int
+            lib.buscar_turmas_por_texto.argtypes = [ctypes.c_char_p, ctypes.POINTER(Turma), ctypes.c_int]; lib.buscar_turmas_por_texto.restype = ctypes.c_int
+        if hasattr(lib, 'salvar_alunos_lote'):
+            lib.salvar_turmas_lote.argtypes = [ctypes.POINTER(Turma), ctypes.c_int]; lib.salvar_turmas_lote.restype = ctypes.c_int
+            lib.salvar_alunos_lote.argtypes = [ctypes.POINTER(Aluno), ctypes.c_int]; lib.salvar_alunos_lote.restype = ctypes.c_int
+        if hasattr(lib, 'db_snapshot_begin'):
+            lib.db_snapshot_begin.argtypes = []; lib.db_snapshot_begin.restype = ctypes.c_int
+            lib.db_snapshot_end.argtypes = [ctypes.c_int]; lib.db_snapshot_end.restype = ctypes.c_int
+            lib.snapshot_contar_alunos.argtypes = [ctypes.c_int]; lib.snapshot_contar_alunos.restype = ctypes.c_int
+            lib.snapshot_listar_resumos.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.POINTER(AlunoResumo), ctypes.c_int]; lib.snapshot_listar_resumos.restype = ctypes.c_int
+        if hasattr(lib, 'estatisticas_turma'):
+            lib.estatisticas_turma.argtypes = [ctypes.c_int, ctypes.POINTER(EstatTurma)]; lib.estatisticas_turma.restype = ctypes.c_int
+        if hasattr(lib, 'frequencia_turma'):
+            lib.frequencia_aluno.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]; lib.frequencia_aluno.restype = ctypes.c_int
+            lib.frequencia_turma.argtypes = [ctypes.c_int, ctypes.POINTER(FrequenciaData), ctypes.c_int]; lib.frequencia_turma.restype = ctypes.c_int
+            lib.listar_ausentes.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.POINTER(ctypes.c_int), ctypes.c_int]; lib.listar_ausentes.restype = ctypes.c_int
+        if hasattr(lib, 'recalcular_medias'):
+            lib.recalcular_medias.argtypes = [ctypes.c_int]; lib.recalcular_medias.restype = ctypes.c_int
+        if hasattr(lib, 'db_geracao'):
+            lib.db_geracao.argtypes = []; lib.db_geracao.restype = ctypes.c_uint
+        if hasattr(lib, 'servidor_executar'):
+            # (resposta, comando, tamanho, binario) -> 0, ou < 0 para encerrar a conexão
+            SERVIDOR_TRATADOR = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p, ctypes.POINTER(ctypes.c_char), ctypes.c_int, ctypes.c_int)
+            # (socket, primeiro comando, tamanho): a conexão passa a ser do Python
+            SERVIDOR_ADOTAR = ctypes.CFUNCTYPE(None, ctypes.c_longlong, ctypes.POINTER(ctypes.c_char), ctypes.c_int)
+            lib.servidor_executar.argtypes = [ctypes.c_int, ctypes.c_int, SERVIDOR_TRATADOR, SERVIDOR_ADOTAR]; lib.servidor_executar.restype = ctypes.c_int
+            lib.servidor_responder.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int]; lib.servidor_responder.restype = ctypes.c_int
+        if hasattr(lib, 'db_registro_gravar'):
+            lib.db_registro_gravar.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]; lib.db_registro_gravar.restype = ctypes.c_int
+            lib.db_registro_remover.argtypes = [ctypes.c_int, ctypes.c_char_p]; lib.db_registro_remover.restype = ctypes.c_int
+            lib.db_registro_listar.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_int]; lib.db_registro_listar.restype = ctypes.c_int
+        if hasattr(lib, 'credenciais_derivar'):
+            lib.credenciais_iniciar.argtypes = [ctypes.c_int, ctypes.c_int]; lib.credenciais_iniciar.restype = ctypes.c_int
+            lib.credenciais_derivar.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]; lib.credenciais_derivar.restype = ctypes.c_int
+            lib.credenciais_sessao_criar.argtypes = [ctypes.c_char_p, ctypes.c_char_p]; lib.credenciais_sessao_criar.restype = ctypes.c_int
+            lib.credenciais_sessao_validar.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]; lib.credenciais_sessao_validar.restype = ctypes.c_int
+            lib.credenciais_sessao_encerrar.argtypes = [ctypes.c_char_p]; lib.credenciais_sessao_encerrar.restype = ctypes.c_int
+            lib.credenciais_sessao_encerrar_usuario.argtypes = [ctypes.c_char_p]; lib.credenciais_sessao_encerrar_usuario.restype = ctypes.c_int
+            lib.credenciais_iniciar(0, 0)
+        if hasattr(lib, 'db_metricas'):
+            lib.db_metricas.argtypes = [ctypes.POINTER(DbMetrica), ctypes.c_int]; lib.db_metricas.restype = ctypes.c_int
+            lib.db_metricas_io.argtypes = [ctypes.POINTER(DbMetricasIO)]; lib.db_metricas_io.restype = ctypes.c_int
+        if hasattr(lib, 'servidor_metricas'):
+            lib.servidor_metricas.argtypes = [ctypes.POINTER(DbMetrica), ctypes.c_int, ctypes.POINTER(ServidorMetricas)]; lib.servidor_metricas.restype = ctypes.c_int
+        if hasattr(lib, 'servidor_enviar_arquivo'):
+            lib.servidor_enviar_arquivo.argtypes = [ctypes.c_longlong, ctypes.c_char_p]; lib.servidor_enviar_arquivo.restype = ctypes.c_longlong
+            lib.servidor_receber_arquivo.argtypes = [ctypes.c_longlong, ctypes.c_char_p, ctypes.c_longlong]; lib.servidor_receber_arquivo.restype = ctypes.c_longlong
+        if hasattr(lib, 'db_replicacao_ler'):
+            u64 = ctypes.POINTER(ctypes.c_ulonglong)
+            lib.db_replicacao_estado.argtypes = [u64, u64]; lib.db_replicacao_estado.restype = ctypes.c_int
+            lib.db_replicacao_ler.argtypes = [ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.c_char_p, ctypes.c_int, u64]; lib.db_replicacao_ler.restype = ctypes.c_int
+            lib.db_replicacao_historico.argtypes = [ctypes.c_int]; lib.db_replicacao_historico.restype = ctypes.c_int
+            lib.db_replicacao_copiar.argtypes = [ctypes.c_char_p, u64, u64]; lib.db_replicacao_copiar.restype = ctypes.c_int
+            lib.db_replicacao_instalar.argtypes = [ctypes.c_char_p, u64, u64]; lib.db_replicacao_instalar.restype = ctypes.c_int
+            lib.db_replicacao_aplicar.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]; lib.db_replicacao_aplicar.restype = ctypes.c_int
+        if hasattr(lib, 'db_alteracoes_desde'):
+            lib.db_alteracoes_desde.argtypes = [ctypes.c_ulonglong, ctypes.c_ulonglong, ctypes.POINTER(DbAlteracao), ctypes.c_int,
+                                                ctypes.POINTER(ctypes.c_ulonglong)]
+            lib.db_alteracoes_desde.restype = ctypes.c_int
+        if hasattr(lib, 'servidor_somente_leitura'):
+            lib.servidor_somente_leitura.argtypes = [ctypes.c_int]; lib.servidor_somente_leitura.restype = ctypes.c_int
+        if hasattr(lib, 'salvar_notas'):
+            lib.salvar_notas.argtypes = [ctypes.c_int, ctypes.POINTER(Notas)]; lib.salvar_notas.restype = ctypes.c_int
+            lib.buscar_notas.argtypes = [ctypes.c_int, ctypes.POINTER(Notas)]; lib.buscar_notas.restype = ctypes.c_int
+
     except (OSError, AttributeError) as e:
         print(f"[SERVIDOR-ERRO] Erro fatal ao carregar a biblioteca C: {e}")
         # If C lib cannot be loaded, continue; we'll fallback for some operations
@@ -433,8 +614,13 @@ def run_server():
             return default
     
     
+    # Avança a cada gravação dos JSON do servidor (ver executar)
+    geracao_json = 0
+
     def save_json_data(filename, data):
         """Salva dados JSON no servidor"""
+        nonlocal geracao_json
+        geracao_json += 1
         try:
             tmp = filename + '.tmp'
             with open(tmp, 'w', encoding='utf-8') as f:
@@ -444,549 +630,1316 @@ def run_server():
         except Exception:
             return False
     
+    class DicionarioRastreado(dict):
+        """dict que anota as chaves acessadas desde a última gravação: alterações
+        (mesmo dentro dos valores, que só se alcançam por uma chave) ficam entre elas.
+        Percorrer items()/values() marca tudo, para não perder alterações feitas assim."""
+        def __init__(self, *args):
+            super().__init__(*args); self.tocados = set(); self.todos = False
+        def __getitem__(self, chave): self.tocados.add(chave); return super().__getitem__(chave)
+        def __setitem__(self, chave, valor): self.tocados.add(chave); super().__setitem__(chave, valor)
+        def __delitem__(self, chave): self.tocados.add(chave); super().__delitem__(chave)
+        def get(self, chave, padrao=None): self.tocados.add(chave); return super().get(chave, padrao)
+        def setdefault(self, chave, padrao=None): self.tocados.add(chave); return super().setdefault(chave, padrao)
+        def pop(self, chave, *padrao): self.tocados.add(chave); return super().pop(chave, *padrao)
+        def update(self, *args, **kwargs):
+            novos = dict(*args, **kwargs); self.tocados.update(novos); super().update(novos)
+        def items(self): self.todos = True; return super().items()
+        def values(self): self.todos = True; return super().values()
+
+    class TabelaNativa:
+        """Tabela chave -> JSON da biblioteca C (db_registro_*): cada gravação acrescenta
+        ao log só os registros que mudaram, em vez de reescrever o arquivo JSON inteiro"""
+        def __init__(self, numero):
+            self.numero = numero
+            self.gravados = {}  # chave -> JSON gravado (para pular o que não mudou)
+
+        def carregar(self):
+            tamanho = lib.db_registro_listar(self.numero, None, 0)
+            buffer = ctypes.create_string_buffer(max(tamanho, 1))
+            lib.db_registro_listar(self.numero, buffer, tamanho)
+            dados, bruto, pos = DicionarioRastreado(), buffer.raw[:tamanho], 0
+            while pos < tamanho:
+                tamanho_chave, tamanho_valor = struct.unpack_from('<ii', bruto, pos); pos += 8
+                chave = bruto[pos:pos + tamanho_chave].decode('utf-8'); pos += tamanho_chave
+                texto = bruto[pos:pos + tamanho_valor].decode('utf-8'); pos += tamanho_valor
+                try: dict.__setitem__(dados, chave, json.loads(texto))
+                except ValueError: continue
+                self.gravados[chave] = texto
+            return dados
+
+        def sincronizar(self, dados, chaves=None):
+            """Grava as chaves alteradas de 'dados' e remove as que saíram (None = todas)"""
+            if chaves is None: chaves = set(dict.keys(dados)) | set(self.gravados)
+            ok = True
+            for chave in chaves:
+                if dict.__contains__(dados, chave):
+                    texto = json.dumps(dict.__getitem__(dados, chave), ensure_ascii=False)
+                    if self.gravados.get(chave) == texto: continue
+                    bruto = texto.encode('utf-8')
+                    if lib.db_registro_gravar(self.numero, chave.encode('utf-8'), bruto, len(bruto)): self.gravados[chave] = texto
+                    else: ok = False
+                elif chave in self.gravados:
+                    lib.db_registro_remover(self.numero, chave.encode('utf-8'))
+                    del self.gravados[chave]
+            return ok
+
+        def salvar(self, dados):
+            nonlocal geracao_json
+            geracao_json += 1
+            rastreado = isinstance(dados, DicionarioRastreado)
+            ok = self.sincronizar(dados, None if not rastreado or dados.todos else dados.tocados)
+            if rastreado: dados.tocados, dados.todos = set(), False
+            return ok
+
+        def migrar(self, dados, arquivo, extrair):
+            """Importa o JSON antigo (se ainda existir) e o renomeia para .migrado"""
+            if primario: return dados  # a réplica só recebe o que o primário gravou
+            antigos = load_json_data(arquivo, None)
+            if antigos is None: return dados  # ausente ou ilegível
+            dict.clear(dados); dict.update(dados, extrair(antigos))
+            if self.sincronizar(dados): os.replace(arquivo, arquivo + ".migrado")
+            return dados
+
+    def extrair_secao(secao):
+        return lambda dados: dados.get(secao, {}) if isinstance(dados, dict) and isinstance(dados.get(secao), dict) else {}
+
+    def extrair_dict(dados):
+        return dados if isinstance(dados, dict) else {}
+
+    # Anotações são uma lista; na tabela, cada uma fica sob o seu título (único)
+    def anotacoes_por_titulo(anotacoes_list):
+        return {str(a.get('titulo', '')): a for a in anotacoes_list if isinstance(a, dict)}
+
+    # Builds com tabelas de registros guardam tudo na biblioteca C; as outras seguem nos JSON
+    if lib and hasattr(lib, 'db_registro_gravar'):
+        tabela_usuarios, tabela_provas, tabela_turnos, tabela_exames, tabela_anotacoes = (TabelaNativa(n) for n in range(5))
+    else:
+        tabela_usuarios = tabela_provas = tabela_turnos = tabela_exames = tabela_anotacoes = None
+
     def save_provas_data(provas_dict):
         """Salva dados de provas no formato correto"""
+        if tabela_provas: return tabela_provas.salvar(provas_dict)
         return save_json_data(provas_file, {'provas': provas_dict})
     
     def save_turnos_data(turnos_dict):
         """Salva dados de turnos no formato correto"""
+        if tabela_turnos: return tabela_turnos.salvar(turnos_dict)
         return save_json_data(turnos_file, {'turnos': turnos_dict})
     
     def save_exames_data(exames_dict):
         """Salva dados de exames no formato correto"""
+        if tabela_exames: return tabela_exames.salvar(exames_dict)
         return save_json_data(exames_file, {'exames': exames_dict})
     
     def save_anotacoes_data(anotacoes_list):
         """Salva dados de anotações"""
+        if tabela_anotacoes: return tabela_anotacoes.salvar(anotacoes_por_titulo(anotacoes_list))
         return save_json_data(anotacoes_file, anotacoes_list)
     
+    # Réplica de leitura: troca o banco local pela cópia do primário antes de carregar as tabelas
+    replica = None
+    def instalar_copia():
+        copia = replica["conexao"].pedir(["REPLICA_COPIA"])
+        if copia is None: raise ConnectionError("o primário não fala o protocolo binário")
+        if not isinstance(copia[0], bytes): raise ConnectionError(copia[0])
+        caminho = os.path.join(server_data_folder, "replica.copia")
+        with open(caminho, "wb") as f: f.write(copia[0])
+        instancia, seq = ctypes.c_ulonglong(), ctypes.c_ulonglong()
+        ok = lib.db_replicacao_instalar(os.fsencode(caminho), ctypes.byref(instancia), ctypes.byref(seq))
+        os.remove(caminho)
+        if not ok: raise ConnectionError("cópia do primário inválida")
+        replica["instancia"], replica["seq"] = instancia.value, seq.value
+        print(f"[REPLICA] Cópia do primário instalada (sequência {seq.value})")
+
+    if primario:
+        if not lib or not hasattr(lib, 'db_replicacao_instalar') or not tabela_usuarios:
+            print("[SERVIDOR-ERRO] A réplica precisa da biblioteca C com replicação."); return
+        host_primario, _, porta_primario = primario.rpartition(':')
+        # Uma conexão para seguir o histórico e outra para encaminhar as alterações
+        replica = {"conexao": ConexaoServidor(host_primario or HOST, int(porta_primario)),
+                   "escrita": ConexaoServidor(host_primario or HOST, int(porta_primario)),
+                   "instancia": 0, "seq": 0, "trava": threading.Lock()}
+        instalar_copia()
+
     # Carregar dados iniciais do servidor
-    server_users = load_json_data(users_file, {})
-    server_provas_raw = load_json_data(provas_file, {})
-    server_provas = server_provas_raw.get('provas', {}) if isinstance(server_provas_raw, dict) else {}
-    server_turnos_raw = load_json_data(turnos_file, {})
-    server_turnos = server_turnos_raw.get('turnos', {}) if isinstance(server_turnos_raw, dict) else {}
-    server_exames_raw = load_json_data(exames_file, {})
-    server_exames = server_exames_raw.get('exames', {}) if isinstance(server_exames_raw, dict) else {}
-    server_anotacoes = load_json_data(anotacoes_file, [])
+    if tabela_usuarios:
+        server_users = tabela_usuarios.migrar(tabela_usuarios.carregar(), users_file, extrair_dict)
+        server_provas = tabela_provas.migrar(tabela_provas.carregar(), provas_file, extrair_secao('provas'))
+        server_turnos = tabela_turnos.migrar(tabela_turnos.carregar(), turnos_file, extrair_secao('turnos'))
+        server_exames = tabela_exames.migrar(tabela_exames.carregar(), exames_file, extrair_secao('exames'))
+        anotacoes = tabela_anotacoes.migrar(tabela_anotacoes.carregar(), anotacoes_file,
+                                            lambda dados: anotacoes_por_titulo(dados if isinstance(dados, list) else []))
+        server_anotacoes = list(dict.values(anotacoes))
+    else:
+        server_users = load_json_data(users_file, {})
+        server_provas_raw = load_json_data(provas_file, {})
+        server_provas = server_provas_raw.get('provas', {}) if isinstance(server_provas_raw, dict) else {}
+        server_turnos_raw = load_json_data(turnos_file, {})
+        server_turnos = server_turnos_raw.get('turnos', {}) if isinstance(server_turnos_raw, dict) else {}
+        server_exames_raw = load_json_data(exames_file, {})
+        server_exames = server_exames_raw.get('exames', {}) if isinstance(server_exames_raw, dict) else {}
+        server_anotacoes = load_json_data(anotacoes_file, [])
+
+    usar_credenciais = bool(lib and hasattr(lib, 'credenciais_derivar'))
+
+    class CredenciaisOcupadas(Exception):
+        """Orçamento de derivações PBKDF2 da biblioteca C esgotado (rajada de logins)"""
+
+    class UserDatabaseServidor(UserDatabase):
+        # PBKDF2 no grupo de trabalhadores da biblioteca C, com SHA-NI quando há
+        def _derivar(self, password, salt, iterations):
+            senha, chave = password.encode('utf-8'), ctypes.create_string_buffer(32)
+            r = lib.credenciais_derivar(senha, len(senha), salt, len(salt), iterations, chave)
+            if r < 0: raise CredenciaisOcupadas()
+            return chave.raw if r else None
+
+        def _hash_password(self, password: str, iterations: int = 200000):
+            import secrets, base64
+            salt = secrets.token_bytes(16)
+            dk = self._derivar(password, salt, iterations) if usar_credenciais else None
+            if dk is None: return super()._hash_password(password, iterations)
+            return f"pbkdf2${iterations}${base64.b64encode(salt).decode('ascii')}${base64.b64encode(dk).decode('ascii')}"
+
+        def _verify_password_hash(self, stored: str, password: str):
+            import base64, hmac
+            if not usar_credenciais or not stored.startswith('pbkdf2$'):
+                return super()._verify_password_hash(stored, password)
+            try:
+                parts = stored.split('$')
+                iterations = int(parts[1]); salt = base64.b64decode(parts[2]); dk = base64.b64decode(parts[3])
+            except Exception:
+                return False, False
+            novo = self._derivar(password, salt, iterations) if len(dk) == 32 else None
+            if novo is None: return super()._verify_password_hash(stored, password)  # fora dos limites da biblioteca
+            return hmac.compare_digest(novo, dk), True
+
+        def save_users(self, users=None):
+            nonlocal geracao_json
+            # Na tabela nativa, um login ou uma edição grava só o usuário alterado
+            if tabela_usuarios and users is None and isinstance(self.users, DicionarioRastreado):
+                return tabela_usuarios.salvar(self.users)
+            geracao_json += 1  # usuários também entram no cache de respostas
+            return super().save_users(users)
 
     # Inicializar UserDatabase com arquivo do servidor
-    user_db = UserDatabase()
+    user_db = UserDatabaseServidor()
     user_db.filename = users_file  # Usar arquivo do servidor
     user_db.users = server_users  # Carregar usuários do servidor
     user_db.save_users()  # Salvar qualquer migração ou inicialização
 
     UPLOAD_FOLDER = "uploads"; os.makedirs(UPLOAD_FOLDER, exist_ok=True)
-    file_lock = threading.Lock()
-
 
-
-    def handle_client(conn, addr):
-        print(f"[SERVIDOR] Nova conexão de {addr}")
-        try:
-            while True:
-                data = conn.recv(1024).decode('utf-8')
-                if not data: break
-                
-                parts = data.split('|'); command = parts[0]
-                response = "ERRO: Comando não reconhecido."
-
-                if command == "ADD_TURMA":
-                    with file_lock:
-                        id_turma = int(parts[1])
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        else:
-                            if lib.turma_existe(id_turma):
-                                response = "ERRO: ID de turma já existe."
-                            else:
-                                turma = Turma(id=id_turma, nome_disciplina=parts[2].encode('utf-8'), nome_professor=parts[3].encode('utf-8'))
-                                lib.salvar_turma(ctypes.byref(turma)); response = "SUCESSO: Turma adicionada."
-                
-                elif command == "LIST_TURMAS":
-                    if not lib:
-                        response = "Nenhuma turma cadastrada."
+    # Métricas dos comandos atendidos aqui (STATS): chamadas, tempo, espera pelo
+    # file_lock, erros e histograma nas mesmas faixas de db_metricas
+    metricas_thread = threading.local()
+    metricas_comandos, metricas_lock = {}, threading.Lock()
+    metricas_cache = {"acertos": 0, "faltas": 0}
+
+    def faixa_metrica(segundos):
+        return min(int(segundos * 1e6).bit_length(), METRICA_FAIXAS - 1)
+
+    class TravaMedida:
+        """threading.Lock que soma a espera para adquiri-la ao comando em andamento na thread"""
+        def __init__(self):
+            self.trava = threading.Lock()
+        def __enter__(self):
+            inicio = time.perf_counter()
+            self.trava.acquire()
+            metricas_thread.espera = getattr(metricas_thread, 'espera', 0.0) + time.perf_counter() - inicio
+            return self
+        def __exit__(self, *exc):
+            self.trava.release()
+
+    def medir_comando(nome, tempo, erro):
+        espera, metricas_thread.espera = getattr(metricas_thread, 'espera', 0.0), 0.0
+        with metricas_lock:
+            m = metricas_comandos.get(nome)
+            if m is None:
+                m = metricas_comandos[nome] = {"chamadas": 0, "tempo": 0.0, "espera": 0.0, "erros": 0, "faixas": [0] * METRICA_FAIXAS}
+            m["chamadas"] += 1; m["tempo"] += tempo; m["espera"] += espera; m["erros"] += erro
+            m["faixas"][faixa_metrica(tempo)] += 1
+
+    file_lock = TravaMedida()
+    # Builds novas da biblioteca C têm trava interna de leitura/escrita: comandos que só
+    # mexem nela dispensam o file_lock (que continua protegendo os arquivos JSON)
+    db_lock = contextlib.nullcontext() if lib and hasattr(lib, 'db_seguro_para_threads') else file_lock
+
+
+
+    # Usam o socket diretamente (handshake OK_SEND_DATA / OK_DOWNLOAD): só na conexão de texto
+    COMANDOS_DE_TRANSFERENCIA = ("UPLOAD_FILE", "IMPORT_CSV", "EXPORT_NOTAS", "DOWNLOAD_FILE")
+    # Arquivo ainda sendo recebido (renomeado para o nome final ao terminar)
+    SUFIXO_PARCIAL = ".parte"
+
+    def receber_arquivo(conn, caminho, tamanho):
+        """Grava 'tamanho' bytes do socket direto no arquivo; retorna quantos chegaram"""
+        conn.setblocking(True)
+        if lib and hasattr(lib, 'servidor_receber_arquivo'):
+            return lib.servidor_receber_arquivo(conn.fileno(), os.fsencode(caminho), tamanho)
+        recebidos = 0
+        with open(caminho, "wb", buffering=0) as f:
+            if tamanho > 0 and hasattr(os, 'posix_fallocate'):
+                try: os.posix_fallocate(f.fileno(), 0, tamanho)
+                except OSError: pass  # sistema de arquivos sem suporte
+            bloco = memoryview(bytearray(65536))
+            while recebidos < tamanho:
+                n = conn.recv_into(bloco, min(len(bloco), tamanho - recebidos))
+                if not n: break
+                f.write(bloco[:n]); recebidos += n
+            f.truncate(recebidos)
+        return recebidos
+
+    def enviar_arquivo(conn, caminho):
+        """Envia o arquivo sem copiá-lo para o Python (sendfile/TransmitFile)"""
+        conn.setblocking(True)
+        if lib and hasattr(lib, 'servidor_enviar_arquivo'):
+            if lib.servidor_enviar_arquivo(conn.fileno(), os.fsencode(caminho)) < 0:
+                raise OSError("falha ao enviar o arquivo")
+        else:
+            with open(caminho, "rb") as f:
+                conn.sendfile(f)
+
+    def processar(conn, data, binario):
+        """Executa um comando e retorna a resposta (str, ou bytes nos comandos *_BIN).
+        None = a conexão terminou (transferências que respondem pelo próprio socket)"""
+        parts = data.split('|'); command = parts[0]
+        response = "ERRO: Comando não reconhecido."
+
+        if binario and command in COMANDOS_DE_TRANSFERENCIA:
+            response = "ERRO: Transferências de arquivo usam a conexão de texto."
+
+        elif binario and command == "LIST_TURMAS_BIN":
+            # Turma[] empacotado, direto do array ctypes
+            capacidade, count = 256, 0
+            while lib:
+                turmas = (Turma * capacidade)()
+                count = lib.listar_turmas(turmas, capacidade)
+                if count < capacidade: break
+                capacidade *= 2
+            response = ctypes.string_at(turmas, count * ctypes.sizeof(Turma)) if count else b""
+
+        elif binario and command == "LIST_RESUMOS_TURMA_BIN":
+            # AlunoResumo[] empacotado da turma
+            if not lib or not hasattr(lib, 'listar_resumos_por_turma'):
+                response = "ERRO: Resumos indisponíveis nesta versão da biblioteca C."
+            else:
+                id_turma = int(parts[1])
+                total = lib.contar_alunos_por_turma(id_turma)
+                alunos = (AlunoResumo * max(total, 1))()
+                count = lib.listar_resumos_por_turma(id_turma, 0, alunos, total)
+                response = ctypes.string_at(alunos, count * ctypes.sizeof(AlunoResumo)) if count > 0 else b""
+
+        elif command == "ADD_TURMA":
+            with db_lock:
+                id_turma = int(parts[1])
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                else:
+                    if lib.turma_existe(id_turma):
+                        response = "ERRO: ID de turma já existe."
                     else:
-                        TurmasArray = Turma * 100; turmas = TurmasArray()
-                        # CORRIGIDO: Passa o array diretamente, sem byref()
-                        count = lib.listar_turmas(turmas, 100)
-                        if count == 0:
-                            response = "Nenhuma turma cadastrada."
+                        turma = Turma(id=id_turma, nome_disciplina=parts[2].encode('utf-8'), nome_professor=parts[3].encode('utf-8'))
+                        if lib.salvar_turma(ctypes.byref(turma)):
+                            response = "SUCESSO: Turma adicionada."
                         else:
-                            response = ""
-                            for i in range(count): response += f"ID: {turmas[i].id}, Disciplina: {turmas[i].nome_disciplina.decode('utf-8')}, Prof: {turmas[i].nome_professor.decode('utf-8')}\n"
-                
-                elif command == "ADD_ALUNO":
-                    with file_lock:
-                        id_turma, matricula = int(parts[1]), int(parts[2])
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        else:
-                            if lib.matricula_existe(matricula):
-                                response = "ERRO: Matrícula já cadastrada."
-                            else:
-                                # Create an Aluno instance; nested fields (notas/avaliacoes/presencas) will be zero-initialized
-                                aluno = Aluno(id_turma=id_turma, matricula=matricula, nome=parts[3].encode('utf-8'))
-                                lib.salvar_aluno(ctypes.byref(aluno)); response = "SUCESSO: Aluno adicionado."
-
-                elif command == "LIST_ALUNOS_POR_TURMA":
-                    id_turma = int(parts[1])
-                    if not lib:
-                        response = "Nenhum aluno encontrado para esta turma."
+                            response = "ERRO: Falha ao gravar a turma."
+
+        elif command == "LIST_TURMAS":
+            if not lib:
+                response = "Nenhuma turma cadastrada."
+            else:
+                TurmasArray = Turma * 100; turmas = TurmasArray()
+                # CORRIGIDO: Passa o array diretamente, sem byref()
+                count = lib.listar_turmas(turmas, 100)
+                if count == 0:
+                    response = "Nenhuma turma cadastrada."
+                else:
+                    response = ""
+                    for i in range(count): response += f"ID: {turmas[i].id}, Disciplina: {turmas[i].nome_disciplina.decode('utf-8')}, Prof: {turmas[i].nome_professor.decode('utf-8')}\n"
+
+        elif command in ("BUSCAR_TURMAS", "BUSCAR_ALUNOS"):
+            # Busca por prefixo de palavras, sem acentos nem maiúsculas: BUSCAR_ALUNOS|texto[|limite]
+            limite = min(max(int(parts[2]) if len(parts) > 2 and parts[2] else 50, 1), 1000)
+            texto = parts[1].encode('utf-8')
+            if not lib or not hasattr(lib, 'buscar_alunos_por_nome'):
+                response = "ERRO: Busca indisponível nesta versão da biblioteca C."
+            elif command == "BUSCAR_TURMAS":
+                turmas = (Turma * limite)()
+                count = lib.buscar_turmas_por_texto(texto, turmas, limite)
+                response = "".join(f"ID: {turmas[i].id}, Disciplina: {turmas[i].nome_disciplina.decode('utf-8')}, Prof: {turmas[i].nome_professor.decode('utf-8')}\n"
+                                   for i in range(count)) or "Nenhuma turma encontrada."
+            else:
+                alunos = (AlunoResumo * limite)()
+                count = lib.buscar_alunos_por_nome(texto, alunos, limite)
+                response = "".join(f"Matrícula: {alunos[i].matricula}, Nome: {alunos[i].nome.decode('utf-8')}\n"
+                                   for i in range(count)) or "Nenhum aluno encontrado."
+
+        elif command == "ADD_ALUNO":
+            with db_lock:
+                id_turma, matricula = int(parts[1]), int(parts[2])
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                else:
+                    if lib.matricula_existe(matricula):
+                        response = "ERRO: Matrícula já cadastrada."
                     else:
-                        AlunosArray = Aluno * 100; alunos = AlunosArray()
-                        # CORRIGIDO: Passa o array diretamente, sem byref()
-                        count = lib.listar_alunos_por_turma(id_turma, alunos, 100)
-                        if count == 0:
-                            response = "Nenhum aluno encontrado para esta turma."
+                        # Create an Aluno instance; nested fields (notas/avaliacoes/presencas) will be zero-initialized
+                        aluno = Aluno(id_turma=id_turma, matricula=matricula, nome=parts[3].encode('utf-8'))
+                        if lib.salvar_aluno(ctypes.byref(aluno)):
+                            response = "SUCESSO: Aluno adicionado."
                         else:
-                            # Incluir notas, média E exame na resposta para o cliente exibir dados completos
-                            # IMPORTANTE: Dados sempre vêm do servidor, garantindo sincronização
-                            response = ""
-                            for i in range(count):
-                                try:
-                                    # Buscar notas básicas do banco C
-                                    np1 = float(alunos[i].notas.np1)
-                                    np2 = float(alunos[i].notas.np2)
-                                    pim = float(alunos[i].notas.pim)
-                                    media = float(alunos[i].notas.media)
-                                except Exception:
-                                    np1 = np2 = pim = media = 0.0
-                                
-                                # Buscar nota de exame do arquivo do servidor (exames.json)
-                                # Exame é armazenado separadamente pois não faz parte do banco C
-                                exame = get_nota_exame_local(alunos[i].matricula, server_exames)
-                                
-                                # Retornar linha completa com TODAS as informações do aluno
-                                response += (
-                                    f"Matrícula: {alunos[i].matricula}, Nome: {alunos[i].nome.decode('utf-8')}, "
-                                    f"NP1: {np1:.1f}, NP2: {np2:.1f}, PIM: {pim:.1f}, Média: {media:.1f}, Exame: {exame:.1f}\n"
-                                )
-                
-                # ... (restante dos comandos, que já estavam corretos) ...
-                elif command == "GET_TURMA_DATA":
-                    id_turma = int(parts[1]); turma_encontrada = Turma()
-                    if not lib:
-                        response = "ERRO: Biblioteca C não carregada."
-                    elif lib.buscar_turma_por_id(id_turma, ctypes.byref(turma_encontrada)):
-                        response = f"{turma_encontrada.nome_disciplina.decode('utf-8')}|{turma_encontrada.nome_professor.decode('utf-8')}"
+                            response = "ERRO: Falha ao gravar o aluno."
+
+        elif command == "LIST_ALUNOS_POR_TURMA":
+            id_turma = int(parts[1])
+            if not lib:
+                response = "Nenhum aluno encontrado para esta turma."
+            elif hasattr(lib, 'listar_resumos_por_turma'):
+                # Resumos (matrícula, nome, notas) dimensionados pela turma: evita copiar ~6 KB por aluno
+                total = lib.contar_alunos_por_turma(id_turma)
+                alunos = (AlunoResumo * max(total, 1))()
+                count = lib.listar_resumos_por_turma(id_turma, 0, alunos, total)
+            else:
+                AlunosArray = Aluno * 100; alunos = AlunosArray()
+                # CORRIGIDO: Passa o array diretamente, sem byref()
+                count = lib.listar_alunos_por_turma(id_turma, alunos, 100)
+            if lib:
+                if count == 0:
+                    response = "Nenhum aluno encontrado para esta turma."
+                else:
+                    # Incluir notas, média E exame na resposta para o cliente exibir dados completos
+                    # IMPORTANTE: Dados sempre vêm do servidor, garantindo sincronização
+                    response = ""
+                    for i in range(count):
+                        try:
+                            # Buscar notas básicas do banco C
+                            np1 = float(alunos[i].notas.np1)
+                            np2 = float(alunos[i].notas.np2)
+                            pim = float(alunos[i].notas.pim)
+                            media = float(alunos[i].notas.media)
+                        except Exception:
+                            np1 = np2 = pim = media = 0.0
+
+                        # Buscar nota de exame do arquivo do servidor (exames.json)
+                        # Exame é armazenado separadamente pois não faz parte do banco C
+                        exame = get_nota_exame_local(alunos[i].matricula, server_exames)
+
+                        # Retornar linha completa com TODAS as informações do aluno
+                        response += (
+                            f"Matrícula: {alunos[i].matricula}, Nome: {alunos[i].nome.decode('utf-8')}, "
+                            f"NP1: {np1:.1f}, NP2: {np2:.1f}, PIM: {pim:.1f}, Média: {media:.1f}, Exame: {exame:.1f}\n"
+                        )
+
+        # ... (restante dos comandos, que já estavam corretos) ...
+        elif command == "GET_TURMA_DATA":
+            id_turma = int(parts[1]); turma_encontrada = Turma()
+            if not lib:
+                response = "ERRO: Biblioteca C não carregada."
+            elif lib.buscar_turma_por_id(id_turma, ctypes.byref(turma_encontrada)):
+                response = f"{turma_encontrada.nome_disciplina.decode('utf-8')}|{turma_encontrada.nome_professor.decode('utf-8')}"
+            else:
+                response = "ERRO: Turma não encontrada."
+
+        elif command == "UPDATE_TURMA":
+            with db_lock:
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                elif lib.atualizar_turma(int(parts[1]), parts[2].encode('utf-8'), parts[3].encode('utf-8')):
+                    response = "SUCESSO: Dados da turma atualizados."
+                else:
+                    response = "ERRO: Falha ao atualizar."
+
+        elif command == "DELETE_TURMA":
+            with db_lock:
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                elif lib.deletar_turma(int(parts[1])):
+                    response = "SUCESSO: Turma e alunos associados foram excluídos."
+                else:
+                    response = "ERRO: Turma não encontrada."
+
+        elif command == "CHANGE_TURMA_ID":
+            with db_lock:
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                else:
+                    ret_code = lib.alterar_id_turma(int(parts[1]), int(parts[2]))
+                    if ret_code == 1:
+                        response = "SUCESSO: ID da turma alterado."
+                    elif ret_code == -1:
+                        response = f"ERRO: O novo ID '{parts[2]}' já está em uso."
                     else:
-                        response = "ERRO: Turma não encontrada."
-
-                elif command == "UPDATE_TURMA":
-                    with file_lock:
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        elif lib.atualizar_turma(int(parts[1]), parts[2].encode('utf-8'), parts[3].encode('utf-8')):
-                            response = "SUCESSO: Dados da turma atualizados."
-                        else:
-                            response = "ERRO: Falha ao atualizar."
-
-                elif command == "DELETE_TURMA":
-                    with file_lock:
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        elif lib.deletar_turma(int(parts[1])):
-                            response = "SUCESSO: Turma e alunos associados foram excluídos."
-                        else:
-                            response = "ERRO: Turma não encontrada."
+                        response = f"ERRO: Turma com ID antigo não encontrada."
 
-                elif command == "CHANGE_TURMA_ID":
-                    with file_lock:
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        else:
-                            ret_code = lib.alterar_id_turma(int(parts[1]), int(parts[2]))
-                            if ret_code == 1:
-                                response = "SUCESSO: ID da turma alterado."
-                            elif ret_code == -1:
-                                response = f"ERRO: O novo ID '{parts[2]}' já está em uso."
-                            else:
-                                response = f"ERRO: Turma com ID antigo não encontrada."
-
-                elif command == "GET_ALUNO_DATA":
-                    matricula = int(parts[1]); aluno_encontrado = Aluno()
-                    if not lib:
-                        response = "ERRO: Biblioteca C não carregada."
-                    elif lib.buscar_aluno_por_matricula(matricula, ctypes.byref(aluno_encontrado)):
-                        response = f"{aluno_encontrado.nome.decode('utf-8')}"
+        elif command == "GET_ALUNO_DATA":
+            matricula = int(parts[1])
+            if lib and hasattr(lib, 'buscar_resumo_aluno'):
+                # Só o nome é usado: o resumo evita montar o Aluno completo
+                aluno_encontrado = AlunoResumo(); buscar_aluno = lib.buscar_resumo_aluno
+            else:
+                aluno_encontrado = Aluno(); buscar_aluno = lib.buscar_aluno_por_matricula if lib else None
+            if not lib:
+                response = "ERRO: Biblioteca C não carregada."
+            elif buscar_aluno(matricula, ctypes.byref(aluno_encontrado)):
+                response = f"{aluno_encontrado.nome.decode('utf-8')}"
+            else:
+                response = "ERRO: Aluno não encontrado."
+
+        elif command == "GET_ESTATISTICAS_TURMA":
+            # Estatísticas calculadas na biblioteca C, sem transferir a turma inteira
+            if not lib or not hasattr(lib, 'estatisticas_turma'):
+                response = "ERRO: Estatísticas indisponíveis nesta versão da biblioteca C."
+            else:
+                est = EstatTurma()
+                if not lib.estatisticas_turma(int(parts[1]), ctypes.byref(est)):
+                    response = "ERRO: Turma sem alunos."
+                else:
+                    componentes = ("np1", "np2", "pim", "media")
+                    def por_componente(n): return {c: round(getattr(n, c), 4) for c in componentes}
+                    response = json.dumps({
+                        "total": est.total, "com_notas": est.com_notas,
+                        "aprovados": est.aprovados, "abaixo_da_media": est.abaixo_da_media,
+                        "soma": por_componente(est.soma), "minimo": por_componente(est.minimo),
+                        "maximo": por_componente(est.maximo), "media": por_componente(est.media),
+                        "variancia": por_componente(est.variancia),
+                        "faixas": {c: list(est.faixas[k]) for k, c in enumerate(componentes)},
+                    })
+
+        elif command == "GET_FREQUENCIA_TURMA":
+            # Presentes e lançados por data de aula, contados na biblioteca C
+            if not lib or not hasattr(lib, 'frequencia_turma'):
+                response = "ERRO: Frequência indisponível nesta versão da biblioteca C."
+            else:
+                id_turma, capacidade = int(parts[1]), 256
+                while True:
+                    datas = (FrequenciaData * capacidade)()
+                    n = lib.frequencia_turma(id_turma, datas, capacidade)
+                    if n < capacidade: break
+                    capacidade *= 2
+                response = json.dumps([{"data": d.data.decode('ascii'), "presentes": d.presentes,
+                                        "registrados": d.registrados} for d in datas[:n]])
+
+        elif command == "RECALCULAR_MEDIAS":
+            # RECALCULAR_MEDIAS|politica (0 = padrão, 1 = aritmética, 2 = só provas)
+            politica = int(parts[1]) if len(parts) > 1 and parts[1] else 0
+            with db_lock:
+                if not lib or not hasattr(lib, 'recalcular_medias'):
+                    response = "ERRO: Recálculo indisponível nesta versão da biblioteca C."
+                else:
+                    atualizados = lib.recalcular_medias(politica)
+                    if atualizados < 0:
+                        response = "ERRO: Política de média inválida."
                     else:
-                        response = "ERRO: Aluno não encontrado."
-
-                elif command == "UPDATE_ALUNO":
-                    with file_lock:
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        elif lib.atualizar_aluno(int(parts[1]), parts[2].encode('utf-8')):
-                            response = "SUCESSO: Dados do aluno atualizados."
-                        else:
-                            response = "ERRO: Falha ao atualizar."
-                
-                elif command == "DELETE_ALUNO":
-                    with file_lock:
-                        if lib and hasattr(lib, 'deletar_aluno'):
-                            if lib.deletar_aluno(int(parts[1])):
-                                response = "SUCESSO: Aluno excluído."
-                            else:
-                                response = "ERRO: Falha ao excluir aluno (matrícula não encontrada)."
-                        else:
-                            # Se a biblioteca C ou a função não existir, a operação não é suportada.
-                            response = "ERRO: Funcionalidade não disponível (biblioteca C ausente)."
-                
-                elif command == "CHANGE_ALUNO_ID":
-                     with file_lock:
-                        if not lib:
-                            response = "ERRO: Biblioteca C não carregada."
-                        else:
-                            ret_code = lib.alterar_matricula_aluno(int(parts[1]), int(parts[2]))
-                            if ret_code == 1:
-                                response = "SUCESSO: Matrícula alterada."
-                            elif ret_code == -1:
-                                response = f"ERRO: A nova matrícula '{parts[2]}' já existe."
-                            else:
-                                response = f"ERRO: Aluno com matrícula antiga não encontrado."
+                        response = f"SUCESSO: Média recalculada para {atualizados} alunos."
+
+        elif command == "UPDATE_ALUNO":
+            with db_lock:
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                elif lib.atualizar_aluno(int(parts[1]), parts[2].encode('utf-8')):
+                    response = "SUCESSO: Dados do aluno atualizados."
+                else:
+                    response = "ERRO: Falha ao atualizar."
+
+        elif command == "DELETE_ALUNO":
+            with db_lock:
+                if lib and hasattr(lib, 'deletar_aluno'):
+                    if lib.deletar_aluno(int(parts[1])):
+                        response = "SUCESSO: Aluno excluído."
+                    else:
+                        response = "ERRO: Falha ao excluir aluno (matrícula não encontrada)."
+                else:
+                    # Se a biblioteca C ou a função não existir, a operação não é suportada.
+                    response = "ERRO: Funcionalidade não disponível (biblioteca C ausente)."
+
+        elif command == "CHANGE_ALUNO_ID":
+             with db_lock:
+                if not lib:
+                    response = "ERRO: Biblioteca C não carregada."
+                else:
+                    ret_code = lib.alterar_matricula_aluno(int(parts[1]), int(parts[2]))
+                    if ret_code == 1:
+                        response = "SUCESSO: Matrícula alterada."
+                    elif ret_code == -1:
+                        response = f"ERRO: A nova matrícula '{parts[2]}' já existe."
+                    else:
+                        response = f"ERRO: Aluno com matrícula antiga não encontrado."
 
-                elif command == "UPDATE_NOTAS":
-                    # Client sends: UPDATE_NOTAS|matricula|np1|np2|pim|media
+        elif command == "UPDATE_NOTAS":
+            # Client sends: UPDATE_NOTAS|matricula|np1|np2|pim|media
+            try:
+                matricula = int(parts[1])
+                np1, np2, pim, media = float(parts[2]), float(parts[3]), float(parts[4]), float(parts[5])
+                # float() aceita "nan" e "inf"; nota não finita quebraria as estatísticas
+                if not all(math.isfinite(v) for v in (np1, np2, pim, media)):
+                    raise ValueError("nota não finita")
+
+                # Usar a função salvar_notas da biblioteca C
+                if lib and hasattr(lib, 'salvar_notas'):
+                    # Criar estrutura Notas
+                    notas = Notas()
+                    notas.np1 = ctypes.c_float(np1)
+                    notas.np2 = ctypes.c_float(np2)
+                    notas.pim = ctypes.c_float(pim)
+                    notas.media = ctypes.c_float(media)
+
+                    if lib.salvar_notas(matricula, ctypes.byref(notas)):
+                        response = "SUCESSO: Notas atualizadas."
+                    else:
+                        response = "ERRO: Falha ao atualizar notas via C lib."
+                else:
+                    # Fallback persistence: store in binary .dat (struct '<i4f')
+                    notas_path = os.path.join(UPLOAD_FOLDER, 'notas.dat')
+                    rec_fmt = '<i4f'  # matricula (int32), np1,np2,pim,media as floats
                     try:
-                        matricula = int(parts[1])
-                        np1, np2, pim, media = float(parts[2]), float(parts[3]), float(parts[4]), float(parts[5])
-                        
-                        # Usar a função salvar_notas da biblioteca C
-                        if lib and hasattr(lib, 'salvar_notas'):
-                            # Criar estrutura Notas
-                            notas = Notas()
-                            notas.np1 = ctypes.c_float(np1)
-                            notas.np2 = ctypes.c_float(np2)
-                            notas.pim = ctypes.c_float(pim)
-                            notas.media = ctypes.c_float(media)
-                            
-                            # Chamar salvar_notas
-                            lib.salvar_notas.argtypes = [ctypes.c_int, ctypes.POINTER(Notas)]
-                            lib.salvar_notas.restype = ctypes.c_int
-                            
-                            if lib.salvar_notas(matricula, ctypes.byref(notas)):
-                                response = "SUCESSO: Notas atualizadas."
-                            else:
-                                response = "ERRO: Falha ao atualizar notas via C lib."
-                        else:
-                            # Fallback persistence: store in binary .dat (struct '<i4f')
-                            notas_path = os.path.join(UPLOAD_FOLDER, 'notas.dat')
-                            rec_fmt = '<i4f'  # matricula (int32), np1,np2,pim,media as floats
+                        # Load existing records into a dict
+                        notas_db = {}
+                        if os.path.exists(notas_path):
                             try:
-                                # Load existing records into a dict
+                                with open(notas_path, 'rb') as bf:
+                                    data = bf.read()
+                                rec_size = struct.calcsize(rec_fmt)
+                                if len(data) % rec_size == 0:
+                                    for i in range(0, len(data), rec_size):
+                                        chunk = data[i:i+rec_size]
+                                        m, a, b, c, d = struct.unpack(rec_fmt, chunk)
+                                        notas_db[str(m)] = (a, b, c, d)
+                            except Exception:
+                                # ignore parse problems and continue with empty db
                                 notas_db = {}
-                                if os.path.exists(notas_path):
+
+                        # update current matricula
+                        notas_db[str(matricula)] = (np1, np2, pim, media)
+
+                        # write back atomically under lock
+                        with file_lock:
+                            tmp_path = notas_path + '.tmp'
+                            with open(tmp_path, 'wb') as bf:
+                                for mkey, vals in notas_db.items():
                                     try:
-                                        with open(notas_path, 'rb') as bf:
-                                            data = bf.read()
-                                        rec_size = struct.calcsize(rec_fmt)
-                                        if len(data) % rec_size == 0:
-                                            for i in range(0, len(data), rec_size):
-                                                chunk = data[i:i+rec_size]
-                                                m, a, b, c, d = struct.unpack(rec_fmt, chunk)
-                                                notas_db[str(m)] = (a, b, c, d)
+                                        m_int = int(mkey)
+                                        bf.write(struct.pack(rec_fmt, m_int, float(vals[0]), float(vals[1]), float(vals[2]), float(vals[3])))
                                     except Exception:
-                                        # ignore parse problems and continue with empty db
-                                        notas_db = {}
+                                        # skip malformed keys
+                                        continue
+                            os.replace(tmp_path, notas_path)
 
-                                # update current matricula
-                                notas_db[str(matricula)] = (np1, np2, pim, media)
-
-                                # write back atomically under lock
-                                with file_lock:
-                                    tmp_path = notas_path + '.tmp'
-                                    with open(tmp_path, 'wb') as bf:
-                                        for mkey, vals in notas_db.items():
-                                            try:
-                                                m_int = int(mkey)
-                                                bf.write(struct.pack(rec_fmt, m_int, float(vals[0]), float(vals[1]), float(vals[2]), float(vals[3])))
-                                            except Exception:
-                                                # skip malformed keys
-                                                continue
-                                    os.replace(tmp_path, notas_path)
-
-                                response = "SUCESSO: Notas salvas (fallback)."
-                            except Exception as e:
-                                response = f"ERRO: Falha ao salvar notas: {e}"
+                        response = "SUCESSO: Notas salvas (fallback)."
                     except Exception as e:
-                        response = f"ERRO: Formato inválido para UPDATE_NOTAS: {e}"
-
-                elif command == "UPLOAD_FILE":
-                    id_turma, filename, filesize = parts[1], parts[2], int(parts[3])
-                    turma_folder = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}"); os.makedirs(turma_folder, exist_ok=True)
-                    filepath = os.path.join(turma_folder, f"{int(time.time())}_{os.path.basename(filename)}")
-                    conn.sendall(b"OK_SEND_DATA")
-                    with open(filepath, "wb") as f:
-                        bytes_received = 0
-                        while bytes_received < filesize:
-                            chunk = conn.recv(4096)
-                            if not chunk: break
-                            f.write(chunk); bytes_received += len(chunk)
-                    response = "SUCESSO: Arquivo recebido."
-
-                elif command == "LIST_FILES":
-                    id_turma = parts[1]
-                    turma_folder = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}")
-                    if not os.path.exists(turma_folder):
-                        response = "Nenhuma atividade encontrada para esta turma."
-                    else:
-                        files = os.listdir(turma_folder)
-                        if not files:
-                            response = "Nenhuma atividade encontrada para esta turma."
+                        response = f"ERRO: Falha ao salvar notas: {e}"
+            except Exception as e:
+                response = f"ERRO: Formato inválido para UPDATE_NOTAS: {e}"
+
+        elif command == "UPLOAD_FILE":
+            id_turma, filename, filesize = parts[1], parts[2], int(parts[3])
+            turma_folder = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}"); os.makedirs(turma_folder, exist_ok=True)
+            filepath = os.path.join(turma_folder, f"{int(time.time())}_{os.path.basename(filename)}")
+            # Recebe com outro nome: o arquivo só aparece (e só pode ser baixado) completo
+            parcial = f"{filepath}.{threading.get_ident()}{SUFIXO_PARCIAL}"
+            conn.sendall(b"OK_SEND_DATA")
+            if receber_arquivo(conn, parcial, filesize) == filesize:
+                os.replace(parcial, filepath)
+                response = "SUCESSO: Arquivo recebido."
+            else:
+                try: os.remove(parcial)
+                except OSError: pass
+                response = "ERRO: Transferência incompleta."
+
+        elif command == "IMPORT_CSV":
+            # Client sends: IMPORT_CSV|alunos|tamanho (linhas id_turma,matricula,nome)
+            #           ou: IMPORT_CSV|turmas|tamanho (linhas id,disciplina,professor)
+            tipo, filesize = parts[1], int(parts[2])
+            conn.sendall(b"OK_SEND_DATA")
+            conteudo = bytearray()
+            while len(conteudo) < filesize:
+                chunk = conn.recv(min(65536, filesize - len(conteudo)))
+                if not chunk: break
+                conteudo += chunk
+            linhas = []
+            for campos in csv.reader(io.StringIO(conteudo.decode('utf-8-sig'))):
+                if len(campos) < 3: continue
+                try: linhas.append((int(campos[0]), int(campos[1]) if tipo == "alunos" else campos[1], campos[2]))
+                except ValueError: continue  # cabeçalho ou linha inválida
+            if not lib or not hasattr(lib, 'salvar_alunos_lote'):
+                response = "ERRO: Importação em lote indisponível nesta versão da biblioteca C."
+            elif tipo not in ("alunos", "turmas"):
+                response = "ERRO: Tipo de importação inválido."
+            else:
+                LOTE = 1000  # limita o array ctypes (~6 KB por Aluno)
+                inseridos = 0
+                with db_lock:
+                    for inicio in range(0, len(linhas), LOTE):
+                        parte = linhas[inicio:inicio + LOTE]
+                        if tipo == "alunos":
+                            arr = (Aluno * len(parte))()
+                            for k, (id_turma, matricula, nome) in enumerate(parte):
+                                arr[k].id_turma, arr[k].matricula, arr[k].nome = id_turma, matricula, nome.encode('utf-8')[:99]
+                            inseridos += lib.salvar_alunos_lote(arr, len(parte))
                         else:
-                            response = "\n".join(files)
+                            arr = (Turma * len(parte))()
+                            for k, (id_turma, disciplina, professor) in enumerate(parte):
+                                arr[k].id, arr[k].nome_disciplina, arr[k].nome_professor = id_turma, disciplina.encode('utf-8')[:99], professor.encode('utf-8')[:99]
+                            inseridos += lib.salvar_turmas_lote(arr, len(parte))
+                response = f"SUCESSO: {inseridos} registros importados ({len(linhas) - inseridos} ignorados por já existirem)."
+
+        elif command == "EXPORT_NOTAS":
+            # Exporta as notas de todos os alunos em CSV, lidas de um snapshot: o
+            # relatório fica consistente sem bloquear quem está lançando notas
+            if not lib or not hasattr(lib, 'db_snapshot_begin'):
+                response = "ERRO: Exportação indisponível nesta versão da biblioteca C."
+            else:
+                snapshot = lib.db_snapshot_begin()
+                if not snapshot:
+                    response = "ERRO: Falha ao abrir snapshot."
+                else:
+                    try:
+                        linhas = ["matricula,nome,np1,np2,pim,media"]
+                        total = lib.snapshot_contar_alunos(snapshot)
+                        LOTE = 1000; resumos = (AlunoResumo * LOTE)()
+                        for inicio in range(0, total, LOTE):
+                            c = lib.snapshot_listar_resumos(snapshot, inicio, resumos, LOTE)
+                            for i in range(c):
+                                r = resumos[i]; n = r.notas
+                                nome = r.nome.decode('utf-8', errors='replace').replace('"', '""')
+                                linhas.append(f'{r.matricula},"{nome}",{n.np1:.2f},{n.np2:.2f},{n.pim:.2f},{n.media:.2f}')
+                    finally:
+                        lib.db_snapshot_end(snapshot)
+                    conteudo = ("\n".join(linhas) + "\n").encode('utf-8')
+                    conn.sendall(f"OK_DOWNLOAD|{len(conteudo)}\n".encode('utf-8') + conteudo)
+                    return None  # Mesmo protocolo do DOWNLOAD_FILE
+
+        elif command == "LIST_FILES":
+            id_turma = parts[1]
+            turma_folder = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}")
+            if not os.path.exists(turma_folder):
+                response = "Nenhuma atividade encontrada para esta turma."
+            else:
+                files = [f for f in os.listdir(turma_folder) if not f.endswith(SUFIXO_PARCIAL)]
+                if not files:
+                    response = "Nenhuma atividade encontrada para esta turma."
+                else:
+                    response = "\n".join(files)
 
-                elif command == "DOWNLOAD_FILE":
-                    id_turma, filename = parts[1], parts[2]
-                    filepath = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}", filename)
-                    if not os.path.exists(filepath):
-                        response = "ERRO: Arquivo não encontrado."
+        elif command == "DOWNLOAD_FILE":
+            id_turma, filename = parts[1], parts[2]
+            filepath = os.path.join(UPLOAD_FOLDER, f"turma_{id_turma}", filename)
+            if not os.path.isfile(filepath) or filename.endswith(SUFIXO_PARCIAL):
+                response = "ERRO: Arquivo não encontrado."
+            else:
+                # O '\n' separa o cabeçalho dos bytes do arquivo, que seguem no mesmo envio
+                filesize = os.path.getsize(filepath)
+                conn.sendall(f"OK_DOWNLOAD|{filesize}\n".encode('utf-8'))
+                enviar_arquivo(conn, filepath)
+                return None  # Skip sending additional response
+
+        # Comandos de gerenciamento de usuários
+        elif command == "LOGIN":
+            # O PBKDF2 roda fora do file_lock: uma rajada de logins não trava os outros comandos.
+            # Com a biblioteca C, a resposta traz também um token para o LOGIN_TOKEN.
+            username, password = parts[1], parts[2] if len(parts) > 2 else ""
+            with file_lock:
+                dados = user_db.users.get(username)
+                stored = dados.get('password') if isinstance(dados, dict) and dados.get('status') != 'pending' else None
+            ok, was_hash = user_db._verify_password_hash(stored, password) if stored is not None else (False, False)
+            if ok and not was_hash:
+                # Senha antiga em texto puro: grava o hash, se ela não mudou nesse meio-tempo
+                novo = user_db._hash_password(password)
+                with file_lock:
+                    if username in user_db.users and user_db.users[username].get('password') == stored:
+                        user_db.users[username]['password'] = novo
+                        user_db.save_users()
+            with file_lock:
+                role = user_db.get_role(username) if ok else None
+            if role is None:
+                response = "ERRO: Credenciais inválidas"
+            else:
+                token = ctypes.create_string_buffer(65)
+                if usar_credenciais and lib.credenciais_sessao_criar(username.encode('utf-8'), token):
+                    response = f"SUCESSO|{role}|{token.value.decode('ascii')}"
+                else:
+                    response = f"SUCESSO|{role}"
+
+        elif command == "LOGIN_TOKEN":
+            # Reautenticação na reconexão: só confere o token, sem PBKDF2
+            usuario = ctypes.create_string_buffer(256)
+            if not usar_credenciais:
+                response = "ERRO: Sessões indisponíveis nesta versão da biblioteca C."
+            elif len(parts) < 2 or not lib.credenciais_sessao_validar(parts[1].encode('ascii', 'replace'), usuario, 256):
+                response = "ERRO: Sessão inválida ou expirada"
+            else:
+                username = usuario.value.decode('utf-8')
+                with file_lock:
+                    dados = user_db.users.get(username)
+                    role = dados.get('role') if isinstance(dados, dict) and dados.get('status') != 'pending' else None
+                response = f"SUCESSO|{username}|{role}" if role else "ERRO: Sessão inválida ou expirada"
+
+        elif command == "LOGOUT":
+            if usar_credenciais and len(parts) > 1: lib.credenciais_sessao_encerrar(parts[1].encode('ascii', 'replace'))
+            response = "SUCESSO: Sessão encerrada"
+
+        elif command == "CREATE_USER":
+            username, password, role = parts[1], parts[2] if len(parts) > 2 else "", parts[3] if len(parts) > 3 else "professor"
+            email = parts[4] if len(parts) > 4 else None
+            with file_lock:
+                success, msg = user_db.add_user(username, password, role, email)
+                response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
+
+        elif command == "GET_USER_DATA":
+            username = parts[1]
+            with file_lock:
+                user_data = user_db.get_user_data(username)
+                if user_data:
+                    # Não enviar a senha
+                    safe_data = {k: v for k, v in user_data.items() if k != 'password' and k != 'secret_answer'}
+                    response = "SUCESSO|" + json.dumps(safe_data)
+                else:
+                    response = "ERRO: Usuário não encontrado"
+
+        elif command == "UPDATE_USER":
+            username = parts[1]
+            updates_json = parts[2] if len(parts) > 2 else "{}"
+            try:
+                updates = json.loads(updates_json)
+                with file_lock:
+                    if username in user_db.users:
+                        user_db.users[username].update(updates)
+                        user_db.save_users()
+                        if usar_credenciais and ('password' in updates or 'status' in updates):
+                            lib.credenciais_sessao_encerrar_usuario(username.encode('utf-8'))
+                        response = "SUCESSO: Dados atualizados"
                     else:
-                        filesize = os.path.getsize(filepath)
-                        conn.sendall(f"OK_DOWNLOAD|{filesize}".encode('utf-8'))
-                        with open(filepath, "rb") as f:
-                            while (chunk := f.read(4096)):
-                                conn.sendall(chunk)
-                        return  # Skip sending additional response
-                
-                # Comandos de gerenciamento de usuários
-                elif command == "LOGIN":
-                    username, password = parts[1], parts[2] if len(parts) > 2 else ""
-                    with file_lock:
-                        if user_db.verify_user(username, password):
-                            role = user_db.get_role(username)
-                            response = f"SUCESSO|{role}"
-                        else:
-                            response = "ERRO: Credenciais inválidas"
-                
-                elif command == "CREATE_USER":
-                    username, password, role = parts[1], parts[2] if len(parts) > 2 else "", parts[3] if len(parts) > 3 else "professor"
-                    email = parts[4] if len(parts) > 4 else None
-                    with file_lock:
-                        success, msg = user_db.add_user(username, password, role, email)
-                        response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
-                
-                elif command == "GET_USER_DATA":
-                    username = parts[1]
-                    with file_lock:
-                        user_data = user_db.get_user_data(username)
-                        if user_data:
-                            import json
-                            # Não enviar a senha
-                            safe_data = {k: v for k, v in user_data.items() if k != 'password' and k != 'secret_answer'}
-                            response = "SUCESSO|" + json.dumps(safe_data)
-                        else:
-                            response = "ERRO: Usuário não encontrado"
-                
-                elif command == "UPDATE_USER":
-                    username = parts[1]
-                    updates_json = parts[2] if len(parts) > 2 else "{}"
-                    import json
-                    try:
-                        updates = json.loads(updates_json)
-                        with file_lock:
-                            if username in user_db.users:
-                                user_db.users[username].update(updates)
-                                user_db.save_users()
-                                response = "SUCESSO: Dados atualizados"
-                            else:
-                                response = "ERRO: Usuário não encontrado"
-                    except Exception as e:
-                        response = f"ERRO: {str(e)}"
-                
-                elif command == "UPDATE_PASSWORD":
-                    username, old_password, new_password = parts[1], parts[2], parts[3]
-                    with file_lock:
-                        success, msg = user_db.update_password(username, old_password, new_password)
-                        response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
-                
-                elif command == "SET_PASSWORD":
-                    username, new_password = parts[1], parts[2]
-                    with file_lock:
-                        success, msg = user_db.set_password(username, new_password)
-                        response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
-                
-                elif command == "LIST_USERS":
-                    with file_lock:
-                        import json
-                        safe_users = {}
-                        for uname, udata in user_db.users.items():
-                            safe_users[uname] = {k: v for k, v in udata.items() if k != 'password' and k != 'secret_answer'}
-                        response = json.dumps(safe_users, ensure_ascii=False)
-                
-                elif command == "DELETE_USER":
-                    username = parts[1]
-                    with file_lock:
-                        if username in user_db.users:
-                            del user_db.users[username]
-                            user_db.save_users()
-                            response = "SUCESSO: Usuário removido"
-                        else:
-                            response = "ERRO: Usuário não encontrado"
-                
-                elif command == "APPROVE_USER":
-                    username = parts[1]
-                    with file_lock:
-                        if username in user_db.users:
-                            user_db.users[username]['status'] = 'approved'
-                            user_db.save_users()
-                            response = "SUCESSO: Usuário aprovado"
-                        else:
-                            response = "ERRO: Usuário não encontrado"
-                
-                # Comandos para gerenciamento de provas
-                elif command == "GET_PROVAS":
-                    with file_lock:
-                        import json
-                        response = json.dumps(server_provas, ensure_ascii=False)
-                
-                elif command == "GET_PROVAS_TURMA":
-                    id_turma = str(parts[1])
-                    with file_lock:
-                        if id_turma in server_provas:
-                            import json
-                            response = json.dumps(server_provas[id_turma], ensure_ascii=False)
-                        else:
-                            response = json.dumps({'NP1': None, 'NP2': None, 'PIM': None, 'Exame': None}, ensure_ascii=False)
-                
-                elif command == "SET_PROVAS_TURMA":
-                    id_turma = str(parts[1])
-                    np1 = parts[2] if len(parts) > 2 and parts[2] else None
-                    np2 = parts[3] if len(parts) > 3 and parts[3] else None
-                    pim = parts[4] if len(parts) > 4 and parts[4] else None
-                    exame = parts[5] if len(parts) > 5 and parts[5] else None
-                    with file_lock:
-                        if id_turma not in server_provas:
-                            server_provas[id_turma] = {}
-                        if np1 is not None:
-                            server_provas[id_turma]['NP1'] = np1
-                        if np2 is not None:
-                            server_provas[id_turma]['NP2'] = np2
-                        if pim is not None:
-                            server_provas[id_turma]['PIM'] = pim
-                        if exame is not None:
-                            server_provas[id_turma]['Exame'] = exame
-                        if save_provas_data(server_provas):
-                            response = "SUCESSO: Datas de provas atualizadas"
-                        else:
-                            response = "ERRO: Falha ao salvar dados"
-                
-                # Comandos para gerenciamento de turnos
-                elif command == "GET_TURNO":
-                    id_turma = str(parts[1])
-                    with file_lock:
-                        response = server_turnos.get(id_turma, 'matutino')
-                
-                elif command == "SET_TURNO":
-                    id_turma = str(parts[1])
-                    turno = parts[2]
-                    with file_lock:
-                        server_turnos[id_turma] = turno
-                        if save_turnos_data(server_turnos):
-                            response = "SUCESSO: Turno atualizado"
-                        else:
-                            response = "ERRO: Falha ao salvar turno"
-                
-                # Comandos para gerenciamento de exames
-                elif command == "GET_EXAME":
-                    matricula = str(parts[1])
-                    with file_lock:
-                        nota = server_exames.get(matricula, 0.0)
-                        response = str(nota)
-                
-                elif command == "SET_EXAME":
-                    matricula = str(parts[1])
-                    nota = float(parts[2])
-                    with file_lock:
-                        server_exames[matricula] = nota
-                        if save_exames_data(server_exames):
-                            response = "SUCESSO: Nota de exame atualizada"
-                        else:
-                            response = "ERRO: Falha ao salvar nota"
-                
-                elif command == "GET_ALL_EXAMES":
-                    with file_lock:
-                        import json
-                        response = json.dumps(server_exames, ensure_ascii=False)
-                
-                # Comandos para gerenciamento de anotações
-                elif command == "GET_ANOTACOES":
-                    with file_lock:
-                        import json
-                        response = json.dumps(server_anotacoes, ensure_ascii=False)
-                
-                elif command == "ADD_ANOTACAO":
-                    import json
-                    import datetime
-                    anotacao_json = parts[1] if len(parts) > 1 else "{}"
-                    try:
-                        anotacao = json.loads(anotacao_json)
-                        titulo = anotacao.get('titulo', '')
-                        conteudo = anotacao.get('conteudo', '')
-                        with file_lock:
-                            # Verificar se já existe anotação com mesmo título
-                            exists = False
-                            for a in server_anotacoes:
-                                if a.get('titulo') == titulo:
-                                    exists = True
-                                    break
-                            
-                            if exists:
-                                response = "ERRO: Anotação com este título já existe"
-                            else:
-                                nova_anotacao = {
-                                    'titulo': titulo,
-                                    'conteudo': conteudo,
-                                    'data': datetime.datetime.now().strftime("%d/%m/%Y %H:%M")
-                                }
-                                server_anotacoes.append(nova_anotacao)
-                                if save_anotacoes_data(server_anotacoes):
-                                    response = "SUCESSO: Anotação adicionada"
-                                else:
-                                    response = "ERRO: Falha ao salvar anotação"
-                    except Exception as e:
-                        response = f"ERRO: {str(e)}"
-                
-                elif command == "UPDATE_ANOTACAO":
-                    import json
-                    titulo_antigo = parts[1] if len(parts) > 1 else ""
-                    anotacao_json = parts[2] if len(parts) > 2 else "{}"
-                    try:
-                        anotacao = json.loads(anotacao_json)
-                        with file_lock:
-                            encontrado = False
-                            for a in server_anotacoes:
-                                if a.get('titulo') == titulo_antigo:
-                                    a.update(anotacao)
-                                    encontrado = True
-                                    break
-                            
-                            if encontrado and save_anotacoes_data(server_anotacoes):
-                                response = "SUCESSO: Anotação atualizada"
-                            else:
-                                response = "ERRO: Anotação não encontrada"
-                    except Exception as e:
-                        response = f"ERRO: {str(e)}"
-                
-                elif command == "DELETE_ANOTACAO":
-                    titulo = parts[1] if len(parts) > 1 else ""
-                    with file_lock:
-                        server_anotacoes = [a for a in server_anotacoes if a.get('titulo') != titulo]
+                        response = "ERRO: Usuário não encontrado"
+            except Exception as e:
+                response = f"ERRO: {str(e)}"
+
+        elif command == "UPDATE_PASSWORD":
+            username, old_password, new_password = parts[1], parts[2], parts[3]
+            with file_lock:
+                success, msg = user_db.update_password(username, old_password, new_password)
+                response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
+            if success and usar_credenciais: lib.credenciais_sessao_encerrar_usuario(username.encode('utf-8'))
+
+        elif command == "SET_PASSWORD":
+            username, new_password = parts[1], parts[2]
+            with file_lock:
+                success, msg = user_db.set_password(username, new_password)
+                response = f"SUCESSO: {msg}" if success else f"ERRO: {msg}"
+            if success and usar_credenciais: lib.credenciais_sessao_encerrar_usuario(username.encode('utf-8'))
+
+        elif command == "LIST_USERS":
+            with file_lock:
+                safe_users = {}
+                for uname, udata in user_db.users.items():
+                    safe_users[uname] = {k: v for k, v in udata.items() if k != 'password' and k != 'secret_answer'}
+                response = json.dumps(safe_users, ensure_ascii=False)
+
+        elif command == "DELETE_USER":
+            username = parts[1]
+            with file_lock:
+                if username in user_db.users:
+                    del user_db.users[username]
+                    user_db.save_users()
+                    if usar_credenciais: lib.credenciais_sessao_encerrar_usuario(username.encode('utf-8'))
+                    response = "SUCESSO: Usuário removido"
+                else:
+                    response = "ERRO: Usuário não encontrado"
+
+        elif command == "APPROVE_USER":
+            username = parts[1]
+            with file_lock:
+                if username in user_db.users:
+                    user_db.users[username]['status'] = 'approved'
+                    user_db.save_users()
+                    response = "SUCESSO: Usuário aprovado"
+                else:
+                    response = "ERRO: Usuário não encontrado"
+
+        # Comandos para gerenciamento de provas
+        elif command == "GET_PROVAS":
+            with file_lock:
+                response = json.dumps(server_provas, ensure_ascii=False)
+
+        elif command == "GET_PROVAS_TURMA":
+            id_turma = str(parts[1])
+            with file_lock:
+                if id_turma in server_provas:
+                    response = json.dumps(server_provas[id_turma], ensure_ascii=False)
+                else:
+                    response = json.dumps({'NP1': None, 'NP2': None, 'PIM': None, 'Exame': None}, ensure_ascii=False)
+
+        elif command == "SET_PROVAS_TURMA":
+            id_turma = str(parts[1])
+            np1 = parts[2] if len(parts) > 2 and parts[2] else None
+            np2 = parts[3] if len(parts) > 3 and parts[3] else None
+            pim = parts[4] if len(parts) > 4 and parts[4] else None
+            exame = parts[5] if len(parts) > 5 and parts[5] else None
+            with file_lock:
+                if id_turma not in server_provas:
+                    server_provas[id_turma] = {}
+                if np1 is not None:
+                    server_provas[id_turma]['NP1'] = np1
+                if np2 is not None:
+                    server_provas[id_turma]['NP2'] = np2
+                if pim is not None:
+                    server_provas[id_turma]['PIM'] = pim
+                if exame is not None:
+                    server_provas[id_turma]['Exame'] = exame
+                if save_provas_data(server_provas):
+                    response = "SUCESSO: Datas de provas atualizadas"
+                else:
+                    response = "ERRO: Falha ao salvar dados"
+
+        # Comandos para gerenciamento de turnos
+        elif command == "GET_TURNO":
+            id_turma = str(parts[1])
+            with file_lock:
+                response = server_turnos.get(id_turma, 'matutino')
+
+        elif command == "SET_TURNO":
+            id_turma = str(parts[1])
+            turno = parts[2]
+            with file_lock:
+                server_turnos[id_turma] = turno
+                if save_turnos_data(server_turnos):
+                    response = "SUCESSO: Turno atualizado"
+                else:
+                    response = "ERRO: Falha ao salvar turno"
+
+        # Comandos para gerenciamento de exames
+        elif command == "GET_EXAME":
+            matricula = str(parts[1])
+            with file_lock:
+                nota = server_exames.get(matricula, 0.0)
+                response = str(nota)
+
+        elif command == "SET_EXAME":
+            matricula = str(parts[1])
+            nota = float(parts[2])
+            with file_lock:
+                server_exames[matricula] = nota
+                if save_exames_data(server_exames):
+                    response = "SUCESSO: Nota de exame atualizada"
+                else:
+                    response = "ERRO: Falha ao salvar nota"
+
+        elif command == "GET_ALL_EXAMES":
+            with file_lock:
+                response = json.dumps(server_exames, ensure_ascii=False)
+
+        # Comandos para gerenciamento de anotações
+        elif command == "GET_ANOTACOES":
+            with file_lock:
+                response = json.dumps(server_anotacoes, ensure_ascii=False)
+
+        elif command == "ADD_ANOTACAO":
+            import datetime
+            anotacao_json = parts[1] if len(parts) > 1 else "{}"
+            try:
+                anotacao = json.loads(anotacao_json)
+                titulo = anotacao.get('titulo', '')
+                conteudo = anotacao.get('conteudo', '')
+                with file_lock:
+                    # Verificar se já existe anotação com mesmo título
+                    exists = False
+                    for a in server_anotacoes:
+                        if a.get('titulo') == titulo:
+                            exists = True
+                            break
+
+                    if exists:
+                        response = "ERRO: Anotação com este título já existe"
+                    else:
+                        nova_anotacao = {
+                            'titulo': titulo,
+                            'conteudo': conteudo,
+                            'data': datetime.datetime.now().strftime("%d/%m/%Y %H:%M")
+                        }
+                        server_anotacoes.append(nova_anotacao)
                         if save_anotacoes_data(server_anotacoes):
-                            response = "SUCESSO: Anotação removida"
+                            response = "SUCESSO: Anotação adicionada"
                         else:
-                            response = "ERRO: Falha ao remover anotação"
+                            response = "ERRO: Falha ao salvar anotação"
+            except Exception as e:
+                response = f"ERRO: {str(e)}"
 
-                conn.sendall(response.encode('utf-8'))
+        elif command == "UPDATE_ANOTACAO":
+            titulo_antigo = parts[1] if len(parts) > 1 else ""
+            anotacao_json = parts[2] if len(parts) > 2 else "{}"
+            try:
+                anotacao = json.loads(anotacao_json)
+                titulo_novo = anotacao.get('titulo', titulo_antigo)
+                with file_lock:
+                    # O título identifica a anotação (a tabela nativa guarda uma por título)
+                    if titulo_novo != titulo_antigo and any(a.get('titulo') == titulo_novo for a in server_anotacoes):
+                        response = "ERRO: Anotação com este título já existe"
+                    else:
+                        encontrado = False
+                        for a in server_anotacoes:
+                            if a.get('titulo') == titulo_antigo:
+                                a.update(anotacao)
+                                encontrado = True
+                                break
+
+                        if encontrado and save_anotacoes_data(server_anotacoes):
+                            response = "SUCESSO: Anotação atualizada"
+                        else:
+                            response = "ERRO: Anotação não encontrada"
+            except Exception as e:
+                response = f"ERRO: {str(e)}"
+
+        elif command == "DELETE_ANOTACAO":
+            titulo = parts[1] if len(parts) > 1 else ""
+            with file_lock:
+                server_anotacoes[:] = [a for a in server_anotacoes if a.get('titulo') != titulo]
+                if save_anotacoes_data(server_anotacoes):
+                    response = "SUCESSO: Anotação removida"
+                else:
+                    response = "ERRO: Falha ao remover anotação"
+
+        elif binario and command == "REPLICA_LOG":
+            # Histórico a partir da sequência da réplica (CABECALHO_REPLICA + registros do log)
+            if not lib or not hasattr(lib, 'db_replicacao_ler'):
+                response = "ERRO: Replicação indisponível nesta versão da biblioteca C."
+            else:
+                instancia, seq = int(parts[1]), int(parts[2])
+                fim, estado = ctypes.c_ulonglong(), ctypes.c_ulonglong()
+                # Começa pequeno; o buffer do tamanho do histórico só quando a transação não coube
+                for tamanho in (1 << 20, 8 * 1024 * 1024):
+                    buffer = ctypes.create_string_buffer(tamanho)
+                    n = lib.db_replicacao_ler(instancia, seq, buffer, tamanho, ctypes.byref(fim))
+                    lib.db_replicacao_estado(None, ctypes.byref(estado))
+                    if n != 0 or estado.value == seq: break
+                response = CABECALHO_REPLICA.pack(int(n >= 0), instancia, fim.value, estado.value) + (buffer.raw[:n] if n > 0 else b"")
+
+        elif binario and command == "REPLICA_COPIA":
+            # .dat compactados de uma vez (db_replicacao_copiar), para a réplica recomeçar
+            if not lib or not hasattr(lib, 'db_replicacao_copiar'):
+                response = "ERRO: Replicação indisponível nesta versão da biblioteca C."
+            else:
+                caminho = os.path.join(server_data_folder, f"replica_{threading.get_ident()}.copia")
+                instancia, seq = ctypes.c_ulonglong(), ctypes.c_ulonglong()
+                if lib.db_replicacao_copiar(os.fsencode(caminho), ctypes.byref(instancia), ctypes.byref(seq)):
+                    with open(caminho, "rb") as f: response = f.read()
+                    os.remove(caminho)
+                else:
+                    response = "ERRO: Falha ao gerar a cópia para a réplica."
+
+        elif command == "GET_CHANGES_SINCE":
+            # Chega aqui sem o servidor nativo (ou com argumentos que ele não aceitou)
+            if not lib or not hasattr(lib, 'db_alteracoes_desde'):
+                response = "ERRO: Alterações indisponíveis nesta versão da biblioteca C."
+            else:
+                response = alteracoes_desde(int(parts[1]), int(parts[2]), int(parts[3]) if len(parts) > 3 and parts[3] else 0)
+
+        elif command == "STATS":
+            # STATS = tabela de texto; STATS|prometheus = formato de exposição do Prometheus
+            response = relatorio_metricas(len(parts) > 1 and parts[1].lower() == "prometheus")
+
+        return response
+
+    # GET_CHANGES_SINCE: mesmos nomes e limites de cmd_alteracoes_desde (servidor.c)
+    ENTIDADES_ALTERACAO = (None, "turma", "aluno", "registro", "todos_alunos")
+    ACOES_ALTERACAO = (None, "inserir", "alterar", "remover", "nova_chave")
+    TABELAS_ALTERACAO = ("usuarios", "provas", "turnos", "exames", "anotacoes")
+    ALTERACOES_POR_RESPOSTA = 1000
+
+    def alteracoes_desde(instancia, seq, espera_ms):
+        """JSON das alterações a partir de seq; sem nenhuma, consulta de novo até espera_ms"""
+        lista = (DbAlteracao * ALTERACOES_POR_RESPOSTA)()
+        proxima = ctypes.c_ulonglong()
+        prazo = time.monotonic() + min(espera_ms, 30000) / 1000
+        while True:
+            n = lib.db_alteracoes_desde(instancia, seq, lista, len(lista), ctypes.byref(proxima)) if instancia else -1
+            if n != 0 or time.monotonic() >= prazo: break
+            time.sleep(0.05)
+        if n < 0:
+            atual = ctypes.c_ulonglong()
+            lib.db_replicacao_estado(ctypes.byref(atual), ctypes.byref(proxima))
+            instancia = atual.value
+        alteracoes = []
+        for a in lista[:max(n, 0)]:
+            item = {"seq": a.seq, "entidade": ENTIDADES_ALTERACAO[a.entidade], "acao": ACOES_ALTERACAO[a.acao]}
+            if item["entidade"] == "registro":
+                if a.chave == 0: continue  # contas de usuário não são publicadas
+                item.update(tabela=TABELAS_ALTERACAO[a.chave], chave=a.registro.decode('utf-8', errors='replace'))
+            elif item["entidade"] != "todos_alunos":
+                item["chave"] = a.chave
+                if item["entidade"] == "aluno": item["turma"] = a.turma
+                if item["acao"] == "nova_chave": item["valor"] = a.valor
+            alteracoes.append(item)
+        return json.dumps({"instancia": instancia, "seq": proxima.value, "recarregar": n < 0, "mais": n == len(lista),
+                           "alteracoes": alteracoes}, ensure_ascii=False, separators=(',', ':'))
+
+    def coletar_metricas():
+        """(comandos, funções da biblioteca, E/S, caches, servidor nativo). Comandos e funções:
+        nome -> (origem, chamadas, tempo s, espera s, erros, faixas)"""
+        with metricas_lock:
+            comandos = {nome: ("python", m["chamadas"], m["tempo"], m["espera"], m["erros"], list(m["faixas"]))
+                        for nome, m in metricas_comandos.items()}
+            caches = {"python": (metricas_cache["acertos"], metricas_cache["faltas"])}
+        funcoes, io, nativo = {}, None, None
+        if lib and hasattr(lib, 'db_metricas'):
+            capacidade = max(lib.db_metricas(None, 0), 1)
+            itens = (DbMetrica * capacidade)()
+            for m in itens[:min(lib.db_metricas(itens, capacidade), capacidade)]:
+                funcoes[m.nome.decode()] = ("c", m.chamadas, m.tempo_ns / 1e9, m.espera_ns / 1e9, 0, list(m.faixas))
+            io = DbMetricasIO(); lib.db_metricas_io(ctypes.byref(io))
+            if hasattr(lib, 'db_cache_frios'): caches["avaliacoes"] = (io.acertos_frios, io.leituras_frios)
+        if lib and hasattr(lib, 'servidor_metricas'):
+            nativo = ServidorMetricas()
+            capacidade = max(lib.servidor_metricas(None, 0, None), 1)
+            itens = (DbMetrica * capacidade)()
+            lib.servidor_metricas(itens, capacidade, ctypes.byref(nativo))
+            for m in itens:
+                if m.chamadas:
+                    # Aqui espera_ns é o tempo na fila dos trabalhadores
+                    comandos[m.nome.decode()] = ("nativo", m.chamadas, m.tempo_ns / 1e9, m.espera_ns / 1e9, 0, list(m.faixas))
+            caches["nativo"] = (nativo.acertos_cache, nativo.faltas_cache)
+        return comandos, funcoes, io, caches, nativo
+
+    def limite_faixa(k):
+        """Limite superior (s) da faixa k; a última não tem limite"""
+        return None if k == METRICA_FAIXAS - 1 else (1 << k) * 1e-6
+
+    def percentil_faixas(faixas, p):
+        total, acumulado = sum(faixas), 0
+        for k, n in enumerate(faixas):
+            acumulado += n
+            if total and acumulado >= p * total: return limite_faixa(k)
+        return None
+
+    def relatorio_metricas(prometheus):
+        comandos, funcoes, io, caches, nativo = coletar_metricas()
+        if prometheus:
+            linhas = []
+            def serie(nome, tipo, ajuda, valores):
+                linhas.append(f"# HELP {nome} {ajuda}"); linhas.append(f"# TYPE {nome} {tipo}")
+                linhas.extend(f"{nome}{rotulos} {valor}" for rotulos, valor in valores)
+            def histograma(nome, ajuda, rotulo, itens):
+                linhas.append(f"# HELP {nome} {ajuda}"); linhas.append(f"# TYPE {nome} histogram")
+                for chave, (origem, chamadas, tempo, _, _, faixas) in itens:
+                    base, acumulado = f'{rotulo}="{chave}",origem="{origem}"', 0
+                    for k, n in enumerate(faixas):
+                        acumulado += n
+                        limite = limite_faixa(k)
+                        linhas.append(f'{nome}_bucket{{{base},le="{limite if limite is not None else "+Inf"}"}} {acumulado}')
+                    linhas.append(f"{nome}_sum{{{base}}} {tempo}"); linhas.append(f"{nome}_count{{{base}}} {chamadas}")
+            for tabela, prefixo, rotulo in ((comandos, "sistema_comando", "comando"), (funcoes, "sistema_db_funcao", "funcao")):
+                itens = sorted(tabela.items())
+                serie(f"{prefixo}_chamadas_total", "counter", "Chamadas", [(f'{{{rotulo}="{c}",origem="{m[0]}"}}', m[1]) for c, m in itens])
+                serie(f"{prefixo}_espera_segundos_total", "counter", "Espera pela trava (ou pela fila, origem nativo)",
+                      [(f'{{{rotulo}="{c}",origem="{m[0]}"}}', m[3]) for c, m in itens])
+                if tabela is comandos:
+                    serie(f"{prefixo}_erros_total", "counter", "Respostas ERRO", [(f'{{{rotulo}="{c}",origem="{m[0]}"}}', m[4]) for c, m in itens])
+                histograma(f"{prefixo}_duracao_segundos", "Duração das chamadas", rotulo, itens)
+            if io:
+                serie("sistema_db_bytes_escritos_total", "counter", "Bytes gravados pela biblioteca",
+                      [(f'{{arquivo="{a}"}}', getattr(io, f"bytes_{a}")) for a in ("log", "turmas", "alunos", "frequencia", "registros")])
+                serie("sistema_db_compactacoes_total", "counter", "Compactações do log", [("", io.compactacoes)])
+                serie("sistema_db_compactacao_segundos_total", "counter", "Tempo compactando", [("", io.tempo_compactacao_ns / 1e9)])
+                serie("sistema_db_descargas_log_total", "counter", "Descargas do buffer do log", [("", io.descargas_log)])
+                serie("sistema_db_tamanho_log_bytes", "gauge", "Tamanho atual do log", [("", io.tamanho_log)])
+            serie("sistema_cache_acertos_total", "counter", "Respostas servidas do cache", [(f'{{cache="{c}"}}', v[0]) for c, v in caches.items()])
+            serie("sistema_cache_faltas_total", "counter", "Respostas de leitura montadas de novo", [(f'{{cache="{c}"}}', v[1]) for c, v in caches.items()])
+            if nativo:
+                serie("sistema_conexoes_total", "counter", "Conexões aceitas pelo servidor nativo", [("", nativo.conexoes)])
+                serie("sistema_comandos_repassados_total", "counter", "Comandos do servidor nativo repassados ao Python", [("", nativo.repassados)])
+            return "\n".join(linhas) + "\n"
+
+        def tabela(titulo, itens, rotulo_espera):
+            linhas = [titulo, f"{'nome':<28} {'origem':<7} {'chamadas':>9} {'total s':>9} {'média ms':>9} {'p99 ms <=':>10} {rotulo_espera:>10} {'erros':>6}"]
+            for nome, (origem, chamadas, tempo, espera, erros, faixas) in sorted(itens.items(), key=lambda i: -i[1][2]):
+                p99 = percentil_faixas(faixas, 0.99)
+                linhas.append(f"{nome:<28} {origem:<7} {chamadas:>9} {tempo:>9.3f} {1e3 * tempo / max(chamadas, 1):>9.3f} "
+                              f"{'-' if p99 is None else f'{p99 * 1e3:.3f}':>10} {espera * 1e3:>10.1f} {erros:>6}")
+            return linhas
+        linhas = tabela("COMANDOS", comandos, "espera ms")
+        if funcoes: linhas += [""] + tabela("BIBLIOTECA C", funcoes, "trava ms")
+        if io:
+            linhas += ["", "E/S", f"log: {io.bytes_log} bytes em {io.descargas_log} descargas (tamanho atual {io.tamanho_log})",
+                       f"compactações: {io.compactacoes} ({io.tempo_compactacao_ns / 1e9:.3f} s), "
+                       f"turmas.dat {io.bytes_turmas}, alunos.dat {io.bytes_alunos}, frequencia.dat {io.bytes_frequencia}, "
+                       f"registros.dat {io.bytes_registros} bytes"]
+        linhas += ["", "CACHE"] + [f"{c}: {a} acertos, {f} faltas ({100.0 * a / max(a + f, 1):.1f}%)" for c, (a, f) in caches.items()]
+        if nativo: linhas.append(f"servidor nativo: {nativo.conexoes} conexões, {nativo.repassados} comandos repassados ao Python")
+        return "\n".join(linhas)
+
+    # Cache das respostas de leitura, já codificadas: uma entrada vale enquanto a geração
+    # (db_geracao da biblioteca C, geracao_json dos arquivos do servidor) não muda
+    COMANDOS_CACHE_JSON = ("LIST_USERS", "GET_USER_DATA", "GET_PROVAS", "GET_PROVAS_TURMA", "GET_TURNO",
+                           "GET_EXAME", "GET_ALL_EXAMES", "GET_ANOTACOES")
+    COMANDOS_CACHE_DB = ("LIST_TURMAS", "LIST_TURMAS_BIN", "LIST_ALUNOS_POR_TURMA", "LIST_RESUMOS_TURMA_BIN",
+                         "GET_TURMA_DATA", "GET_ALUNO_DATA", "GET_ESTATISTICAS_TURMA", "GET_FREQUENCIA_TURMA",
+                         "BUSCAR_TURMAS", "BUSCAR_ALUNOS")
+    geracao_db = lib.db_geracao if lib and hasattr(lib, 'db_geracao') else None
+    # Sem db_geracao (DLL antiga) não há como saber quando os dados da biblioteca mudam
+    comandos_cache = COMANDOS_CACHE_JSON + (COMANDOS_CACHE_DB if geracao_db else ())
+    cache_respostas, LIMITE_CACHE = {}, 4096
+
+    RESPOSTA_DESCONHECIDO = "ERRO: Comando não reconhecido.".encode('utf-8')
+
+    def executar(conn, data, binario):
+        """executar_com_cache() somando o comando às métricas do STATS"""
+        inicio, metricas_thread.espera = time.perf_counter(), 0.0
+        resultado, erro = None, 1
+        try:
+            resultado = executar_com_cache(conn, data, binario)
+            erro = int(resultado is not None and resultado[1] == QUADRO_TEXTO and resultado[0].startswith(b"ERRO"))
+            return resultado
+        finally:
+            nome = data.split('|', 1)[0]
+            if resultado is not None and resultado[0] == RESPOSTA_DESCONHECIDO: nome = "(desconhecido)"
+            medir_comando(nome, time.perf_counter() - inicio, erro)
+
+    # Na réplica rodam localmente só as consultas; o resto vai ao primário
+    COMANDOS_REPLICA = COMANDOS_CACHE_JSON + COMANDOS_CACHE_DB + ("STATS", "REPLICA_LOG", "REPLICA_COPIA", "GET_CHANGES_SINCE")
+
+    def recarregar_tabelas(bits):
+        """Relê da biblioteca as tabelas de registros alteradas pela replicação (bit 1 << tabela)"""
+        nonlocal geracao_json
+        tabelas = (tabela_usuarios, server_users), (tabela_provas, server_provas), (tabela_turnos, server_turnos), (tabela_exames, server_exames)
+        with file_lock:
+            for tabela, dados in tabelas:
+                if not bits & (1 << tabela.numero): continue
+                tabela.gravados.clear()
+                dict.clear(dados); dict.update(dados, tabela.carregar())
+            if bits & (1 << tabela_anotacoes.numero):
+                tabela_anotacoes.gravados.clear()
+                server_anotacoes[:] = list(dict.values(tabela_anotacoes.carregar()))
+            geracao_json += 1
+
+    def alcancar_primario():
+        """Aplica o histórico do primário até a sequência atual dele. Sem o trecho
+        pedido (primário reiniciado ou réplica atrasada demais), instala uma cópia nova"""
+        with replica["trava"]:
+            while True:
+                resposta = replica["conexao"].pedir([f"REPLICA_LOG|{replica['instancia']}|{replica['seq']}"])
+                if resposta is None: raise ConnectionError("o primário não fala o protocolo binário")
+                if not isinstance(resposta[0], bytes): raise ConnectionError(resposta[0])
+                status, _, fim, atual = CABECALHO_REPLICA.unpack_from(resposta[0])
+                registros = resposta[0][CABECALHO_REPLICA.size:]
+                tabelas = ctypes.c_int(0)
+                n = lib.db_replicacao_aplicar(registros, len(registros), ctypes.byref(tabelas)) if status else -1
+                if n < 0:
+                    instalar_copia()
+                    recarregar_tabelas((1 << 5) - 1)
+                    continue
+                if tabelas.value: recarregar_tabelas(tabelas.value)
+                replica["seq"] = fim
+                if not n or fim >= atual: return
+
+    def seguir_primario():
+        while True:
+            try:
+                alcancar_primario()
+            except (OSError, ConnectionError, ValueError, struct.error) as e:
+                print(f"[REPLICA-ERRO] Falha ao seguir o primário: {e}")
+                time.sleep(1)
+            time.sleep(INTERVALO_REPLICA)
+
+    def encaminhar_ao_primario(data, binario):
+        """Executa no primário e espera a réplica alcançá-lo (quem grava lê o que gravou)"""
+        if data.split('|', 1)[0] in COMANDOS_DE_TRANSFERENCIA:
+            return "ERRO: Transferências de arquivo devem ser feitas no servidor primário.".encode('utf-8'), QUADRO_TEXTO
+        try:
+            resposta = replica["escrita"].pedir([data])
+            if resposta is None: raise ConnectionError("o primário não fala o protocolo binário")
+            alcancar_primario()
+        except (OSError, ConnectionError, ValueError, struct.error) as e:
+            print(f"[REPLICA-ERRO] Falha ao encaminhar ao primário: {e}")
+            return "ERRO: Servidor primário indisponível.".encode('utf-8'), QUADRO_TEXTO
+        corpo = resposta[0]
+        return (corpo, QUADRO_BINARIO) if isinstance(corpo, bytes) else (corpo.encode('utf-8'), QUADRO_TEXTO)
+
+    def executar_com_cache(conn, data, binario):
+        """processar() com o cache de respostas: retorna (corpo, tipo do quadro), ou None"""
+        if replica and data.split('|', 1)[0] not in COMANDOS_REPLICA: return encaminhar_ao_primario(data, binario)
+        chave = (data, binario) if data.split('|', 1)[0] in comandos_cache else None
+        if chave:
+            # Lida antes da consulta: uma gravação no meio deixa a entrada já vencida
+            geracao = (geracao_db() if geracao_db else 0, geracao_json)
+            item = cache_respostas.get(chave)
+            acerto = bool(item and item[0] == geracao)
+            with metricas_lock: metricas_cache["acertos" if acerto else "faltas"] += 1
+            if acerto: return item[1]
+        try:
+            response = processar(conn, data, binario)
+        except CredenciaisOcupadas:
+            return "ERRO: Servidor ocupado, tente novamente.".encode('utf-8'), QUADRO_TEXTO
+        if response is None: return None
+        resultado = (response, QUADRO_BINARIO) if isinstance(response, bytes) else (response.encode('utf-8'), QUADRO_TEXTO)
+        if chave:
+            if len(cache_respostas) >= LIMITE_CACHE: cache_respostas.clear()
+            cache_respostas[chave] = (geracao, resultado)
+        return resultado
+
+    def handle_client(conn, addr, inicial=None):
+        # inicial: primeiro comando de uma conexão de texto já lido pelo laço de eventos nativo
+        print(f"[SERVIDOR] Nova conexão de {addr}")
+        try:
+            binario = inicial is None and conn.recv(1, socket.MSG_PEEK) == PROTOCOLO_MAGIC[:1]
+            if binario:
+                if receber_exato(conn, len(PROTOCOLO_MAGIC)) != PROTOCOLO_MAGIC: return
+                # Quadros pequenos em sequência: sem Nagle, cada resposta sai na hora
+                conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                conn.sendall(PROTOCOLO_MAGIC)
+            while True:
+                if binario:
+                    quadro = ler_quadro(conn)
+                    if quadro is None: break
+                    id_pedido, _, corpo = quadro
+                    data = corpo.decode('utf-8')
+                elif inicial is not None:
+                    data, inicial = inicial.decode('utf-8'), None
+                else:
+                    data = conn.recv(1024).decode('utf-8')
+                    if not data: break
+
+                resultado = executar(conn, data, binario)
+                if resultado is None: return
+                corpo, tipo = resultado
+                if binario: enviar_quadro(conn, id_pedido, corpo, tipo)
+                else: conn.sendall(corpo)
         except Exception as e:
             print(f"[SERVIDOR-ERRO] Erro com {addr}: {e}")
         finally:
             print(f"[SERVIDOR] Conexão com {addr} encerrada."); conn.close()
     
+    if replica:
+        threading.Thread(target=seguir_primario, daemon=True).start()
+
+    if lib and hasattr(lib, 'servidor_executar'):
+        # Laço de eventos nativo: uma thread de E/S atende todas as conexões e um grupo fixo de
+        # trabalhadores executa os comandos. Os que só usam a biblioteca rodam em C; os demais
+        # chegam aqui pelo tratador, e as transferências de arquivo voltam para handle_client.
+        def tratar(resposta, comando, tamanho, binario):
+            try:
+                resultado = executar(None, ctypes.string_at(comando, tamanho).decode('utf-8'), bool(binario))
+            except Exception as e:
+                print(f"[SERVIDOR-ERRO] Erro no comando: {e}")
+                return -1  # encerra a conexão, como no handle_client
+            if resultado is None: return -1
+            corpo, tipo = resultado
+            lib.servidor_responder(resposta, corpo, len(corpo), tipo == QUADRO_BINARIO)
+            return 0
+
+        def adotar(soquete, dados, tamanho):
+            try:
+                conn = socket.socket(fileno=soquete); conn.setblocking(True)
+                threading.Thread(target=handle_client, args=(conn, conn.getpeername(), ctypes.string_at(dados, tamanho)), daemon=True).start()
+            except Exception as e:
+                print(f"[SERVIDOR-ERRO] Erro ao assumir conexão: {e}")
+
+        tratador, adotante = SERVIDOR_TRATADOR(tratar), SERVIDOR_ADOTAR(adotar)
+        if replica and hasattr(lib, 'servidor_somente_leitura'): lib.servidor_somente_leitura(1)
+        print(f"[SERVIDOR] Escutando em 0.0.0.0:{porta} (laço de eventos nativo)")
+        lib.servidor_executar(porta, 0, tratador, adotante)
+        print("[SERVIDOR-ERRO] Laço de eventos nativo indisponível, usando uma thread por conexão")
+
     server = socket.socket(socket.AF_INET, socket.SOCK_STREAM); server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-    server.bind(('0.0.0.0', 65432)); server.listen()
-    print("[SERVIDOR] Escutando em 0.0.0.0:65432")
+    server.bind(('0.0.0.0', porta)); server.listen()
+    print(f"[SERVIDOR] Escutando em 0.0.0.0:{porta}")
     while True:
         conn, addr = server.accept(); threading.Thread(target=handle_client, args=(conn, addr), daemon=True).start()
 
@@ -996,13 +1949,130 @@ HOST, PORT = '127.0.0.1', 65432
 # FUNÇÕES AUXILIARES PARA COMUNICAÇÃO COM O SERVIDOR VIA SOCKET
 # ==============================================================================
 
-def send_server_command(command, buffer=8192):
-    """Envia um comando ao servidor e retorna a resposta"""
-    try:
+class ConexaoServidor:
+    """Conexão persistente no protocolo binário, com até JANELA pedidos em voo.
+
+    Com um servidor antigo (que não responde o PROTOCOLO_MAGIC), pedir() retorna
+    None e o chamador usa uma conexão de texto por comando, como antes.
+    """
+    JANELA = 32
+
+    def __init__(self, host, port):
+        self.host, self.port = host, port
+        self.sock = None
+        self.binario = None  # None = ainda não negociado
+        self.proximo_id = 1
+        self.lock = threading.Lock()
+
+    def _conectar(self):
+        s = socket.create_connection((self.host, self.port))
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        s.sendall(PROTOCOLO_MAGIC)
+        self.binario = receber_exato(s, len(PROTOCOLO_MAGIC)) == PROTOCOLO_MAGIC
+        if self.binario: self.sock = s
+        else: s.close()
+
+    def _fechar(self):
+        if self.sock:
+            try: self.sock.close()
+            except OSError: pass
+        self.sock = None
+
+    def pedir(self, comandos):
+        """Envia os comandos em pipeline e retorna as respostas na mesma ordem
+        (str, ou bytes nos comandos *_BIN)"""
+        if not comandos: return []
+        with self.lock:
+            reaproveitada = self.sock is not None
+            if not reaproveitada:
+                if self.binario is False: return None
+                self._conectar()
+                if not self.binario: return None
+            respostas = [None] * len(comandos)
+            try:
+                self._pipeline(comandos, respostas)
+            except (OSError, ConnectionError):
+                self._fechar()
+                # Conexão antiga derrubada (servidor reiniciado): nada foi atendido, tenta de novo
+                if not reaproveitada or any(r is not None for r in respostas): raise
+                self._conectar()
+                if not self.binario: return None
+                try: self._pipeline(comandos, respostas)
+                except (OSError, ConnectionError):
+                    self._fechar()
+                    raise
+            return respostas
+
+    def _pipeline(self, comandos, respostas):
+        pendentes = {}  # id -> posição do comando
+        enviados = 0
+        while enviados < len(comandos) or pendentes:
+            while enviados < len(comandos) and len(pendentes) < self.JANELA:
+                id_pedido = self.proximo_id
+                self.proximo_id = id_pedido % 0xFFFFFFFF + 1
+                pendentes[id_pedido] = enviados
+                enviar_quadro(self.sock, id_pedido, comandos[enviados].encode('utf-8'))
+                enviados += 1
+            quadro = ler_quadro(self.sock)
+            if quadro is None: raise ConnectionError("o servidor encerrou a conexão")
+            id_pedido, tipo, corpo = quadro
+            respostas[pendentes.pop(id_pedido)] = corpo if tipo == QUADRO_BINARIO else corpo.decode('utf-8')
+
+conexao_servidor = ConexaoServidor(HOST, PORT)
+
+ESPERA_ALTERACOES_MS = 25000  # o servidor segura o GET_CHANGES_SINCE até haver alteração
+INTERVALO_ALTERACOES_MS = 300  # a interface confere a fila local do acompanhamento
+
+class AcompanhamentoAlteracoes:
+    """Segue o GET_CHANGES_SINCE numa conexão própria (a espera deixa a conexão
+    ocupada) e põe na fila (alterações, recarregar) a cada resposta com novidades.
+    A fila é consumida pela thread da interface."""
+
+    def __init__(self, host=HOST, port=PORT):
+        self.conexao = ConexaoServidor(host, port)
+        self.fila = queue.Queue()
+        self.instancia, self.seq = 0, 0
+        self.parado = threading.Event()
+        threading.Thread(target=self._seguir, daemon=True).start()
+
+    def parar(self):
+        self.parado.set()
+        self.conexao._fechar()
+
+    def _seguir(self):
+        while not self.parado.is_set():
+            try:
+                resposta = self.conexao.pedir([f"GET_CHANGES_SINCE|{self.instancia}|{self.seq}|{ESPERA_ALTERACOES_MS}"])
+                # Servidor sem o comando: as telas só se atualizam quando pedidas
+                if resposta is None or not resposta[0].startswith('{'): return
+                dados = json.loads(resposta[0])
+            except (OSError, ConnectionError, ValueError):
+                if self.parado.wait(2): return
+                continue
+            # O primeiro pedido sempre volta com recarregar: só marca o ponto de partida
+            primeiro = not self.instancia
+            self.instancia, self.seq = dados["instancia"], dados["seq"]
+            if dados["alteracoes"] or (dados["recarregar"] and not primeiro):
+                self.fila.put((dados["alteracoes"], dados["recarregar"]))
+
+def send_server_commands(commands, buffer=8192):
+    """Envia vários comandos de uma vez e retorna as respostas na mesma ordem.
+    Levanta a exceção de conexão em caso de falha."""
+    respostas = conexao_servidor.pedir(commands)
+    if respostas is not None: return respostas
+    # Servidor antigo: uma conexão de texto por comando (respostas limitadas a 'buffer')
+    respostas = []
+    for command in commands:
         with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
             s.connect((HOST, PORT))
             s.sendall(command.encode('utf-8'))
-            return s.recv(buffer).decode('utf-8')
+            respostas.append(s.recv(buffer).decode('utf-8'))
+    return respostas
+
+def send_server_command(command, buffer=8192):
+    """Envia um comando ao servidor e retorna a resposta"""
+    try:
+        return send_server_commands([command], buffer)[0]
     except Exception as e:
         print(f"[CLIENTE-ERRO] Erro ao conectar ao servidor: {e}")
         return None
@@ -3219,6 +4289,7 @@ class App(tk.Tk):
         self._setup_theme() # <-- MUDANÇA: Centraliza a configuração de estilo
         # Initialize sorting state early (used by _update_display before widgets may be created)
         self._sort_state = {}
+        self._exibicao = None  # ("turmas",) ou ("alunos", id_turma): lista que as alterações atualizam
         # Apply theme according to dark_mode flag
         try:
             self._apply_app_theme()
@@ -3230,6 +4301,44 @@ class App(tk.Tk):
         
         self.protocol("WM_DELETE_WINDOW", self.on_closing)
         self.listar_turmas()
+        # A lista exibida se atualiza sozinha quando outro cliente altera os dados
+        self.alteracoes = AcompanhamentoAlteracoes()
+        self.after(INTERVALO_ALTERACOES_MS, self._aplicar_alteracoes)
+
+    def destroy(self):
+        if hasattr(self, 'alteracoes'): self.alteracoes.parar()
+        super().destroy()
+
+    def _alteracao_afeta(self, a):
+        """Se a alteração (GET_CHANGES_SINCE) muda a lista exibida em self._exibicao"""
+        entidade, chave = a["entidade"], str(a.get("chave"))
+        if self._exibicao == ("turmas",):
+            return (entidade == "turma" or (entidade == "aluno" and a["acao"] in ("inserir", "remover")) or
+                    (entidade == "registro" and a["tabela"] == "turnos"))
+        id_t = self._exibicao[1]
+        return (entidade == "todos_alunos" or (entidade == "turma" and chave == id_t) or
+                (entidade == "aluno" and str(a["turma"]) == id_t) or
+                (entidade == "registro" and (a["tabela"] == "exames" or (a["tabela"] == "turnos" and chave == id_t))))
+
+    def _aplicar_alteracoes(self):
+        """Refaz só a lista exibida, e só se alguma alteração recebida a afeta"""
+        afeta = False
+        while True:
+            try: alteracoes, recarregar = self.alteracoes.fila.get_nowait()
+            except queue.Empty: break
+            if not self._exibicao: continue
+            afeta = afeta or recarregar or any(self._alteracao_afeta(a) for a in alteracoes)
+            # Turma exibida trocou de id ou foi removida
+            for a in alteracoes:
+                if self._exibicao[0] != "alunos" or a["entidade"] != "turma" or str(a["chave"]) != self._exibicao[1]: continue
+                if a["acao"] == "nova_chave": self._exibicao = ("alunos", str(a["valor"]))
+                elif a["acao"] == "remover": self._exibicao = ("turmas",)
+        if afeta and self._exibicao:
+            # Se a tela não puder ser refeita (turma sumiu, acesso), deixa de acompanhar
+            exibicao, self._exibicao = self._exibicao, None
+            if exibicao == ("turmas",): self.listar_turmas()
+            else: self._refresh_aluno_list(exibicao[1])
+        self.after(INTERVALO_ALTERACOES_MS, self._aplicar_alteracoes)
 
     def _load_image_with_transparency(self, img_path, size=None):
         """Load image (PNG preferred) with alpha compositing over current background.
@@ -4211,13 +5320,21 @@ class App(tk.Tk):
             messagebox.showinfo("Perfil do Usuário", info)
             
     def _send_request(self, request, buffer=8192):
-        try:
-            with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
-                s.connect((HOST, PORT)); s.sendall(request.encode('utf-8')); return s.recv(buffer).decode('utf-8')
-        except Exception as e: messagebox.showerror("Erro de Conexão", f"Não foi possível conectar ao servidor: {e}"); return None
+        return self._send_requests([request], buffer)[0]
+
+    def _send_requests(self, requests, buffer=8192):
+        """Vários pedidos numa só ida ao servidor (pipeline); None nas respostas se falhar"""
+        try: return send_server_commands(requests, buffer)
+        except Exception as e: messagebox.showerror("Erro de Conexão", f"Não foi possível conectar ao servidor: {e}"); return [None] * len(requests)
+
+    def _listar_alunos_turmas(self, resp_turmas):
+        """LIST_ALUNOS_POR_TURMA de todas as turmas de uma resposta de LIST_TURMAS, em pipeline"""
+        ids = [linha.split(', ')[0].split(': ')[1] for linha in resp_turmas.strip().split('\n') if linha.startswith('ID: ')]
+        return dict(zip(ids, self._send_requests([f"LIST_ALUNOS_POR_TURMA|{tid}" for tid in ids])))
 
     def _update_display(self, title, headers, data):
         """Atualiza o display com novos dados"""
+        self._exibicao = None
         try:
             # Atualiza o cabeçalho se existir
             if hasattr(self, 'header_label'):
@@ -4655,12 +5772,13 @@ class App(tk.Tk):
                 return
             
             id_t = None
+            alunos_por_turma = self._listar_alunos_turmas(resp_list)
             for linha in resp_list.strip().split('\n'):
                 if linha:
                     partes = linha.split(', ')
                     tid = partes[0].split(': ')[1]
                     
-                    alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                    alunos_resp = alunos_por_turma.get(tid)
                     if alunos_resp and "Nenhum aluno" not in alunos_resp:
                         for aluno_linha in alunos_resp.strip().split('\n'):
                             if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -4733,6 +5851,7 @@ class App(tk.Tk):
         # Buscar todas as turmas
         turmas_resp = self._send_request("LIST_TURMAS")
         if turmas_resp and "Nenhuma turma" not in turmas_resp:
+            alunos_por_turma = self._listar_alunos_turmas(turmas_resp)
             for linha in turmas_resp.strip().split('\n'):
                 if linha:
                     partes = linha.split(', ')
@@ -4743,7 +5862,7 @@ class App(tk.Tk):
                         continue
                     
                     # Buscar alunos da turma
-                    alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                    alunos_resp = alunos_por_turma.get(tid)
                     if alunos_resp and "Nenhum aluno" not in alunos_resp:
                         for aluno_linha in alunos_resp.strip().split('\n'):
                             if aluno_linha:
@@ -4778,6 +5897,31 @@ class App(tk.Tk):
         aluno_combo.pack(fill=tk.X, pady=(0, 10))
         if aluno_values:
             aluno_combo.current(0)
+
+        # Filtro por nome: prefixos das palavras, sem acentos nem maiúsculas (BUSCAR_ALUNOS).
+        # A lista continua restrita aos alunos acessíveis; servidores antigos filtram aqui.
+        tk.Label(search_frame, text="Filtrar por nome:", font=('Arial', 10, 'bold'),
+                bg=self.colors['card'], fg=self.colors['text']).pack(anchor='w', pady=(0, 5))
+        filtro_var = tk.StringVar()
+        ttk.Entry(search_frame, textvariable=filtro_var, width=60, font=('Arial', 10)).pack(fill=tk.X, pady=(0, 10))
+
+        def filtrar_alunos(*_):
+            texto = filtro_var.get().strip()
+            visiveis = alunos_disponiveis
+            if texto:
+                resp = self._send_request(f"BUSCAR_ALUNOS|{texto.replace('|', ' ')[:99]}|1000")
+                if resp and not resp.startswith("ERRO"):
+                    encontrados = {linha.split(', ')[0].split(': ')[1] for linha in resp.strip().split('\n') if linha.startswith("Matrícula: ")}
+                    visiveis = [a for a in alunos_disponiveis if a['matricula'] in encontrados]
+                else:
+                    visiveis = [a for a in alunos_disponiveis if texto.casefold() in a['nome'].casefold()]
+            aluno_combo['values'] = [f"{a['matricula']} - {a['nome']}" for a in visiveis]
+            if visiveis:
+                aluno_combo.current(0)
+            else:
+                aluno_var.set("")
+
+        filtro_var.trace_add('write', filtrar_alunos)
         
         # Frame para exibir informações
         info_frame = tk.LabelFrame(main_frame, text="Informações Detalhadas", 
@@ -5413,6 +6557,7 @@ class App(tk.Tk):
             turmas_data = []
             turno_usuario = self.db.users.get(self.username, {}).get('turno', 'matutino')
             
+            alunos_por_turma = self._listar_alunos_turmas(resp)
             for linha in resp.strip().split('\n'):
                 if linha:
                     # Extrai os dados da linha
@@ -5430,7 +6575,7 @@ class App(tk.Tk):
                             continue  # Pula turmas de outros turnos
                     
                     # Conta alunos da turma
-                    alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{id_turma}")
+                    alunos_resp = alunos_por_turma.get(id_turma)
                     total_alunos = 0
                     if alunos_resp and "Nenhum aluno" not in alunos_resp:
                         total_alunos = len(alunos_resp.strip().split('\n'))
@@ -5446,6 +6591,7 @@ class App(tk.Tk):
             self._update_display("Lista de Turmas", headers, turmas_data)
         else:
             self._update_display("Lista de Turmas", [], [])
+        self._exibicao = ("turmas",)
     
     def calendario_provas(self):
         """Interface de calendário de provas com controle de acesso por perfil"""
@@ -5474,13 +6620,14 @@ class App(tk.Tk):
         
         id_turma = None
         disciplina = None
+        alunos_por_turma = self._listar_alunos_turmas(resp_list)
         for linha in resp_list.strip().split('\n'):
             if linha:
                 partes = linha.split(', ')
                 tid = partes[0].split(': ')[1]
                 disc = partes[1].split(': ')[1]
                 
-                alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                alunos_resp = alunos_por_turma.get(tid)
                 if alunos_resp and "Nenhum aluno" not in alunos_resp:
                     for aluno_linha in alunos_resp.strip().split('\n'):
                         if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -5867,6 +7014,7 @@ class App(tk.Tk):
             # Buscar todas as turmas e seus alunos
             turmas_resp = self._send_request("LIST_TURMAS")
             if turmas_resp and "Nenhuma turma" not in turmas_resp:
+                alunos_por_turma = self._listar_alunos_turmas(turmas_resp)
                 for linha in turmas_resp.strip().split('\n'):
                     if linha.strip():  # Verificar se a linha não está vazia
                         try:
@@ -5875,7 +7023,7 @@ class App(tk.Tk):
                             if len(partes) > 0 and ':' in partes[0]:
                                 id_turma = partes[0].split(':')[1].strip()
                                 # Buscar alunos desta turma
-                                alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{id_turma}")
+                                alunos_resp = alunos_por_turma.get(id_turma)
                                 if alunos_resp and "Nenhum aluno" not in alunos_resp:
                                     for aluno_linha in alunos_resp.strip().split('\n'):
                                         if aluno_linha.strip() and 'Matrícula:' in aluno_linha:
@@ -6052,6 +7200,7 @@ class App(tk.Tk):
 
         if not resp or "Nenhum aluno" in resp:
             self._update_display(f"Alunos da Turma {id_t} - {disc}", [], [])
+            self._exibicao = ("alunos", str(id_t))
             return
 
         alunos_data = []
@@ -6135,6 +7284,7 @@ class App(tk.Tk):
 
         headers = ["Matrícula", "Nome", "NP1", "NP2", "PIM", "Média", "Faltas", "Turno", "Exame", "Status"]
         self._update_display(f"Alunos da Turma {id_t} - {disc}", headers, alunos_data)
+        self._exibicao = ("alunos", str(id_t))
 
     def editar_aluno(self):
         # Apenas admin pode editar alunos
@@ -7564,8 +8714,7 @@ class App(tk.Tk):
             with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
                 s.connect((HOST,PORT)); s.sendall(f"UPLOAD_FILE|{id_t}|{f_name}|{f_size}".encode('utf-8'))
                 if s.recv(1024)==b"OK_SEND_DATA":
-                    with open(f_path,"rb") as f:
-                        while (chunk := f.read(4096)): s.sendall(chunk)
+                    with open(f_path,"rb") as f: s.sendfile(f)
                     fin_resp=s.recv(1024).decode('utf-8'); messagebox.showinfo("Upload",fin_resp)
         except Exception as e: messagebox.showerror("Erro Upload", f"Ocorreu um erro: {e}")
 
@@ -7584,12 +8733,13 @@ class App(tk.Tk):
                 return
             
             id_t = None
+            alunos_por_turma = self._listar_alunos_turmas(resp_list)
             for linha in resp_list.strip().split('\n'):
                 if linha:
                     partes = linha.split(', ')
                     tid = partes[0].split(': ')[1]
                     
-                    alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                    alunos_resp = alunos_por_turma.get(tid)
                     if alunos_resp and "Nenhum aluno" not in alunos_resp:
                         for aluno_linha in alunos_resp.strip().split('\n'):
                             if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -7708,22 +8858,11 @@ class App(tk.Tk):
                 with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
                     s.connect((HOST, PORT))
                     s.sendall(f"DOWNLOAD_FILE|{id_turma}|{arquivo_original}".encode('utf-8'))
-                    response = s.recv(1024).decode('utf-8')
-                    
-                    if "ERRO" in response:
-                        messagebox.showerror("Erro", response)
+                    erro = receber_download(s, save_path)
+                    if erro:
+                        messagebox.showerror("Erro", erro)
                         return
-                    
-                    if response.startswith("OK_DOWNLOAD"):
-                        filesize = int(response.split("|")[1])
-                        with open(save_path, "wb") as f:
-                            bytes_received = 0
-                            while bytes_received < filesize:
-                                chunk = s.recv(min(4096, filesize - bytes_received))
-                                if not chunk: break
-                                f.write(chunk)
-                                bytes_received += len(chunk)
-                        messagebox.showinfo("Sucesso", "Arquivo baixado com sucesso!")
+                    messagebox.showinfo("Sucesso", "Arquivo baixado com sucesso!")
             except Exception as e:
                 messagebox.showerror("Erro", f"Erro ao baixar arquivo: {e}")
 
@@ -8523,12 +9662,13 @@ class App(tk.Tk):
             # Procurar aluno em todas as turmas
             aluno_info = None
             id_turma = None
+            alunos_por_turma = self._listar_alunos_turmas(resp_list)
             for linha in resp_list.strip().split('\n'):
                 if linha:
                     partes = linha.split(', ')
                     tid = partes[0].split(': ')[1]
                     
-                    alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                    alunos_resp = alunos_por_turma.get(tid)
                     if alunos_resp and "Nenhum aluno" not in alunos_resp:
                         for aluno_linha in alunos_resp.strip().split('\n'):
                             if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -8664,12 +9804,13 @@ class App(tk.Tk):
             return
         
         id_turma = None
+        alunos_por_turma = self._listar_alunos_turmas(resp_list)
         for linha in resp_list.strip().split('\n'):
             if linha:
                 partes = linha.split(', ')
                 tid = partes[0].split(': ')[1]
                 
-                alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                alunos_resp = alunos_por_turma.get(tid)
                 if alunos_resp and "Nenhum aluno" not in alunos_resp:
                     for aluno_linha in alunos_resp.strip().split('\n'):
                         if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -8723,12 +9864,13 @@ class App(tk.Tk):
             return
         
         id_turma = None
+        alunos_por_turma = self._listar_alunos_turmas(resp_list)
         for linha in resp_list.strip().split('\n'):
             if linha:
                 partes = linha.split(', ')
                 tid = partes[0].split(': ')[1]
                 
-                alunos_resp = self._send_request(f"LIST_ALUNOS_POR_TURMA|{tid}")
+                alunos_resp = alunos_por_turma.get(tid)
                 if alunos_resp and "Nenhum aluno" not in alunos_resp:
                     for aluno_linha in alunos_resp.strip().split('\n'):
                         if aluno_linha and f"Matrícula: {matricula}" in aluno_linha:
@@ -10363,6 +11505,15 @@ class App(tk.Tk):
         carregar_anotacoes()
 
 if __name__ == "__main__":
+    if "--servidor" in sys.argv[1:]:
+        # Só o servidor, sem a GUI: --servidor [--porta N] [--replica-de HOST:PORTA]
+        import argparse
+        p = argparse.ArgumentParser(description="Servidor do sistema acadêmico")
+        p.add_argument("--servidor", action="store_true")
+        p.add_argument("--porta", type=int, default=PORT)
+        p.add_argument("--replica-de", metavar="HOST:PORTA", help="réplica de leitura deste servidor primário")
+        args = p.parse_args()
+        run_server(args.porta, args.replica_de); sys.exit(0)
     if os.name!='posix': multiprocessing.freeze_support(); multiprocessing.set_start_method('spawn', True)
     print("[MAIN] Iniciando servidor..."); server_p = multiprocessing.Process(target=run_server, daemon=True); server_p.start(); time.sleep(1.5)
     if not server_p.is_alive(): print("[MAIN-ERRO] Falha ao iniciar o servidor.")
@@ -0,0 +1,500 @@
+#include "credenciais.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "bcrypt.lib")
+#endif
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Instruções SHA (SHA-NI) de x86, escolhidas em tempo de execução pelo CPUID
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define USAR_SHA_NI 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ALVO_SHA_NI
+#else
+#include <cpuid.h>
+#define ALVO_SHA_NI __attribute__((target("sha,sse4.1")))
+#endif
+#endif
+
+#define MAX_TRABALHADORES 64
+#define MAX_ITERACOES 100000000
+#define MAX_SAL 1024
+#define SESSOES_GRUPOS 1024     // cache associativo: grupo = início do token, 4 vias por grupo
+#define SESSOES_VIAS 4
+#define MAX_USUARIO 256
+
+// --- Portabilidade: travas e threads ---
+
+#ifdef _WIN32
+typedef SRWLOCK Trava;
+typedef CONDITION_VARIABLE Condicao;
+#define TRAVA_INICIAL SRWLOCK_INIT
+#define CONDICAO_INICIAL CONDITION_VARIABLE_INIT
+static void travar(Trava* t) { AcquireSRWLockExclusive(t); }
+static void destravar(Trava* t) { ReleaseSRWLockExclusive(t); }
+static void esperar(Condicao* c, Trava* t) { SleepConditionVariableSRW(c, t, INFINITE, 0); }
+static void sinalizar(Condicao* c) { WakeConditionVariable(c); }
+static void sinalizar_todos(Condicao* c) { WakeAllConditionVariable(c); }
+
+static DWORD WINAPI rotina_trabalhador(LPVOID arg);
+static int criar_thread() {
+    HANDLE t = CreateThread(NULL, 0, rotina_trabalhador, NULL, 0, NULL);
+    if (t) CloseHandle(t);
+    return t != NULL;
+}
+static int numero_processadores() { SYSTEM_INFO info; GetSystemInfo(&info); return (int)info.dwNumberOfProcessors; }
+static int bytes_aleatorios(unsigned char* destino, int tamanho) {
+    return BCryptGenRandom(NULL, destino, (ULONG)tamanho, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
+}
+#else
+typedef pthread_mutex_t Trava;
+typedef pthread_cond_t Condicao;
+#define TRAVA_INICIAL PTHREAD_MUTEX_INITIALIZER
+#define CONDICAO_INICIAL PTHREAD_COND_INITIALIZER
+static void travar(Trava* t) { pthread_mutex_lock(t); }
+static void destravar(Trava* t) { pthread_mutex_unlock(t); }
+static void esperar(Condicao* c, Trava* t) { pthread_cond_wait(c, t); }
+static void sinalizar(Condicao* c) { pthread_cond_signal(c); }
+static void sinalizar_todos(Condicao* c) { pthread_cond_broadcast(c); }
+
+static void* rotina_trabalhador(void* arg);
+static int criar_thread() {
+    pthread_t t;
+    if (pthread_create(&t, NULL, rotina_trabalhador, NULL) != 0) return 0;
+    pthread_detach(t);
+    return 1;
+}
+static int numero_processadores() { long n = sysconf(_SC_NPROCESSORS_ONLN); return n > 0 ? (int)n : 1; }
+static int bytes_aleatorios(unsigned char* destino, int tamanho) {
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (!f) return 0;
+    int ok = fread(destino, 1, (size_t)tamanho, f) == (size_t)tamanho;
+    fclose(f);
+    return ok;
+}
+#endif
+
+// --- SHA-256 ---
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t ESTADO_INICIAL[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Comprime um bloco já convertido em 16 palavras (big-endian lido)
+static void comprimir_escalar(uint32_t estado[8], const uint32_t bloco[16]) {
+    uint32_t w[64];
+    memcpy(w, bloco, 16 * sizeof(uint32_t));
+    for (int t = 16; t < 64; t++) {
+        uint32_t s0 = ROTR(w[t - 15], 7) ^ ROTR(w[t - 15], 18) ^ (w[t - 15] >> 3);
+        uint32_t s1 = ROTR(w[t - 2], 17) ^ ROTR(w[t - 2], 19) ^ (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    uint32_t a = estado[0], b = estado[1], c = estado[2], d = estado[3];
+    uint32_t e = estado[4], f = estado[5], g = estado[6], h = estado[7];
+    for (int t = 0; t < 64; t++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    estado[0] += a; estado[1] += b; estado[2] += c; estado[3] += d;
+    estado[4] += e; estado[5] += f; estado[6] += g; estado[7] += h;
+}
+
+#ifdef USAR_SHA_NI
+// Quatro rodadas por volta com SHA256RNDS2; o estado fica como ABEF/CDGH
+ALVO_SHA_NI static void comprimir_sha_ni(uint32_t estado[8], const uint32_t bloco[16]) {
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&estado[0]), 0xB1);     // CDAB
+    __m128i estado1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&estado[4]), 0x1B); // EFGH
+    __m128i estado0 = _mm_alignr_epi8(tmp, estado1, 8);                                       // ABEF
+    estado1 = _mm_blend_epi16(estado1, tmp, 0xF0);                                            // CDGH
+    __m128i abef = estado0, cdgh = estado1, w[4];
+    for (int i = 0; i < 16; i++) {
+        __m128i m;
+        if (i < 4) {
+            m = w[i] = _mm_loadu_si128((const __m128i*)&bloco[4 * i]);
+        } else {
+            // w[i & 3] = W(i-4), (i+1) & 3 = W(i-3), (i+2) & 3 = W(i-2), (i+3) & 3 = W(i-1)
+            m = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+            m = _mm_add_epi32(m, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+            m = w[i & 3] = _mm_sha256msg2_epu32(m, w[(i + 3) & 3]);
+        }
+        m = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)&K[4 * i]));
+        estado1 = _mm_sha256rnds2_epu32(estado1, estado0, m);
+        estado0 = _mm_sha256rnds2_epu32(estado0, estado1, _mm_shuffle_epi32(m, 0x0E));
+    }
+    estado0 = _mm_add_epi32(estado0, abef);
+    estado1 = _mm_add_epi32(estado1, cdgh);
+    tmp = _mm_shuffle_epi32(estado0, 0x1B);                    // FEBA
+    estado1 = _mm_shuffle_epi32(estado1, 0xB1);                // DCHG
+    _mm_storeu_si128((__m128i*)&estado[0], _mm_blend_epi16(tmp, estado1, 0xF0));  // DCBA
+    _mm_storeu_si128((__m128i*)&estado[4], _mm_alignr_epi8(estado1, tmp, 8));     // HGFE
+}
+
+static int cpu_tem_sha() {
+    unsigned int a, b, c, d;
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return 0;
+    __cpuidex(r, 1, 0); c = (unsigned int)r[2];
+    __cpuidex(r, 7, 0); b = (unsigned int)r[1];
+    (void)a; (void)d;
+#else
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid_count(1, 0, a, b, c, d);
+    unsigned int c1 = c;
+    __cpuid_count(7, 0, a, b, c, d);
+    c = c1;
+#endif
+    return (b & (1u << 29)) && (c & (1u << 19)) && (c & (1u << 9));  // SHA, SSE4.1, SSSE3
+}
+#endif
+
+typedef void (*Compressor)(uint32_t estado[8], const uint32_t bloco[16]);
+static Compressor comprimir = comprimir_escalar;
+
+static uint32_t ler_be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void escrever_be32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16); p[2] = (unsigned char)(v >> 8); p[3] = (unsigned char)v;
+}
+
+// SHA-256 incremental, usado no que não é o laço principal (chave HMAC e U1)
+typedef struct {
+    uint32_t estado[8];
+    unsigned char pendente[64];
+    int tamanho_pendente;
+    uint64_t total;
+} Sha256;
+
+static void sha_iniciar(Sha256* s, const uint32_t estado[8], uint64_t ja_processado) {
+    memcpy(s->estado, estado, sizeof(s->estado));
+    s->tamanho_pendente = 0;
+    s->total = ja_processado;
+}
+
+static void sha_bloco(Sha256* s, const unsigned char* p) {
+    uint32_t w[16];
+    for (int k = 0; k < 16; k++) w[k] = ler_be32(p + 4 * k);
+    comprimir(s->estado, w);
+}
+
+static void sha_atualizar(Sha256* s, const unsigned char* dados, size_t tamanho) {
+    s->total += tamanho;
+    while (tamanho > 0) {
+        size_t n = 64 - (size_t)s->tamanho_pendente;
+        if (n > tamanho) n = tamanho;
+        memcpy(s->pendente + s->tamanho_pendente, dados, n);
+        s->tamanho_pendente += (int)n; dados += n; tamanho -= n;
+        if (s->tamanho_pendente == 64) { sha_bloco(s, s->pendente); s->tamanho_pendente = 0; }
+    }
+}
+
+static void sha_finalizar(Sha256* s, uint32_t out[8]) {
+    uint64_t bits = s->total * 8;
+    unsigned char fim[72] = { 0x80 };
+    size_t n = (size_t)(s->tamanho_pendente < 56 ? 56 - s->tamanho_pendente : 120 - s->tamanho_pendente);
+    for (int k = 0; k < 8; k++) fim[n + k] = (unsigned char)(bits >> (56 - 8 * k));
+    sha_atualizar(s, fim, n + 8);
+    memcpy(out, s->estado, 8 * sizeof(uint32_t));
+}
+
+// --- PBKDF2-HMAC-SHA256 ---
+
+// Estados depois de comprimir a chave com ipad e opad: cada HMAC de 32 bytes
+// vira duas compressões de um bloco só, com o preenchimento fixo
+static void preparar_hmac(const unsigned char* chave, int tamanho, uint32_t interno[8], uint32_t externo[8]) {
+    unsigned char bloco[64] = { 0 };
+    if (tamanho > 64) {
+        Sha256 s;
+        uint32_t resumo[8];
+        sha_iniciar(&s, ESTADO_INICIAL, 0);
+        sha_atualizar(&s, chave, (size_t)tamanho);
+        sha_finalizar(&s, resumo);
+        for (int k = 0; k < 8; k++) escrever_be32(bloco + 4 * k, resumo[k]);
+    } else if (tamanho > 0) {
+        memcpy(bloco, chave, (size_t)tamanho);
+    }
+    unsigned char pad[64];
+    uint32_t w[16];
+    for (int k = 0; k < 64; k++) pad[k] = bloco[k] ^ 0x36;
+    for (int k = 0; k < 16; k++) w[k] = ler_be32(pad + 4 * k);
+    memcpy(interno, ESTADO_INICIAL, 8 * sizeof(uint32_t));
+    comprimir(interno, w);
+    for (int k = 0; k < 64; k++) pad[k] = bloco[k] ^ 0x5c;
+    for (int k = 0; k < 16; k++) w[k] = ler_be32(pad + 4 * k);
+    memcpy(externo, ESTADO_INICIAL, 8 * sizeof(uint32_t));
+    comprimir(externo, w);
+}
+
+static void pbkdf2_sha256(const char* senha, int tamanho_senha, const unsigned char* sal, int tamanho_sal,
+                          int iteracoes, unsigned char* out) {
+    uint32_t interno[8], externo[8], u[8], t[8];
+    preparar_hmac((const unsigned char*)senha, tamanho_senha, interno, externo);
+
+    // U1 = HMAC(senha, sal || INT(1))
+    static const unsigned char bloco_um[4] = { 0, 0, 0, 1 };
+    Sha256 s;
+    sha_iniciar(&s, interno, 64);
+    sha_atualizar(&s, sal, (size_t)tamanho_sal);
+    sha_atualizar(&s, bloco_um, 4);
+    sha_finalizar(&s, u);
+    unsigned char resumo[32];
+    for (int k = 0; k < 8; k++) escrever_be32(resumo + 4 * k, u[k]);
+    sha_iniciar(&s, externo, 64);
+    sha_atualizar(&s, resumo, 32);
+    sha_finalizar(&s, u);
+    memcpy(t, u, sizeof(t));
+
+    // Ui = HMAC(senha, Ui-1): mensagem de 32 bytes, total de 96 (64 da chave + 32)
+    uint32_t bloco[16] = { 0 };
+    bloco[8] = 0x80000000u;
+    bloco[15] = 96 * 8;
+    for (int i = 1; i < iteracoes; i++) {
+        uint32_t meio[8];
+        memcpy(bloco, u, sizeof(u));
+        memcpy(meio, interno, sizeof(meio));
+        comprimir(meio, bloco);
+        memcpy(bloco, meio, sizeof(meio));
+        memcpy(u, externo, sizeof(u));
+        comprimir(u, bloco);
+        for (int k = 0; k < 8; k++) t[k] ^= u[k];
+    }
+    for (int k = 0; k < 8; k++) escrever_be32(out + 4 * k, t[k]);
+}
+
+// --- Grupo de trabalhadores ---
+
+typedef struct Derivacao {
+    const char* senha;
+    int tamanho_senha;
+    const unsigned char* sal;
+    int tamanho_sal;
+    int iteracoes;
+    unsigned char* saida;
+    int pronta;
+    struct Derivacao* proxima;
+} Derivacao;
+
+static Trava trava_grupo = TRAVA_INICIAL;
+static Condicao condicao_fila = CONDICAO_INICIAL;    // há derivação na fila
+static Condicao condicao_pronta = CONDICAO_INICIAL;  // alguma derivação terminou
+static Derivacao* fila_inicio = NULL;
+static Derivacao* fila_fim = NULL;
+static int num_trabalhadores = 0;
+static int orcamento_derivacoes = 0;
+static int derivacoes_pendentes = 0;    // na fila ou em andamento
+
+#ifdef _WIN32
+static DWORD WINAPI rotina_trabalhador(LPVOID arg) {
+#else
+static void* rotina_trabalhador(void* arg) {
+#endif
+    (void)arg;
+    travar(&trava_grupo);
+    for (;;) {
+        while (!fila_inicio) esperar(&condicao_fila, &trava_grupo);
+        Derivacao* d = fila_inicio;
+        fila_inicio = d->proxima;
+        if (!fila_inicio) fila_fim = NULL;
+        destravar(&trava_grupo);
+        pbkdf2_sha256(d->senha, d->tamanho_senha, d->sal, d->tamanho_sal, d->iteracoes, d->saida);
+        travar(&trava_grupo);
+        d->pronta = 1;
+        derivacoes_pendentes--;
+        sinalizar_todos(&condicao_pronta);
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+// Chamada com trava_grupo
+static int iniciar_grupo(int trabalhadores, int orcamento) {
+    if (num_trabalhadores) return 1;
+#ifdef USAR_SHA_NI
+    if (cpu_tem_sha()) comprimir = comprimir_sha_ni;
+#endif
+    // Metade dos processadores: uma rajada de logins não toma a CPU dos comandos
+    if (trabalhadores <= 0) trabalhadores = numero_processadores() / 2;
+    if (trabalhadores < 1) trabalhadores = 1;
+    if (trabalhadores > MAX_TRABALHADORES) trabalhadores = MAX_TRABALHADORES;
+    for (int k = 0; k < trabalhadores; k++) {
+        if (!criar_thread()) break;
+        num_trabalhadores++;
+    }
+    // Padrão: cerca de meio segundo de fila por trabalhador com 200 mil iterações
+    orcamento_derivacoes = orcamento > 0 ? orcamento : 16 * num_trabalhadores;
+    return num_trabalhadores > 0;
+}
+
+EXPORT int credenciais_iniciar(int trabalhadores, int orcamento) {
+    travar(&trava_grupo);
+    int ok = iniciar_grupo(trabalhadores, orcamento);
+    destravar(&trava_grupo);
+    return ok;
+}
+
+EXPORT int credenciais_derivar(const char* senha, int tamanho_senha, const unsigned char* sal, int tamanho_sal,
+                               int iteracoes, unsigned char* out_chave) {
+    if (!senha || tamanho_senha < 0 || !sal || tamanho_sal < 0 || tamanho_sal > MAX_SAL ||
+        iteracoes < 1 || iteracoes > MAX_ITERACOES || !out_chave) return 0;
+    Derivacao d = { senha, tamanho_senha, sal, tamanho_sal, iteracoes, out_chave, 0, NULL };
+    travar(&trava_grupo);
+    if (!iniciar_grupo(0, 0)) {
+        destravar(&trava_grupo);
+        return 0;
+    }
+    if (derivacoes_pendentes >= orcamento_derivacoes) {
+        destravar(&trava_grupo);
+        return -1;
+    }
+    derivacoes_pendentes++;
+    if (fila_fim) fila_fim->proxima = &d; else fila_inicio = &d;
+    fila_fim = &d;
+    sinalizar(&condicao_fila);
+    while (!d.pronta) esperar(&condicao_pronta, &trava_grupo);
+    destravar(&trava_grupo);
+    return 1;
+}
+
+// --- Sessões ---
+
+typedef struct {
+    char token[CREDENCIAIS_TAMANHO_TOKEN];
+    char usuario[MAX_USUARIO];
+    time_t expira;      // 0 = via livre
+} Sessao;
+
+static Sessao sessoes[SESSOES_GRUPOS][SESSOES_VIAS];
+static Trava trava_sessoes = TRAVA_INICIAL;
+
+static int valor_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Grupo da sessão pelo início do token (aleatório); -1 se o token é malformado
+static int grupo_token(const char* token) {
+    if (!token || strlen(token) != CREDENCIAIS_TAMANHO_TOKEN) return -1;
+    unsigned int g = 0;
+    for (int k = 0; k < CREDENCIAIS_TAMANHO_TOKEN; k++) {
+        int v = valor_hex(token[k]);
+        if (v < 0) return -1;
+        if (k < 8) g = g << 4 | (unsigned int)v;
+    }
+    return (int)(g % SESSOES_GRUPOS);
+}
+
+// Comparação em tempo constante
+static int mesmo_token(const char* a, const char* b) {
+    unsigned char diferenca = 0;
+    for (int k = 0; k < CREDENCIAIS_TAMANHO_TOKEN; k++) diferenca |= (unsigned char)(a[k] ^ b[k]);
+    return diferenca == 0;
+}
+
+EXPORT int credenciais_sessao_criar(const char* usuario, char* out_token) {
+    if (!usuario || !out_token || strlen(usuario) >= MAX_USUARIO) return 0;
+    unsigned char aleatorio[CREDENCIAIS_TAMANHO_TOKEN / 2];
+    if (!bytes_aleatorios(aleatorio, (int)sizeof(aleatorio))) return 0;
+    static const char hex[] = "0123456789abcdef";
+    for (int k = 0; k < (int)sizeof(aleatorio); k++) {
+        out_token[2 * k] = hex[aleatorio[k] >> 4];
+        out_token[2 * k + 1] = hex[aleatorio[k] & 15];
+    }
+    out_token[CREDENCIAIS_TAMANHO_TOKEN] = '\0';
+    time_t agora = time(NULL);
+    travar(&trava_sessoes);
+    // Via livre ou vencida; com o grupo cheio, substitui a que vence primeiro
+    Sessao* grupo = sessoes[grupo_token(out_token)];
+    Sessao* via = &grupo[0];
+    for (int k = 0; k < SESSOES_VIAS; k++) {
+        if (grupo[k].expira <= agora) { via = &grupo[k]; break; }
+        if (grupo[k].expira < via->expira) via = &grupo[k];
+    }
+    memcpy(via->token, out_token, CREDENCIAIS_TAMANHO_TOKEN);
+    strcpy(via->usuario, usuario);
+    via->expira = agora + CREDENCIAIS_VALIDADE_SESSAO;
+    destravar(&trava_sessoes);
+    return 1;
+}
+
+EXPORT int credenciais_sessao_validar(const char* token, char* out_usuario, int max_len) {
+    int g = grupo_token(token);
+    if (g < 0) return 0;
+    time_t agora = time(NULL);
+    int ok = 0;
+    travar(&trava_sessoes);
+    for (int k = 0; k < SESSOES_VIAS; k++) {
+        Sessao* s = &sessoes[g][k];
+        if (s->expira > agora && mesmo_token(s->token, token)) {
+            ok = out_usuario && (int)strlen(s->usuario) < max_len;
+            if (ok) strcpy(out_usuario, s->usuario);
+            break;
+        }
+    }
+    destravar(&trava_sessoes);
+    return ok;
+}
+
+EXPORT int credenciais_sessao_encerrar(const char* token) {
+    int g = grupo_token(token), ok = 0;
+    if (g < 0) return 0;
+    travar(&trava_sessoes);
+    for (int k = 0; k < SESSOES_VIAS; k++) {
+        if (sessoes[g][k].expira && mesmo_token(sessoes[g][k].token, token)) {
+            sessoes[g][k].expira = 0;
+            ok = 1;
+        }
+    }
+    destravar(&trava_sessoes);
+    return ok;
+}
+
+EXPORT int credenciais_sessao_encerrar_usuario(const char* usuario) {
+    if (!usuario) return 0;
+    int encerradas = 0;
+    travar(&trava_sessoes);
+    for (int g = 0; g < SESSOES_GRUPOS; g++) {
+        for (int k = 0; k < SESSOES_VIAS; k++) {
+            if (sessoes[g][k].expira && strcmp(sessoes[g][k].usuario, usuario) == 0) {
+                sessoes[g][k].expira = 0;
+                encerradas++;
+            }
+        }
+    }
+    destravar(&trava_sessoes);
+    return encerradas;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef CREDENCIAIS_H
+#define CREDENCIAIS_H
+
+#include "database.h"
+
+// Verificação de senhas PBKDF2-HMAC-SHA256 (o formato "pbkdf2$iterações$sal$hash"
+// do UserDatabase) num grupo fixo de trabalhadores, separado dos que atendem os
+// comandos, e cache das sessões já autenticadas.
+
+#define CREDENCIAIS_TAMANHO_CHAVE 32    // mesmo dklen padrão do hashlib.pbkdf2_hmac
+#define CREDENCIAIS_TAMANHO_TOKEN 64    // token em hexadecimal, sem o '\0'
+#define CREDENCIAIS_VALIDADE_SESSAO (8 * 3600)  // segundos
+
+// Inicia o grupo de trabalhadores (<= 0 usa metade dos processadores) com um
+// orçamento de derivações em andamento ou na fila (<= 0 usa 16 por
+// trabalhador). Chamada implícita, com os padrões, na primeira derivação.
+EXPORT int credenciais_iniciar(int trabalhadores, int orcamento);
+// Deriva a chave PBKDF2-HMAC-SHA256 de 32 bytes em out_chave num trabalhador e
+// espera o resultado. Retorna 1, 0 se os parâmetros são inválidos, ou -1 sem
+// esperar se o orçamento está esgotado (rajada de logins).
+EXPORT int credenciais_derivar(const char* senha, int tamanho_senha, const unsigned char* sal, int tamanho_sal,
+                               int iteracoes, unsigned char* out_chave);
+
+// Sessões: token aleatório -> usuário, válido por CREDENCIAIS_VALIDADE_SESSAO.
+// out_token recebe CREDENCIAIS_TAMANHO_TOKEN + 1 bytes.
+EXPORT int credenciais_sessao_criar(const char* usuario, char* out_token);
+// Retorna 1 e copia o usuário se o token é válido
+EXPORT int credenciais_sessao_validar(const char* token, char* out_usuario, int max_len);
+EXPORT int credenciais_sessao_encerrar(const char* token);
+// Encerra todas as sessões do usuário (troca de senha, remoção); retorna quantas
+EXPORT int credenciais_sessao_encerrar_usuario(const char* usuario);
+
+#endif // CREDENCIAIS_H
\ No newline at end of file
@@ -1,217 +1,4149 @@
+// pthread_rwlock_t, clock_gettime e nanosleep fora do modo GNU (-std=c11)
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "database.h"
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+// Núcleo SSE das estatísticas de notas (SSE2 é garantido em x86-64)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USAR_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-#define MAX_TURMAS 100
-#define MAX_ALUNOS 500
 #define TURMAS_DB_FILE "turmas.dat"
 #define ALUNOS_DB_FILE "alunos.dat"
+#define LOG_DB_FILE "database.log"
+#define FREQUENCIA_DB_FILE "frequencia.dat"
+#define REGISTROS_DB_FILE "registros.dat"
+
+// Temporários da compactação: os arquivos só são trocados quando completos
+#define TURMAS_TMP_FILE "turmas.dat.tmp"
+#define ALUNOS_TMP_FILE "alunos.dat.tmp"
+#define FREQUENCIA_TMP_FILE "frequencia.dat.tmp"
+#define REGISTROS_TMP_FILE "registros.dat.tmp"
+#define LOG_TMP_FILE "database.log.tmp"
+
+// Cabeçalho do arquivo de log. Logs sem ele são do formato antigo (sem CRC).
+#define LOG_ASSINATURA 0x474F4C53  // "SLOG"
+#define LOG_VERSAO 2
+
+// Cabeçalho de turmas.dat e alunos.dat (CabecalhoArquivoDados). Arquivos sem
+// ele são do formato antigo ("int quantidade + structs") e são convertidos na carga.
+#define DADOS_ASSINATURA 0x54414453  // "SDAT"
+#define DADOS_VERSAO 1
+
+// Mesmos limites dos arrays de Aluno, usados no formato dos arquivos .dat
+#define MAX_AVALIACOES 10
+#define MAX_PRESENCAS 50
+
+// Quando o log passa deste tamanho, ele é compactado nos arquivos .dat
+#define LOG_LIMITE_COMPACTACAO (1024 * 1024)
+// Buffer do log: nos modos adiados, várias alterações viram uma única escrita
+#define LOG_TAMANHO_BUFFER (64 * 1024)
+
+// Tipos de registro do log (write-ahead log)
+// Cada alteração grava apenas o delta, em vez de reescrever o arquivo inteiro
+enum {
+    REG_TURMA_INSERIR = 1,      // dados: Turma
+    REG_TURMA_ATUALIZAR,        // dados: "disciplina\0professor\0"
+    REG_TURMA_REMOVER,          // sem dados (remove também os alunos da turma)
+    REG_TURMA_ALTERAR_ID,       // dados: int novo_id
+    REG_ALUNO_INSERIR,          // dados: Aluno
+    REG_ALUNO_NOME,             // dados: "nome\0"
+    REG_ALUNO_REMOVER,          // sem dados
+    REG_ALUNO_ALTERAR_MATRICULA, // dados: int nova_matricula
+    REG_ALUNO_NOTAS,            // dados: Notas
+    REG_ALUNO_PRESENCA,         // dados: Presenca (substitui a da mesma data)
+    REG_ALUNO_AVALIACAO,        // dados: Avaliacao
+    REG_ALUNO_ATUALIZAR_AVALIACAO, // dados: AtualizacaoAvaliacao
+    REG_TRANSACAO_INICIO,       // sem dados: os registros até o FIM valem juntos ou não valem
+    REG_TRANSACAO_FIM,          // sem dados
+    REG_COMPACTACAO,            // sem dados: .dat temporários completos (ponto de commit)
+    REG_RECALCULAR_MEDIAS,      // sem dados; chave = política (reaplicar refaz o cálculo)
+    REG_REGISTRO_GRAVAR,        // chave = tabela; dados: "chave\0valor"
+    REG_REGISTRO_REMOVER        // chave = tabela; dados: "chave\0"
+};
+
+typedef struct {
+    int assinatura;
+    int versao;
+} CabecalhoArquivoLog;
+
+// Cabeçalho de cada registro do log, seguido de 'tamanho' bytes de dados
+typedef struct {
+    int tipo;
+    int chave;      // id da turma ou matrícula do aluno
+    int tamanho;
+    unsigned int crc;   // CRC-32 do cabeçalho (com crc = 0) e dos dados
+} CabecalhoLog;
+
+// Log lido na inicialização (ver ler_log)
+typedef struct {
+    unsigned char* dados;
+    long tamanho;
+    int invalido;   // arquivo sem cabeçalho válido (ou ilegível): nem reaplicado nem descartado
+    long inicio;    // primeiro registro a reaplicar (logo após a última compactação)
+    long fim;       // fim do último registro íntegro
+    int compactacao_pendente;
+} LogLido;
+
+typedef struct {
+    unsigned int assinatura;
+    int versao;
+    int quantidade;         // registros na parte quente
+    unsigned int tamanho;   // bytes da parte quente, logo após o cabeçalho
+    unsigned int crc;       // CRC-32 da parte quente
+} CabecalhoArquivoDados;
+
+// Índice hash (endereçamento aberto, sondagem linear) de chave -> posição no array
+typedef struct {
+    int chave;
+    int posicao;    // -1 indica posição livre
+} EntradaHash;
+
+typedef struct {
+    EntradaHash* entradas;
+    int capacidade; // sempre potência de 2
+    int usados;
+    int deslocamento; // 32 - log2(capacidade): o hash usa os bits altos do produto
+} TabelaHash;
+
+// Dados frios de um aluno: avaliações, numa tabela de tamanho variável
+// alocada só para quem tem alguma, ordenada e indexada pela data convertida
+// em AAAAMMDD (datas_avaliacoes tem a mesma capacidade). As presenças ficam
+// nos mapas de bits da turma (FrequenciaTurma); aqui só a vaga do aluno neles.
+typedef struct {
+    Avaliacao* avaliacoes;
+    int* datas_avaliacoes;
+    int num_avaliacoes;
+    int capacidade_avaliacoes;
+    int vaga;           // vaga + 1 na frequência da turma (0 = nenhuma presença lançada)
+    int emprestado;     // 1 = aponta para alunos.dat do formato antigo mapeado (somente leitura)
+    unsigned int bloco; // != 0: avaliações ainda em alunos.dat, nesta posição (lidas sob demanda)
+    int indexado;       // 1 = datas_avaliacoes preenchidas e avaliações em ordem de data
+} DadosFrios;
 
-// Banco de dados em memória
-static Turma turmas[MAX_TURMAS];
+// Frequência de uma turma em mapas de bits: uma linha por data de aula e uma
+// coluna (vaga) por aluno com alguma presença lançada. O bit da vaga em
+// 'registrado' indica presença ou falta lançada na data, em 'presente' só a
+// presença. Linha d, palavra w: [d * palavras + w].
+typedef unsigned long long Palavra;
+#define BITS_PALAVRA 64
+
+typedef struct {
+    int id_turma;
+    int num_datas;
+    int capacidade_datas;
+    int palavras;           // palavras por linha (vagas = palavras * BITS_PALAVRA)
+    int alunos;             // vagas ocupadas; a turma sai da tabela quando chega a 0
+    int* dias;              // AAAAMMDD de cada linha, em ordem crescente
+    Palavra* registrado;
+    Palavra* presente;
+    Palavra* ocupadas;      // vagas em uso
+    int* matriculas;        // dono de cada vaga
+} FrequenciaTurma;
+
+// Bloco de uma turma em frequencia.dat, seguido de dias[num_datas],
+// matriculas[palavras * BITS_PALAVRA], ocupadas[palavras] e das linhas de
+// registrado e de presente (num_datas * palavras cada)
+typedef struct {
+    int id_turma;
+    int num_datas;
+    int palavras;
+} CabecalhoFrequencia;
+
+// Visão somente leitura de um arquivo mapeado em memória
+typedef struct {
+    const unsigned char* base;
+    size_t tamanho;
+#ifdef _WIN32
+    HANDLE arquivo;
+    HANDLE mapeamento;
+#endif
+} ArquivoMapeado;
+
+typedef char NomeAluno[100];
+
+// Registro de uma tabela chave -> valor, num único bloco "chave\0valor\0"
+typedef struct {
+    char* bloco;
+    int tamanho_chave;
+    int tamanho_valor;
+    unsigned int hash;
+} Registro;
+
+// Registros em ordem de inserção, com índice hash (endereçamento aberto) de
+// chave -> posição + 1 (0 indica posição livre)
+typedef struct {
+    Registro* registros;
+    int num_registros;
+    int capacidade_registros;
+    int* indice;
+    int capacidade_indice;  // sempre potência de 2
+} TabelaRegistros;
+
+// Cabeçalho de cada registro em registros.dat, seguido de "chave\0valor"
+typedef struct {
+    int tabela;
+    int tamanho_chave;
+    int tamanho_valor;
+} CabecalhoRegistro;
+
+// Dados de REG_ALUNO_ATUALIZAR_AVALIACAO: data (AAAAMMDD) da avaliação substituída
+typedef struct {
+    int data;
+    Avaliacao avaliacao;
+} AtualizacaoAvaliacao;
+
+// Banco de dados em memória (arrays que crescem dobrando de capacidade)
+static Turma* turmas = NULL;
 static int num_turmas = 0;
-static Aluno alunos[MAX_ALUNOS];
+static int capacidade_turmas = 0;
+
+// Alunos em colunas (struct-of-arrays): as chaves e notas ficam em arrays
+// densos, varridos sem carregar os ~6 KB de avaliações/presenças de cada
+// aluno. O struct Aluno completo só é montado na hora de devolver ao chamador.
+static int* alunos_matricula = NULL;
+static int* alunos_id_turma = NULL;
+static Notas* alunos_notas = NULL;
+static NomeAluno* alunos_nome = NULL;
+static DadosFrios* alunos_frios = NULL;
 static int num_alunos = 0;
+static int capacidade_alunos = 0;
 static int dados_carregados = 0;
 
-// Protótipos de funções internas
-void carregar_dados();
-void salvar_dados_turmas();
-void salvar_dados_alunos();
+// Índices por Turma.id e por matrícula
+static TabelaHash hash_turmas = { NULL, 0, 0, 0 };
+static TabelaHash hash_alunos = { NULL, 0, 0, 0 };
+
+// Lista de alunos de cada turma: lista circular duplamente encadeada
+// sobre as posições dos alunos, com id_turma -> primeiro aluno da lista.
+// Alunos cuja turma não existe também ganham lista, pelo mesmo id_turma.
+static TabelaHash hash_listas_turma = { NULL, 0, 0, 0 };
+static int* prox_na_turma = NULL;   // mesma capacidade das colunas de alunos
+static int* ant_na_turma = NULL;
+
+// Frequências por turma, com índice id_turma -> posição
+static FrequenciaTurma* frequencias = NULL;
+static int num_frequencias = 0;
+static int capacidade_frequencias = 0;
+static TabelaHash hash_frequencias = { NULL, 0, 0, 0 };
+
+// Tabelas de registros (usuários, provas, turnos, exames e anotações do servidor)
+static TabelaRegistros tabelas_registros[DB_NUM_TABELAS];
+
+// Backend mmap: os .dat são lidos por mapeamento em vez de fread
+static int usar_mmap = 0;
+
+// Origem das avaliações lidas sob demanda (DadosFrios.bloco): alunos.dat
+// mapeado (backend mmap) ou aberto para leituras posicionais. No formato
+// antigo mapeado, o mapeamento guarda as avaliações emprestadas.
+static ArquivoMapeado mapa_alunos = { 0 };
+#ifdef _WIN32
+static HANDLE arquivo_frios = INVALID_HANDLE_VALUE;
+#else
+static int arquivo_frios = -1;
+#endif
+
+// Formato dos .dat encontrado na carga
+static int formato_antigo = 0;       // algum .dat sem cabeçalho: regravado ao fim da carga
+static int arquivos_protegidos = 0;  // .dat de versão mais nova ou corrompido: banco somente leitura
+
+// Estado do log
+static FILE* f_log = NULL;
+static long tamanho_log = 0;
+
+// Política de durabilidade (ver db_set_durability)
+static int politica_durabilidade = DB_DURABILIDADE_IMEDIATA;
+static int intervalo_agrupamento_ms = 10;
+static int log_pendente = 0;        // há registros no buffer ainda não descarregados
+static int descarregador_ativo = 0;
+
+// --- Portabilidade: trava e thread ---
+
+#ifdef _WIN32
+typedef SRWLOCK Trava;
+#define TRAVA_INICIAL SRWLOCK_INIT
+static void travar(Trava* t) { AcquireSRWLockExclusive(t); }
+static void destravar(Trava* t) { ReleaseSRWLockExclusive(t); }
+static void dormir_ms(int ms) { Sleep(ms); }
+#else
+typedef pthread_mutex_t Trava;
+#define TRAVA_INICIAL PTHREAD_MUTEX_INITIALIZER
+static void travar(Trava* t) { pthread_mutex_lock(t); }
+static void destravar(Trava* t) { pthread_mutex_unlock(t); }
+static void dormir_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+#endif
+
+// Protege f_log e o estado de durabilidade, compartilhados com o descarregador
+static Trava trava_log = TRAVA_INICIAL;
+
+// Trava de leitura/escrita dos dados: consultas rodam em paralelo entre si,
+// alterações (e a carga inicial) rodam sozinhas
+#ifdef _WIN32
+typedef SRWLOCK TravaDados;
+#define TRAVA_DADOS_INICIAL SRWLOCK_INIT
+static void travar_leitura(TravaDados* t) { AcquireSRWLockShared(t); }
+static void destravar_leitura(TravaDados* t) { ReleaseSRWLockShared(t); }
+static void travar_escrita(TravaDados* t) { AcquireSRWLockExclusive(t); }
+static void destravar_escrita(TravaDados* t) { ReleaseSRWLockExclusive(t); }
+#else
+typedef pthread_rwlock_t TravaDados;
+#define TRAVA_DADOS_INICIAL PTHREAD_RWLOCK_INITIALIZER
+static void travar_leitura(TravaDados* t) { pthread_rwlock_rdlock(t); }
+static void destravar_leitura(TravaDados* t) { pthread_rwlock_unlock(t); }
+static void travar_escrita(TravaDados* t) { pthread_rwlock_wrlock(t); }
+static void destravar_escrita(TravaDados* t) { pthread_rwlock_unlock(t); }
+#endif
+
+static TravaDados trava_dados = TRAVA_DADOS_INICIAL;
+static unsigned int geracao_dados = 0;  // ver db_geracao
+
+// --- Métricas (ver db_metricas) ---
+// Contadores com soma atômica: consultas em paralelo não disputam uma trava só
+// para se contar
+
+#ifdef _MSC_VER
+#define LOCAL_DA_THREAD __declspec(thread)
+static void somar_metrica(long long* contador, long long valor) { InterlockedExchangeAdd64((volatile LONG64*)contador, valor); }
+static long long ler_metrica(const long long* contador) { return InterlockedCompareExchange64((volatile LONG64*)contador, 0, 0); }
+#else
+#define LOCAL_DA_THREAD __thread
+static void somar_metrica(long long* contador, long long valor) { __atomic_fetch_add(contador, valor, __ATOMIC_RELAXED); }
+static long long ler_metrica(const long long* contador) { return __atomic_load_n(contador, __ATOMIC_RELAXED); }
+#endif
+
+#ifdef _WIN32
+static long long relogio_ns() {
+    static LARGE_INTEGER frequencia;
+    LARGE_INTEGER t;
+    if (!frequencia.QuadPart) QueryPerformanceFrequency(&frequencia);
+    QueryPerformanceCounter(&t);
+    return (long long)((double)t.QuadPart * 1e9 / (double)frequencia.QuadPart);
+}
+#else
+static long long relogio_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+#endif
+
+#define MAX_METRICAS 64
+
+typedef struct {
+    const char* nome;   // __func__ da função exportada
+    long long chamadas;
+    long long tempo_ns;
+    long long espera_ns;
+    long long faixas[DB_METRICA_FAIXAS];
+} Metrica;
+
+static Metrica metricas[MAX_METRICAS];
+static int num_metricas = 0;
+static Trava trava_metricas = TRAVA_INICIAL;
+static DbMetricasIO metricas_io;
+
+// Início e espera pela trava da chamada em andamento nesta thread
+static LOCAL_DA_THREAD long long inicio_chamada, espera_chamada;
+
+// Posição da função nas métricas, criada na primeira chamada (-1 se não cabe)
+static int registrar_metrica(const char* nome) {
+    travar(&trava_metricas);
+    int i = 0;
+    while (i < num_metricas && strcmp(metricas[i].nome, nome) != 0) i++;
+    if (i == num_metricas) {
+        if (num_metricas < MAX_METRICAS) metricas[num_metricas++].nome = nome;
+        else i = -1;
+    }
+    destravar(&trava_metricas);
+    return i;
+}
+
+// Faixa 0 = abaixo de 1 us; faixa k = [2^(k-1), 2^k) us
+static int faixa_metrica(long long tempo_ns) {
+    long long us = tempo_ns / 1000;
+    int k = 0;
+    while (us > 0 && k < DB_METRICA_FAIXAS - 1) { us >>= 1; k++; }
+    return k;
+}
+
+static void somar_chamada(int* indice, const char* nome, long long tempo_ns, long long espera_ns) {
+    if (*indice < 0) *indice = registrar_metrica(nome);
+    if (*indice < 0) return;
+    Metrica* m = &metricas[*indice];
+    somar_metrica(&m->chamadas, 1);
+    somar_metrica(&m->tempo_ns, tempo_ns);
+    somar_metrica(&m->espera_ns, espera_ns);
+    somar_metrica(&m->faixas[faixa_metrica(tempo_ns)], 1);
+}
+
+// abrir_leitura/abrir_escrita marcam o início da chamada e quanto ela esperou
+// pela trava; fechar_leitura/fechar_escrita somam o tempo na função exportada
+// que as chamou (uma posição estática por ponto de saída, resolvida pelo nome)
+#define MEDIR_CHAMADA() do { \
+    static int metrica_ = -1; \
+    somar_chamada(&metrica_, __func__, relogio_ns() - inicio_chamada, espera_chamada); \
+} while (0)
+#define fechar_leitura() do { destravar_leitura(&trava_dados); MEDIR_CHAMADA(); } while (0)
+#define fechar_escrita() do { geracao_dados++; destravar_escrita(&trava_dados); MEDIR_CHAMADA(); } while (0)
+
+// Protótipos de funções internas
+void carregar_dados();
+static int salvar_dados_turmas(const char* caminho);
+static int salvar_dados_alunos(const char* caminho, unsigned int* blocos);
+static int salvar_dados_frequencia(const char* caminho);
+static void ler_frequencias();
+static void ler_registros();
+static int salvar_dados_registros(const char* caminho);
+static int importar_presencas(int i, const Presenca* presencas, int quantidade);
+static int copiar_presencas(int i, int de, int ate, Presenca* arr, int max_len);
+static int aplicar_registro(int tipo, int chave, const void* dados, int tamanho);
+static int indice_aluno(int matricula);
+static int aplicar_recalculo_medias(int politica);
+static void reconstruir_indices();
+static void conferir_palavras();
+static int compactar();
+static void descarregar_dados();
+static int reservar_snapshots();
+static unsigned int crc32_atualizar(unsigned int crc, const void* dados, size_t tamanho);
+static int abrir_origem_fria();
+static void fechar_origem_fria();
+static int ler_origem_fria(unsigned int posicao, void* destino, size_t n);
+static size_t ler_bloco_frio(unsigned int posicao, unsigned char* destino, int usar_cache);
+static void reabrir_origem_fria(const unsigned int* blocos);
+
+// Consulta: trava de leitura, fazendo antes a carga inicial se ainda não houve
+static void abrir_leitura() {
+    inicio_chamada = relogio_ns();
+    travar_leitura(&trava_dados);
+    espera_chamada = relogio_ns() - inicio_chamada;
+    if (dados_carregados) return;
+    destravar_leitura(&trava_dados);
+    travar_escrita(&trava_dados);
+    carregar_dados();
+    destravar_escrita(&trava_dados);
+    travar_leitura(&trava_dados);
+}
+
+static void abrir_escrita() {
+    inicio_chamada = relogio_ns();
+    travar_escrita(&trava_dados);
+    espera_chamada = relogio_ns() - inicio_chamada;
+    carregar_dados();
+}
+
+// Muda a cada escrita (mesmo as recusadas): quem guarda respostas prontas só
+// precisa comparar a geração em que elas foram montadas
+EXPORT unsigned int db_geracao() {
+    travar_leitura(&trava_dados);
+    unsigned int g = geracao_dados;
+    destravar_leitura(&trava_dados);
+    return g;
+}
+
+EXPORT int db_metricas(DbMetrica* arr, int max_len) {
+    travar(&trava_metricas);
+    int n = num_metricas;
+    destravar(&trava_metricas);
+    for (int i = 0; i < n && i < max_len; i++) {
+        const Metrica* m = &metricas[i];
+        memset(&arr[i], 0, sizeof(DbMetrica));
+        strncpy(arr[i].nome, m->nome, DB_METRICA_NOME - 1);
+        arr[i].chamadas = ler_metrica(&m->chamadas);
+        arr[i].tempo_ns = ler_metrica(&m->tempo_ns);
+        arr[i].espera_ns = ler_metrica(&m->espera_ns);
+        for (int k = 0; k < DB_METRICA_FAIXAS; k++) arr[i].faixas[k] = ler_metrica(&m->faixas[k]);
+    }
+    return n;
+}
+
+EXPORT int db_metricas_io(DbMetricasIO* out) {
+    if (!out) return 0;
+    out->bytes_log = ler_metrica(&metricas_io.bytes_log);
+    out->bytes_turmas = ler_metrica(&metricas_io.bytes_turmas);
+    out->bytes_alunos = ler_metrica(&metricas_io.bytes_alunos);
+    out->bytes_frequencia = ler_metrica(&metricas_io.bytes_frequencia);
+    out->bytes_registros = ler_metrica(&metricas_io.bytes_registros);
+    out->compactacoes = ler_metrica(&metricas_io.compactacoes);
+    out->tempo_compactacao_ns = ler_metrica(&metricas_io.tempo_compactacao_ns);
+    out->descargas_log = ler_metrica(&metricas_io.descargas_log);
+    out->leituras_frios = ler_metrica(&metricas_io.leituras_frios);
+    out->acertos_frios = ler_metrica(&metricas_io.acertos_frios);
+    travar(&trava_log);
+    out->tamanho_log = tamanho_log;
+    destravar(&trava_log);
+    return 1;
+}
+
+// --- Snapshots: leitura consistente com cópia na escrita ---
+
+// Um snapshot guarda, para cada coluna quente, um ponteiro por página de
+// linhas. As páginas apontam para os arrays vivos até a primeira escrita numa
+// linha visível ao snapshot; só então aquela página é copiada para ele. Abrir
+// um snapshot não copia o banco e os escritores continuam trabalhando
+// enquanto um relatório percorre o snapshot. Avaliações e presenças (dados
+// frios) não fazem parte do snapshot.
+#define SNAPSHOT_LINHAS_PAGINA 256
+
+enum { COL_TURMAS, COL_MATRICULA, COL_ID_TURMA, COL_NOTAS, COL_NOME, NUM_COLUNAS_SNAPSHOT };
+
+typedef struct {
+    int id;
+    int invalido;   // faltou memória para preservar uma página: leituras falham
+    int linhas[NUM_COLUNAS_SNAPSHOT];
+    unsigned char** paginas[NUM_COLUNAS_SNAPSHOT];
+} Snapshot;
+
+static Snapshot* snapshots = NULL;
+static int num_snapshots = 0;
+static int capacidade_snapshots = 0;
+static int proximo_id_snapshot = 1;
+
+static const size_t tamanho_linha_snapshot[NUM_COLUNAS_SNAPSHOT] = {
+    sizeof(Turma), sizeof(int), sizeof(int), sizeof(Notas), sizeof(NomeAluno)
+};
+
+static unsigned char* coluna_viva(int c) {
+    switch (c) {
+    case COL_TURMAS: return (unsigned char*)turmas;
+    case COL_MATRICULA: return (unsigned char*)alunos_matricula;
+    case COL_ID_TURMA: return (unsigned char*)alunos_id_turma;
+    case COL_NOTAS: return (unsigned char*)alunos_notas;
+    default: return (unsigned char*)alunos_nome;
+    }
+}
+
+static unsigned char* pagina_viva(int c, int p) {
+    return coluna_viva(c) + (size_t)p * SNAPSHOT_LINHAS_PAGINA * tamanho_linha_snapshot[c];
+}
+
+static int paginas_snapshot(const Snapshot* s, int c) {
+    return (s->linhas[c] + SNAPSHOT_LINHAS_PAGINA - 1) / SNAPSHOT_LINHAS_PAGINA;
+}
+
+// Se a página p ainda é a do array vivo, copia para o snapshot as linhas dela que ele enxerga
+static void separar_pagina(Snapshot* s, int c, int p) {
+    unsigned char* viva = pagina_viva(c, p);
+    if (s->paginas[c][p] != viva) return;
+    int linhas = s->linhas[c] - p * SNAPSHOT_LINHAS_PAGINA;
+    if (linhas > SNAPSHOT_LINHAS_PAGINA) linhas = SNAPSHOT_LINHAS_PAGINA;
+    unsigned char* copia = (unsigned char*)malloc((size_t)linhas * tamanho_linha_snapshot[c]);
+    if (copia) memcpy(copia, viva, (size_t)linhas * tamanho_linha_snapshot[c]);
+    else s->invalido = 1;
+    s->paginas[c][p] = copia;
+}
+
+// Chamada antes de escrever a linha i da coluna c (com a trava de escrita)
+static void preservar(int c, int i) {
+    for (int k = 0; k < num_snapshots; k++) {
+        if (i < snapshots[k].linhas[c]) separar_pagina(&snapshots[k], c, i / SNAPSHOT_LINHAS_PAGINA);
+    }
+}
+
+static void preservar_aluno(int i) {
+    if (!num_snapshots) return;
+    for (int c = COL_MATRICULA; c < NUM_COLUNAS_SNAPSHOT; c++) preservar(c, i);
+}
+
+// Chamada antes de realocar a coluna c: páginas ainda compartilhadas apontariam para memória liberada
+static void preservar_coluna(int c) {
+    for (int k = 0; k < num_snapshots; k++) {
+        for (int p = 0; p < paginas_snapshot(&snapshots[k], c); p++) separar_pagina(&snapshots[k], c, p);
+    }
+}
+
+static void liberar_snapshot(Snapshot* s) {
+    for (int c = 0; c < NUM_COLUNAS_SNAPSHOT; c++) {
+        if (!s->paginas[c]) continue;
+        for (int p = 0; p < paginas_snapshot(s, c); p++) {
+            if (s->paginas[c][p] != pagina_viva(c, p)) free(s->paginas[c][p]);
+        }
+        free(s->paginas[c]);
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+static int criar_snapshot() {
+    if (!reservar_snapshots()) return 0;
+    Snapshot* s = &snapshots[num_snapshots];
+    memset(s, 0, sizeof(*s));
+    for (int c = 0; c < NUM_COLUNAS_SNAPSHOT; c++) {
+        s->linhas[c] = c == COL_TURMAS ? num_turmas : num_alunos;
+        int n = paginas_snapshot(s, c);
+        s->paginas[c] = (unsigned char**)malloc((n ? n : 1) * sizeof(unsigned char*));
+        if (!s->paginas[c]) {
+            liberar_snapshot(s);
+            return 0;
+        }
+        for (int p = 0; p < n; p++) s->paginas[c][p] = pagina_viva(c, p);
+    }
+    s->id = proximo_id_snapshot++;
+    num_snapshots++;
+    return s->id;
+}
+
+static Snapshot* buscar_snapshot(int id) {
+    for (int k = 0; k < num_snapshots; k++) {
+        if (snapshots[k].id == id) return snapshots[k].invalido ? NULL : &snapshots[k];
+    }
+    return NULL;
+}
+
+static const void* linha_snapshot(const Snapshot* s, int c, int i) {
+    return s->paginas[c][i / SNAPSHOT_LINHAS_PAGINA] + (size_t)(i % SNAPSHOT_LINHAS_PAGINA) * tamanho_linha_snapshot[c];
+}
+
+static void montar_resumo_snapshot(const Snapshot* s, int i, AlunoResumo* r) {
+    r->matricula = *(const int*)linha_snapshot(s, COL_MATRICULA, i);
+    memcpy(r->nome, linha_snapshot(s, COL_NOME, i), sizeof(r->nome));
+    r->notas = *(const Notas*)linha_snapshot(s, COL_NOTAS, i);
+}
+
+// --- Armazenamento dinâmico ---
+
+// Garante espaço para 'necessario' elementos no array, dobrando a capacidade
+// (custo amortizado constante por inserção). Retorna 0 se faltar memória.
+static int reservar(void** dados, int* capacidade, int necessario, size_t tamanho_elemento) {
+    if (necessario <= *capacidade) return 1;
+    int nova = *capacidade ? *capacidade : 16;
+    while (nova < necessario) nova *= 2;
+    void* novos = realloc(*dados, (size_t)nova * tamanho_elemento);
+    if (!novos) return 0;
+    *dados = novos;
+    *capacidade = nova;
+    return 1;
+}
+
+static int reservar_turmas(int necessario) {
+    if (necessario > capacidade_turmas) preservar_coluna(COL_TURMAS);
+    return reservar((void**)&turmas, &capacidade_turmas, necessario, sizeof(Turma));
+}
+
+// Todas as colunas de alunos e os encadeamentos por turma crescem juntos
+// (mesma capacidade inicial e mesma sequência de dobras)
+static int reservar_snapshots() {
+    return reservar((void**)&snapshots, &capacidade_snapshots, num_snapshots + 1, sizeof(Snapshot));
+}
+
+static int reservar_alunos(int necessario) {
+    if (necessario <= capacidade_alunos) return 1;
+    for (int c = COL_MATRICULA; c < NUM_COLUNAS_SNAPSHOT; c++) preservar_coluna(c);
+    int capacidade;
+#define RESERVAR_COLUNA(coluna) \
+    capacidade = capacidade_alunos; \
+    if (!reservar((void**)&coluna, &capacidade, necessario, sizeof(*coluna))) return 0;
+    RESERVAR_COLUNA(alunos_matricula)
+    RESERVAR_COLUNA(alunos_id_turma)
+    RESERVAR_COLUNA(alunos_notas)
+    RESERVAR_COLUNA(alunos_nome)
+    RESERVAR_COLUNA(alunos_frios)
+    RESERVAR_COLUNA(prox_na_turma)
+    RESERVAR_COLUNA(ant_na_turma)
+#undef RESERVAR_COLUNA
+    capacidade_alunos = capacidade;
+    return 1;
+}
+
+// --- Visão de compatibilidade: Aluno <-> colunas ---
+
+static int limitar(int quantidade, int maximo) {
+    return quantidade < 0 ? 0 : (quantidade > maximo ? maximo : quantidade);
+}
+
+// Entradas e datas crescem juntas, com a mesma capacidade
+static int reservar_entradas(void** entradas, int** datas, int* capacidade, int necessario, size_t tamanho) {
+    int capacidade_datas = *capacidade;
+    if (!reservar((void**)datas, &capacidade_datas, necessario, sizeof(int))) return 0;
+    return reservar(entradas, capacidade, necessario, tamanho);
+}
+
+// --- Formato compacto dos .dat ---
+// Textos com 1 ou 2 bytes de tamanho seguidos dos bytes (sem o '\0').
+// turmas.dat: cabeçalho | por turma: id, disciplina, professor
+// alunos.dat: cabeçalho | parte quente, por aluno: matrícula, id_turma, notas,
+//             nome, u8 num_avaliacoes e, se houver, u32 posição do bloco frio
+//             | blocos frios: u32 crc, u32 tamanho, avaliações (nota, data, comentário)
+// As presenças ficam só em frequencia.dat.
+
+#define MAX_REGISTRO_TURMA (sizeof(Turma) + 2)
+#define MAX_REGISTRO_ALUNO (2 * sizeof(int) + sizeof(Notas) + 1 + sizeof(NomeAluno) + 1 + sizeof(unsigned int))
+#define MAX_BLOCO_FRIO (2 * sizeof(unsigned int) + MAX_AVALIACOES * (sizeof(Avaliacao) + 3))
+#define MIN_REGISTRO_TURMA (sizeof(int) + 2)
+#define MIN_REGISTRO_ALUNO (2 * sizeof(int) + sizeof(Notas) + 2)
+
+// Leitura com verificação de limites: passar do fim zera 'ok'
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* fim;
+    int ok;
+} Leitor;
+
+static void ler_campo(Leitor* l, void* destino, size_t n) {
+    if (!l->ok || (size_t)(l->fim - l->p) < n) {
+        l->ok = 0;
+        memset(destino, 0, n);
+        return;
+    }
+    memcpy(destino, l->p, n);
+    l->p += n;
+}
+
+// Texto com 1 ou 2 bytes de tamanho (largura), terminado em '\0' no destino
+static void ler_texto(Leitor* l, char* destino, size_t capacidade, int largura) {
+    unsigned char curto = 0;
+    unsigned short longo = 0;
+    if (largura == 1) ler_campo(l, &curto, 1);
+    else ler_campo(l, &longo, sizeof(longo));
+    size_t n = largura == 1 ? curto : longo;
+    memset(destino, 0, capacidade);
+    if (n >= capacidade) l->ok = 0;
+    if (l->ok) ler_campo(l, destino, n);
+}
+
+static unsigned char* escrever_campo(unsigned char* p, const void* dados, size_t n) {
+    memcpy(p, dados, n);
+    return p + n;
+}
+
+static unsigned char* escrever_texto(unsigned char* p, const char* texto, size_t capacidade, int largura) {
+    size_t n = 0;
+    while (n < capacidade - 1 && texto[n]) n++;
+    unsigned char curto = (unsigned char)n;
+    unsigned short longo = (unsigned short)n;
+    p = largura == 1 ? escrever_campo(p, &curto, 1) : escrever_campo(p, &longo, sizeof(longo));
+    return escrever_campo(p, texto, n);
+}
+
+// Bloco frio com as avaliações; retorna o tamanho (até MAX_BLOCO_FRIO)
+static size_t codificar_avaliacoes(const Avaliacao* avaliacoes, int quantidade, unsigned char* destino) {
+    unsigned char* p = destino + 2 * sizeof(unsigned int);
+    for (int k = 0; k < quantidade; k++) {
+        p = escrever_campo(p, &avaliacoes[k].nota, sizeof(float));
+        p = escrever_texto(p, avaliacoes[k].data, sizeof(avaliacoes[k].data), 1);
+        p = escrever_texto(p, avaliacoes[k].comentario, sizeof(avaliacoes[k].comentario), 2);
+    }
+    unsigned int tamanho = (unsigned int)(p - destino - 2 * sizeof(unsigned int));
+    unsigned int crc = crc32_atualizar(0, destino + 2 * sizeof(unsigned int), tamanho);
+    memcpy(destino, &crc, sizeof(crc));
+    memcpy(destino + sizeof(crc), &tamanho, sizeof(tamanho));
+    return (size_t)(p - destino);
+}
+
+// Decodifica 'quantidade' avaliações de um bloco frio; 0 se truncado ou com CRC errado
+static int decodificar_avaliacoes(const unsigned char* bloco, const unsigned char* fim, int quantidade, Avaliacao* destino) {
+    Leitor l = { bloco, fim, 1 };
+    unsigned int crc, tamanho;
+    ler_campo(&l, &crc, sizeof(crc));
+    ler_campo(&l, &tamanho, sizeof(tamanho));
+    if (!l.ok || tamanho > (size_t)(fim - l.p) || crc32_atualizar(0, l.p, tamanho) != crc) return 0;
+    l.fim = l.p + tamanho;
+    memset(destino, 0, quantidade * sizeof(Avaliacao));
+    for (int k = 0; k < quantidade; k++) {
+        ler_campo(&l, &destino[k].nota, sizeof(float));
+        ler_texto(&l, destino[k].data, sizeof(destino[k].data), 1);
+        ler_texto(&l, destino[k].comentario, sizeof(destino[k].comentario), 2);
+    }
+    return l.ok;
+}
+
+// Avaliações dos dados frios: as da memória ou, se ainda estão em alunos.dat,
+// decodificadas em 'lidas'; NULL se o bloco não pôde ser lido ou está corrompido
+static const Avaliacao* avaliacoes_frias(const DadosFrios* frios, Avaliacao* lidas) {
+    if (!frios->bloco) return frios->avaliacoes;
+    unsigned char bloco[MAX_BLOCO_FRIO];
+    size_t n = ler_bloco_frio(frios->bloco, bloco, 1);
+    return n && decodificar_avaliacoes(bloco, bloco + n, frios->num_avaliacoes, lidas) ? lidas : NULL;
+}
+
+static int copiar_avaliacoes(DadosFrios* frios, const Avaliacao* origem, int quantidade) {
+    if (quantidade <= 0) return 1;
+    if (!reservar_entradas((void**)&frios->avaliacoes, &frios->datas_avaliacoes, &frios->capacidade_avaliacoes,
+                           quantidade, sizeof(Avaliacao))) return 0;
+    memcpy(frios->avaliacoes, origem, quantidade * sizeof(Avaliacao));
+    frios->num_avaliacoes = quantidade;
+    return 1;
+}
+
+static void liberar_frios(DadosFrios* frios) {
+    if (!frios->emprestado) free(frios->avaliacoes);
+    free(frios->datas_avaliacoes);
+    memset(frios, 0, sizeof(*frios));
+}
+
+// Traz para a memória própria os dados frios emprestados ou ainda em
+// alunos.dat; deve ser chamada antes de alterá-los
+static int materializar_frios(DadosFrios* frios) {
+    if (!frios->emprestado && !frios->bloco) return 1;
+    DadosFrios copia;
+    memset(&copia, 0, sizeof(copia));
+    Avaliacao lidas[MAX_AVALIACOES];
+    const Avaliacao* origem = avaliacoes_frias(frios, lidas);
+    if (!origem || !copiar_avaliacoes(&copia, origem, frios->num_avaliacoes)) {
+        liberar_frios(&copia);
+        return 0;
+    }
+    copia.vaga = frios->vaga;
+    *frios = copia;
+    return 1;
+}
+
+// --- Índice por data das avaliações e presenças ---
+
+// Converte "DD/MM/YYYY" em AAAAMMDD, que pode ser comparado como inteiro; -1 se inválida
+static int converter_data(const char* data) {
+    for (int k = 0; k < 10; k++) {
+        if (k == 2 || k == 5) {
+            if (data[k] != '/') return -1;
+        } else if (data[k] < '0' || data[k] > '9') {
+            return -1;
+        }
+    }
+    int dia = (data[0] - '0') * 10 + (data[1] - '0');
+    int mes = (data[3] - '0') * 10 + (data[4] - '0');
+    int ano = (data[6] - '0') * 1000 + (data[7] - '0') * 100 + (data[8] - '0') * 10 + (data[9] - '0');
+    if (dia < 1 || dia > 31 || mes < 1 || mes > 12) return -1;
+    return ano * 10000 + mes * 100 + dia;
+}
+
+// Busca binária: primeira posição com data >= chave (ou > chave, se depois_dos_iguais)
+static int posicao_por_data(const int* datas, int n, int chave, int depois_dos_iguais) {
+    int inicio = 0, fim = n;
+    while (inicio < fim) {
+        int meio = (inicio + fim) / 2;
+        if (datas[meio] < chave || (depois_dos_iguais && datas[meio] == chave)) inicio = meio + 1;
+        else fim = meio;
+    }
+    return inicio;
+}
+
+static void inserir_por_data(void* entradas, int* datas, int n, int pos, const void* entrada, int chave, size_t tamanho) {
+    unsigned char* e = (unsigned char*)entradas;
+    memmove(e + (pos + 1) * tamanho, e + pos * tamanho, (n - pos) * tamanho);
+    memmove(datas + pos + 1, datas + pos, (n - pos) * sizeof(int));
+    memcpy(e + pos * tamanho, entrada, tamanho);
+    datas[pos] = chave;
+}
+
+static void remover_por_data(void* entradas, int* datas, int n, int pos, size_t tamanho) {
+    unsigned char* e = (unsigned char*)entradas;
+    memmove(e + pos * tamanho, e + (pos + 1) * tamanho, (n - pos - 1) * tamanho);
+    memmove(datas + pos, datas + pos + 1, (n - pos - 1) * sizeof(int));
+}
+
+// Calcula as datas de entradas vindas do arquivo e as ordena (inserção estável, n <= 50)
+static void ordenar_por_data(void* entradas, int* datas, int n, size_t tamanho, size_t deslocamento_data) {
+    unsigned char* e = (unsigned char*)entradas;
+    unsigned char temp[sizeof(Avaliacao) > sizeof(Presenca) ? sizeof(Avaliacao) : sizeof(Presenca)];
+    for (int i = 0; i < n; i++) {
+        int chave = converter_data((const char*)(e + i * tamanho + deslocamento_data));
+        if (chave < 0) chave = 0;  // datas inválidas antigas ficam no início
+        memcpy(temp, e + i * tamanho, tamanho);
+        int j = i;
+        for (; j > 0 && datas[j - 1] > chave; j--) {
+            memcpy(e + j * tamanho, e + (j - 1) * tamanho, tamanho);
+            datas[j] = datas[j - 1];
+        }
+        memcpy(e + j * tamanho, temp, tamanho);
+        datas[j] = chave;
+    }
+}
+
+// Garante o índice por data; feito sob demanda para não tocar nos dados
+// frios de todos os alunos durante a carga
+static int indexar_frios(DadosFrios* f) {
+    if (f->indexado) return 1;
+    if (!materializar_frios(f)) return 0;
+    ordenar_por_data(f->avaliacoes, f->datas_avaliacoes, f->num_avaliacoes, sizeof(Avaliacao), offsetof(Avaliacao, data));
+    f->indexado = 1;
+    return 1;
+}
+
+static int aplicar_avaliacao(DadosFrios* f, const Avaliacao* av) {
+    int chave = converter_data(av->data);
+    if (chave < 0 || !indexar_frios(f)) return 0;
+    if (f->num_avaliacoes >= MAX_AVALIACOES ||
+        !reservar_entradas((void**)&f->avaliacoes, &f->datas_avaliacoes, &f->capacidade_avaliacoes,
+                           f->num_avaliacoes + 1, sizeof(Avaliacao))) return 0;
+    int pos = posicao_por_data(f->datas_avaliacoes, f->num_avaliacoes, chave, 1);
+    inserir_por_data(f->avaliacoes, f->datas_avaliacoes, f->num_avaliacoes, pos, av, chave, sizeof(Avaliacao));
+    f->num_avaliacoes++;
+    return 1;
+}
+
+// Substitui a primeira avaliação da data indicada, reposicionando-a se a data mudou
+static int aplicar_atualizar_avaliacao(DadosFrios* f, const AtualizacaoAvaliacao* at) {
+    int nova_chave = converter_data(at->avaliacao.data);
+    if (nova_chave < 0 || !indexar_frios(f)) return 0;
+    int pos = posicao_por_data(f->datas_avaliacoes, f->num_avaliacoes, at->data, 0);
+    if (pos >= f->num_avaliacoes || f->datas_avaliacoes[pos] != at->data) return 0;
+    remover_por_data(f->avaliacoes, f->datas_avaliacoes, f->num_avaliacoes, pos, sizeof(Avaliacao));
+    pos = posicao_por_data(f->datas_avaliacoes, f->num_avaliacoes - 1, nova_chave, 1);
+    inserir_por_data(f->avaliacoes, f->datas_avaliacoes, f->num_avaliacoes - 1, pos, &at->avaliacao, nova_chave, sizeof(Avaliacao));
+    return 1;
+}
+
+// Distribui um Aluno nas colunas da posição i (já reservada)
+static int gravar_colunas_aluno(int i, const Aluno* a) {
+    preservar_aluno(i);
+    alunos_matricula[i] = a->matricula;
+    alunos_id_turma[i] = a->id_turma;
+    alunos_notas[i] = a->notas;
+    memcpy(alunos_nome[i], a->nome, sizeof(NomeAluno));
+    alunos_nome[i][sizeof(NomeAluno) - 1] = '\0';
+    memset(&alunos_frios[i], 0, sizeof(DadosFrios));
+    // As presenças vão depois para a frequência da turma (importar_presencas)
+    return copiar_avaliacoes(&alunos_frios[i], a->avaliacoes, limitar(a->num_avaliacoes, MAX_AVALIACOES));
+}
+
+// Monta o struct Aluno completo a partir das colunas (formato das funções exportadas)
+static void montar_aluno(int i, Aluno* a) {
+    memset(a, 0, sizeof(*a));
+    a->matricula = alunos_matricula[i];
+    a->id_turma = alunos_id_turma[i];
+    a->notas = alunos_notas[i];
+    memcpy(a->nome, alunos_nome[i], sizeof(NomeAluno));
+    const DadosFrios* frios = &alunos_frios[i];
+    a->num_avaliacoes = limitar(frios->num_avaliacoes, MAX_AVALIACOES);
+    const Avaliacao* avaliacoes = a->num_avaliacoes ? avaliacoes_frias(frios, a->avaliacoes) : NULL;
+    if (!avaliacoes) a->num_avaliacoes = 0;
+    else if (avaliacoes != a->avaliacoes) memcpy(a->avaliacoes, avaliacoes, a->num_avaliacoes * sizeof(Avaliacao));
+    // O Aluno só comporta as MAX_PRESENCAS primeiras; a frequência da turma guarda todas
+    a->num_presencas = copiar_presencas(i, 0, INT_MAX, a->presencas, MAX_PRESENCAS);
+}
+
+static void montar_resumo(int i, AlunoResumo* r) {
+    r->matricula = alunos_matricula[i];
+    memcpy(r->nome, alunos_nome[i], sizeof(NomeAluno));
+    r->notas = alunos_notas[i];
+}
+
+// Copia as colunas da posição 'de' para 'para' (os dados frios mudam de dono)
+static void mover_colunas_aluno(int de, int para) {
+    preservar_aluno(para);
+    alunos_matricula[para] = alunos_matricula[de];
+    alunos_id_turma[para] = alunos_id_turma[de];
+    alunos_notas[para] = alunos_notas[de];
+    memcpy(alunos_nome[para], alunos_nome[de], sizeof(NomeAluno));
+    alunos_frios[para] = alunos_frios[de];
+    memset(&alunos_frios[de], 0, sizeof(DadosFrios));
+}
+
+// --- Mapeamento de arquivos (MapViewOfFile no Windows, mmap nos demais) ---
+
+static int mapear_arquivo(const char* nome, ArquivoMapeado* m) {
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->arquivo = CreateFileA(nome, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->arquivo == INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER tamanho;
+    if (!GetFileSizeEx(m->arquivo, &tamanho) || tamanho.QuadPart == 0) {
+        CloseHandle(m->arquivo);
+        return 0;
+    }
+    m->mapeamento = CreateFileMappingA(m->arquivo, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapeamento) {
+        CloseHandle(m->arquivo);
+        return 0;
+    }
+    m->base = MapViewOfFile(m->mapeamento, FILE_MAP_READ, 0, 0, 0);
+    if (!m->base) {
+        CloseHandle(m->mapeamento);
+        CloseHandle(m->arquivo);
+        return 0;
+    }
+    m->tamanho = (size_t)tamanho.QuadPart;
+#else
+    int fd = open(nome, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+    m->base = base;
+    m->tamanho = (size_t)st.st_size;
+#endif
+    return 1;
+}
+
+static void desmapear_arquivo(ArquivoMapeado* m) {
+    if (!m->base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m->base);
+    CloseHandle(m->mapeamento);
+    CloseHandle(m->arquivo);
+#else
+    munmap((void*)m->base, m->tamanho);
+#endif
+    memset(m, 0, sizeof(*m));
+}
+
+// Quantidade de registros de um .dat do formato antigo ("int quantidade +
+// structs"), limitada ao que cabe no arquivo
+static int registros_legados(const unsigned char* base, size_t tamanho, size_t tamanho_registro) {
+    int quantidade = 0;
+    if (tamanho < sizeof(int)) return 0;
+    memcpy(&quantidade, base, sizeof(int));
+    size_t cabem = (tamanho - sizeof(int)) / tamanho_registro;
+    if (quantidade < 0) return 0;
+    return (size_t)quantidade > cabem ? (int)cabem : quantidade;
+}
+
+// Confere o cabeçalho de um .dat na memória e posiciona 'l' na parte quente.
+// Retorna 1 no formato atual, 0 no antigo (sem assinatura) e -1 se esta
+// versão não sabe ler o arquivo. Parte quente truncada ou com CRC errado é
+// lida até onde der, mas o arquivo não é mais regravado.
+static int abrir_arquivo_dados(const unsigned char* base, size_t tamanho, size_t registro_minimo,
+                               CabecalhoArquivoDados* cab, Leitor* l) {
+    if (tamanho < sizeof(*cab)) return 0;
+    memcpy(cab, base, sizeof(*cab));
+    if (cab->assinatura != DADOS_ASSINATURA) return 0;
+    if (cab->versao != DADOS_VERSAO || cab->quantidade < 0) {
+        arquivos_protegidos = 1;
+        return -1;
+    }
+    size_t disponivel = tamanho - sizeof(*cab);
+    l->p = base + sizeof(*cab);
+    l->fim = l->p + (cab->tamanho < disponivel ? cab->tamanho : disponivel);
+    l->ok = 1;
+    if (cab->tamanho > disponivel || crc32_atualizar(0, l->p, cab->tamanho) != cab->crc) arquivos_protegidos = 1;
+    size_t cabem = (size_t)(l->fim - l->p) / registro_minimo;
+    if ((size_t)cab->quantidade > cabem) cab->quantidade = (int)cabem;
+    return 1;
+}
+
+static void interpretar_turmas(const unsigned char* base, size_t tamanho) {
+    CabecalhoArquivoDados cab;
+    Leitor l;
+    int formato = abrir_arquivo_dados(base, tamanho, MIN_REGISTRO_TURMA, &cab, &l);
+    if (formato == 0) {
+        formato_antigo = 1;
+        int quantidade = registros_legados(base, tamanho, sizeof(Turma));
+        if (quantidade > 0 && reservar_turmas(quantidade)) {
+            memcpy(turmas, base + sizeof(int), quantidade * sizeof(Turma));
+            num_turmas = quantidade;
+        }
+        return;
+    }
+    if (formato < 0 || cab.quantidade == 0 || !reservar_turmas(cab.quantidade)) return;
+    while (num_turmas < cab.quantidade) {
+        Turma* t = &turmas[num_turmas];
+        ler_campo(&l, &t->id, sizeof(int));
+        ler_texto(&l, t->nome_disciplina, sizeof(t->nome_disciplina), 1);
+        ler_texto(&l, t->nome_professor, sizeof(t->nome_professor), 1);
+        if (!l.ok) break;
+        num_turmas++;
+    }
+}
+
+// Formato antigo de alunos.dat: "int quantidade + registros Aluno". Com
+// emprestar, as avaliações continuam apontando para os registros em 'base'.
+static int interpretar_alunos_legado(const unsigned char* base, size_t tamanho, int com_presencas, int emprestar) {
+    int quantidade = registros_legados(base, tamanho, sizeof(Aluno));
+    if (quantidade <= 0 || !reservar_alunos(quantidade)) return 0;
+    const Aluno* registros = (const Aluno*)(base + sizeof(int));
+    for (int i = 0; i < quantidade; i++) {
+        const Aluno* a = &registros[i];
+        if (emprestar) {
+            alunos_matricula[i] = a->matricula;
+            alunos_id_turma[i] = a->id_turma;
+            alunos_notas[i] = a->notas;
+            memcpy(alunos_nome[i], a->nome, sizeof(NomeAluno));
+            alunos_nome[i][sizeof(NomeAluno) - 1] = '\0';
+            DadosFrios* frios = &alunos_frios[i];
+            memset(frios, 0, sizeof(*frios));
+            frios->num_avaliacoes = limitar(a->num_avaliacoes, MAX_AVALIACOES);
+            frios->avaliacoes = (Avaliacao*)a->avaliacoes;
+            frios->emprestado = 1;
+        } else if (!gravar_colunas_aluno(i, a)) {
+            break;
+        }
+        num_alunos = i + 1;
+        if (com_presencas) importar_presencas(i, a->presencas, limitar(a->num_presencas, MAX_PRESENCAS));
+    }
+    return emprestar && num_alunos > 0;
+}
+
+// Distribui alunos.dat nas colunas (e, no formato antigo com com_presencas,
+// as presenças na frequência da turma). No formato atual basta a parte
+// quente: as avaliações ficam em alunos.dat (DadosFrios.bloco). Retorna 1
+// se o arquivo precisa continuar aberto ou mapeado.
+static int interpretar_alunos(const unsigned char* base, size_t tamanho, int com_presencas, int emprestar) {
+    CabecalhoArquivoDados cab;
+    Leitor l;
+    int formato = abrir_arquivo_dados(base, tamanho, MIN_REGISTRO_ALUNO, &cab, &l);
+    if (formato == 0) {
+        formato_antigo = 1;
+        return interpretar_alunos_legado(base, tamanho, com_presencas, emprestar);
+    }
+    if (formato < 0 || cab.quantidade == 0 || !reservar_alunos(cab.quantidade)) return 0;
+    int no_arquivo = 0;
+    while (num_alunos < cab.quantidade) {
+        int i = num_alunos;
+        unsigned char n = 0;
+        unsigned int bloco = 0;
+        ler_campo(&l, &alunos_matricula[i], sizeof(int));
+        ler_campo(&l, &alunos_id_turma[i], sizeof(int));
+        ler_campo(&l, &alunos_notas[i], sizeof(Notas));
+        ler_texto(&l, alunos_nome[i], sizeof(NomeAluno), 1);
+        ler_campo(&l, &n, 1);
+        if (n) ler_campo(&l, &bloco, sizeof(bloco));
+        if (!l.ok) break;
+        DadosFrios* frios = &alunos_frios[i];
+        memset(frios, 0, sizeof(*frios));
+        num_alunos = i + 1;
+        if (!n) continue;
+        if (n > MAX_AVALIACOES || bloco < sizeof(cab) + cab.tamanho) {
+            arquivos_protegidos = 1;
+            continue;
+        }
+        frios->num_avaliacoes = n;
+        frios->bloco = bloco;
+        no_arquivo = 1;
+    }
+    return no_arquivo;
+}
+
+// Lê o arquivo inteiro para a memória (liberada pelo chamador); 0 se não existe ou está vazio
+static int ler_arquivo(const char* nome, unsigned char** dados, size_t* tamanho) {
+    FILE* f = fopen(nome, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long total = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *dados = total > 0 ? (unsigned char*)malloc(total) : NULL;
+    *tamanho = *dados ? fread(*dados, 1, total, f) : 0;
+    fclose(f);
+    if (*tamanho == 0) free(*dados);
+    return *tamanho > 0;
+}
+
+static void ler_turmas_mmap() {
+    ArquivoMapeado m;
+    if (!mapear_arquivo(TURMAS_DB_FILE, &m)) return;
+    interpretar_turmas(m.base, m.tamanho);
+    desmapear_arquivo(&m);
+}
+
+// As colunas quentes são copiadas; as avaliações continuam no arquivo
+// mapeado (páginas só são lidas do disco quando acessadas)
+static void ler_alunos_mmap(int com_presencas) {
+    if (!mapear_arquivo(ALUNOS_DB_FILE, &mapa_alunos)) return;
+    if (!interpretar_alunos(mapa_alunos.base, mapa_alunos.tamanho, com_presencas, 1)) desmapear_arquivo(&mapa_alunos);
+}
+
+// Empréstimos do formato antigo apontam para o mapeamento: antes de
+// reescrever alunos.dat viram cópia própria
+static int materializar_emprestados() {
+    for (int i = 0; i < num_alunos; i++) {
+        if (alunos_frios[i].emprestado && !materializar_frios(&alunos_frios[i])) return 0;
+    }
+    return 1;
+}
+
+static void ler_turmas() {
+    unsigned char* dados;
+    size_t tamanho;
+    if (!ler_arquivo(TURMAS_DB_FILE, &dados, &tamanho)) return;
+    interpretar_turmas(dados, tamanho);
+    free(dados);
+}
+
+// No formato atual lê só o cabeçalho e a parte quente; o arquivo fica aberto
+// para as leituras sob demanda das avaliações
+static void ler_alunos(int com_presencas) {
+    FILE* f = fopen(ALUNOS_DB_FILE, "rb");
+    if (!f) return;
+    fseek(f, 0, SEEK_END);
+    long total = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    CabecalhoArquivoDados cab;
+    size_t tamanho = total > 0 ? (size_t)total : 0;
+    if (tamanho >= sizeof(cab) && fread(&cab, sizeof(cab), 1, f) == 1 && cab.assinatura == DADOS_ASSINATURA &&
+        cab.tamanho < tamanho - sizeof(cab)) tamanho = sizeof(cab) + cab.tamanho;
+    fseek(f, 0, SEEK_SET);
+    unsigned char* dados = tamanho ? (unsigned char*)malloc(tamanho) : NULL;
+    size_t lidos = dados ? fread(dados, 1, tamanho, f) : 0;
+    fclose(f);
+    if (lidos && interpretar_alunos(dados, lidos, com_presencas, 0) && !abrir_origem_fria()) arquivos_protegidos = 1;
+    free(dados);
+}
+
+// --- Escrita segura em disco ---
+
+// Garante que o conteúdo chegou ao disco, e não só ao cache do sistema
+static int sincronizar(FILE* f) {
+    if (fflush(f) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Substitui 'destino' por 'origem' numa única operação atômica
+static int substituir_arquivo(const char* origem, const char* destino) {
+#ifdef _WIN32
+    return MoveFileExA(origem, destino, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(origem, destino) != 0) return 0;
+    // A troca de nome só é durável depois de sincronizar o diretório
+    int d = open(".", O_RDONLY);
+    if (d >= 0) { fsync(d); close(d); }
+    return 1;
+#endif
+}
+
+static int arquivo_existe(const char* caminho) {
+    FILE* f = fopen(caminho, "rb");
+    if (f) fclose(f);
+    return f != NULL;
+}
+
+// CRC-32 (polinômio 0xEDB88320, o mesmo do zlib), processado por nibble
+static unsigned int crc32_atualizar(unsigned int crc, const void* dados, size_t tamanho) {
+    static const unsigned int tabela[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const unsigned char* p = (const unsigned char*)dados;
+    crc = ~crc;
+    while (tamanho--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ tabela[crc & 15];
+        crc = (crc >> 4) ^ tabela[crc & 15];
+    }
+    return ~crc;
+}
+
+static unsigned int crc_registro(const CabecalhoLog* cab, const void* dados) {
+    CabecalhoLog c = *cab;
+    c.crc = 0;
+    unsigned int crc = crc32_atualizar(0, &c, sizeof(c));
+    return cab->tamanho > 0 ? crc32_atualizar(crc, dados, cab->tamanho) : crc;
+}
+
+// --- Histórico de alterações para as réplicas (ver db_replicacao_ler) ---
+
+// Registros no formato do log (CabecalhoLog + dados), em ordem de sequência:
+// posicoes[k] é onde começa o de sequência seq_inicio + k e turmas[k] é a
+// turma do aluno alterado (ver db_alteracoes_desde). Alterado com a trava de
+// escrita dos dados e lido com a de leitura.
+static struct {
+    unsigned char* dados;
+    int tamanho;
+    int capacidade;
+    int limite;
+    int* posicoes;
+    int* turmas;
+    int num;
+    int capacidade_posicoes;
+    int capacidade_turmas;
+    unsigned long long seq_inicio;
+} historico = { NULL, 0, 0, DB_HISTORICO_PADRAO, NULL, NULL, 0, 0, 0, 0 };
+static unsigned long long seq_alteracoes = 0;   // sequência da próxima alteração (seq_inicio + num)
+static unsigned long long instancia_dados = 0;  // sorteada a cada carga
+static void (*aviso_alteracoes)(void) = NULL;   // ver db_avisar_alteracoes
+
+static void esvaziar_historico() {
+    historico.tamanho = historico.num = 0;
+    historico.seq_inicio = seq_alteracoes;
+}
+
+// Descarta os registros mais antigos até caberem mais 'bytes' em 'registros'
+// (com folga de um quarto, para não mover o histórico a cada alteração).
+// Retorna 0 se não cabe no limite ou faltou memória.
+static int abrir_espaco_historico(int bytes, int registros) {
+    if (bytes > historico.limite) return 0;
+    if (historico.tamanho + bytes > historico.limite) {
+        int alvo = historico.limite / 4 * 3, k = 0;
+        while (k < historico.num && historico.tamanho - historico.posicoes[k] + bytes > alvo) k++;
+        int deslocamento = k < historico.num ? historico.posicoes[k] : historico.tamanho;
+        memmove(historico.dados, historico.dados + deslocamento, historico.tamanho - deslocamento);
+        for (int j = k; j < historico.num; j++) historico.posicoes[j - k] = historico.posicoes[j] - deslocamento;
+        memmove(historico.turmas, historico.turmas + k, (size_t)(historico.num - k) * sizeof(int));
+        historico.tamanho -= deslocamento;
+        historico.num -= k;
+        historico.seq_inicio += k;
+    }
+    return reservar((void**)&historico.dados, &historico.capacidade, historico.tamanho + bytes, 1) &&
+           reservar((void**)&historico.posicoes, &historico.capacidade_posicoes, historico.num + registros, sizeof(int)) &&
+           reservar((void**)&historico.turmas, &historico.capacidade_turmas, historico.num + registros, sizeof(int));
+}
+
+// Depois de abrir_espaco_historico
+static void acrescentar_historico(int tipo, int chave, const void* dados, int tamanho, int turma) {
+    CabecalhoLog cab = { tipo, chave, tamanho, 0 };
+    cab.crc = crc_registro(&cab, dados);
+    historico.turmas[historico.num] = turma;
+    historico.posicoes[historico.num++] = historico.tamanho;
+    memcpy(historico.dados + historico.tamanho, &cab, sizeof(cab));
+    if (tamanho > 0) memcpy(historico.dados + historico.tamanho + sizeof(cab), dados, tamanho);
+    historico.tamanho += (int)sizeof(cab) + tamanho;
+    seq_alteracoes++;
+}
+
+// Alteração que não coube: a sequência avança mesmo assim e as réplicas
+// atrasadas precisam de uma cópia nova
+static void perder_historico(int registros) {
+    seq_alteracoes += registros;
+    esvaziar_historico();
+}
+
+static void avisar_alteracoes() {
+    if (aviso_alteracoes) aviso_alteracoes();
+}
+
+static void publicar_alteracao(int tipo, int chave, const void* dados, int tamanho, int turma) {
+    if (abrir_espaco_historico((int)sizeof(CabecalhoLog) + tamanho, 1)) acrescentar_historico(tipo, chave, dados, tamanho, turma);
+    else perder_historico(1);
+    avisar_alteracoes();
+}
+
+// Inserções de um lote (posições inicio..fim-1), numa transação como no log
+static void publicar_lote(int tipo, int inicio, int fim) {
+    int n = fim - inicio, tamanho = tipo == REG_TURMA_INSERIR ? (int)sizeof(Turma) : (int)sizeof(Aluno);
+    double bytes = (double)(n + 2) * sizeof(CabecalhoLog) + (double)n * tamanho;
+    if (bytes > historico.limite || !abrir_espaco_historico((int)bytes, n + 2)) {
+        perder_historico(n + 2);
+        avisar_alteracoes();
+        return;
+    }
+    Aluno a;
+    acrescentar_historico(REG_TRANSACAO_INICIO, 0, NULL, 0, -1);
+    for (int i = inicio; i < fim; i++) {
+        if (tipo == REG_TURMA_INSERIR) {
+            acrescentar_historico(tipo, turmas[i].id, &turmas[i], tamanho, turmas[i].id);
+        } else {
+            montar_aluno(i, &a);
+            acrescentar_historico(tipo, a.matricula, &a, tamanho, a.id_turma);
+        }
+    }
+    acrescentar_historico(REG_TRANSACAO_FIM, 0, NULL, 0, -1);
+    avisar_alteracoes();
+}
+
+// --- Recuperação na inicialização ---
+
+// Lê o log inteiro e valida os registros em sequência, parando no primeiro
+// incompleto ou com CRC errado (queda durante a gravação). Localiza também a
+// última marca de compactação: o que vem antes dela já está nos .dat novos.
+// Arquivo sem o cabeçalho desta versão fica marcado como inválido.
+static void ler_log(LogLido* log) {
+    memset(log, 0, sizeof(*log));
+    FILE* f = fopen(LOG_DB_FILE, "rb");
+    if (!f) return;
+    fseek(f, 0, SEEK_END);
+    long tamanho = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (tamanho > 0 && (log->dados = (unsigned char*)malloc(tamanho)) != NULL) {
+        log->tamanho = (long)fread(log->dados, 1, tamanho, f);
+    }
+    fclose(f);
+    if (tamanho <= 0) return;
+
+    CabecalhoArquivoLog arquivo;
+    if (log->tamanho < tamanho || log->tamanho < (long)sizeof(arquivo) ||
+        (memcpy(&arquivo, log->dados, sizeof(arquivo)), arquivo.assinatura != LOG_ASSINATURA || arquivo.versao != LOG_VERSAO)) {
+        log->invalido = 1;
+        return;
+    }
+    long pos = sizeof(arquivo);
+    log->inicio = pos;
+    while (pos + (long)sizeof(CabecalhoLog) <= log->tamanho) {
+        CabecalhoLog cab;
+        memcpy(&cab, log->dados + pos, sizeof(cab));
+        if (cab.tamanho < 0 || cab.tamanho > log->tamanho - pos - (long)sizeof(cab)) break;
+        if (crc_registro(&cab, log->dados + pos + sizeof(cab)) != cab.crc) break;
+        pos += sizeof(cab) + cab.tamanho;
+        if (cab.tipo == REG_COMPACTACAO) {
+            log->inicio = pos;
+            log->compactacao_pendente = 1;
+        }
+    }
+    log->fim = pos;
+}
+
+// Aplica os registros do log entre as posições 'de' e 'ate'
+static void aplicar_trecho_log(const LogLido* log, long de, long ate) {
+    union { Aluno aluno; unsigned char bytes[sizeof(Aluno)]; } dados;  // cópia alinhada
+    while (de < ate) {
+        CabecalhoLog cab;
+        memcpy(&cab, log->dados + de, sizeof(cab));
+        de += sizeof(cab);
+        if (cab.tipo == REG_REGISTRO_GRAVAR || cab.tipo == REG_REGISTRO_REMOVER) {
+            // Só bytes (sem exigência de alinhamento) e sem limite de tamanho
+            aplicar_registro(cab.tipo, cab.chave, log->dados + de, cab.tamanho);
+        } else if (cab.tamanho <= (int)sizeof(dados) && cab.tipo != REG_TRANSACAO_INICIO && cab.tipo != REG_TRANSACAO_FIM) {
+            memcpy(dados.bytes, log->dados + de, cab.tamanho);
+            aplicar_registro(cab.tipo, cab.chave, dados.bytes, cab.tamanho);
+        }
+        de += cab.tamanho;
+    }
+}
+
+// Reaplica sobre os .dat os registros posteriores à última compactação.
+// Registros de uma transação só são aplicados quando o FIM dela está no log.
+// Retorna 0 se o log precisa ser reescrito (final corrompido, transação
+// incompleta ou compactação interrompida).
+static int reproduzir_log(const LogLido* log) {
+    long pos = log->inicio, transacao = -1;
+    while (pos < log->fim) {
+        CabecalhoLog cab;
+        memcpy(&cab, log->dados + pos, sizeof(cab));
+        long proximo = pos + (long)sizeof(cab) + cab.tamanho;
+        if (cab.tipo == REG_TRANSACAO_INICIO) {
+            transacao = proximo;
+        } else if (cab.tipo == REG_TRANSACAO_FIM) {
+            if (transacao != -1) aplicar_trecho_log(log, transacao, pos);
+            transacao = -1;
+        } else if (transacao == -1) {
+            aplicar_trecho_log(log, pos, proximo);
+        }
+        pos = proximo;
+    }
+    tamanho_log = log->fim;
+    return log->fim == log->tamanho && transacao == -1 && !log->compactacao_pendente;
+}
+
+// Função para carregar os dados dos arquivos binários
+void carregar_dados() {
+    if (dados_carregados) return;
+    LogLido log;
+    ler_log(&log);
+    if (log.compactacao_pendente) {
+        // Queda depois do commit da compactação: termina as trocas de arquivo
+        if (arquivo_existe(TURMAS_TMP_FILE)) substituir_arquivo(TURMAS_TMP_FILE, TURMAS_DB_FILE);
+        if (arquivo_existe(ALUNOS_TMP_FILE)) substituir_arquivo(ALUNOS_TMP_FILE, ALUNOS_DB_FILE);
+        if (arquivo_existe(FREQUENCIA_TMP_FILE)) substituir_arquivo(FREQUENCIA_TMP_FILE, FREQUENCIA_DB_FILE);
+        if (arquivo_existe(REGISTROS_TMP_FILE)) substituir_arquivo(REGISTROS_TMP_FILE, REGISTROS_DB_FILE);
+    } else {
+        // Temporários sem commit são de uma compactação interrompida: descartados
+        remove(TURMAS_TMP_FILE);
+        remove(ALUNOS_TMP_FILE);
+        remove(FREQUENCIA_TMP_FILE);
+        remove(REGISTROS_TMP_FILE);
+    }
+    // Sem frequencia.dat (dados de versões anteriores), as presenças vêm dos registros de alunos.dat
+    int presencas_em_alunos = !arquivo_existe(FREQUENCIA_DB_FILE);
+    if (usar_mmap) {
+        ler_turmas_mmap();
+        ler_alunos_mmap(presencas_em_alunos);
+    } else {
+        ler_turmas();
+        ler_alunos(presencas_em_alunos);
+    }
+    dados_carregados = 1;
+    reconstruir_indices();
+    if (!presencas_em_alunos) ler_frequencias();
+    ler_registros();
+    int log_integro = reproduzir_log(&log);
+    free(log.dados);
+    conferir_palavras();
+    // Sequências de cargas anteriores (ou de outro processo) não valem mais
+    instancia_dados = ((unsigned long long)time(NULL) << 32 ^ (unsigned long long)relogio_ns()) | 1;
+    esvaziar_historico();
+    // Compactar também converte os .dat do formato antigo (troca atômica, como sempre).
+    // Sem reescrever um log com final corrompido, o que fosse acrescentado depois
+    // se perderia na próxima carga: o banco fica somente leitura. Um log sem
+    // cabeçalho válido não pode ser lido nem descartado: também somente leitura.
+    if (log.invalido) arquivos_protegidos = 1;
+    else if ((!log_integro || formato_antigo) && !compactar() && !log_integro) arquivos_protegidos = 1;
+}
+
+// Sincroniza e fecha um .dat recém-gravado, somando o tamanho às métricas
+static int concluir_arquivo_dados(FILE* f, int ok, long long* bytes) {
+    ok = ok && sincronizar(f);
+    if (ok) somar_metrica(bytes, (long long)ftell(f));
+    return fclose(f) == 0 && ok;
+}
+
+// Regrava o cabeçalho, agora com tamanho e CRC da parte quente, e volta ao fim
+static int gravar_cabecalho_dados(FILE* f, const CabecalhoArquivoDados* cab) {
+    return fseek(f, 0, SEEK_SET) == 0 && fwrite(cab, sizeof(*cab), 1, f) == 1 && fseek(f, 0, SEEK_END) == 0;
+}
+
+static size_t codificar_turma(const Turma* t, unsigned char* destino) {
+    unsigned char* p = escrever_campo(destino, &t->id, sizeof(int));
+    p = escrever_texto(p, t->nome_disciplina, sizeof(t->nome_disciplina), 1);
+    p = escrever_texto(p, t->nome_professor, sizeof(t->nome_professor), 1);
+    return (size_t)(p - destino);
+}
+
+// Registro quente do aluno i; bloco_frio só é gravado se ele tem avaliações
+static size_t codificar_aluno(int i, unsigned int bloco_frio, unsigned char* destino) {
+    unsigned char n = (unsigned char)limitar(alunos_frios[i].num_avaliacoes, MAX_AVALIACOES);
+    unsigned char* p = escrever_campo(destino, &alunos_matricula[i], sizeof(int));
+    p = escrever_campo(p, &alunos_id_turma[i], sizeof(int));
+    p = escrever_campo(p, &alunos_notas[i], sizeof(Notas));
+    p = escrever_texto(p, alunos_nome[i], sizeof(NomeAluno), 1);
+    p = escrever_campo(p, &n, 1);
+    if (n) p = escrever_campo(p, &bloco_frio, sizeof(bloco_frio));
+    return (size_t)(p - destino);
+}
+
+// Bloco frio do aluno i em 'destino' (copiado sem decodificar se ainda está
+// em alunos.dat, sem passar pelo cache); 0 se não tem avaliações ou falhou
+static size_t codificar_frios_aluno(int i, unsigned char* destino) {
+    const DadosFrios* frios = &alunos_frios[i];
+    if (frios->bloco) return ler_bloco_frio(frios->bloco, destino, 0);
+    int n = limitar(frios->num_avaliacoes, MAX_AVALIACOES);
+    return n ? codificar_avaliacoes(frios->avaliacoes, n, destino) : 0;
+}
+
+// Tamanho que o bloco frio do aluno i terá (só o cabeçalho dele é lido do arquivo)
+static size_t medir_frios_aluno(int i, unsigned char* rascunho) {
+    unsigned int tamanho = 0;
+    unsigned int bloco = alunos_frios[i].bloco;
+    if (!bloco) return codificar_frios_aluno(i, rascunho);
+    return ler_origem_fria(bloco + sizeof(unsigned int), &tamanho, sizeof(tamanho)) ? 2 * sizeof(unsigned int) + tamanho : 0;
+}
+
+// Funções para salvar os dados nos arquivos (já sincronizados com o disco)
+static int salvar_dados_turmas(const char* caminho) {
+    FILE* f = fopen(caminho, "wb");
+    if (!f) return 0;
+    CabecalhoArquivoDados cab = { DADOS_ASSINATURA, DADOS_VERSAO, num_turmas, 0, 0 };
+    unsigned char registro[MAX_REGISTRO_TURMA];
+    int ok = fwrite(&cab, sizeof(cab), 1, f) == 1;
+    for (int i = 0; ok && i < num_turmas; i++) {
+        size_t n = codificar_turma(&turmas[i], registro);
+        cab.tamanho += (unsigned int)n;
+        cab.crc = crc32_atualizar(cab.crc, registro, n);
+        ok = fwrite(registro, 1, n, f) == n;
+    }
+    ok = ok && gravar_cabecalho_dados(f, &cab);
+    return concluir_arquivo_dados(f, ok, &metricas_io.bytes_turmas);
+}
+
+// Parte quente primeiro (lida inteira na carga) e depois os blocos frios, na
+// mesma ordem; a primeira passada só calcula onde eles começam. 'blocos'
+// recebe a posição do bloco de cada aluno no arquivo novo (0 = nenhum).
+static int salvar_dados_alunos(const char* caminho, unsigned int* blocos) {
+    FILE* f = fopen(caminho, "wb");
+    if (!f) return 0;
+    CabecalhoArquivoDados cab = { DADOS_ASSINATURA, DADOS_VERSAO, num_alunos, 0, 0 };
+    unsigned char registro[MAX_REGISTRO_ALUNO];
+    unsigned char bloco[MAX_BLOCO_FRIO];
+    for (int i = 0; i < num_alunos; i++) cab.tamanho += (unsigned int)codificar_aluno(i, 0, registro);
+    unsigned int posicao_frios = (unsigned int)sizeof(cab) + cab.tamanho;
+    int ok = fwrite(&cab, sizeof(cab), 1, f) == 1;
+    for (int i = 0; ok && i < num_alunos; i++) {
+        size_t n = codificar_aluno(i, posicao_frios, registro);
+        cab.crc = crc32_atualizar(cab.crc, registro, n);
+        ok = fwrite(registro, 1, n, f) == n;
+        blocos[i] = alunos_frios[i].num_avaliacoes ? posicao_frios : 0;
+        if (blocos[i]) {
+            size_t frios = medir_frios_aluno(i, bloco);
+            ok = ok && frios > 0;
+            posicao_frios += (unsigned int)frios;
+        }
+    }
+    for (int i = 0; ok && i < num_alunos; i++) {
+        if (!blocos[i]) continue;
+        size_t n = codificar_frios_aluno(i, bloco);
+        ok = n > 0 && (unsigned int)ftell(f) == blocos[i] && fwrite(bloco, 1, n, f) == n;
+    }
+    ok = ok && gravar_cabecalho_dados(f, &cab);
+    return concluir_arquivo_dados(f, ok, &metricas_io.bytes_alunos);
+}
+
+// --- Log de alterações (write-ahead log) ---
+
+static int abrir_log() {
+    if (f_log) return 1;
+    f_log = fopen(LOG_DB_FILE, "ab");
+    if (!f_log) return 0;
+    setvbuf(f_log, NULL, _IOFBF, LOG_TAMANHO_BUFFER);
+    fseek(f_log, 0, SEEK_END);
+    if (ftell(f_log) == 0) {
+        CabecalhoArquivoLog cab = { LOG_ASSINATURA, LOG_VERSAO };
+        // Sem o cabeçalho no disco, o log seria tratado como corrompido na carga
+        if (fwrite(&cab, sizeof(cab), 1, f_log) != 1 || fflush(f_log) != 0) {
+            fclose(f_log);
+            f_log = NULL;
+            remove(LOG_DB_FILE);
+            return 0;
+        }
+        tamanho_log = sizeof(cab);
+    }
+    return 1;
+}
+
+// Corta do log o que passou de 'tamanho' (registro que não foi gravado
+// inteiro), fechando o arquivo; chamada com trava_log
+static void cortar_log(long tamanho) {
+    if (f_log) fclose(f_log);
+    f_log = NULL;
+#ifdef _WIN32
+    int fd = _open(LOG_DB_FILE, _O_RDWR | _O_BINARY);
+    if (fd >= 0) {
+        _chsize(fd, tamanho);
+        _close(fd);
+    }
+#else
+    if (truncate(LOG_DB_FILE, tamanho) != 0) {}
+#endif
+    tamanho_log = tamanho;
+    log_pendente = 0;
+}
+
+// Leva o buffer do log até o disco (fsync), não só ao cache do sistema;
+// chamada com trava_log
+static int descarregar_log() {
+    somar_metrica(&metricas_io.descargas_log, 1);
+    return sincronizar(f_log);
+}
+
+// Descarrega o buffer do log conforme a política; chamada com trava_log.
+// Retorna 0 se a descarga imediata falhou.
+static int concluir_escrita_log() {
+    if (politica_durabilidade == DB_DURABILIDADE_IMEDIATA) {
+        log_pendente = 0;
+        return descarregar_log();
+    }
+    log_pendente = 1;
+    return 1;
+}
+
+// Acrescenta um registro ao log aberto, sem descarregar o buffer.
+// Retorna 0 se a escrita falhou (disco cheio, limite de tamanho).
+static int acrescentar_log(int tipo, int chave, const void* dados, int tamanho) {
+    CabecalhoLog cab = { tipo, chave, tamanho, 0 };
+    cab.crc = crc_registro(&cab, dados);
+    int ok = fwrite(&cab, sizeof(cab), 1, f_log) == 1 && (tamanho <= 0 || fwrite(dados, 1, tamanho, f_log) == (size_t)tamanho);
+    tamanho_log += sizeof(cab) + tamanho;
+    somar_metrica(&metricas_io.bytes_log, (long long)sizeof(cab) + tamanho);
+    return ok;
+}
+
+// Retorna 0 se o registro não chegou ao log (nem aos .dat, sem log): o que
+// foi escrito dele é cortado e a alteração não vale
+static int escrever_log(int tipo, int chave, const void* dados, int tamanho) {
+    travar(&trava_log);
+    if (!abrir_log()) {
+        destravar(&trava_log);
+        // Sem log disponível: reescreve os arquivos (falha também sem a marca de commit)
+        return compactar();
+    }
+    long antes = tamanho_log;
+    int ok = acrescentar_log(tipo, chave, dados, tamanho) && concluir_escrita_log();
+    if (!ok) cortar_log(antes);
+    int cheio = ok && tamanho_log >= LOG_LIMITE_COMPACTACAO;
+    destravar(&trava_log);
+    if (cheio) compactar();
+    return ok;
+}
+
+// Grava de uma só vez as inserções de um lote, que ocupam as posições
+// inicio..fim-1 (inserções sempre vão para o fim dos arrays), numa transação
+// do log: uma queda no meio não deixa o lote pela metade. Se o lote não
+// cabe no log antes do limite, compacta direto: na gravação registro a
+// registro o log seria compactado várias vezes no meio do lote.
+// Retorna 0 se o lote não foi gravado (ver escrever_log).
+static int persistir_lote(int tipo, int inicio, int fim) {
+    if (inicio >= fim) return 1;
+    int tamanho = tipo == REG_TURMA_INSERIR ? (int)sizeof(Turma) : (int)sizeof(Aluno);
+    double bytes = (double)(fim - inicio + 2) * sizeof(CabecalhoLog) + (double)(fim - inicio) * tamanho;
+    int ok;
+    travar(&trava_log);
+    if (!abrir_log() || tamanho_log + bytes >= LOG_LIMITE_COMPACTACAO) {
+        destravar(&trava_log);
+        ok = compactar();
+    } else {
+        Aluno a;
+        long antes = tamanho_log;
+        ok = acrescentar_log(REG_TRANSACAO_INICIO, 0, NULL, 0);
+        for (int i = inicio; ok && i < fim; i++) {
+            if (tipo == REG_TURMA_INSERIR) {
+                ok = acrescentar_log(tipo, turmas[i].id, &turmas[i], tamanho);
+            } else {
+                montar_aluno(i, &a);
+                ok = acrescentar_log(tipo, a.matricula, &a, tamanho);
+            }
+        }
+        ok = ok && acrescentar_log(REG_TRANSACAO_FIM, 0, NULL, 0) && concluir_escrita_log();
+        if (!ok) cortar_log(antes);
+        destravar(&trava_log);
+    }
+    if (ok) publicar_lote(tipo, inicio, fim);
+    return ok;
+}
+
+// Alteração aplicada em memória que não chegou ao disco: volta ao estado
+// gravado (com a trava de escrita). A carga muda a instância, então réplicas
+// e clientes do histórico também recomeçam.
+static void desfazer_alteracoes() {
+    descarregar_dados();
+    carregar_dados();
+    avisar_alteracoes();
+}
+
+// Turma afetada pela alteração, antes de aplicá-la (-1 se não é de turma nem aluno)
+static int turma_da_alteracao(int tipo, int chave, const void* dados, int tamanho) {
+    if (tipo >= REG_TURMA_INSERIR && tipo <= REG_TURMA_ALTERAR_ID) return chave;
+    if (tipo == REG_ALUNO_INSERIR) {
+        Aluno a;
+        if (tamanho != sizeof(Aluno)) return -1;
+        memcpy(&a, dados, sizeof(a));
+        return a.id_turma;
+    }
+    if (tipo > REG_ALUNO_INSERIR && tipo <= REG_ALUNO_ATUALIZAR_AVALIACAO) {
+        int i = indice_aluno(chave);
+        return i == -1 ? -1 : alunos_id_turma[i];
+    }
+    return -1;
+}
+
+// Aplica a alteração em memória e, se ela foi aceita, grava no log. Se a
+// aplicação fica pela metade ou a gravação falha, a alteração é desfeita e
+// retorna 0.
+static int registrar_alteracao(int tipo, int chave, const void* dados, int tamanho) {
+    if (arquivos_protegidos) return 0;
+    int turma = turma_da_alteracao(tipo, chave, dados, tamanho);
+    int aplicado = aplicar_registro(tipo, chave, dados, tamanho);
+    if (aplicado != 1) {
+        if (aplicado == -1) desfazer_alteracoes();
+        return 0;
+    }
+    conferir_palavras();
+    if (!escrever_log(tipo, chave, dados, tamanho)) {
+        desfazer_alteracoes();
+        return 0;
+    }
+    publicar_alteracao(tipo, chave, dados, tamanho, turma);
+    return 1;
+}
+
+// Troca os .dat pelos temporários e recomeça o log só com o cabeçalho
+static int concluir_compactacao() {
+    if (!substituir_arquivo(TURMAS_TMP_FILE, TURMAS_DB_FILE) ||
+        !substituir_arquivo(ALUNOS_TMP_FILE, ALUNOS_DB_FILE) ||
+        !substituir_arquivo(FREQUENCIA_TMP_FILE, FREQUENCIA_DB_FILE) ||
+        !substituir_arquivo(REGISTROS_TMP_FILE, REGISTROS_DB_FILE)) return 0;
+    FILE* f = fopen(LOG_TMP_FILE, "wb");
+    if (!f) return 0;
+    CabecalhoArquivoLog cab = { LOG_ASSINATURA, LOG_VERSAO };
+    int ok = fwrite(&cab, sizeof(cab), 1, f) == 1 && sincronizar(f);
+    if (fclose(f) != 0 || !ok || !substituir_arquivo(LOG_TMP_FILE, LOG_DB_FILE)) return 0;
+    tamanho_log = sizeof(cab);
+    return 1;
+}
+
+// Copia todo o estado para os arquivos .dat e esvazia o log (com a trava de escrita).
+// Os .dat novos são gravados em temporários e o registro REG_COMPACTACAO no log é o
+// ponto de commit: antes dele a recuperação descarta os temporários, depois dele
+// conclui as trocas. Se a troca falhar aqui, os registros seguintes continuam no
+// log depois da marca e são reaplicados sobre os .dat novos.
+static int compactar() {
+    // .dat que esta versão não leu por inteiro não pode ser substituído
+    if (arquivos_protegidos) return 0;
+    long long inicio = relogio_ns();
+    somar_metrica(&metricas_io.compactacoes, 1);
+    unsigned int* blocos = (unsigned int*)malloc((num_alunos + 1) * sizeof(unsigned int));
+    int gravados = blocos && materializar_emprestados() &&
+                   salvar_dados_turmas(TURMAS_TMP_FILE) && salvar_dados_alunos(ALUNOS_TMP_FILE, blocos) &&
+                   salvar_dados_frequencia(FREQUENCIA_TMP_FILE) && salvar_dados_registros(REGISTROS_TMP_FILE);
+    travar(&trava_log);
+    // Sem a marca no disco, o log antigo ainda vale sobre os .dat: nada é trocado
+    int marcado = 0;
+    if (gravados && abrir_log()) {
+        long antes = tamanho_log;
+        marcado = acrescentar_log(REG_COMPACTACAO, 0, NULL, 0) && sincronizar(f_log);
+        if (marcado) {
+            fclose(f_log);
+            f_log = NULL;
+            log_pendente = 0;
+        } else {
+            // Marca que talvez chegue ao disco mais tarde valeria sem os temporários
+            cortar_log(antes);
+        }
+    }
+    if (!marcado) {
+        destravar(&trava_log);
+        free(blocos);
+        remove(TURMAS_TMP_FILE);
+        remove(ALUNOS_TMP_FILE);
+        remove(FREQUENCIA_TMP_FILE);
+        remove(REGISTROS_TMP_FILE);
+        return 0;
+    }
+    // alunos.dat aberto ou mapeado não pode ser substituído no Windows
+    fechar_origem_fria();
+    int ok = concluir_compactacao();
+    destravar(&trava_log);
+    reabrir_origem_fria(arquivo_existe(ALUNOS_TMP_FILE) ? NULL : blocos);
+    free(blocos);
+    somar_metrica(&metricas_io.tempo_compactacao_ns, relogio_ns() - inicio);
+    return ok;
+}
+
+EXPORT int db_compactar() {
+    abrir_escrita();
+    int ok = compactar();
+    fechar_escrita();
+    return ok;
+}
+
+// --- Durabilidade: descarga imediata, agrupada ou manual ---
+
+EXPORT int db_flush() {
+    travar(&trava_log);
+    int ok = !f_log || descarregar_log();
+    if (ok) log_pendente = 0;
+    destravar(&trava_log);
+    return ok;
+}
+
+// A cada intervalo, descarrega numa só escrita o que se acumulou no buffer.
+// Termina sozinho quando a política deixa de ser a agrupada.
+static void laco_descarregador() {
+    for (;;) {
+        travar(&trava_log);
+        int intervalo = intervalo_agrupamento_ms;
+        destravar(&trava_log);
+        dormir_ms(intervalo);
+        travar(&trava_log);
+        if (log_pendente && f_log) descarregar_log();
+        log_pendente = 0;
+        if (politica_durabilidade != DB_DURABILIDADE_AGRUPADA) {
+            descarregador_ativo = 0;
+            destravar(&trava_log);
+            return;
+        }
+        destravar(&trava_log);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI rotina_descarregador(LPVOID arg) { (void)arg; laco_descarregador(); return 0; }
+#else
+static void* rotina_descarregador(void* arg) { (void)arg; laco_descarregador(); return NULL; }
+#endif
+
+// Chamada com trava_log
+static int iniciar_descarregador() {
+    if (descarregador_ativo) return 1;
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, rotina_descarregador, NULL, 0, NULL);
+    if (!h) return 0;
+    CloseHandle(h);
+#else
+    pthread_t t;
+    if (pthread_create(&t, NULL, rotina_descarregador, NULL) != 0) return 0;
+    pthread_detach(t);
+#endif
+    descarregador_ativo = 1;
+    return 1;
+}
+
+EXPORT int db_set_durability(int politica, int intervalo_ms) {
+    if (politica < DB_DURABILIDADE_IMEDIATA || politica > DB_DURABILIDADE_MANUAL) return 0;
+    travar(&trava_log);
+    if (politica == DB_DURABILIDADE_AGRUPADA) {
+        if (intervalo_ms > 0) intervalo_agrupamento_ms = intervalo_ms;
+        if (!iniciar_descarregador()) {
+            destravar(&trava_log);
+            return 0;
+        }
+    }
+    politica_durabilidade = politica;
+    // Ao voltar para o modo imediato, nada pode ficar para trás no buffer
+    if (politica == DB_DURABILIDADE_IMEDIATA && log_pendente && f_log) {
+        descarregar_log();
+        log_pendente = 0;
+    }
+    destravar(&trava_log);
+    return 1;
+}
+
+// --- Índices hash ---
+
+// Fibonacci: os bits altos do produto misturam todos os bits da chave; os baixos não
+static unsigned int hash_chave(int chave, int deslocamento) {
+    return ((unsigned int)chave * 2654435761u) >> deslocamento;
+}
+
+static int hash_buscar(const TabelaHash* h, int chave) {
+    if (h->capacidade == 0) return -1;
+    unsigned int mascara = (unsigned int)h->capacidade - 1;
+    for (unsigned int i = hash_chave(chave, h->deslocamento); ; i = (i + 1) & mascara) {
+        if (h->entradas[i].posicao == -1) return -1;
+        if (h->entradas[i].chave == chave) return h->entradas[i].posicao;
+    }
+}
+
+static int hash_redimensionar(TabelaHash* h, int nova_capacidade) {
+    EntradaHash* novas = malloc(nova_capacidade * sizeof(EntradaHash));
+    if (!novas) return 0;
+    for (int i = 0; i < nova_capacidade; i++) novas[i].posicao = -1;
+    unsigned int mascara = (unsigned int)nova_capacidade - 1;
+    int deslocamento = 32;
+    while ((1 << (32 - deslocamento)) < nova_capacidade) deslocamento--;
+    for (int i = 0; i < h->capacidade; i++) {
+        if (h->entradas[i].posicao == -1) continue;
+        unsigned int j = hash_chave(h->entradas[i].chave, deslocamento);
+        while (novas[j].posicao != -1) j = (j + 1) & mascara;
+        novas[j] = h->entradas[i];
+    }
+    free(h->entradas);
+    h->entradas = novas;
+    h->capacidade = nova_capacidade;
+    h->deslocamento = deslocamento;
+    return 1;
+}
+
+// Insere a chave ou, se ela já existir, atualiza sua posição
+static int hash_definir(TabelaHash* h, int chave, int posicao) {
+    // Mantém a ocupação abaixo de 50% para sondagens curtas
+    if ((h->usados + 1) * 2 > h->capacidade &&
+        !hash_redimensionar(h, h->capacidade ? h->capacidade * 2 : 64)) return 0;
+    unsigned int mascara = (unsigned int)h->capacidade - 1;
+    unsigned int i = hash_chave(chave, h->deslocamento);
+    while (h->entradas[i].posicao != -1 && h->entradas[i].chave != chave) i = (i + 1) & mascara;
+    if (h->entradas[i].posicao == -1) h->usados++;
+    h->entradas[i].chave = chave;
+    h->entradas[i].posicao = posicao;
+    return 1;
+}
+
+// Remoção com deslocamento para trás: dispensa marcadores de "removido"
+static void hash_remover(TabelaHash* h, int chave) {
+    if (h->capacidade == 0) return;
+    unsigned int mascara = (unsigned int)h->capacidade - 1;
+    unsigned int i = hash_chave(chave, h->deslocamento);
+    while (h->entradas[i].posicao != -1 && h->entradas[i].chave != chave) i = (i + 1) & mascara;
+    if (h->entradas[i].posicao == -1) return;
+    for (unsigned int j = (i + 1) & mascara; h->entradas[j].posicao != -1; j = (j + 1) & mascara) {
+        unsigned int k = hash_chave(h->entradas[j].chave, h->deslocamento);
+        // Move a entrada j para a lacuna i se a posição ideal dela não estiver em (i, j]
+        if (((j - k) & mascara) >= ((j - i) & mascara)) {
+            h->entradas[i] = h->entradas[j];
+            i = j;
+        }
+    }
+    h->entradas[i].posicao = -1;
+    h->usados--;
+}
+
+static void hash_limpar(TabelaHash* h) {
+    for (int i = 0; i < h->capacidade; i++) h->entradas[i].posicao = -1;
+    h->usados = 0;
+}
+
+// --- Avaliações sob demanda ---
+
+static int abrir_origem_fria() {
+    if (usar_mmap) return mapa_alunos.base || mapear_arquivo(ALUNOS_DB_FILE, &mapa_alunos);
+#ifdef _WIN32
+    if (arquivo_frios == INVALID_HANDLE_VALUE) {
+        arquivo_frios = CreateFileA(ALUNOS_DB_FILE, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    return arquivo_frios != INVALID_HANDLE_VALUE;
+#else
+    if (arquivo_frios < 0) arquivo_frios = open(ALUNOS_DB_FILE, O_RDONLY);
+    return arquivo_frios >= 0;
+#endif
+}
+
+static void fechar_origem_fria() {
+    desmapear_arquivo(&mapa_alunos);
+#ifdef _WIN32
+    if (arquivo_frios != INVALID_HANDLE_VALUE) CloseHandle(arquivo_frios);
+    arquivo_frios = INVALID_HANDLE_VALUE;
+#else
+    if (arquivo_frios >= 0) close(arquivo_frios);
+    arquivo_frios = -1;
+#endif
+}
+
+// Leitura posicional: pode ser feita por várias consultas ao mesmo tempo
+static int ler_origem_fria(unsigned int posicao, void* destino, size_t n) {
+    if (mapa_alunos.base) {
+        if (posicao > mapa_alunos.tamanho || n > mapa_alunos.tamanho - posicao) return 0;
+        memcpy(destino, mapa_alunos.base + posicao, n);
+        return 1;
+    }
+#ifdef _WIN32
+    OVERLAPPED o;
+    memset(&o, 0, sizeof(o));
+    o.Offset = posicao;
+    DWORD lidos = 0;
+    return arquivo_frios != INVALID_HANDLE_VALUE && ReadFile(arquivo_frios, destino, (DWORD)n, &lidos, &o) && lidos == n;
+#else
+    return arquivo_frios >= 0 && pread(arquivo_frios, destino, n, (off_t)posicao) == (ssize_t)n;
+#endif
+}
+
+// Cache LRU dos blocos lidos de alunos.dat, limitado em bytes. Não é usado
+// com o backend mmap, em que o cache de páginas do sistema faz esse papel.
+typedef struct {
+    unsigned int posicao;   // do bloco em alunos.dat (chave)
+    unsigned int tamanho;
+    int anterior;           // lista do mais recente ao mais antigo; -1 nas pontas
+    int proximo;            // também encadeia as entradas livres
+    unsigned char* bloco;
+} EntradaCacheFrios;
+
+static struct {
+    EntradaCacheFrios* entradas;
+    int capacidade;
+    int usadas;     // entradas do array já usadas alguma vez
+    int livres;
+    int recente;
+    int antiga;     // a próxima a sair
+    size_t bytes;
+    size_t limite;
+    TabelaHash indice;  // posição do bloco -> entrada
+} cache_frios = { NULL, 0, 0, -1, -1, -1, 0, DB_CACHE_FRIOS_PADRAO, { NULL, 0, 0, 0 } };
+static Trava trava_cache_frios = TRAVA_INICIAL;
+
+static void desligar_cache_frios(int e) {
+    EntradaCacheFrios* x = &cache_frios.entradas[e];
+    if (x->anterior != -1) cache_frios.entradas[x->anterior].proximo = x->proximo;
+    else cache_frios.recente = x->proximo;
+    if (x->proximo != -1) cache_frios.entradas[x->proximo].anterior = x->anterior;
+    else cache_frios.antiga = x->anterior;
+}
+
+static void ligar_cache_frios(int e) {
+    EntradaCacheFrios* x = &cache_frios.entradas[e];
+    x->anterior = -1;
+    x->proximo = cache_frios.recente;
+    if (cache_frios.recente != -1) cache_frios.entradas[cache_frios.recente].anterior = e;
+    else cache_frios.antiga = e;
+    cache_frios.recente = e;
+}
+
+static void liberar_entrada_cache_frios(int e) {
+    EntradaCacheFrios* x = &cache_frios.entradas[e];
+    free(x->bloco);
+    x->bloco = NULL;
+    x->proximo = cache_frios.livres;
+    cache_frios.livres = e;
+}
+
+static void remover_cache_frios(int e) {
+    desligar_cache_frios(e);
+    hash_remover(&cache_frios.indice, (int)cache_frios.entradas[e].posicao);
+    cache_frios.bytes -= cache_frios.entradas[e].tamanho;
+    liberar_entrada_cache_frios(e);
+}
+
+// Chamadas com trava_cache_frios
+static void reduzir_cache_frios(size_t limite) {
+    while (cache_frios.bytes > limite && cache_frios.antiga != -1) remover_cache_frios(cache_frios.antiga);
+}
+
+static void guardar_cache_frios(unsigned int posicao, const unsigned char* bloco, size_t tamanho) {
+    if (tamanho > cache_frios.limite) return;
+    reduzir_cache_frios(cache_frios.limite - tamanho);
+    int e = cache_frios.livres;
+    if (e != -1) {
+        cache_frios.livres = cache_frios.entradas[e].proximo;
+    } else {
+        if (!reservar((void**)&cache_frios.entradas, &cache_frios.capacidade, cache_frios.usadas + 1,
+                      sizeof(EntradaCacheFrios))) return;
+        e = cache_frios.usadas++;
+    }
+    EntradaCacheFrios* x = &cache_frios.entradas[e];
+    x->bloco = (unsigned char*)malloc(tamanho);
+    if (!x->bloco || !hash_definir(&cache_frios.indice, (int)posicao, e)) {
+        liberar_entrada_cache_frios(e);
+        return;
+    }
+    memcpy(x->bloco, bloco, tamanho);
+    x->posicao = posicao;
+    x->tamanho = (unsigned int)tamanho;
+    cache_frios.bytes += tamanho;
+    ligar_cache_frios(e);
+}
+
+// Copia para 'destino' (MAX_BLOCO_FRIO bytes) o bloco frio na posição
+// indicada de alunos.dat; retorna o tamanho, ou 0 se não pôde ser lido
+static size_t ler_bloco_frio(unsigned int posicao, unsigned char* destino, int usar_cache) {
+    usar_cache = usar_cache && !mapa_alunos.base;
+    if (usar_cache) {
+        size_t n = 0;
+        travar(&trava_cache_frios);
+        int e = hash_buscar(&cache_frios.indice, (int)posicao);
+        if (e != -1) {
+            n = cache_frios.entradas[e].tamanho;
+            memcpy(destino, cache_frios.entradas[e].bloco, n);
+            desligar_cache_frios(e);
+            ligar_cache_frios(e);
+        }
+        destravar(&trava_cache_frios);
+        if (n) {
+            somar_metrica(&metricas_io.acertos_frios, 1);
+            return n;
+        }
+    }
+    unsigned int tamanho = 0;
+    if (!ler_origem_fria(posicao + sizeof(unsigned int), &tamanho, sizeof(tamanho)) ||
+        tamanho > MAX_BLOCO_FRIO - 2 * sizeof(unsigned int) ||
+        !ler_origem_fria(posicao, destino, 2 * sizeof(unsigned int) + tamanho)) return 0;
+    size_t n = 2 * sizeof(unsigned int) + tamanho;
+    if (usar_cache) {
+        somar_metrica(&metricas_io.leituras_frios, 1);
+        travar(&trava_cache_frios);
+        guardar_cache_frios(posicao, destino, n);
+        destravar(&trava_cache_frios);
+    }
+    return n;
+}
+
+// Depois de uma compactação, com a origem fechada. Com 'blocos' (alunos.dat
+// foi trocado), as avaliações passam a ser lidas do arquivo novo e as cópias
+// em memória são liberadas; sem, o arquivo antigo continua valendo.
+static void reabrir_origem_fria(const unsigned int* blocos) {
+    int necessaria = 0;
+    if (blocos) {
+        travar(&trava_cache_frios);
+        reduzir_cache_frios(0);
+        destravar(&trava_cache_frios);
+    }
+    for (int i = 0; i < num_alunos; i++) {
+        DadosFrios* f = &alunos_frios[i];
+        if (blocos && blocos[i]) {
+            int vaga = f->vaga, n = limitar(f->num_avaliacoes, MAX_AVALIACOES);
+            liberar_frios(f);
+            f->vaga = vaga;
+            f->num_avaliacoes = n;
+            f->bloco = blocos[i];
+        }
+        if (f->bloco) necessaria = 1;
+    }
+    if (necessaria && !abrir_origem_fria()) arquivos_protegidos = 1;
+}
+
+// Limite em bytes do cache de avaliações lidas sob demanda (0 desliga,
+// negativo só consulta); retorna o limite anterior
+EXPORT int db_cache_frios(int bytes) {
+    travar(&trava_cache_frios);
+    int anterior = (int)cache_frios.limite;
+    if (bytes >= 0) {
+        cache_frios.limite = (size_t)bytes;
+        reduzir_cache_frios(cache_frios.limite);
+    }
+    destravar(&trava_cache_frios);
+    return anterior;
+}
+
+// --- Frequência: mapas de bits por turma ---
+
+// Quantidade de bits 1 numa palavra
+#if defined(__GNUC__)
+#define contar_bits(x) __builtin_popcountll(x)
+#else
+static int contar_bits(Palavra x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+// Posição do bit 1 mais baixo (x != 0)
+static int menor_bit(Palavra x) {
+    return contar_bits(~x & (x - 1));
+}
+
+// AAAAMMDD -> "DD/MM/YYYY" (o inverso de converter_data)
+static void formatar_data(int chave, char* data) {
+    int dia = chave % 100, mes = chave / 100 % 100, ano = chave / 10000 % 10000;
+    data[0] = (char)('0' + dia / 10); data[1] = (char)('0' + dia % 10); data[2] = '/';
+    data[3] = (char)('0' + mes / 10); data[4] = (char)('0' + mes % 10); data[5] = '/';
+    data[6] = (char)('0' + ano / 1000); data[7] = (char)('0' + ano / 100 % 10);
+    data[8] = (char)('0' + ano / 10 % 10); data[9] = (char)('0' + ano % 10);
+    data[10] = '\0';
+}
+
+static FrequenciaTurma* buscar_frequencia(int id_turma) {
+    int k = hash_buscar(&hash_frequencias, id_turma);
+    return k == -1 ? NULL : &frequencias[k];
+}
+
+// Frequência da turma, criada vazia se ainda não existe
+static FrequenciaTurma* obter_frequencia(int id_turma) {
+    FrequenciaTurma* f = buscar_frequencia(id_turma);
+    if (f) return f;
+    if (!reservar((void**)&frequencias, &capacidade_frequencias, num_frequencias + 1, sizeof(FrequenciaTurma)) ||
+        !hash_definir(&hash_frequencias, id_turma, num_frequencias)) return NULL;
+    f = &frequencias[num_frequencias++];
+    memset(f, 0, sizeof(*f));
+    f->id_turma = id_turma;
+    return f;
+}
+
+// Retorna 0 se a frequência movida para a posição k ficou fora do índice
+static int liberar_frequencia(int k) {
+    FrequenciaTurma* f = &frequencias[k];
+    hash_remover(&hash_frequencias, f->id_turma);
+    free(f->dias);
+    free(f->registrado);
+    free(f->presente);
+    free(f->ocupadas);
+    free(f->matriculas);
+    if (k == --num_frequencias) return 1;
+    frequencias[k] = frequencias[num_frequencias];
+    return hash_definir(&hash_frequencias, frequencias[k].id_turma, k);
+}
+
+// Dobra as vagas da turma, copiando as linhas para a nova largura
+static int ampliar_vagas(FrequenciaTurma* f) {
+    int palavras = f->palavras ? f->palavras * 2 : 1;
+    Palavra* ocupadas = (Palavra*)realloc(f->ocupadas, palavras * sizeof(Palavra));
+    if (!ocupadas) return 0;
+    f->ocupadas = ocupadas;
+    int* matriculas = (int*)realloc(f->matriculas, (size_t)palavras * BITS_PALAVRA * sizeof(int));
+    if (!matriculas) return 0;
+    f->matriculas = matriculas;
+    Palavra* registrado = NULL;
+    Palavra* presente = NULL;
+    if (f->capacidade_datas) {
+        registrado = (Palavra*)calloc((size_t)f->capacidade_datas * palavras, sizeof(Palavra));
+        presente = (Palavra*)calloc((size_t)f->capacidade_datas * palavras, sizeof(Palavra));
+        if (!registrado || !presente) {
+            free(registrado);
+            free(presente);
+            return 0;
+        }
+        for (int d = 0; d < f->num_datas; d++) {
+            memcpy(registrado + (size_t)d * palavras, f->registrado + (size_t)d * f->palavras, f->palavras * sizeof(Palavra));
+            memcpy(presente + (size_t)d * palavras, f->presente + (size_t)d * f->palavras, f->palavras * sizeof(Palavra));
+        }
+    }
+    free(f->registrado);
+    free(f->presente);
+    f->registrado = registrado;
+    f->presente = presente;
+    memset(f->ocupadas + f->palavras, 0, (palavras - f->palavras) * sizeof(Palavra));
+    memset(f->matriculas + f->palavras * BITS_PALAVRA, 0, (size_t)(palavras - f->palavras) * BITS_PALAVRA * sizeof(int));
+    f->palavras = palavras;
+    return 1;
+}
+
+// Linha da data (AAAAMMDD), aberta zerada na ordem das datas se ainda não existe; -1 se faltar memória
+static int linha_data(FrequenciaTurma* f, int chave) {
+    int pos = posicao_por_data(f->dias, f->num_datas, chave, 0);
+    if (pos < f->num_datas && f->dias[pos] == chave) return pos;
+    size_t linha = f->palavras * sizeof(Palavra);
+    int capacidade;
+#define RESERVAR_LINHAS(array, tamanho) \
+    capacidade = f->capacidade_datas; \
+    if (!reservar((void**)&f->array, &capacidade, f->num_datas + 1, tamanho)) return -1;
+    RESERVAR_LINHAS(dias, sizeof(int))
+    RESERVAR_LINHAS(registrado, linha)
+    RESERVAR_LINHAS(presente, linha)
+#undef RESERVAR_LINHAS
+    f->capacidade_datas = capacidade;
+    size_t seguintes = f->num_datas - pos;
+    memmove(f->dias + pos + 1, f->dias + pos, seguintes * sizeof(int));
+    memmove(f->registrado + (size_t)(pos + 1) * f->palavras, f->registrado + (size_t)pos * f->palavras, seguintes * linha);
+    memmove(f->presente + (size_t)(pos + 1) * f->palavras, f->presente + (size_t)pos * f->palavras, seguintes * linha);
+    memset(f->registrado + (size_t)pos * f->palavras, 0, linha);
+    memset(f->presente + (size_t)pos * f->palavras, 0, linha);
+    f->dias[pos] = chave;
+    f->num_datas++;
+    return pos;
+}
+
+// Vaga do aluno i em f (a frequência da turma dele), ocupando uma livre se
+// ele ainda não tem; -1 se faltar memória
+static int vaga_aluno(FrequenciaTurma* f, int i) {
+    if (alunos_frios[i].vaga) return alunos_frios[i].vaga - 1;
+    int w = 0;
+    while (w < f->palavras && f->ocupadas[w] == ~(Palavra)0) w++;
+    if (w == f->palavras && !ampliar_vagas(f)) return -1;
+    int v = w * BITS_PALAVRA + menor_bit(~f->ocupadas[w]);
+    f->ocupadas[w] |= (Palavra)1 << (v % BITS_PALAVRA);
+    f->matriculas[v] = alunos_matricula[i];
+    f->alunos++;
+    alunos_frios[i].vaga = v + 1;
+    return v;
+}
+
+// Apaga os lançamentos da vaga v e descarta as datas que ficaram sem nenhum
+static void apagar_vaga(FrequenciaTurma* f, int v) {
+    int w = v / BITS_PALAVRA, linhas = 0;
+    Palavra bit = (Palavra)1 << (v % BITS_PALAVRA);
+    f->ocupadas[w] &= ~bit;
+    for (int d = 0; d < f->num_datas; d++) {
+        Palavra* registrado = f->registrado + (size_t)d * f->palavras;
+        Palavra* presente = f->presente + (size_t)d * f->palavras;
+        registrado[w] &= ~bit;
+        presente[w] &= ~bit;
+        int vazia = 1;
+        for (int k = 0; k < f->palavras && vazia; k++) vazia = registrado[k] == 0;
+        if (vazia) continue;
+        if (linhas != d) {
+            f->dias[linhas] = f->dias[d];
+            memcpy(f->registrado + (size_t)linhas * f->palavras, registrado, f->palavras * sizeof(Palavra));
+            memcpy(f->presente + (size_t)linhas * f->palavras, presente, f->palavras * sizeof(Palavra));
+        }
+        linhas++;
+    }
+    f->num_datas = linhas;
+}
+
+// Devolve a vaga do aluno i (antes de removê-lo)
+static void liberar_vaga(int i) {
+    int v = alunos_frios[i].vaga - 1, k = hash_buscar(&hash_frequencias, alunos_id_turma[i]);
+    alunos_frios[i].vaga = 0;
+    if (v < 0 || k == -1) return;
+    apagar_vaga(&frequencias[k], v);
+    if (--frequencias[k].alunos == 0) liberar_frequencia(k);
+}
+
+// Lança presença ou falta do aluno i na data; substitui o lançamento anterior da mesma data
+static int marcar_presenca(int i, int chave, int presente) {
+    FrequenciaTurma* f = obter_frequencia(alunos_id_turma[i]);
+    if (!f) return 0;
+    int v = vaga_aluno(f, i), d = v == -1 ? -1 : linha_data(f, chave);
+    if (d == -1) {
+        if (!f->alunos) liberar_frequencia((int)(f - frequencias));
+        return 0;
+    }
+    size_t w = (size_t)d * f->palavras + v / BITS_PALAVRA;
+    Palavra bit = (Palavra)1 << (v % BITS_PALAVRA);
+    f->registrado[w] |= bit;
+    if (presente) f->presente[w] |= bit;
+    else f->presente[w] &= ~bit;
+    return 1;
+}
+
+static int aplicar_presenca(int i, const Presenca* p) {
+    int chave = converter_data(p->data);
+    return chave >= 0 && marcar_presenca(i, chave, p->presente != 0);
+}
+
+// Presenças de um registro Aluno (alunos.dat antigo ou inserção); datas inválidas são ignoradas
+static int importar_presencas(int i, const Presenca* presencas, int quantidade) {
+    for (int k = 0; k < quantidade; k++) {
+        int chave = converter_data(presencas[k].data);
+        if (chave >= 0 && !marcar_presenca(i, chave, presencas[k].presente != 0)) return 0;
+    }
+    return 1;
+}
+
+// Lançamentos do aluno i com data entre 'de' e 'ate' (AAAAMMDD), em ordem de data
+static int copiar_presencas(int i, int de, int ate, Presenca* arr, int max_len) {
+    int v = alunos_frios[i].vaga - 1, c = 0;
+    const FrequenciaTurma* f = v < 0 ? NULL : buscar_frequencia(alunos_id_turma[i]);
+    if (!f) return 0;
+    Palavra bit = (Palavra)1 << (v % BITS_PALAVRA);
+    for (int d = posicao_por_data(f->dias, f->num_datas, de, 0); d < f->num_datas && f->dias[d] <= ate && c < max_len; d++) {
+        size_t w = (size_t)d * f->palavras + v / BITS_PALAVRA;
+        if (!(f->registrado[w] & bit)) continue;
+        memset(&arr[c], 0, sizeof(Presenca));
+        formatar_data(f->dias[d], arr[c].data);
+        arr[c].presente = (f->presente[w] & bit) != 0;
+        c++;
+    }
+    return c;
+}
+
+// A matrícula do aluno i mudou: atualiza o dono da vaga
+static void renomear_vaga(int i, int matricula) {
+    FrequenciaTurma* f = alunos_frios[i].vaga ? buscar_frequencia(alunos_id_turma[i]) : NULL;
+    if (f) f->matriculas[alunos_frios[i].vaga - 1] = matricula;
+}
+
+// O id da turma mudou (alunos_id_turma já atualizado): renomeia a frequência
+// ou, se alunos avulsos com o novo id já tinham presenças, junta as duas.
+// Retorna 0 se faltou memória (a junção pode ter ficado pela metade).
+static int mover_frequencia(int id_antigo, int id_novo) {
+    int k = hash_buscar(&hash_frequencias, id_antigo);
+    if (k == -1) return 1;
+    if (hash_buscar(&hash_frequencias, id_novo) == -1) {
+        if (!hash_definir(&hash_frequencias, id_novo, k)) return 0;
+        hash_remover(&hash_frequencias, id_antigo);
+        frequencias[k].id_turma = id_novo;
+        return 1;
+    }
+    const FrequenciaTurma* f = &frequencias[k];
+    for (int v = 0; v < f->palavras * BITS_PALAVRA; v++) {
+        Palavra bit = (Palavra)1 << (v % BITS_PALAVRA);
+        int i;
+        if (!(f->ocupadas[v / BITS_PALAVRA] & bit) || (i = hash_buscar(&hash_alunos, f->matriculas[v])) == -1) continue;
+        alunos_frios[i].vaga = 0;
+        for (int d = 0; d < f->num_datas; d++) {
+            size_t w = (size_t)d * f->palavras + v / BITS_PALAVRA;
+            if ((f->registrado[w] & bit) && !marcar_presenca(i, f->dias[d], (f->presente[w] & bit) != 0)) return 0;
+        }
+    }
+    return liberar_frequencia(k);
+}
+
+static void* alocar_lido(FILE* arq, size_t quantidade, size_t tamanho) {
+    void* p = malloc(quantidade ? quantidade * tamanho : 1);
+    if (p && fread(p, tamanho, quantidade, arq) != quantidade) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Lê frequencia.dat: "int quantidade + blocos CabecalhoFrequencia". Chamada
+// com os alunos e os índices já carregados, devolve cada vaga ao seu aluno.
+static void ler_frequencias() {
+    FILE* arq = fopen(FREQUENCIA_DB_FILE, "rb");
+    if (!arq) return;
+    int quantidade = 0;
+    if (fread(&quantidade, sizeof(int), 1, arq) != 1) quantidade = 0;
+    for (int t = 0; t < quantidade; t++) {
+        CabecalhoFrequencia cab;
+        if (fread(&cab, sizeof(cab), 1, arq) != 1 || cab.num_datas < 0 || cab.palavras <= 0 ||
+            buscar_frequencia(cab.id_turma)) break;
+        FrequenciaTurma* f = obter_frequencia(cab.id_turma);
+        if (!f) break;
+        size_t vagas = (size_t)cab.palavras * BITS_PALAVRA, bits = (size_t)cab.num_datas * cab.palavras;
+        f->num_datas = f->capacidade_datas = cab.num_datas;
+        f->palavras = cab.palavras;
+        f->dias = (int*)alocar_lido(arq, cab.num_datas, sizeof(int));
+        f->matriculas = f->dias ? (int*)alocar_lido(arq, vagas, sizeof(int)) : NULL;
+        f->ocupadas = f->matriculas ? (Palavra*)alocar_lido(arq, cab.palavras, sizeof(Palavra)) : NULL;
+        f->registrado = f->ocupadas ? (Palavra*)alocar_lido(arq, bits, sizeof(Palavra)) : NULL;
+        f->presente = f->registrado ? (Palavra*)alocar_lido(arq, bits, sizeof(Palavra)) : NULL;
+        if (!f->presente) {
+            liberar_frequencia(num_frequencias - 1);
+            break;
+        }
+        for (int v = 0; v < (int)vagas; v++) {
+            if (!(f->ocupadas[v / BITS_PALAVRA] & ((Palavra)1 << (v % BITS_PALAVRA)))) continue;
+            int i = hash_buscar(&hash_alunos, f->matriculas[v]);
+            if (i != -1 && alunos_id_turma[i] == f->id_turma && !alunos_frios[i].vaga) {
+                alunos_frios[i].vaga = v + 1;
+                f->alunos++;
+            } else {
+                apagar_vaga(f, v);  // aluno que não existe mais
+            }
+        }
+        if (!f->alunos) liberar_frequencia(num_frequencias - 1);
+    }
+    fclose(arq);
+}
+
+static int salvar_dados_frequencia(const char* caminho) {
+    FILE* arq = fopen(caminho, "wb");
+    if (!arq) return 0;
+    int ok = fwrite(&num_frequencias, sizeof(int), 1, arq) == 1;
+    for (int k = 0; ok && k < num_frequencias; k++) {
+        const FrequenciaTurma* f = &frequencias[k];
+        CabecalhoFrequencia cab = { f->id_turma, f->num_datas, f->palavras };
+        size_t vagas = (size_t)f->palavras * BITS_PALAVRA, bits = (size_t)f->num_datas * f->palavras;
+        ok = fwrite(&cab, sizeof(cab), 1, arq) == 1 &&
+             fwrite(f->dias, sizeof(int), f->num_datas, arq) == (size_t)f->num_datas &&
+             fwrite(f->matriculas, sizeof(int), vagas, arq) == vagas &&
+             fwrite(f->ocupadas, sizeof(Palavra), f->palavras, arq) == (size_t)f->palavras &&
+             fwrite(f->registrado, sizeof(Palavra), bits, arq) == bits &&
+             fwrite(f->presente, sizeof(Palavra), bits, arq) == bits;
+    }
+    return concluir_arquivo_dados(arq, ok, &metricas_io.bytes_frequencia);
+}
+
+// --- Tabelas de registros: chave de texto -> valor ---
+
+static unsigned int hash_texto(const char* texto, int tamanho) {
+    unsigned int h = 2166136261u;  // FNV-1a
+    for (int k = 0; k < tamanho; k++) h = (h ^ (unsigned char)texto[k]) * 16777619u;
+    return h;
+}
+
+static int registro_buscar(const TabelaRegistros* t, const char* chave, int tamanho_chave, unsigned int hash) {
+    if (!t->capacidade_indice) return -1;
+    unsigned int mascara = (unsigned int)t->capacidade_indice - 1;
+    for (unsigned int p = hash & mascara; t->indice[p]; p = (p + 1) & mascara) {
+        const Registro* r = &t->registros[t->indice[p] - 1];
+        if (r->hash == hash && r->tamanho_chave == tamanho_chave && memcmp(r->bloco, chave, tamanho_chave) == 0) {
+            return t->indice[p] - 1;
+        }
+    }
+    return -1;
+}
+
+// Refaz o índice com pelo menos o dobro de posições que registros
+static int registro_reindexar(TabelaRegistros* t, int necessario) {
+    int capacidade = t->capacidade_indice ? t->capacidade_indice : 16;
+    while (capacidade < necessario * 2) capacidade *= 2;
+    if (capacidade != t->capacidade_indice) {
+        int* novo = (int*)malloc((size_t)capacidade * sizeof(int));
+        if (!novo) return 0;
+        free(t->indice);
+        t->indice = novo;
+        t->capacidade_indice = capacidade;
+    }
+    memset(t->indice, 0, (size_t)capacidade * sizeof(int));
+    unsigned int mascara = (unsigned int)capacidade - 1;
+    for (int i = 0; i < t->num_registros; i++) {
+        unsigned int p = t->registros[i].hash & mascara;
+        while (t->indice[p]) p = (p + 1) & mascara;
+        t->indice[p] = i + 1;
+    }
+    return 1;
+}
+
+// Separa "chave\0valor" dos dados de um registro do log; retorna o tamanho da chave ou 0
+static int separar_chave(const char* dados, int tamanho) {
+    const char* fim = (const char*)memchr(dados, '\0', tamanho);
+    int tamanho_chave = fim ? (int)(fim - dados) : 0;
+    return tamanho_chave <= DB_REGISTRO_CHAVE_MAXIMA ? tamanho_chave : 0;
+}
+
+static int aplicar_gravar_registro(int tabela, const char* dados, int tamanho) {
+    if (tabela < 0 || tabela >= DB_NUM_TABELAS || tamanho < 2) return 0;
+    int tamanho_chave = separar_chave(dados, tamanho);
+    if (!tamanho_chave) return 0;
+    TabelaRegistros* t = &tabelas_registros[tabela];
+    char* bloco = (char*)malloc((size_t)tamanho + 1);
+    if (!bloco) return 0;
+    memcpy(bloco, dados, tamanho);
+    bloco[tamanho] = '\0';
+    unsigned int hash = hash_texto(dados, tamanho_chave);
+    int i = registro_buscar(t, dados, tamanho_chave, hash);
+    if (i != -1) {
+        free(t->registros[i].bloco);
+        t->registros[i].bloco = bloco;
+        t->registros[i].tamanho_valor = tamanho - tamanho_chave - 1;
+        return 1;
+    }
+    if (!reservar((void**)&t->registros, &t->capacidade_registros, t->num_registros + 1, sizeof(Registro)) ||
+        ((t->num_registros + 1) * 2 > t->capacidade_indice && !registro_reindexar(t, t->num_registros + 1))) {
+        free(bloco);
+        return 0;
+    }
+    Registro* r = &t->registros[t->num_registros++];
+    r->bloco = bloco;
+    r->tamanho_chave = tamanho_chave;
+    r->tamanho_valor = tamanho - tamanho_chave - 1;
+    r->hash = hash;
+    unsigned int mascara = (unsigned int)t->capacidade_indice - 1, p = hash & mascara;
+    while (t->indice[p]) p = (p + 1) & mascara;
+    t->indice[p] = t->num_registros;
+    return 1;
+}
+
+// A remoção mantém a ordem de inserção (desloca os seguintes e refaz o índice):
+// as tabelas são pequenas e remoções raras
+static int aplicar_remover_registro(int tabela, const char* dados, int tamanho) {
+    if (tabela < 0 || tabela >= DB_NUM_TABELAS || tamanho < 2) return 0;
+    int tamanho_chave = separar_chave(dados, tamanho);
+    if (!tamanho_chave) return 0;
+    TabelaRegistros* t = &tabelas_registros[tabela];
+    int i = registro_buscar(t, dados, tamanho_chave, hash_texto(dados, tamanho_chave));
+    if (i == -1) return 0;
+    free(t->registros[i].bloco);
+    memmove(&t->registros[i], &t->registros[i + 1], (size_t)(t->num_registros - i - 1) * sizeof(Registro));
+    t->num_registros--;
+    registro_reindexar(t, t->num_registros);
+    return 1;
+}
+
+// Lê registros.dat: "int quantidade + (CabecalhoRegistro, "chave\0valor")"
+static void ler_registros() {
+    FILE* arq = fopen(REGISTROS_DB_FILE, "rb");
+    if (!arq) return;
+    int quantidade = 0;
+    if (fread(&quantidade, sizeof(int), 1, arq) != 1) quantidade = 0;
+    for (int k = 0; k < quantidade; k++) {
+        CabecalhoRegistro cab;
+        if (fread(&cab, sizeof(cab), 1, arq) != 1 || cab.tamanho_chave <= 0 ||
+            cab.tamanho_chave > DB_REGISTRO_CHAVE_MAXIMA || cab.tamanho_valor < 0 ||
+            cab.tamanho_valor > DB_REGISTRO_VALOR_MAXIMO) break;
+        int tamanho = cab.tamanho_chave + 1 + cab.tamanho_valor;
+        char* dados = (char*)alocar_lido(arq, (size_t)tamanho, 1);
+        if (!dados) break;
+        aplicar_gravar_registro(cab.tabela, dados, tamanho);
+        free(dados);
+    }
+    fclose(arq);
+}
+
+static int salvar_dados_registros(const char* caminho) {
+    FILE* arq = fopen(caminho, "wb");
+    if (!arq) return 0;
+    int quantidade = 0;
+    for (int tabela = 0; tabela < DB_NUM_TABELAS; tabela++) quantidade += tabelas_registros[tabela].num_registros;
+    int ok = fwrite(&quantidade, sizeof(int), 1, arq) == 1;
+    for (int tabela = 0; ok && tabela < DB_NUM_TABELAS; tabela++) {
+        const TabelaRegistros* t = &tabelas_registros[tabela];
+        for (int i = 0; ok && i < t->num_registros; i++) {
+            const Registro* r = &t->registros[i];
+            CabecalhoRegistro cab = { tabela, r->tamanho_chave, r->tamanho_valor };
+            size_t tamanho = (size_t)r->tamanho_chave + 1 + r->tamanho_valor;
+            ok = fwrite(&cab, sizeof(cab), 1, arq) == 1 && fwrite(r->bloco, 1, tamanho, arq) == tamanho;
+        }
+    }
+    return concluir_arquivo_dados(arq, ok, &metricas_io.bytes_registros);
+}
+
+// --- Índice de palavras: busca por prefixo em nomes ---
+
+// Texto normalizado para a busca: minúsculas, sem acentos (UTF-8 de U+00C0 a
+// U+00FF, o bastante para nomes em português) e palavras separadas por um
+// espaço. Pontuação ASCII separa palavras; outros caracteres entram como estão.
+#define TAMANHO_NORMALIZADO 208     // disciplina + ' ' + professor
+#define MAX_PALAVRAS_BUSCA 8
+
+static const char sem_acento[64] =
+    "aaaaaaaceeeeiiii" "dnooooo ouuuuyts" "aaaaaaaceeeeiiii" "dnooooo ouuuuyty";
+
+static int normalizar_texto(const char* texto, size_t max, char* destino, int capacidade) {
+    const unsigned char* p = (const unsigned char*)texto;
+    const unsigned char* fim = p + strnlen(texto, max);
+    int n = 0;
+    while (p < fim && n < capacidade - 1) {
+        unsigned char c = *p++;
+        if (c == 0xC3 && p < fim && *p >= 0x80 && *p <= 0xBF) c = (unsigned char)sem_acento[*p++ - 0x80];
+        else if (c == 0xC2 && p < fim && *p >= 0x80 && *p <= 0xBF) { c = *p == 0xAA ? 'a' : *p == 0xBA ? 'o' : ' '; p++; }
+        else if (c >= 'A' && c <= 'Z') c = (unsigned char)(c - 'A' + 'a');
+        else if (c < 0x80 && !(c >= 'a' && c <= 'z') && !(c >= '0' && c <= '9')) c = ' ';
+        if (c != ' ') destino[n++] = (char)c;
+        else if (n > 0 && destino[n - 1] != ' ') destino[n++] = ' ';
+    }
+    if (n > 0 && destino[n - 1] == ' ') n--;
+    destino[n] = '\0';
+    return n;
+}
+
+static void normalizar_turma(const Turma* t, char* destino) {
+    int n = normalizar_texto(t->nome_disciplina, sizeof(t->nome_disciplina), destino, TAMANHO_NORMALIZADO / 2);
+    if (n > 0) destino[n++] = ' ';
+    if (normalizar_texto(t->nome_professor, sizeof(t->nome_professor), destino + n, TAMANHO_NORMALIZADO - n) == 0 && n > 0)
+        destino[n - 1] = '\0';
+}
+
+// Os 8 primeiros bytes da palavra como inteiro (a ordem dos inteiros é a
+// ordem alfabética das palavras), completados com 'preencher'
+static unsigned long long prefixo_palavra(const char* palavra, int tamanho, int preencher) {
+    unsigned long long k = 0;
+    for (int b = 0; b < 8; b++) k = (k << 8) | (unsigned char)(b < tamanho ? palavra[b] : preencher);
+    return k;
+}
+
+// Uma entrada por palavra de cada nome. [0, ordenadas) está em ordem de
+// prefixo; as inseridas depois ficam soltas no fim até serem intercaladas.
+// Textos alterados ou removidos deixam entradas obsoletas, que a busca
+// descarta conferindo o texto atual, até a próxima reconstrução.
+typedef struct {
+    unsigned long long prefixo;
+    int chave;      // id da turma ou matrícula
+} EntradaPalavra;
+
+typedef struct {
+    EntradaPalavra* entradas;
+    int num;
+    int capacidade;
+    int ordenadas;
+    int obsoletas;
+    int valido;     // 0 = faltou memória: a busca percorre todos os registros
+} IndicePalavras;
+
+static IndicePalavras palavras_alunos = { NULL, 0, 0, 0, 0, 0 };
+static IndicePalavras palavras_turmas = { NULL, 0, 0, 0, 0, 0 };
+
+static int comparar_palavras(const void* a, const void* b) {
+    const EntradaPalavra* x = (const EntradaPalavra*)a;
+    const EntradaPalavra* y = (const EntradaPalavra*)b;
+    if (x->prefixo != y->prefixo) return x->prefixo < y->prefixo ? -1 : 1;
+    return (x->chave > y->chave) - (x->chave < y->chave);
+}
+
+// Ordena as soltas e as intercala com as ordenadas, de trás para frente
+static void intercalar_palavras(IndicePalavras* ind) {
+    int soltas = ind->num - ind->ordenadas;
+    if (soltas <= 0) return;
+    EntradaPalavra* copia = malloc((size_t)soltas * sizeof(EntradaPalavra));
+    if (!copia) {
+        qsort(ind->entradas, ind->num, sizeof(EntradaPalavra), comparar_palavras);
+        ind->ordenadas = ind->num;
+        return;
+    }
+    qsort(ind->entradas + ind->ordenadas, soltas, sizeof(EntradaPalavra), comparar_palavras);
+    memcpy(copia, ind->entradas + ind->ordenadas, (size_t)soltas * sizeof(EntradaPalavra));
+    int i = ind->ordenadas - 1, j = soltas - 1, k = ind->num - 1;
+    while (j >= 0) {
+        if (i >= 0 && comparar_palavras(&ind->entradas[i], &copia[j]) > 0) ind->entradas[k--] = ind->entradas[i--];
+        else ind->entradas[k--] = copia[j--];
+    }
+    free(copia);
+    ind->ordenadas = ind->num;
+}
+
+static void acrescentar_palavras(IndicePalavras* ind, const char* texto, int chave) {
+    if (!ind->valido) return;
+    for (const char* p = texto; *p; ) {
+        const char* fim = strchr(p, ' ');
+        int tamanho = fim ? (int)(fim - p) : (int)strlen(p);
+        if (!reservar((void**)&ind->entradas, &ind->capacidade, ind->num + 1, sizeof(EntradaPalavra))) {
+            ind->valido = 0;
+            return;
+        }
+        ind->entradas[ind->num].prefixo = prefixo_palavra(p, tamanho, 0);
+        ind->entradas[ind->num++].chave = chave;
+        p += tamanho + (fim != NULL);
+    }
+    // Limite das soltas proporcional ao índice: custo de intercalação amortizado constante
+    if (ind->num - ind->ordenadas > 256 + ind->ordenadas / 32) intercalar_palavras(ind);
+}
+
+static void descartar_palavras(IndicePalavras* ind, const char* texto) {
+    if (*texto) ind->obsoletas++;
+    for (const char* p = texto; (p = strchr(p, ' ')) != NULL; p++) ind->obsoletas++;
+}
+
+static void indexar_aluno(int i) {
+    char texto[TAMANHO_NORMALIZADO];
+    normalizar_texto(alunos_nome[i], sizeof(NomeAluno), texto, sizeof(texto));
+    acrescentar_palavras(&palavras_alunos, texto, alunos_matricula[i]);
+}
+
+static void desindexar_aluno(int i) {
+    char texto[TAMANHO_NORMALIZADO];
+    normalizar_texto(alunos_nome[i], sizeof(NomeAluno), texto, sizeof(texto));
+    descartar_palavras(&palavras_alunos, texto);
+}
+
+static void indexar_turma(int i) {
+    char texto[TAMANHO_NORMALIZADO];
+    normalizar_turma(&turmas[i], texto);
+    acrescentar_palavras(&palavras_turmas, texto, turmas[i].id);
+}
+
+static void desindexar_turma(int i) {
+    char texto[TAMANHO_NORMALIZADO];
+    normalizar_turma(&turmas[i], texto);
+    descartar_palavras(&palavras_turmas, texto);
+}
+
+static void reconstruir_palavras() {
+    palavras_alunos.num = palavras_alunos.ordenadas = palavras_alunos.obsoletas = 0;
+    palavras_turmas.num = palavras_turmas.ordenadas = palavras_turmas.obsoletas = 0;
+    palavras_alunos.valido = palavras_turmas.valido = 1;
+    for (int i = 0; i < num_alunos; i++) indexar_aluno(i);
+    for (int i = 0; i < num_turmas; i++) indexar_turma(i);
+    intercalar_palavras(&palavras_alunos);
+    intercalar_palavras(&palavras_turmas);
+}
+
+// Reconstrói quando faltou memória ou quando as obsoletas já são maioria
+static void conferir_palavras() {
+    const IndicePalavras* indices[2] = { &palavras_alunos, &palavras_turmas };
+    for (int k = 0; k < 2; k++) {
+        if (!indices[k]->valido || (indices[k]->obsoletas > 1024 && indices[k]->obsoletas > indices[k]->num / 2)) {
+            reconstruir_palavras();
+            return;
+        }
+    }
+}
+
+// Palavras da busca, já normalizadas. Uma delas (a guia) escolhe os
+// candidatos no índice e as demais só são conferidas.
+typedef struct {
+    char texto[TAMANHO_NORMALIZADO];
+    const char* palavras[MAX_PALAVRAS_BUSCA];
+    int tamanhos[MAX_PALAVRAS_BUSCA];
+    int num_palavras;
+} Busca;
+
+static int preparar_busca(const char* texto, Busca* b) {
+    normalizar_texto(texto, TAMANHO_NORMALIZADO - 1, b->texto, sizeof(b->texto));
+    b->num_palavras = 0;
+    for (const char* p = b->texto; *p && b->num_palavras < MAX_PALAVRAS_BUSCA; ) {
+        const char* fim = strchr(p, ' ');
+        int tamanho = fim ? (int)(fim - p) : (int)strlen(p);
+        b->palavras[b->num_palavras] = p;
+        b->tamanhos[b->num_palavras++] = tamanho;
+        p += tamanho + (fim != NULL);
+    }
+    return b->num_palavras;
+}
+
+// 1 se cada palavra da busca começa alguma palavra do texto normalizado
+static int busca_confere(const Busca* b, const char* texto) {
+    for (int k = 0; k < b->num_palavras; k++) {
+        const char* p = texto;
+        while (strncmp(p, b->palavras[k], b->tamanhos[k]) != 0) {
+            if ((p = strchr(p, ' ')) == NULL) return 0;
+            p++;
+        }
+    }
+    return 1;
+}
+
+// Primeira entrada ordenada com prefixo >= 'prefixo' (ou > com 'depois')
+static int primeira_palavra(const IndicePalavras* ind, unsigned long long prefixo, int depois) {
+    int de = 0, ate = ind->ordenadas;
+    while (de < ate) {
+        int meio = de + (ate - de) / 2;
+        if (ind->entradas[meio].prefixo < prefixo || (depois && ind->entradas[meio].prefixo == prefixo)) de = meio + 1;
+        else ate = meio;
+    }
+    return de;
+}
+
+// Chama 'aceitar' para cada chave (sem repetir) com alguma palavra que pode
+// começar com a guia, em ordem de prefixo, até ele retornar 0. Sem índice
+// válido, passa por todas as chaves de 'todas'.
+static void percorrer_candidatos(const IndicePalavras* ind, const Busca* b, const int* todas, int num_todas,
+                                 size_t passo, int (*aceitar)(int chave, void* contexto), void* contexto) {
+    if (!ind->valido) {
+        for (int i = 0; i < num_todas; i++)
+            if (!aceitar(*(const int*)((const char*)todas + (size_t)i * passo), contexto)) return;
+        return;
+    }
+    // Guia: a palavra com menos entradas ordenadas na sua faixa de prefixos
+    unsigned long long de = 0, ate = 0;
+    int inicio = 0, menor = INT_MAX;
+    for (int k = 0; k < b->num_palavras; k++) {
+        unsigned long long d = prefixo_palavra(b->palavras[k], b->tamanhos[k], 0);
+        unsigned long long a = prefixo_palavra(b->palavras[k], b->tamanhos[k], 0xFF);
+        int primeira = primeira_palavra(ind, d, 0), quantidade = primeira_palavra(ind, a, 1) - primeira;
+        if (quantidade < menor) { menor = quantidade; inicio = primeira; de = d; ate = a; }
+    }
+    // As soltas que servem, ordenadas à parte, entram na ordem junto com o trecho ordenado
+    int soltas = 0;
+    EntradaPalavra* extras = NULL;
+    for (int k = ind->ordenadas; k < ind->num; k++) {
+        if (ind->entradas[k].prefixo < de || ind->entradas[k].prefixo > ate) continue;
+        if (!extras && !(extras = malloc((size_t)(ind->num - k) * sizeof(EntradaPalavra)))) break;
+        extras[soltas++] = ind->entradas[k];
+    }
+    if (soltas > 1) qsort(extras, soltas, sizeof(EntradaPalavra), comparar_palavras);
+    TabelaHash vistas = { NULL, 0, 0, 0 };
+    int i = inicio, j = 0;
+    for (;;) {
+        const EntradaPalavra* e;
+        int ordenada_serve = i < ind->ordenadas && ind->entradas[i].prefixo <= ate;
+        if (ordenada_serve && (j >= soltas || comparar_palavras(&ind->entradas[i], &extras[j]) <= 0)) e = &ind->entradas[i++];
+        else if (j < soltas) e = &extras[j++];
+        else break;
+        if (hash_buscar(&vistas, e->chave) != -1) continue;
+        hash_definir(&vistas, e->chave, 1);
+        if (!aceitar(e->chave, contexto)) break;
+    }
+    free(vistas.entradas);
+    free(extras);
+}
+
+// --- Aplicação das alterações em memória ---
+// Usadas tanto pelas funções exportadas quanto pela reaplicação do log
+
+static int indice_turma(int id) {
+    return hash_buscar(&hash_turmas, id);
+}
+
+static int indice_aluno(int matricula) {
+    return hash_buscar(&hash_alunos, matricula);
+}
+
+// Acrescenta o aluno da posição i no fim da lista da sua turma
+static int lista_turma_inserir(int i) {
+    int primeiro = hash_buscar(&hash_listas_turma, alunos_id_turma[i]);
+    if (primeiro == -1) {
+        if (!hash_definir(&hash_listas_turma, alunos_id_turma[i], i)) return 0;
+        prox_na_turma[i] = ant_na_turma[i] = i;
+        return 1;
+    }
+    int ultimo = ant_na_turma[primeiro];
+    prox_na_turma[ultimo] = i; ant_na_turma[i] = ultimo;
+    prox_na_turma[i] = primeiro; ant_na_turma[primeiro] = i;
+    return 1;
+}
+
+static void lista_turma_remover(int i) {
+    int id = alunos_id_turma[i];
+    if (prox_na_turma[i] == i) {
+        hash_remover(&hash_listas_turma, id);
+        return;
+    }
+    prox_na_turma[ant_na_turma[i]] = prox_na_turma[i];
+    ant_na_turma[prox_na_turma[i]] = ant_na_turma[i];
+    if (hash_buscar(&hash_listas_turma, id) == i) hash_definir(&hash_listas_turma, id, prox_na_turma[i]);
+}
+
+// Corrige os encadeamentos quando o aluno da posição 'de' passa para 'para'
+static void lista_turma_mover(int de, int para) {
+    if (prox_na_turma[de] == de) {
+        prox_na_turma[para] = ant_na_turma[para] = para;
+    } else {
+        prox_na_turma[para] = prox_na_turma[de]; ant_na_turma[para] = ant_na_turma[de];
+        prox_na_turma[ant_na_turma[para]] = para;
+        ant_na_turma[prox_na_turma[para]] = para;
+    }
+    int id = alunos_id_turma[de];
+    if (hash_buscar(&hash_listas_turma, id) == de) hash_definir(&hash_listas_turma, id, para);
+}
+
+// As remoções movem o último elemento para a lacuna, assim só uma
+// entrada de cada índice precisa ser corrigida
+static void remover_aluno_indice(int i) {
+    desindexar_aluno(i);
+    hash_remover(&hash_alunos, alunos_matricula[i]);
+    lista_turma_remover(i);
+    liberar_vaga(i);
+    liberar_frios(&alunos_frios[i]);
+    if (i != --num_alunos) {
+        lista_turma_mover(num_alunos, i);
+        mover_colunas_aluno(num_alunos, i);
+        hash_definir(&hash_alunos, alunos_matricula[i], i);
+    }
+}
+
+static void remover_turma_indice(int i) {
+    desindexar_turma(i);
+    hash_remover(&hash_turmas, turmas[i].id);
+    if (i != --num_turmas) {
+        preservar(COL_TURMAS, i);
+        turmas[i] = turmas[num_turmas];
+        hash_definir(&hash_turmas, turmas[i].id, i);
+    }
+}
+
+static void reconstruir_indices() {
+    hash_limpar(&hash_turmas);
+    hash_limpar(&hash_alunos);
+    hash_limpar(&hash_listas_turma);
+    for (int i = 0; i < num_turmas; i++) hash_definir(&hash_turmas, turmas[i].id, i);
+    for (int i = 0; i < num_alunos; i++) {
+        hash_definir(&hash_alunos, alunos_matricula[i], i);
+        lista_turma_inserir(i);
+    }
+    reconstruir_palavras();
+}
+
+// Retorna 0 se a alteração foi recusada sem mudar nada e -1 se faltou memória
+// no meio dela (a memória precisa voltar ao estado gravado)
+static int aplicar_registro(int tipo, int chave, const void* dados, int tamanho) {
+    int i;
+    switch (tipo) {
+    case REG_TURMA_INSERIR:
+        if (tamanho != sizeof(Turma) || !reservar_turmas(num_turmas + 1)) return 0;
+        if (indice_turma(chave) != -1) return 0;
+        if (!hash_definir(&hash_turmas, chave, num_turmas)) return 0;
+        preservar(COL_TURMAS, num_turmas);
+        turmas[num_turmas++] = *(const Turma*)dados;
+        indexar_turma(num_turmas - 1);
+        return 1;
+
+    case REG_TURMA_ATUALIZAR: {
+        if ((i = indice_turma(chave)) == -1) return 0;
+        const char* d = (const char*)dados;
+        if (tamanho < 2 || d[tamanho - 1] != '\0') return 0;
+        const char* p = d + strlen(d) + 1;
+        if (p >= d + tamanho) return 0;
+        preservar(COL_TURMAS, i);
+        desindexar_turma(i);
+        strncpy(turmas[i].nome_disciplina, d, 99); turmas[i].nome_disciplina[99] = '\0';
+        strncpy(turmas[i].nome_professor, p, 99); turmas[i].nome_professor[99] = '\0';
+        indexar_turma(i);
+        return 1;
+    }
+
+    case REG_TURMA_REMOVER:
+        if ((i = indice_turma(chave)) == -1) return 0;
+        for (int a; (a = hash_buscar(&hash_listas_turma, chave)) != -1; ) remover_aluno_indice(a);
+        remover_turma_indice(i);
+        return 1;
+
+    case REG_TURMA_ALTERAR_ID: {
+        if (tamanho != sizeof(int)) return 0;
+        int id_novo = *(const int*)dados;
+        if ((i = indice_turma(chave)) == -1 || indice_turma(id_novo) != -1) return 0;
+        if (!hash_definir(&hash_turmas, id_novo, i)) return 0;
+        hash_remover(&hash_turmas, chave);
+        preservar(COL_TURMAS, i);
+        desindexar_turma(i);
+        turmas[i].id = id_novo;
+        indexar_turma(i);
+        int primeiro = hash_buscar(&hash_listas_turma, chave);
+        if (primeiro == -1) return 1;
+        int a = primeiro;
+        do { preservar(COL_ID_TURMA, a); alunos_id_turma[a] = id_novo; a = prox_na_turma[a]; } while (a != primeiro);
+        hash_remover(&hash_listas_turma, chave);
+        int destino = hash_buscar(&hash_listas_turma, id_novo);
+        if (destino == -1) {
+            if (!hash_definir(&hash_listas_turma, id_novo, primeiro)) return -1;
+        } else {
+            // Já havia alunos avulsos com o novo id: concatena as duas listas
+            int ultimo_destino = ant_na_turma[destino], ultimo = ant_na_turma[primeiro];
+            prox_na_turma[ultimo_destino] = primeiro; ant_na_turma[primeiro] = ultimo_destino;
+            prox_na_turma[ultimo] = destino; ant_na_turma[destino] = ultimo;
+        }
+        return mover_frequencia(chave, id_novo) ? 1 : -1;
+    }
+
+    case REG_ALUNO_INSERIR: {
+        if (tamanho != sizeof(Aluno) || !reservar_alunos(num_alunos + 1)) return 0;
+        if (indice_aluno(chave) != -1) return 0;
+        const Aluno* a = (const Aluno*)dados;
+        if (!gravar_colunas_aluno(num_alunos, a)) return 0;
+        if (!hash_definir(&hash_alunos, chave, num_alunos)) {
+            liberar_frios(&alunos_frios[num_alunos]);
+            return 0;
+        }
+        if (!lista_turma_inserir(num_alunos)) {
+            hash_remover(&hash_alunos, chave);
+            liberar_frios(&alunos_frios[num_alunos]);
+            return 0;
+        }
+        num_alunos++;
+        if (!importar_presencas(num_alunos - 1, a->presencas, limitar(a->num_presencas, MAX_PRESENCAS))) {
+            remover_aluno_indice(num_alunos - 1);
+            return 0;
+        }
+        indexar_aluno(num_alunos - 1);
+        return 1;
+    }
 
-// Função para carregar os dados dos arquivos binários
-void carregar_dados() {
-    if (dados_carregados) return;
-    FILE *f_turmas = fopen(TURMAS_DB_FILE, "rb");
-    if (f_turmas) {
-        fread(&num_turmas, sizeof(int), 1, f_turmas);
-        fread(turmas, sizeof(Turma), num_turmas, f_turmas);
-        fclose(f_turmas);
-    }
-    FILE *f_alunos = fopen(ALUNOS_DB_FILE, "rb");
-    if (f_alunos) {
-        fread(&num_alunos, sizeof(int), 1, f_alunos);
-        fread(alunos, sizeof(Aluno), num_alunos, f_alunos);
-        fclose(f_alunos);
+    case REG_ALUNO_NOME: {
+        if ((i = indice_aluno(chave)) == -1) return 0;
+        const char* n = (const char*)dados;
+        if (tamanho < 1 || n[tamanho - 1] != '\0') return 0;
+        preservar(COL_NOME, i);
+        desindexar_aluno(i);
+        strncpy(alunos_nome[i], n, 99); alunos_nome[i][99] = '\0';
+        indexar_aluno(i);
+        return 1;
     }
-    dados_carregados = 1;
-}
 
-// Funções para salvar os dados nos arquivos
-void salvar_dados_turmas() {
-    FILE* f = fopen(TURMAS_DB_FILE, "wb");
-    if (f) {
-        fwrite(&num_turmas, sizeof(int), 1, f);
-        fwrite(turmas, sizeof(Turma), num_turmas, f);
-        fclose(f);
+    case REG_ALUNO_REMOVER:
+        if ((i = indice_aluno(chave)) == -1) return 0;
+        remover_aluno_indice(i);
+        return 1;
+
+    case REG_ALUNO_ALTERAR_MATRICULA: {
+        if (tamanho != sizeof(int)) return 0;
+        int nova = *(const int*)dados;
+        if ((i = indice_aluno(chave)) == -1 || indice_aluno(nova) != -1) return 0;
+        if (!hash_definir(&hash_alunos, nova, i)) return 0;
+        hash_remover(&hash_alunos, chave);
+        preservar(COL_MATRICULA, i);
+        desindexar_aluno(i);
+        alunos_matricula[i] = nova;
+        indexar_aluno(i);
+        renomear_vaga(i, nova);
+        return 1;
     }
-}
 
-void salvar_dados_alunos() {
-    FILE* f = fopen(ALUNOS_DB_FILE, "wb");
-    if (f) {
-        fwrite(&num_alunos, sizeof(int), 1, f);
-        fwrite(alunos, sizeof(Aluno), num_alunos, f);
-        fclose(f);
+    case REG_ALUNO_NOTAS:
+        if (tamanho != sizeof(Notas) || (i = indice_aluno(chave)) == -1) return 0;
+        preservar(COL_NOTAS, i);
+        alunos_notas[i] = *(const Notas*)dados;
+        return 1;
+
+    case REG_ALUNO_PRESENCA:
+        if (tamanho != sizeof(Presenca) || (i = indice_aluno(chave)) == -1) return 0;
+        return aplicar_presenca(i, (const Presenca*)dados);
+
+    case REG_ALUNO_AVALIACAO:
+        if (tamanho != sizeof(Avaliacao) || (i = indice_aluno(chave)) == -1) return 0;
+        return aplicar_avaliacao(&alunos_frios[i], (const Avaliacao*)dados);
+
+    case REG_RECALCULAR_MEDIAS:
+        return aplicar_recalculo_medias(chave);
+
+    case REG_ALUNO_ATUALIZAR_AVALIACAO:
+        if (tamanho != sizeof(AtualizacaoAvaliacao) || (i = indice_aluno(chave)) == -1) return 0;
+        return aplicar_atualizar_avaliacao(&alunos_frios[i], (const AtualizacaoAvaliacao*)dados);
+
+    case REG_REGISTRO_GRAVAR:
+        return aplicar_gravar_registro(chave, (const char*)dados, tamanho);
+
+    case REG_REGISTRO_REMOVER:
+        return aplicar_remover_registro(chave, (const char*)dados, tamanho);
     }
+    return 0;
 }
 
 
+// --- Acesso concorrente ---
+
+// Indica ao chamador (servidor Python) que a biblioteca faz o próprio controle
+// de concorrência e pode ser chamada de várias threads
+EXPORT int db_seguro_para_threads() {
+    return 1;
+}
+
 // --- Implementação das Funções Exportadas ---
 
 // CORRIGIDO: Esta é a versão correta, que aceita um ponteiro.
-EXPORT void salvar_turma(const Turma* nova_turma) {
-    carregar_dados();
-    if (num_turmas < MAX_TURMAS) {
-        turmas[num_turmas++] = *nova_turma; // Usa * para obter o valor do ponteiro
-        salvar_dados_turmas();
-    }
+// Retorna 1 se a turma foi gravada, 0 se o id já existe ou faltou memória.
+EXPORT int salvar_turma(const Turma* nova_turma) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_TURMA_INSERIR, nova_turma->id, nova_turma, sizeof(Turma));
+    fechar_escrita();
+    return ok;
 }
 
 // CORRIGIDO: Esta é a versão correta, que aceita um ponteiro.
-EXPORT void salvar_aluno(const Aluno* novo_aluno) {
-    carregar_dados();
-    if (num_alunos < MAX_ALUNOS) {
-        alunos[num_alunos++] = *novo_aluno; // Usa * para obter o valor do ponteiro
-        salvar_dados_alunos();
+// Retorna 1 se o aluno foi gravado, 0 se a matrícula já existe ou faltou memória.
+EXPORT int salvar_aluno(const Aluno* novo_aluno) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_INSERIR, novo_aluno->matricula, novo_aluno, sizeof(Aluno));
+    fechar_escrita();
+    return ok;
+}
+
+// Inserção em lote: ids repetidos (no banco ou dentro do próprio lote) são
+// ignorados e o lote é gravado uma única vez. Retorna quantas foram inseridas.
+EXPORT int salvar_turmas_lote(const Turma* novas_turmas, int quantidade) {
+    abrir_escrita();
+    int inicio = num_turmas;
+    if (!arquivos_protegidos && quantidade > 0 && reservar_turmas(num_turmas + quantidade)) {
+        for (int k = 0; k < quantidade; k++) {
+            aplicar_registro(REG_TURMA_INSERIR, novas_turmas[k].id, &novas_turmas[k], sizeof(Turma));
+        }
+        if (!persistir_lote(REG_TURMA_INSERIR, inicio, num_turmas)) {
+            desfazer_alteracoes();
+            inicio = num_turmas;
+        }
+    }
+    int inseridas = num_turmas - inicio;
+    fechar_escrita();
+    return inseridas;
+}
+
+EXPORT int salvar_alunos_lote(const Aluno* novos_alunos, int quantidade) {
+    abrir_escrita();
+    int inicio = num_alunos;
+    if (!arquivos_protegidos && quantidade > 0 && reservar_alunos(num_alunos + quantidade)) {
+        for (int k = 0; k < quantidade; k++) {
+            aplicar_registro(REG_ALUNO_INSERIR, novos_alunos[k].matricula, &novos_alunos[k], sizeof(Aluno));
+        }
+        if (!persistir_lote(REG_ALUNO_INSERIR, inicio, num_alunos)) {
+            desfazer_alteracoes();
+            inicio = num_alunos;
+        }
     }
+    int inseridos = num_alunos - inicio;
+    fechar_escrita();
+    return inseridos;
 }
 
 EXPORT int turma_existe(int id) {
-    carregar_dados();
-    for (int i = 0; i < num_turmas; i++) if (turmas[i].id == id) return 1;
-    return 0;
+    abrir_leitura();
+    int existe = indice_turma(id) != -1;
+    fechar_leitura();
+    return existe;
 }
 
 EXPORT int matricula_existe(int matricula) {
-    carregar_dados();
-    for (int i = 0; i < num_alunos; i++) if (alunos[i].matricula == matricula) return 1;
-    return 0;
+    abrir_leitura();
+    int existe = indice_aluno(matricula) != -1;
+    fechar_leitura();
+    return existe;
 }
 
 EXPORT int listar_turmas(Turma* arr, int len) {
-    carregar_dados();
+    abrir_leitura();
     int c = (num_turmas < len) ? num_turmas : len;
     if (c > 0) memcpy(arr, turmas, c * sizeof(Turma));
+    fechar_leitura();
     return c;
 }
 
 EXPORT int listar_alunos_por_turma(int id, Aluno* arr, int len) {
-    carregar_dados();
+    abrir_leitura();
+    int primeiro = hash_buscar(&hash_listas_turma, id);
     int c = 0;
-    for (int i = 0; i < num_alunos && c < len; i++) if (alunos[i].id_turma == id) arr[c++] = alunos[i];
+    if (primeiro != -1 && len > 0) {
+        int i = primeiro;
+        do { montar_aluno(i, &arr[c++]); i = prox_na_turma[i]; } while (i != primeiro && c < len);
+    }
+    fechar_leitura();
     return c;
 }
 
 EXPORT int buscar_turma_por_id(int id, Turma* t) {
-    carregar_dados();
-    for (int i = 0; i < num_turmas; i++) if (turmas[i].id == id) { *t = turmas[i]; return 1; }
-    return 0;
+    abrir_leitura();
+    int i = indice_turma(id);
+    if (i != -1) *t = turmas[i];
+    fechar_leitura();
+    return i != -1;
 }
 
 EXPORT int buscar_aluno_por_matricula(int m, Aluno* a) {
-    carregar_dados();
-    for (int i = 0; i < num_alunos; i++) if (alunos[i].matricula == m) { *a = alunos[i]; return 1; }
-    return 0;
+    abrir_leitura();
+    int i = indice_aluno(m);
+    if (i != -1) montar_aluno(i, a);
+    fechar_leitura();
+    return i != -1;
 }
 
 EXPORT int atualizar_turma(int id, const char* d, const char* p) {
-    carregar_dados();
-    for (int i = 0; i < num_turmas; i++) {
-        if (turmas[i].id == id) {
-            strncpy(turmas[i].nome_disciplina, d, 99); turmas[i].nome_disciplina[99] = '\0';
-            strncpy(turmas[i].nome_professor, p, 99); turmas[i].nome_professor[99] = '\0';
-            salvar_dados_turmas();
-            return 1;
+    // Empacota as duas strings num único registro: "disciplina\0professor\0"
+    char dados[200];
+    int ld = (int)strnlen(d, 99), lp = (int)strnlen(p, 99);
+    memcpy(dados, d, ld); dados[ld] = '\0';
+    memcpy(dados + ld + 1, p, lp); dados[ld + 1 + lp] = '\0';
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_TURMA_ATUALIZAR, id, dados, ld + lp + 2);
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int atualizar_aluno(int m, const char* n) {
+    char nome[100];
+    int ln = (int)strnlen(n, 99);
+    memcpy(nome, n, ln); nome[ln] = '\0';
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_NOME, m, nome, ln + 1);
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int deletar_aluno(int matricula) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_REMOVER, matricula, NULL, 0);
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int deletar_turma(int id_turma) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_TURMA_REMOVER, id_turma, NULL, 0);
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int alterar_id_turma(int id_antigo, int id_novo) {
+    if (id_antigo == id_novo) return 1;
+    abrir_escrita();
+    int ok = indice_turma(id_novo) != -1 ? -1 :
+             registrar_alteracao(REG_TURMA_ALTERAR_ID, id_antigo, &id_novo, sizeof(int));
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int alterar_matricula_aluno(int matricula_antiga, int matricula_nova) {
+    if (matricula_antiga == matricula_nova) return 1;
+    abrir_escrita();
+    int ok = indice_aluno(matricula_nova) != -1 ? -1 :
+             registrar_alteracao(REG_ALUNO_ALTERAR_MATRICULA, matricula_antiga, &matricula_nova, sizeof(int));
+    fechar_escrita();
+    return ok;
+}
+
+// --- Notas, presenças e avaliações ---
+
+// Retorna 0 se o aluno não existe ou alguma nota não é finita (NaN/inf)
+EXPORT int salvar_notas(int matricula, const Notas* notas) {
+    for (int c = 0; c < 4; c++) if (!isfinite((&notas->np1)[c])) return 0;
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_NOTAS, matricula, notas, sizeof(Notas));
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int buscar_notas(int matricula, Notas* out_notas) {
+    abrir_leitura();
+    int i = indice_aluno(matricula);
+    if (i != -1) *out_notas = alunos_notas[i];
+    fechar_leitura();
+    return i != -1;
+}
+
+// Registra a presença do dia; se já houver registro na mesma data, ele é substituído.
+// Retorna 0 se o aluno não existe ou a data é inválida.
+EXPORT int adicionar_presenca(int matricula, const Presenca* presenca) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_PRESENCA, matricula, presenca, sizeof(Presenca));
+    fechar_escrita();
+    return ok;
+}
+
+// Lista as presenças em ordem de data
+EXPORT int listar_presencas(int matricula, Presenca* arr, int max_len) {
+    abrir_leitura();
+    int i = indice_aluno(matricula);
+    int c = i != -1 ? copiar_presencas(i, 0, INT_MAX, arr, max_len) : 0;
+    fechar_leitura();
+    return c;
+}
+
+EXPORT int buscar_presenca_por_data(int matricula, const char* data, Presenca* out_presenca) {
+    int chave = converter_data(data);
+    if (chave < 0) return 0;
+    abrir_leitura();
+    int i = indice_aluno(matricula);
+    int achou = i != -1 && copiar_presencas(i, chave, chave, out_presenca, 1);
+    fechar_leitura();
+    return achou;
+}
+
+// Presenças entre as datas 'inicio' e 'fim' (inclusive), em ordem de data
+EXPORT int listar_presencas_periodo(int matricula, const char* inicio, const char* fim, Presenca* arr, int max_len) {
+    int chave_inicio = converter_data(inicio), chave_fim = converter_data(fim);
+    if (chave_inicio < 0 || chave_fim < 0) return 0;
+    abrir_leitura();
+    int i = indice_aluno(matricula);
+    int c = i != -1 ? copiar_presencas(i, chave_inicio, chave_fim, arr, max_len) : 0;
+    fechar_leitura();
+    return c;
+}
+
+// Frequência a partir dos mapas de bits: a coluna do aluno, ou popcount das linhas da turma
+EXPORT int frequencia_aluno(int matricula, int* out_presencas, int* out_aulas) {
+    abrir_leitura();
+    int i = indice_aluno(matricula), presencas = 0, aulas = 0;
+    const FrequenciaTurma* f = i != -1 && alunos_frios[i].vaga ? buscar_frequencia(alunos_id_turma[i]) : NULL;
+    if (f) {
+        int v = alunos_frios[i].vaga - 1;
+        Palavra bit = (Palavra)1 << (v % BITS_PALAVRA);
+        for (size_t w = v / BITS_PALAVRA; w < (size_t)f->num_datas * f->palavras; w += f->palavras) {
+            aulas += (f->registrado[w] & bit) != 0;
+            presencas += (f->presente[w] & bit) != 0;
         }
     }
-    return 0;
+    fechar_leitura();
+    if (out_presencas) *out_presencas = presencas;
+    if (out_aulas) *out_aulas = aulas;
+    return i != -1;
 }
 
-EXPORT int atualizar_aluno(int m, const char* n) {
-    carregar_dados();
-    for (int i = 0; i < num_alunos; i++) {
-        if (alunos[i].matricula == m) {
-            strncpy(alunos[i].nome, n, 99); alunos[i].nome[99] = '\0';
-            salvar_dados_alunos();
-            return 1;
+EXPORT int frequencia_turma(int id_turma, FrequenciaData* arr, int max_len) {
+    abrir_leitura();
+    const FrequenciaTurma* f = buscar_frequencia(id_turma);
+    int c = 0;
+    for (; f && c < f->num_datas && c < max_len; c++) {
+        const Palavra* registrado = f->registrado + (size_t)c * f->palavras;
+        const Palavra* presente = f->presente + (size_t)c * f->palavras;
+        memset(&arr[c], 0, sizeof(FrequenciaData));
+        formatar_data(f->dias[c], arr[c].data);
+        for (int w = 0; w < f->palavras; w++) {
+            arr[c].registrados += contar_bits(registrado[w]);
+            arr[c].presentes += contar_bits(presente[w]);
         }
     }
-    return 0;
+    fechar_leitura();
+    return c;
 }
 
-EXPORT int deletar_aluno(int matricula) {
-    carregar_dados();
-    for (int i = 0; i < num_alunos; i++) {
-        if (alunos[i].matricula == matricula) {
-            for (int j = i; j < num_alunos - 1; j++) alunos[j] = alunos[j + 1];
-            num_alunos--;
-            salvar_dados_alunos();
-            return 1;
+EXPORT int listar_ausentes(int id_turma, const char* data, int* array_matriculas, int max_len) {
+    int chave = converter_data(data);
+    if (chave < 0) return 0;
+    abrir_leitura();
+    const FrequenciaTurma* f = buscar_frequencia(id_turma);
+    int d = f ? posicao_por_data(f->dias, f->num_datas, chave, 0) : 0, c = 0;
+    if (f && d < f->num_datas && f->dias[d] == chave) {
+        for (int w = 0; w < f->palavras && c < max_len; w++) {
+            size_t k = (size_t)d * f->palavras + w;
+            for (Palavra faltas = f->registrado[k] & ~f->presente[k]; faltas && c < max_len; faltas &= faltas - 1) {
+                array_matriculas[c++] = f->matriculas[w * BITS_PALAVRA + menor_bit(faltas)];
+            }
+        }
+    }
+    fechar_leitura();
+    return c;
+}
+
+EXPORT int adicionar_avaliacao(int matricula, const Avaliacao* avaliacao) {
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_AVALIACAO, matricula, avaliacao, sizeof(Avaliacao));
+    fechar_escrita();
+    return ok;
+}
+
+// Lista as avaliações em ordem de data
+EXPORT int listar_avaliacoes(int matricula, Avaliacao* arr, int max_len) {
+    abrir_leitura();
+    int i = indice_aluno(matricula), c = 0;
+    if (i != -1 && max_len > 0) {
+        const DadosFrios* f = &alunos_frios[i];
+        int n = limitar(f->num_avaliacoes, MAX_AVALIACOES), datas[MAX_AVALIACOES];
+        Avaliacao lidas[MAX_AVALIACOES];
+        const Avaliacao* avaliacoes = n ? avaliacoes_frias(f, lidas) : NULL;
+        if (avaliacoes && !f->indexado) {
+            // Sem índice por data (dados ainda como vieram do arquivo): ordena uma cópia
+            if (avaliacoes != lidas) memcpy(lidas, avaliacoes, n * sizeof(Avaliacao));
+            ordenar_por_data(lidas, datas, n, sizeof(Avaliacao), offsetof(Avaliacao, data));
+            avaliacoes = lidas;
+        }
+        c = !avaliacoes ? 0 : (n < max_len ? n : max_len);
+        if (c > 0) memcpy(arr, avaliacoes, c * sizeof(Avaliacao));
+    }
+    fechar_leitura();
+    return c;
+}
+
+// Substitui a avaliação lançada em 'data' (a primeira, se houver mais de uma no dia)
+EXPORT int atualizar_avaliacao(int matricula, const char* data, const Avaliacao* nova_avaliacao) {
+    AtualizacaoAvaliacao at;
+    at.data = converter_data(data);
+    if (at.data < 0) return 0;
+    at.avaliacao = *nova_avaliacao;
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_ALUNO_ATUALIZAR_AVALIACAO, matricula, &at, sizeof(at));
+    fechar_escrita();
+    return ok;
+}
+
+EXPORT int contar_alunos_por_turma(int id_turma) {
+    abrir_leitura();
+    int primeiro = hash_buscar(&hash_listas_turma, id_turma);
+    int c = 0;
+    if (primeiro != -1) {
+        int i = primeiro;
+        do { c++; i = prox_na_turma[i]; } while (i != primeiro);
+    }
+    fechar_leitura();
+    return c;
+}
+
+EXPORT int listar_resumos_por_turma(int id_turma, int inicio, AlunoResumo* arr, int limite) {
+    abrir_leitura();
+    int primeiro = hash_buscar(&hash_listas_turma, id_turma);
+    int c = 0;
+    if (primeiro != -1 && inicio >= 0 && limite > 0) {
+        int i = primeiro, p = 0;
+        // Pula os 'inicio' primeiros alunos da lista
+        for (; p < inicio; p++) {
+            i = prox_na_turma[i];
+            if (i == primeiro) break;
         }
+        if (p == inicio) {
+            do { montar_resumo(i, &arr[c++]); i = prox_na_turma[i]; } while (i != primeiro && c < limite);
+        }
+    }
+    fechar_leitura();
+    return c;
+}
+
+EXPORT int buscar_resumo_aluno(int matricula, AlunoResumo* r) {
+    abrir_leitura();
+    int i = indice_aluno(matricula);
+    if (i != -1) montar_resumo(i, r);
+    fechar_leitura();
+    return i != -1;
+}
+
+// --- Busca por nome ---
+
+typedef struct {
+    const Busca* busca;
+    void* saida;
+    int max_len;
+    int encontrados;
+} ResultadoBusca;
+
+static int aceitar_aluno(int matricula, void* contexto) {
+    ResultadoBusca* r = (ResultadoBusca*)contexto;
+    int i = indice_aluno(matricula);
+    char texto[TAMANHO_NORMALIZADO];
+    if (i == -1) return 1;
+    normalizar_texto(alunos_nome[i], sizeof(NomeAluno), texto, sizeof(texto));
+    if (busca_confere(r->busca, texto)) montar_resumo(i, (AlunoResumo*)r->saida + r->encontrados++);
+    return r->encontrados < r->max_len;
+}
+
+static int aceitar_turma(int id, void* contexto) {
+    ResultadoBusca* r = (ResultadoBusca*)contexto;
+    int i = indice_turma(id);
+    char texto[TAMANHO_NORMALIZADO];
+    if (i == -1) return 1;
+    normalizar_turma(&turmas[i], texto);
+    if (busca_confere(r->busca, texto)) ((Turma*)r->saida)[r->encontrados++] = turmas[i];
+    return r->encontrados < r->max_len;
+}
+
+EXPORT int buscar_alunos_por_nome(const char* texto, AlunoResumo* arr, int max_len) {
+    Busca busca;
+    ResultadoBusca r = { &busca, arr, max_len, 0 };
+    if (max_len <= 0 || !preparar_busca(texto, &busca)) return 0;
+    abrir_leitura();
+    percorrer_candidatos(&palavras_alunos, &busca, alunos_matricula, num_alunos, sizeof(int), aceitar_aluno, &r);
+    fechar_leitura();
+    return r.encontrados;
+}
+
+EXPORT int buscar_turmas_por_texto(const char* texto, Turma* arr, int max_len) {
+    Busca busca;
+    ResultadoBusca r = { &busca, arr, max_len, 0 };
+    if (max_len <= 0 || !preparar_busca(texto, &busca)) return 0;
+    abrir_leitura();
+    percorrer_candidatos(&palavras_turmas, &busca, num_turmas ? &turmas[0].id : NULL, num_turmas, sizeof(Turma), aceitar_turma, &r);
+    fechar_leitura();
+    return r.encontrados;
+}
+
+// Seleciona o backend de leitura por mapeamento de memória. Só tem efeito
+// antes do primeiro acesso aos dados; retorna 1 se a escolha foi aplicada.
+EXPORT int db_usar_mmap(int ativo) {
+    travar_escrita(&trava_dados);
+    int aplicado = !dados_carregados;
+    if (aplicado) usar_mmap = ativo ? 1 : 0;
+    destravar_escrita(&trava_dados);
+    return aplicado;
+}
+
+// --- Recálculo de médias ---
+
+// Cada política vira um kernel próprio, com os pesos como constantes de
+// compilação: nada de desvio por aluno. A conta é feita em double, como o
+// (np1*4 + np2*4 + pim*2) / 10 da interface em Python, e só o resultado é
+// arredondado para float.
+#define POLITICAS_MEDIA(X) \
+    X(DB_MEDIA_PADRAO,     media_padrao,     4.0, 4.0, 2.0, 10.0) \
+    X(DB_MEDIA_ARITMETICA, media_aritmetica, 1.0, 1.0, 1.0, 3.0) \
+    X(DB_MEDIA_PROVAS,     media_provas,     1.0, 1.0, 0.0, 2.0)
+
+#define MEDIA_ESCALAR(n, p1, p2, p3, divisor) \
+    (float)(((double)(n).np1 * (p1) + (double)(n).np2 * (p2) + (double)(n).pim * (p3)) / (divisor))
+
+#ifdef USAR_SSE
+// Médias das duas primeiras posições de a/b/c (np1s, np2s, pims)
+static __m128d media_pd(__m128 a, __m128 b, __m128 c, double p1, double p2, double p3, double divisor) {
+    __m128d soma = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(a), _mm_set1_pd(p1)), _mm_mul_pd(_mm_cvtps_pd(b), _mm_set1_pd(p2)));
+    soma = _mm_add_pd(soma, _mm_mul_pd(_mm_cvtps_pd(c), _mm_set1_pd(p3)));
+    return _mm_div_pd(soma, _mm_set1_pd(divisor));
+}
+
+// SSE: transpõe 4 alunos (np1/np2/pim/media de cada) em 4 vetores por
+// componente, calcula as 4 médias em duas metades e transpõe de volta
+#define KERNEL_MEDIA(politica, nome, p1, p2, p3, divisor) \
+static void nome(Notas* n, int quantidade) { \
+    int i = 0; \
+    for (; i + 4 <= quantidade; i += 4) { \
+        __m128 a = _mm_loadu_ps(&n[i].np1), b = _mm_loadu_ps(&n[i + 1].np1); \
+        __m128 c = _mm_loadu_ps(&n[i + 2].np1), e = _mm_loadu_ps(&n[i + 3].np1); \
+        _MM_TRANSPOSE4_PS(a, b, c, e); \
+        __m128d baixo = media_pd(a, b, c, p1, p2, p3, divisor); \
+        __m128d alto = media_pd(_mm_movehl_ps(a, a), _mm_movehl_ps(b, b), _mm_movehl_ps(c, c), p1, p2, p3, divisor); \
+        e = _mm_movelh_ps(_mm_cvtpd_ps(baixo), _mm_cvtpd_ps(alto)); \
+        _MM_TRANSPOSE4_PS(a, b, c, e); \
+        _mm_storeu_ps(&n[i].np1, a); _mm_storeu_ps(&n[i + 1].np1, b); \
+        _mm_storeu_ps(&n[i + 2].np1, c); _mm_storeu_ps(&n[i + 3].np1, e); \
+    } \
+    for (; i < quantidade; i++) n[i].media = MEDIA_ESCALAR(n[i], p1, p2, p3, divisor); \
+}
+#else
+#define KERNEL_MEDIA(politica, nome, p1, p2, p3, divisor) \
+static void nome(Notas* n, int quantidade) { \
+    for (int i = 0; i < quantidade; i++) n[i].media = MEDIA_ESCALAR(n[i], p1, p2, p3, divisor); \
+}
+#endif
+POLITICAS_MEDIA(KERNEL_MEDIA)
+#undef KERNEL_MEDIA
+
+// Chamada com a trava de escrita (também na reaplicação do log)
+static int aplicar_recalculo_medias(int politica) {
+    switch (politica) {
+#define CASO_MEDIA(p, nome, p1, p2, p3, divisor) case p: preservar_coluna(COL_NOTAS); nome(alunos_notas, num_alunos); return 1;
+    POLITICAS_MEDIA(CASO_MEDIA)
+#undef CASO_MEDIA
     }
     return 0;
 }
 
-EXPORT int deletar_turma(int id_turma) {
-    carregar_dados();
-    int turma_encontrada = 0;
-    for (int i = num_alunos - 1; i >= 0; i--) {
-        if (alunos[i].id_turma == id_turma) {
-            for (int j = i; j < num_alunos - 1; j++) alunos[j] = alunos[j + 1];
-            num_alunos--;
-        }
-    }
-    for (int i = 0; i < num_turmas; i++) {
-        if (turmas[i].id == id_turma) {
-            turma_encontrada = 1;
-            for (int j = i; j < num_turmas - 1; j++) turmas[j] = turmas[j + 1];
-            num_turmas--;
-            break;
+// --- Estatísticas de notas ---
+
+// Cada Notas (np1, np2, pim, media) ocupa exatamente um registrador SSE, então
+// os quatro componentes são acumulados juntos, um aluno por iteração.
+// 'notas' é o array denso dos alunos considerados (n > 0).
+static void calcular_estatisticas(const Notas* notas, int n, EstatTurma* e) {
+    float soma[4], minimo[4], maximo[4], media[4], variancia[4];
+#ifdef USAR_SSE
+    __m128 vsoma = _mm_setzero_ps();
+    __m128 vmin = _mm_loadu_ps(&notas[0].np1), vmax = vmin;
+    const __m128 zero = _mm_setzero_ps(), ultima_faixa = _mm_set1_ps((float)(EST_FAIXAS - 1));
+    int faixa[4];
+    for (int i = 0; i < n; i++) {
+        __m128 v = _mm_loadu_ps(&notas[i].np1);
+        vsoma = _mm_add_ps(vsoma, v);
+        vmin = _mm_min_ps(vmin, v);
+        vmax = _mm_max_ps(vmax, v);
+        // Faixa do histograma: trunc(nota) limitado a 0..EST_FAIXAS-1
+        __m128i vfaixa = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), ultima_faixa));
+        _mm_storeu_si128((__m128i*)faixa, vfaixa);
+        e->faixas[0][faixa[0]]++; e->faixas[1][faixa[1]]++;
+        e->faixas[2][faixa[2]]++; e->faixas[3][faixa[3]]++;
+    }
+    __m128 vmedia = _mm_div_ps(vsoma, _mm_set1_ps((float)n));
+    // Segunda passada para a variância: evita o cancelamento de E[x²] - E[x]²
+    __m128 vquadrados = _mm_setzero_ps();
+    for (int i = 0; i < n; i++) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(&notas[i].np1), vmedia);
+        vquadrados = _mm_add_ps(vquadrados, _mm_mul_ps(d, d));
+    }
+    _mm_storeu_ps(soma, vsoma);
+    _mm_storeu_ps(minimo, vmin);
+    _mm_storeu_ps(maximo, vmax);
+    _mm_storeu_ps(media, vmedia);
+    _mm_storeu_ps(variancia, _mm_div_ps(vquadrados, _mm_set1_ps((float)n)));
+#else
+    for (int c = 0; c < 4; c++) {
+        soma[c] = 0.0f;
+        minimo[c] = maximo[c] = (&notas[0].np1)[c];
+    }
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < 4; c++) {
+            float v = (&notas[i].np1)[c];
+            soma[c] += v;
+            if (v < minimo[c]) minimo[c] = v;
+            if (v > maximo[c]) maximo[c] = v;
+            // !(v > 0) também leva NaN à faixa 0, como o max do ramo SSE
+            int faixa = !(v > 0.0f) ? 0 : (v >= EST_FAIXAS - 1 ? EST_FAIXAS - 1 : (int)v);
+            e->faixas[c][faixa]++;
         }
     }
-    if (turma_encontrada) {
-        salvar_dados_alunos();
-        salvar_dados_turmas();
+    for (int c = 0; c < 4; c++) {
+        media[c] = soma[c] / n;
+        variancia[c] = 0.0f;
     }
-    return turma_encontrada;
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < 4; c++) {
+            float d = (&notas[i].np1)[c] - media[c];
+            variancia[c] += d * d;
+        }
+    }
+    for (int c = 0; c < 4; c++) variancia[c] /= n;
+#endif
+    memcpy(&e->soma, soma, sizeof(Notas));
+    memcpy(&e->minimo, minimo, sizeof(Notas));
+    memcpy(&e->maximo, maximo, sizeof(Notas));
+    memcpy(&e->media, media, sizeof(Notas));
+    memcpy(&e->variancia, variancia, sizeof(Notas));
 }
 
-EXPORT int alterar_id_turma(int id_antigo, int id_novo) {
-    carregar_dados();
-    if (id_antigo == id_novo) return 1;
-    if (turma_existe(id_novo)) return -1;
-    int turma_idx = -1;
-    for (int i = 0; i < num_turmas; i++) {
-        if (turmas[i].id == id_antigo) {
-            turma_idx = i;
-            break;
+// O recálculo vai para o log como um único registro com a política
+EXPORT int recalcular_medias(int politica) {
+    abrir_escrita();
+    int atualizados = registrar_alteracao(REG_RECALCULAR_MEDIAS, politica, NULL, 0) ? num_alunos : -1;
+    fechar_escrita();
+    return atualizados;
+}
+
+EXPORT int estatisticas_turma(int id_turma, EstatTurma* e) {
+    memset(e, 0, sizeof(*e));
+    abrir_leitura();
+    int primeiro = hash_buscar(&hash_listas_turma, id_turma);
+    Notas* denso = NULL;
+    if (primeiro != -1) {
+        int i = primeiro;
+        do { e->total++; i = prox_na_turma[i]; } while (i != primeiro);
+        // Junta as notas da turma (espalhadas pela coluna) num array denso
+        denso = (Notas*)malloc((size_t)e->total * sizeof(Notas));
+        if (denso) {
+            do {
+                const Notas* n = &alunos_notas[i];
+                if (n->np1 > 0.0f || n->np2 > 0.0f || n->pim > 0.0f) {
+                    denso[e->com_notas++] = *n;
+                    if (n->media >= EST_MEDIA_APROVACAO) e->aprovados++;
+                    else e->abaixo_da_media++;
+                }
+                i = prox_na_turma[i];
+            } while (i != primeiro);
         }
     }
-    if (turma_idx != -1) {
-        turmas[turma_idx].id = id_novo;
-        for (int i = 0; i < num_alunos; i++) {
-            if (alunos[i].id_turma == id_antigo) {
-                alunos[i].id_turma = id_novo;
-            }
+    fechar_leitura();
+    if (primeiro != -1 && !denso) {
+        memset(e, 0, sizeof(*e));
+        return 0;
+    }
+    if (e->com_notas > 0) calcular_estatisticas(denso, e->com_notas, e);
+    free(denso);
+    return e->total > 0;
+}
+
+// --- Snapshots ---
+
+// Fixa uma visão consistente de turmas e alunos (sem copiá-los) e retorna o
+// id do snapshot, ou 0 se faltou memória. Deve ser encerrado com db_snapshot_end.
+EXPORT int db_snapshot_begin() {
+    abrir_escrita();
+    int id = criar_snapshot();
+    fechar_escrita();
+    return id;
+}
+
+EXPORT int db_snapshot_end(int snapshot) {
+    abrir_escrita();
+    int achou = 0;
+    for (int k = 0; k < num_snapshots; k++) {
+        if (snapshots[k].id != snapshot) continue;
+        liberar_snapshot(&snapshots[k]);
+        if (k != --num_snapshots) snapshots[k] = snapshots[num_snapshots];
+        achou = 1;
+        break;
+    }
+    fechar_escrita();
+    return achou;
+}
+
+// Consultas sobre um snapshot: retornam -1 se o id não existe (ou o snapshot
+// foi invalidado por falta de memória)
+EXPORT int snapshot_listar_turmas(int snapshot, Turma* arr, int len) {
+    abrir_leitura();
+    const Snapshot* s = buscar_snapshot(snapshot);
+    int c = -1;
+    if (s) {
+        for (c = 0; c < s->linhas[COL_TURMAS] && c < len; c++) {
+            arr[c] = *(const Turma*)linha_snapshot(s, COL_TURMAS, c);
         }
-        salvar_dados_turmas();
-        salvar_dados_alunos();
-        return 1;
     }
-    return 0;
+    fechar_leitura();
+    return c;
 }
 
-EXPORT int alterar_matricula_aluno(int matricula_antiga, int matricula_nova) {
+EXPORT int snapshot_contar_alunos(int snapshot) {
+    abrir_leitura();
+    const Snapshot* s = buscar_snapshot(snapshot);
+    int c = s ? s->linhas[COL_MATRICULA] : -1;
+    fechar_leitura();
+    return c;
+}
+
+// Resumos das posições inicio..inicio+limite-1 do snapshot (todas as turmas)
+EXPORT int snapshot_listar_resumos(int snapshot, int inicio, AlunoResumo* arr, int limite) {
+    abrir_leitura();
+    const Snapshot* s = buscar_snapshot(snapshot);
+    int c = -1;
+    if (s) {
+        c = 0;
+        for (int i = inicio < 0 ? 0 : inicio; i < s->linhas[COL_MATRICULA] && c < limite; i++) {
+            montar_resumo_snapshot(s, i, &arr[c++]);
+        }
+    }
+    fechar_leitura();
+    return c;
+}
+
+EXPORT int snapshot_listar_resumos_por_turma(int snapshot, int id_turma, AlunoResumo* arr, int limite) {
+    abrir_leitura();
+    const Snapshot* s = buscar_snapshot(snapshot);
+    int c = -1;
+    if (s) {
+        c = 0;
+        for (int i = 0; i < s->linhas[COL_ID_TURMA] && c < limite; i++) {
+            if (*(const int*)linha_snapshot(s, COL_ID_TURMA, i) == id_turma) montar_resumo_snapshot(s, i, &arr[c++]);
+        }
+    }
+    fechar_leitura();
+    return c;
+}
+
+// --- Tabelas de registros ---
+
+// Monta "chave\0valor" para o log; retorna o tamanho ou 0 se a chave é inválida
+static int montar_registro(const char* chave, const char* valor, int tamanho_valor, char** out_dados) {
+    if (!chave || tamanho_valor < 0 || tamanho_valor > DB_REGISTRO_VALOR_MAXIMO || (tamanho_valor && !valor)) return 0;
+    size_t tamanho_chave = strlen(chave);
+    if (tamanho_chave == 0 || tamanho_chave > DB_REGISTRO_CHAVE_MAXIMA) return 0;
+    int tamanho = (int)tamanho_chave + 1 + tamanho_valor;
+    char* dados = (char*)malloc((size_t)tamanho);
+    if (!dados) return 0;
+    memcpy(dados, chave, tamanho_chave + 1);
+    if (tamanho_valor) memcpy(dados + tamanho_chave + 1, valor, tamanho_valor);
+    *out_dados = dados;
+    return tamanho;
+}
+
+EXPORT int db_registro_gravar(int tabela, const char* chave, const char* valor, int tamanho) {
+    char* dados = NULL;
+    int n = montar_registro(chave, valor, tamanho, &dados);
+    if (!n) return 0;
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_REGISTRO_GRAVAR, tabela, dados, n);
+    fechar_escrita();
+    free(dados);
+    return ok;
+}
+
+EXPORT int db_registro_remover(int tabela, const char* chave) {
+    char* dados = NULL;
+    int n = montar_registro(chave, NULL, 0, &dados);
+    if (!n) return 0;
+    abrir_escrita();
+    int ok = registrar_alteracao(REG_REGISTRO_REMOVER, tabela, dados, n);
+    fechar_escrita();
+    free(dados);
+    return ok;
+}
+
+EXPORT int db_registro_ler(int tabela, const char* chave, char* out_valor, int max_len) {
+    if (tabela < 0 || tabela >= DB_NUM_TABELAS || !chave) return -1;
+    int tamanho_chave = (int)strlen(chave), tamanho = -1;
+    abrir_leitura();
+    const TabelaRegistros* t = &tabelas_registros[tabela];
+    int i = registro_buscar(t, chave, tamanho_chave, hash_texto(chave, tamanho_chave));
+    if (i != -1) {
+        const Registro* r = &t->registros[i];
+        tamanho = r->tamanho_valor;
+        if (out_valor && tamanho <= max_len) memcpy(out_valor, r->bloco + r->tamanho_chave + 1, tamanho);
+    }
+    fechar_leitura();
+    return tamanho;
+}
+
+EXPORT int db_registro_contar(int tabela) {
+    if (tabela < 0 || tabela >= DB_NUM_TABELAS) return 0;
+    abrir_leitura();
+    int n = tabelas_registros[tabela].num_registros;
+    fechar_leitura();
+    return n;
+}
+
+EXPORT int db_registro_listar(int tabela, char* buffer, int max_len) {
+    if (tabela < 0 || tabela >= DB_NUM_TABELAS) return 0;
+    abrir_leitura();
+    const TabelaRegistros* t = &tabelas_registros[tabela];
+    long long total = 0;
+    for (int i = 0; i < t->num_registros; i++) total += 2 * (long long)sizeof(int) + t->registros[i].tamanho_chave + t->registros[i].tamanho_valor;
+    if (total > INT_MAX) total = -1;
+    else if (buffer && total <= max_len) {
+        char* p = buffer;
+        for (int i = 0; i < t->num_registros; i++) {
+            const Registro* r = &t->registros[i];
+            memcpy(p, &r->tamanho_chave, sizeof(int)); p += sizeof(int);
+            memcpy(p, &r->tamanho_valor, sizeof(int)); p += sizeof(int);
+            memcpy(p, r->bloco, r->tamanho_chave); p += r->tamanho_chave;
+            memcpy(p, r->bloco + r->tamanho_chave + 1, r->tamanho_valor); p += r->tamanho_valor;
+        }
+    }
+    fechar_leitura();
+    return (int)total;
+}
+// --- Replicação ---
+
+#define COPIA_ASSINATURA 0x50455253  // "SREP"
+#define COPIA_VERSAO 1
+#define NUM_ARQUIVOS_COPIA 4
+
+// Cópia completa para uma réplica: cabeçalho e os .dat em sequência
+typedef struct {
+    unsigned int assinatura;
+    int versao;
+    unsigned long long instancia;
+    unsigned long long seq;     // a cópia tem todas as alterações anteriores a seq
+    unsigned int tamanhos[NUM_ARQUIVOS_COPIA];
+    unsigned int crc;           // CRC-32 dos .dat
+} CabecalhoCopia;
+
+static const char* const arquivos_copia[NUM_ARQUIVOS_COPIA] = {
+    TURMAS_DB_FILE, ALUNOS_DB_FILE, FREQUENCIA_DB_FILE, REGISTROS_DB_FILE
+};
+static const char* const temporarios_copia[NUM_ARQUIVOS_COPIA] = {
+    TURMAS_TMP_FILE, ALUNOS_TMP_FILE, FREQUENCIA_TMP_FILE, REGISTROS_TMP_FILE
+};
+
+// Volta ao estado de antes da carga (com a trava de escrita), mantendo os
+// arrays alocados; a próxima carga lê os arquivos de novo. Snapshots abertos
+// ficam com cópia própria das páginas.
+static void descarregar_dados() {
+    for (int c = 0; c < NUM_COLUNAS_SNAPSHOT; c++) preservar_coluna(c);
+    for (int i = 0; i < num_alunos; i++) liberar_frios(&alunos_frios[i]);
+    num_turmas = num_alunos = 0;
+    for (int k = 0; k < num_frequencias; k++) {
+        free(frequencias[k].dias);
+        free(frequencias[k].registrado);
+        free(frequencias[k].presente);
+        free(frequencias[k].ocupadas);
+        free(frequencias[k].matriculas);
+    }
+    num_frequencias = 0;
+    hash_limpar(&hash_frequencias);
+    for (int t = 0; t < DB_NUM_TABELAS; t++) {
+        TabelaRegistros* r = &tabelas_registros[t];
+        for (int i = 0; i < r->num_registros; i++) free(r->registros[i].bloco);
+        r->num_registros = 0;
+        if (r->indice) memset(r->indice, 0, (size_t)r->capacidade_indice * sizeof(int));
+    }
+    travar(&trava_cache_frios);
+    reduzir_cache_frios(0);
+    destravar(&trava_cache_frios);
+    fechar_origem_fria();
+    travar(&trava_log);
+    if (f_log) fclose(f_log);
+    f_log = NULL;
+    log_pendente = 0;
+    tamanho_log = 0;
+    destravar(&trava_log);
+    formato_antigo = arquivos_protegidos = 0;
+    dados_carregados = 0;
+}
+
+static int gravar_arquivo(const char* caminho, const unsigned char* dados, size_t tamanho) {
+    FILE* f = fopen(caminho, "wb");
+    if (!f) return 0;
+    int ok = (tamanho == 0 || fwrite(dados, 1, tamanho, f) == tamanho) && sincronizar(f);
+    return fclose(f) == 0 && ok;
+}
+
+EXPORT int db_replicacao_estado(unsigned long long* out_instancia, unsigned long long* out_seq) {
+    abrir_leitura();
+    if (out_instancia) *out_instancia = instancia_dados;
+    if (out_seq) *out_seq = seq_alteracoes;
+    fechar_leitura();
+    return 1;
+}
+
+EXPORT int db_replicacao_ler(unsigned long long instancia, unsigned long long seq, char* buffer, int max_bytes,
+                             unsigned long long* out_seq) {
+    abrir_leitura();
+    int copiados = -1;
+    if (instancia == instancia_dados && seq >= historico.seq_inicio && seq <= seq_alteracoes) {
+        // Só avança até o fim da última transação inteira que coube
+        int k = (int)(seq - historico.seq_inicio), fim = k, dentro = 0;
+        int inicio = k < historico.num ? historico.posicoes[k] : historico.tamanho;
+        for (int j = k; j < historico.num; j++) {
+            int proximo = j + 1 < historico.num ? historico.posicoes[j + 1] : historico.tamanho;
+            if (proximo - inicio > max_bytes) break;
+            CabecalhoLog cab;
+            memcpy(&cab, historico.dados + historico.posicoes[j], sizeof(cab));
+            if (cab.tipo == REG_TRANSACAO_INICIO) dentro = 1;
+            else if (cab.tipo == REG_TRANSACAO_FIM) dentro = 0;
+            if (!dentro) fim = j + 1;
+        }
+        copiados = (fim < historico.num ? historico.posicoes[fim] : historico.tamanho) - inicio;
+        if (buffer && copiados > 0) memcpy(buffer, historico.dados + inicio, copiados);
+        if (out_seq) *out_seq = historico.seq_inicio + fim;
+    }
+    fechar_leitura();
+    return copiados;
+}
+
+EXPORT int db_replicacao_historico(int bytes) {
+    abrir_escrita();
+    int anterior = historico.limite;
+    if (bytes >= 0) {
+        historico.limite = bytes;
+        if (historico.tamanho > bytes) esvaziar_historico();
+        if (!bytes) {
+            free(historico.dados);
+            free(historico.posicoes);
+            free(historico.turmas);
+            historico.dados = NULL;
+            historico.posicoes = historico.turmas = NULL;
+            historico.capacidade = historico.capacidade_posicoes = historico.capacidade_turmas = 0;
+        }
+    }
+    fechar_escrita();
+    return anterior;
+}
+
+EXPORT int db_replicacao_copiar(const char* caminho, unsigned long long* out_instancia, unsigned long long* out_seq) {
+    unsigned char* dados[NUM_ARQUIVOS_COPIA] = { NULL };
+    size_t tamanhos[NUM_ARQUIVOS_COPIA] = { 0 };
+    CabecalhoCopia cab;
+    memset(&cab, 0, sizeof(cab));
+    cab.assinatura = COPIA_ASSINATURA;
+    cab.versao = COPIA_VERSAO;
+    abrir_escrita();
+    // Compactados, os .dat têm todas as alterações até aqui e nada além delas
+    int ok = compactar();
+    for (int k = 0; ok && k < NUM_ARQUIVOS_COPIA; k++) {
+        ok = ler_arquivo(arquivos_copia[k], &dados[k], &tamanhos[k]) && tamanhos[k] <= UINT_MAX;
+        if (ok) {
+            cab.tamanhos[k] = (unsigned int)tamanhos[k];
+            cab.crc = crc32_atualizar(cab.crc, dados[k], tamanhos[k]);
+        }
+    }
+    cab.instancia = instancia_dados;
+    cab.seq = seq_alteracoes;
+    fechar_escrita();
+    FILE* f = ok ? fopen(caminho, "wb") : NULL;
+    ok = f && fwrite(&cab, sizeof(cab), 1, f) == 1;
+    for (int k = 0; ok && k < NUM_ARQUIVOS_COPIA; k++) ok = fwrite(dados[k], 1, tamanhos[k], f) == tamanhos[k];
+    if (f && fclose(f) != 0) ok = 0;
+    for (int k = 0; k < NUM_ARQUIVOS_COPIA; k++) free(dados[k]);
+    if (!ok) {
+        if (f) remove(caminho);
+        return 0;
+    }
+    if (out_instancia) *out_instancia = cab.instancia;
+    if (out_seq) *out_seq = cab.seq;
+    return 1;
+}
+
+EXPORT int db_replicacao_instalar(const char* caminho, unsigned long long* out_instancia, unsigned long long* out_seq) {
+    unsigned char* dados;
+    size_t tamanho;
+    if (!ler_arquivo(caminho, &dados, &tamanho)) return 0;
+    CabecalhoCopia cab;
+    size_t esperado = sizeof(cab);
+    int ok = tamanho >= sizeof(cab);
+    if (ok) {
+        memcpy(&cab, dados, sizeof(cab));
+        for (int k = 0; k < NUM_ARQUIVOS_COPIA; k++) esperado += cab.tamanhos[k];
+        ok = cab.assinatura == COPIA_ASSINATURA && cab.versao == COPIA_VERSAO && esperado == tamanho &&
+             crc32_atualizar(0, dados + sizeof(cab), tamanho - sizeof(cab)) == cab.crc;
+    }
+    if (!ok) {
+        free(dados);
+        return 0;
+    }
+    abrir_escrita();
+    descarregar_dados();
+    // Temporários primeiro: uma falha no meio não deixa .dat misturados
+    size_t pos = sizeof(cab);
+    for (int k = 0; ok && k < NUM_ARQUIVOS_COPIA; k++) {
+        ok = gravar_arquivo(temporarios_copia[k], dados + pos, cab.tamanhos[k]);
+        pos += cab.tamanhos[k];
+    }
+    for (int k = 0; ok && k < NUM_ARQUIVOS_COPIA; k++) ok = substituir_arquivo(temporarios_copia[k], arquivos_copia[k]);
+    // O log local vale para os .dat antigos
+    if (ok) remove(LOG_DB_FILE);
+    for (int k = 0; k < NUM_ARQUIVOS_COPIA; k++) remove(temporarios_copia[k]);
     carregar_dados();
-    if (matricula_antiga == matricula_nova) return 1;
-    if (matricula_existe(matricula_nova)) return -1;
-    for (int i = 0; i < num_alunos; i++) {
-        if (alunos[i].matricula == matricula_antiga) {
-            alunos[i].matricula = matricula_nova;
-            salvar_dados_alunos();
-            return 1;
+    avisar_alteracoes();
+    fechar_escrita();
+    free(dados);
+    if (ok && out_instancia) *out_instancia = cab.instancia;
+    if (ok && out_seq) *out_seq = cab.seq;
+    return ok;
+}
+
+// Marca de transação repassada ao log e ao histórico da réplica; retorna 0
+// (com as alterações desfeitas) se não foi gravada
+static int replicar_marca(int tipo) {
+    if (!escrever_log(tipo, 0, NULL, 0)) {
+        desfazer_alteracoes();
+        return 0;
+    }
+    publicar_alteracao(tipo, 0, NULL, 0, -1);
+    return 1;
+}
+
+EXPORT int db_replicacao_aplicar(const char* registros, int tamanho, int* out_tabelas) {
+    const unsigned char* p = (const unsigned char*)registros;
+    if (out_tabelas) *out_tabelas = 0;
+    // Confere tudo antes de aplicar e acha o fim da última transação inteira
+    int pos = 0, fim = 0, num = 0, consumidos = 0, dentro = 0;
+    while (tamanho - pos >= (int)sizeof(CabecalhoLog)) {
+        CabecalhoLog cab;
+        memcpy(&cab, p + pos, sizeof(cab));
+        if (cab.tamanho < 0) return -1;
+        if (cab.tamanho > tamanho - pos - (int)sizeof(cab)) break;
+        if (crc_registro(&cab, p + pos + sizeof(cab)) != cab.crc) return -1;
+        pos += (int)sizeof(cab) + cab.tamanho;
+        num++;
+        if (cab.tipo == REG_TRANSACAO_INICIO) dentro = 1;
+        else if (cab.tipo == REG_TRANSACAO_FIM) dentro = 0;
+        if (!dentro) {
+            fim = pos;
+            consumidos = num;
         }
     }
-    return 0;
+    union { Aluno aluno; unsigned char bytes[sizeof(Aluno)]; } dados;  // cópia alinhada
+    int ok = 1, tabelas = 0;
+    abrir_escrita();
+    for (pos = 0; ok && pos < fim;) {
+        CabecalhoLog cab;
+        memcpy(&cab, p + pos, sizeof(cab));
+        const unsigned char* corpo = p + pos + sizeof(cab);
+        pos += (int)sizeof(cab) + cab.tamanho;
+        if (cab.tipo == REG_TRANSACAO_INICIO || cab.tipo == REG_TRANSACAO_FIM) {
+            if (!arquivos_protegidos) ok = replicar_marca(cab.tipo);
+        } else if (cab.tipo == REG_REGISTRO_GRAVAR || cab.tipo == REG_REGISTRO_REMOVER) {
+            ok = registrar_alteracao(cab.tipo, cab.chave, corpo, cab.tamanho);
+            if (ok && cab.chave >= 0 && cab.chave < DB_NUM_TABELAS) tabelas |= 1 << cab.chave;
+        } else if (cab.tamanho > (int)sizeof(dados)) {
+            ok = 0;
+        } else {
+            memcpy(dados.bytes, corpo, cab.tamanho);
+            ok = registrar_alteracao(cab.tipo, cab.chave, dados.bytes, cab.tamanho);
+        }
+    }
+    fechar_escrita();
+    if (out_tabelas) *out_tabelas = tabelas;
+    return ok ? consumidos : -1;
+}
+
+// --- Alterações para os clientes ---
+
+// Traduz o registro do histórico; retorna 0 para as marcas de transação
+static int descrever_alteracao(const CabecalhoLog* cab, const unsigned char* corpo, int turma, DbAlteracao* alt) {
+    memset(alt, 0, sizeof(*alt));
+    alt->chave = cab->chave;
+    alt->turma = turma;
+    switch (cab->tipo) {
+    case REG_TURMA_INSERIR: alt->entidade = DB_ALTERACAO_TURMA; alt->acao = DB_ACAO_INSERIR; break;
+    case REG_TURMA_ATUALIZAR: alt->entidade = DB_ALTERACAO_TURMA; alt->acao = DB_ACAO_ALTERAR; break;
+    case REG_TURMA_REMOVER: alt->entidade = DB_ALTERACAO_TURMA; alt->acao = DB_ACAO_REMOVER; break;
+    case REG_ALUNO_INSERIR: alt->entidade = DB_ALTERACAO_ALUNO; alt->acao = DB_ACAO_INSERIR; break;
+    case REG_ALUNO_REMOVER: alt->entidade = DB_ALTERACAO_ALUNO; alt->acao = DB_ACAO_REMOVER; break;
+    case REG_TURMA_ALTERAR_ID:
+    case REG_ALUNO_ALTERAR_MATRICULA:
+        alt->entidade = cab->tipo == REG_TURMA_ALTERAR_ID ? DB_ALTERACAO_TURMA : DB_ALTERACAO_ALUNO;
+        alt->acao = DB_ACAO_NOVA_CHAVE;
+        if (cab->tamanho == sizeof(int)) memcpy(&alt->valor, corpo, sizeof(int));
+        break;
+    case REG_RECALCULAR_MEDIAS: alt->entidade = DB_ALTERACAO_TODOS_ALUNOS; alt->acao = DB_ACAO_ALTERAR; break;
+    case REG_REGISTRO_GRAVAR:
+    case REG_REGISTRO_REMOVER: {
+        alt->entidade = DB_ALTERACAO_REGISTRO;
+        alt->acao = cab->tipo == REG_REGISTRO_GRAVAR ? DB_ACAO_ALTERAR : DB_ACAO_REMOVER;
+        int n = 0;
+        while (n < cab->tamanho && n < DB_REGISTRO_CHAVE_MAXIMA && corpo[n]) n++;
+        memcpy(alt->registro, corpo, n);
+        break;
+    }
+    case REG_TRANSACAO_INICIO:
+    case REG_TRANSACAO_FIM:
+        return 0;
+    default:
+        alt->entidade = DB_ALTERACAO_ALUNO;
+        alt->acao = DB_ACAO_ALTERAR;
+    }
+    return 1;
+}
+
+EXPORT int db_alteracoes_desde(unsigned long long instancia, unsigned long long seq, DbAlteracao* array_alteracoes,
+                               int max_len, unsigned long long* out_seq) {
+    abrir_leitura();
+    int n = -1;
+    if (instancia == instancia_dados && seq >= historico.seq_inicio && seq <= seq_alteracoes) {
+        int k = (int)(seq - historico.seq_inicio);
+        for (n = 0; k < historico.num && n < max_len; k++) {
+            CabecalhoLog cab;
+            memcpy(&cab, historico.dados + historico.posicoes[k], sizeof(cab));
+            const unsigned char* corpo = historico.dados + historico.posicoes[k] + sizeof(cab);
+            if (descrever_alteracao(&cab, corpo, historico.turmas[k], &array_alteracoes[n])) {
+                array_alteracoes[n++].seq = historico.seq_inicio + k;
+            }
+        }
+        if (out_seq) *out_seq = historico.seq_inicio + k;
+    } else if (out_seq) {
+        *out_seq = seq_alteracoes;
+    }
+    fechar_leitura();
+    return n;
+}
+
+EXPORT void db_avisar_alteracoes(void (*aviso)(void)) {
+    // Sem carregar os dados nem mudar a geração: só espera quem está publicando
+    travar_escrita(&trava_dados);
+    aviso_alteracoes = aviso;
+    destravar_escrita(&trava_dados);
 }
\ No newline at end of file
@@ -43,11 +43,40 @@ typedef struct {
     int num_presencas;
 } Aluno;
 
+// Projeção leve de um aluno, para listagens que não precisam de
+// avaliações e presenças (~120 bytes em vez de ~6 KB por aluno)
+typedef struct {
+    int matricula;
+    char nome[100];
+    Notas notas;
+} AlunoResumo;
+
+// Estatísticas das notas de uma turma. Cada campo Notas traz o valor para np1,
+// np2, pim e media. Só entram alunos com alguma nota lançada (np1, np2 ou pim > 0).
+#define EST_FAIXAS 10   // faixa k = notas em [k, k+1); a nota 10 entra na última
+#define EST_MEDIA_APROVACAO 7.0f
+typedef struct {
+    int total;              // alunos na turma
+    int com_notas;          // alunos considerados nas estatísticas
+    int aprovados;          // media >= 7
+    int abaixo_da_media;    // media < 7 (pendente de exame ou reprovado)
+    Notas soma;
+    Notas minimo;
+    Notas maximo;
+    Notas media;
+    Notas variancia;        // populacional
+    int faixas[4][EST_FAIXAS];  // histograma por componente (np1, np2, pim, media)
+} EstatTurma;
+
 // Protótipos das Funções
 
 // CORRIGIDO: salvar_turma e salvar_aluno agora aceitam ponteiros (const Turma*)
-EXPORT void salvar_turma(const Turma* nova_turma);
-EXPORT void salvar_aluno(const Aluno* novo_aluno);
+// Retornam 1 em caso de sucesso e 0 se a chave já existe ou faltou memória
+EXPORT int salvar_turma(const Turma* nova_turma);
+EXPORT int salvar_aluno(const Aluno* novo_aluno);
+// Inserção em lote (gravada uma única vez); retorna quantos registros foram inseridos
+EXPORT int salvar_turmas_lote(const Turma* novas_turmas, int quantidade);
+EXPORT int salvar_alunos_lote(const Aluno* novos_alunos, int quantidade);
 
 // (O resto das funções já usava o padrão correto ou tipos primitivos)
 EXPORT int turma_existe(int id);
@@ -67,14 +96,210 @@ EXPORT int deletar_aluno(int matricula);
 EXPORT int salvar_notas(int matricula, const Notas* notas);
 EXPORT int buscar_notas(int matricula, Notas* out_notas);
 
-// Novas funções para presenças
+// Novas funções para presenças (datas no formato DD/MM/YYYY, indexadas por data)
 EXPORT int adicionar_presenca(int matricula, const Presenca* presenca);
 EXPORT int listar_presencas(int matricula, Presenca* array_presencas, int max_len);
 EXPORT int buscar_presenca_por_data(int matricula, const char* data, Presenca* out_presenca);
+EXPORT int listar_presencas_periodo(int matricula, const char* inicio, const char* fim, Presenca* array_presencas, int max_len);
+
+// Frequência (presenças guardadas por turma em mapas de bits, sem limite de aulas).
+// 'registrados' conta os alunos com presença ou falta lançada na data.
+typedef struct {
+    char data[11];  // formato DD/MM/YYYY
+    int presentes;
+    int registrados;
+} FrequenciaData;
+
+// Retorna 0 se o aluno não existe; out_aulas = datas com presença ou falta lançada
+EXPORT int frequencia_aluno(int matricula, int* out_presencas, int* out_aulas);
+// Uma entrada por data de aula da turma, em ordem de data
+EXPORT int frequencia_turma(int id_turma, FrequenciaData* array_datas, int max_len);
+// Matrículas com falta lançada na data
+EXPORT int listar_ausentes(int id_turma, const char* data, int* array_matriculas, int max_len);
 
 // Novas funções para avaliações
 EXPORT int adicionar_avaliacao(int matricula, const Avaliacao* avaliacao);
 EXPORT int listar_avaliacoes(int matricula, Avaliacao* array_avaliacoes, int max_len);
 EXPORT int atualizar_avaliacao(int matricula, const char* data, const Avaliacao* nova_avaliacao);
 
+// Resumos e paginação: listar_resumos_por_turma devolve até 'limite' alunos
+// a partir da posição 'inicio' da lista da turma
+EXPORT int contar_alunos_por_turma(int id_turma);
+EXPORT int listar_resumos_por_turma(int id_turma, int inicio, AlunoResumo* array_resumos, int limite);
+EXPORT int buscar_resumo_aluno(int matricula, AlunoResumo* out_resumo);
+
+// Busca por prefixo de palavras, sem diferenciar maiúsculas nem acentos: cada
+// palavra do texto precisa começar alguma palavra do nome ("ana sil" encontra
+// "Ana Júlia Silva"). Resultados em ordem alfabética da palavra encontrada;
+// retorna quantos foram copiados (até max_len).
+EXPORT int buscar_alunos_por_nome(const char* texto, AlunoResumo* array_resumos, int max_len);
+// O mesmo sobre a disciplina e o professor de cada turma
+EXPORT int buscar_turmas_por_texto(const char* texto, Turma* array_turmas, int max_len);
+
+// Calcula as estatísticas das notas da turma; retorna 0 se a turma não tem alunos
+EXPORT int estatisticas_turma(int id_turma, EstatTurma* out_estatisticas);
+
+// Políticas de cálculo da média (pesos de np1, np2 e pim)
+#define DB_MEDIA_PADRAO 0       // (np1*4 + np2*4 + pim*2) / 10, a mesma da interface
+#define DB_MEDIA_ARITMETICA 1   // (np1 + np2 + pim) / 3
+#define DB_MEDIA_PROVAS 2       // (np1 + np2) / 2
+// Recalcula a media de todos os alunos; retorna quantos foram atualizados ou -1
+EXPORT int recalcular_medias(int politica);
+
+// Armazenamento com log: as alterações são acrescentadas em database.log e
+// compactadas nos arquivos .dat quando o log cresce (ou sob demanda).
+// turmas.dat e alunos.dat têm cabeçalho com versão e CRC; os do formato antigo
+// são convertidos na carga. Se algum é de versão mais nova ou está corrompido,
+// ou se database.log não tem cabeçalho válido, o banco fica somente leitura
+// (alterações e compactação retornam 0).
+EXPORT int db_compactar();
+
+// Todas as funções podem ser chamadas de várias threads: consultas rodam em
+// paralelo e alterações são serializadas por uma trava interna de leitura/escrita
+EXPORT int db_seguro_para_threads();
+
+// Contador que avança a cada alteração dos dados; serve para invalidar caches
+// de respostas montadas a partir das consultas
+EXPORT unsigned int db_geracao();
+
+// Política de durabilidade do log:
+//   IMEDIATA - cada alteração chega ao disco (fsync) antes de a função retornar (padrão)
+//   AGRUPADA - alterações se acumulam e vão juntas ao disco (um fsync) a cada intervalo_ms
+//   MANUAL   - só em db_flush(), na compactação ou ao encerrar o processo
+// Nos modos adiados, uma queda (do processo ou do sistema) perde as alterações
+// ainda não descarregadas; IMEDIATA resiste também a queda de energia.
+#define DB_DURABILIDADE_IMEDIATA 0
+#define DB_DURABILIDADE_AGRUPADA 1
+#define DB_DURABILIDADE_MANUAL 2
+EXPORT int db_set_durability(int politica, int intervalo_ms);
+EXPORT int db_flush();
+
+// Snapshots para relatórios: visão consistente de turmas e alunos (matrícula,
+// turma, nome e notas) enquanto as alterações continuam. As consultas retornam
+// -1 se o snapshot não existe.
+EXPORT int db_snapshot_begin();
+EXPORT int db_snapshot_end(int snapshot);
+EXPORT int snapshot_listar_turmas(int snapshot, Turma* array_turmas, int max_len);
+EXPORT int snapshot_contar_alunos(int snapshot);
+EXPORT int snapshot_listar_resumos(int snapshot, int inicio, AlunoResumo* array_resumos, int limite);
+EXPORT int snapshot_listar_resumos_por_turma(int snapshot, int id_turma, AlunoResumo* array_resumos, int limite);
+
+// Backend mmap (MapViewOfFile no Windows): deve ser chamado antes do primeiro acesso
+EXPORT int db_usar_mmap(int ativo);
+
+// A carga lê só a parte quente de alunos.dat (chaves, nomes e notas); as
+// avaliações de cada aluno são lidas do arquivo na primeira vez que são
+// usadas. As lidas ficam num cache LRU limitado em bytes (0 desliga,
+// negativo só consulta); retorna o limite anterior. Sem efeito no backend mmap.
+#define DB_CACHE_FRIOS_PADRAO (4 * 1024 * 1024)
+EXPORT int db_cache_frios(int bytes);
+
+// Tabelas de registros: chave de texto -> valor em bytes (o servidor guarda JSON),
+// no mesmo log e compactação de turmas e alunos. Gravar um registro acrescenta só
+// ele ao log, sem reescrever a tabela.
+#define DB_TABELA_USUARIOS 0
+#define DB_TABELA_PROVAS 1
+#define DB_TABELA_TURNOS 2
+#define DB_TABELA_EXAMES 3
+#define DB_TABELA_ANOTACOES 4
+#define DB_NUM_TABELAS 5
+#define DB_REGISTRO_CHAVE_MAXIMA 255
+#define DB_REGISTRO_VALOR_MAXIMO (16 * 1024 * 1024)
+// Insere ou substitui; retorna 0 se a tabela ou a chave é inválida ou faltou memória
+EXPORT int db_registro_gravar(int tabela, const char* chave, const char* valor, int tamanho);
+// Retorna 0 se a chave não existe
+EXPORT int db_registro_remover(int tabela, const char* chave);
+// Retorna o tamanho do valor (-1 se não existe); só copia se couber em max_len
+EXPORT int db_registro_ler(int tabela, const char* chave, char* out_valor, int max_len);
+EXPORT int db_registro_contar(int tabela);
+// Todos os registros da tabela, em ordem de inserção, como sequência de
+// [int tamanho_chave][int tamanho_valor][chave][valor]. Retorna o total de bytes
+// e só copia se couber em max_len (senão, chamar de novo com buffer maior).
+EXPORT int db_registro_listar(int tabela, char* buffer, int max_len);
+
+// Métricas de uso, acumuladas desde o início do processo. Cada função exportada
+// que consulta ou altera os dados tem uma entrada, criada na primeira chamada.
+#define DB_METRICA_NOME 48
+#define DB_METRICA_FAIXAS 20    // faixa 0 = abaixo de 1 us; faixa k = [2^(k-1), 2^k) us; a última acumula o resto
+typedef struct {
+    char nome[DB_METRICA_NOME];
+    long long chamadas;
+    long long tempo_ns;         // total dentro da função, com a espera pela trava
+    long long espera_ns;        // esperando a trava de dados
+    long long faixas[DB_METRICA_FAIXAS];  // histograma da duração das chamadas
+} DbMetrica;
+
+typedef struct {
+    long long bytes_log;        // registros acrescentados ao log
+    long long bytes_turmas;     // .dat reescritos pela compactação (salvar_dados_*)
+    long long bytes_alunos;
+    long long bytes_frequencia;
+    long long bytes_registros;
+    long long compactacoes;
+    long long tempo_compactacao_ns;
+    long long descargas_log;    // fsync do buffer do log
+    long long tamanho_log;      // tamanho atual do log
+    long long leituras_frios;   // avaliações lidas de alunos.dat sob demanda (faltas no cache)
+    long long acertos_frios;    // ... e servidas pelo cache (ver db_cache_frios)
+} DbMetricasIO;
+
+// Retorna quantas funções têm métricas e copia até max_len
+EXPORT int db_metricas(DbMetrica* array_metricas, int max_len);
+EXPORT int db_metricas_io(DbMetricasIO* out_io);
+
+// Replicação por envio do log: cada alteração aceita recebe um número de
+// sequência e fica num histórico em memória (os registros no formato do log,
+// limitado em bytes). Uma réplica instala uma cópia completa do primário e
+// depois aplica os registros a partir da sequência da cópia. A instância muda
+// a cada carga: sequências de outra instância não valem.
+#define DB_HISTORICO_PADRAO (8 * 1024 * 1024)
+EXPORT int db_replicacao_estado(unsigned long long* out_instancia, unsigned long long* out_seq);
+// Copia para buffer os registros a partir de seq, só transações inteiras, e
+// retorna os bytes copiados (*out_seq = sequência seguinte). Retorna -1 se seq
+// é de outra instância ou já saiu do histórico: a réplica precisa de uma cópia
+// nova. Com max_bytes >= o limite do histórico sempre há progresso.
+EXPORT int db_replicacao_ler(unsigned long long instancia, unsigned long long seq, char* buffer, int max_bytes,
+                             unsigned long long* out_seq);
+// Limite do histórico em bytes (0 desliga); retorna o anterior
+EXPORT int db_replicacao_historico(int bytes);
+// Compacta e grava em caminho a cópia completa (os quatro .dat), com a
+// instância e a sequência em que foi tirada
+EXPORT int db_replicacao_copiar(const char* caminho, unsigned long long* out_instancia, unsigned long long* out_seq);
+// Substitui todo o banco pela cópia (descarta o estado e o log locais)
+EXPORT int db_replicacao_instalar(const char* caminho, unsigned long long* out_instancia, unsigned long long* out_seq);
+// Aplica registros lidos com db_replicacao_ler (transação incompleta no fim
+// fica de fora). Retorna quantos registros foram consumidos, ou -1 se algum
+// está corrompido ou foi recusado. out_tabelas recebe os bits (1 << tabela)
+// das tabelas de registros alteradas.
+EXPORT int db_replicacao_aplicar(const char* registros, int tamanho, int* out_tabelas);
+
+// Alterações para os clientes: as mesmas sequências da replicação, uma
+// entrada por registro do histórico (as marcas de transação só contam na
+// sequência). chave é o id da turma, a matrícula ou a tabela de registros.
+#define DB_ALTERACAO_TURMA 1
+#define DB_ALTERACAO_ALUNO 2
+#define DB_ALTERACAO_REGISTRO 3      // registro = chave do registro
+#define DB_ALTERACAO_TODOS_ALUNOS 4  // recálculo das médias
+#define DB_ACAO_INSERIR 1
+#define DB_ACAO_ALTERAR 2            // registros: inserido ou substituído
+#define DB_ACAO_REMOVER 3
+#define DB_ACAO_NOVA_CHAVE 4         // valor = nova chave (id ou matrícula)
+typedef struct {
+    unsigned long long seq;
+    int entidade;
+    int acao;
+    int chave;
+    int valor;                  // nova chave em DB_ACAO_NOVA_CHAVE
+    int turma;                  // turma do aluno antes da alteração (-1 se não há)
+    char registro[DB_REGISTRO_CHAVE_MAXIMA + 1];
+} DbAlteracao;
+// Copia até max_len alterações a partir de seq e retorna quantas
+// (*out_seq = sequência seguinte). Retorna -1, com *out_seq = sequência atual,
+// se seq é de outra instância ou já saiu do histórico: recarregar tudo.
+EXPORT int db_alteracoes_desde(unsigned long long instancia, unsigned long long seq, DbAlteracao* array_alteracoes,
+                               int max_len, unsigned long long* out_seq);
+// Função chamada a cada alteração publicada, com a trava de escrita dos dados:
+// só deve sinalizar (NULL desliga)
+EXPORT void db_avisar_alteracoes(void (*aviso)(void));
+
 #endif // DATABASE_H
\ No newline at end of file
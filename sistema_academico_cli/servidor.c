@@ -0,0 +1,1758 @@
+// WSAPoll exige o Windows Vista ou posterior
+#if defined(_WIN32) && !defined(_WIN32_WINNT)
+#define _WIN32_WINNT 0x0600
+#endif
+// splice() nas transferências de arquivo
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "servidor.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mswsock.h>
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "mswsock.lib")
+#endif
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#if defined(__linux__) && !defined(SEM_EPOLL)
+#include <sys/epoll.h>
+#define USAR_EPOLL 1
+#endif
+#endif
+
+// Uma thread de E/S multiplexa todas as conexões e só entrega comandos
+// completos aos trabalhadores; cada conexão tem no máximo uma tarefa em
+// andamento, então os comandos de uma conexão rodam na ordem em que chegaram.
+// A thread de E/S é a única que mexe nas conexões e no poller.
+
+#define LEITURA_TEXTO 1024          // o cliente de texto manda um comando por recv de até 1 KB
+#define LEITURA_BINARIO 65536
+#define QUADRO_CABECALHO 9          // <IIB: tamanho do corpo, id do pedido, tipo
+#define QUADRO_TEXTO 0
+#define QUADRO_BINARIO 1
+#define QUADRO_MAXIMO (256u * 1024 * 1024)
+#define LIMITE_ENTRADA (1 << 20)    // quadros já completos acumulados antes de parar de ler
+#define LIMITE_SAIDA (1 << 20)      // cliente lento: para de ler até a saída esvaziar
+#define MAX_EVENTOS 256
+#define MAX_CAMPOS 8
+#define MAX_TRABALHADORES 64
+
+static const char PROTOCOLO_MAGIC[4] = { 0, 'S', 'A', 'B' };
+
+// Usam o socket diretamente (handshake OK_SEND_DATA / OK_DOWNLOAD): vão para o adotar
+static const char* const COMANDOS_DE_TRANSFERENCIA[] = { "UPLOAD_FILE", "IMPORT_CSV", "EXPORT_NOTAS", "DOWNLOAD_FILE" };
+
+// --- Portabilidade: sockets, travas e threads (SEM_EPOLL força o poll no Linux) ---
+
+#ifdef _WIN32
+typedef SOCKET Soquete;
+#define SOQUETE_INVALIDO INVALID_SOCKET
+#define FLAGS_ENVIO 0
+static void fechar_soquete(Soquete s) { closesocket(s); }
+static int erro_temporario() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+static int sem_descritores() { return WSAGetLastError() == WSAEMFILE || WSAGetLastError() == WSAENOBUFS; }
+static int modo_bloqueante(Soquete s, int bloqueante) {
+    u_long nao_bloqueante = !bloqueante;
+    return ioctlsocket(s, FIONBIO, &nao_bloqueante) == 0;
+}
+
+typedef SRWLOCK Trava;
+typedef CONDITION_VARIABLE Condicao;
+#define TRAVA_INICIAL SRWLOCK_INIT
+#define CONDICAO_INICIAL CONDITION_VARIABLE_INIT
+static void travar(Trava* t) { AcquireSRWLockExclusive(t); }
+static void destravar(Trava* t) { ReleaseSRWLockExclusive(t); }
+static void esperar(Condicao* c, Trava* t) { SleepConditionVariableSRW(c, t, INFINITE, 0); }
+static void sinalizar(Condicao* c) { WakeConditionVariable(c); }
+static void sinalizar_todos(Condicao* c) { WakeAllConditionVariable(c); }
+
+typedef HANDLE Thread;
+static DWORD WINAPI rotina_trabalhador(LPVOID arg);
+static int criar_thread(Thread* t) { *t = CreateThread(NULL, 0, rotina_trabalhador, NULL, 0, NULL); return *t != NULL; }
+static void juntar_thread(Thread t) { WaitForSingleObject(t, INFINITE); CloseHandle(t); }
+static int numero_processadores() { SYSTEM_INFO info; GetSystemInfo(&info); return (int)info.dwNumberOfProcessors; }
+static long long relogio_ns() {
+    static LARGE_INTEGER frequencia;
+    LARGE_INTEGER t;
+    if (!frequencia.QuadPart) QueryPerformanceFrequency(&frequencia);
+    QueryPerformanceCounter(&t);
+    return (long long)((double)t.QuadPart * 1e9 / (double)frequencia.QuadPart);
+}
+#else
+typedef int Soquete;
+#define SOQUETE_INVALIDO (-1)
+#ifdef MSG_NOSIGNAL
+#define FLAGS_ENVIO MSG_NOSIGNAL
+#else
+#define FLAGS_ENVIO 0
+#endif
+static void fechar_soquete(Soquete s) { close(s); }
+static int erro_temporario() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+static int sem_descritores() { return errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM; }
+static int modo_bloqueante(Soquete s, int bloqueante) {
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0) return 0;
+    flags = bloqueante ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    return fcntl(s, F_SETFL, flags) == 0;
+}
+
+typedef pthread_mutex_t Trava;
+typedef pthread_cond_t Condicao;
+#define TRAVA_INICIAL PTHREAD_MUTEX_INITIALIZER
+#define CONDICAO_INICIAL PTHREAD_COND_INITIALIZER
+static void travar(Trava* t) { pthread_mutex_lock(t); }
+static void destravar(Trava* t) { pthread_mutex_unlock(t); }
+static void esperar(Condicao* c, Trava* t) { pthread_cond_wait(c, t); }
+static void sinalizar(Condicao* c) { pthread_cond_signal(c); }
+static void sinalizar_todos(Condicao* c) { pthread_cond_broadcast(c); }
+
+typedef pthread_t Thread;
+static void* rotina_trabalhador(void* arg);
+static int criar_thread(Thread* t) { return pthread_create(t, NULL, rotina_trabalhador, NULL) == 0; }
+static void juntar_thread(Thread t) { pthread_join(t, NULL); }
+static int numero_processadores() { long n = sysconf(_SC_NPROCESSORS_ONLN); return n > 0 ? (int)n : 1; }
+static long long relogio_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+#endif
+
+// --- Buffers ---
+
+// Bytes em [inicio, fim) ainda não consumidos (entrada) ou não enviados (saída)
+typedef struct {
+    char* dados;
+    size_t inicio;
+    size_t fim;
+    size_t capacidade;
+} Buffer;
+
+static size_t buffer_pendente(const Buffer* b) { return b->fim - b->inicio; }
+
+static void buffer_liberar(Buffer* b) {
+    free(b->dados);
+    memset(b, 0, sizeof(*b));
+}
+
+// Garante espaço para 'extra' bytes depois de fim, reaproveitando o início já consumido
+static int buffer_reservar(Buffer* b, size_t extra) {
+    if (b->inicio == b->fim) b->inicio = b->fim = 0;
+    if (b->capacidade - b->fim >= extra) return 1;
+    if (b->inicio > 0) {
+        memmove(b->dados, b->dados + b->inicio, b->fim - b->inicio);
+        b->fim -= b->inicio;
+        b->inicio = 0;
+        if (b->capacidade - b->fim >= extra) return 1;
+    }
+    size_t nova = b->capacidade ? b->capacidade : 4096;
+    while (nova - b->fim < extra) nova *= 2;
+    char* p = (char*)realloc(b->dados, nova);
+    if (!p) return 0;
+    b->dados = p;
+    b->capacidade = nova;
+    return 1;
+}
+
+static int buffer_acrescentar(Buffer* b, const void* dados, size_t tamanho) {
+    if (!buffer_reservar(b, tamanho)) return 0;
+    memcpy(b->dados + b->fim, dados, tamanho);
+    b->fim += tamanho;
+    return 1;
+}
+
+// Resposta de um comando. Os primeiros QUADRO_CABECALHO bytes ficam reservados
+// para o cabeçalho, que a thread de E/S preenche nas conexões binárias.
+typedef struct {
+    char* dados;
+    size_t tamanho;
+    size_t capacidade;
+    int binario;
+    int falhou;     // faltou memória: a conexão é encerrada
+    int aguardar;   // nada a responder ainda: a tarefa espera (ver processar_concluidas e retomar_aguardando)
+    long long prazo;    // relogio_ns() até quando espera; mantido entre as execuções
+} Resposta;
+
+static int resposta_reservar(Resposta* r, size_t extra) {
+    if (r->falhou) return 0;
+    if (r->capacidade - r->tamanho >= extra) return 1;
+    size_t nova = r->capacidade ? r->capacidade : 256;
+    while (nova - r->tamanho < extra) nova *= 2;
+    char* p = (char*)realloc(r->dados, nova);
+    if (!p) { r->falhou = 1; return 0; }
+    r->dados = p;
+    r->capacidade = nova;
+    return 1;
+}
+
+static void resposta_limpar(Resposta* r) {
+    r->tamanho = 0;
+    r->binario = 0;
+    r->aguardar = 0;
+    if (resposta_reservar(r, QUADRO_CABECALHO)) r->tamanho = QUADRO_CABECALHO;
+}
+
+static int responder_bytes(Resposta* r, const void* dados, size_t tamanho, int binario) {
+    if (resposta_reservar(r, tamanho)) {
+        memcpy(r->dados + r->tamanho, dados, tamanho);
+        r->tamanho += tamanho;
+        r->binario = binario;
+    }
+    return 1;
+}
+
+static int responder(Resposta* r, const char* texto) {
+    return responder_bytes(r, texto, strlen(texto), 0);
+}
+
+static int responder_formato(Resposta* r, const char* formato, ...) {
+    va_list args;
+    va_start(args, formato);
+    int n = vsnprintf(NULL, 0, formato, args);
+    va_end(args);
+    if (n < 0) { r->falhou = 1; return 1; }
+    if (!resposta_reservar(r, (size_t)n + 1)) return 1;
+    va_start(args, formato);
+    vsnprintf(r->dados + r->tamanho, (size_t)n + 1, formato, args);
+    va_end(args);
+    r->tamanho += (size_t)n;
+    return 1;
+}
+
+// --- Conexões e tarefas ---
+
+#define CONEXAO_NOVA 0          // ainda não se sabe se é texto ou binária
+#define CONEXAO_TEXTO 1
+#define CONEXAO_BINARIO 2
+#define CONEXAO_ESCUTA 3        // socket de escuta e despertador também passam pelo poller
+#define CONEXAO_DESPERTADOR 4
+
+#define EVENTO_LER 1
+#define EVENTO_ESCREVER 2
+#define EVENTO_ERRO 4
+
+typedef struct Conexao {
+    Soquete sock;
+    int estado;
+    int ocupada;        // há uma tarefa da conexão com os trabalhadores
+    int encerrada;      // socket já fechado ou entregue; a estrutura espera ser liberada
+    int interesse;      // eventos pedidos ao poller
+    int posicao;        // índice no array de pollfd (sem epoll)
+    Buffer entrada;
+    Buffer saida;
+    struct Conexao* ant;
+    struct Conexao* prox;
+    struct Conexao* prox_lixo;
+} Conexao;
+
+#define TAREFA_COMANDO 0
+#define TAREFA_ADOTAR 1
+
+typedef struct Tarefa {
+    struct Tarefa* prox;
+    int tipo;
+    Conexao* conexao;       // NULL em TAREFA_ADOTAR
+    Soquete sock;           // TAREFA_ADOTAR: socket entregue ao adotar
+    int binario;
+    unsigned id;
+    char* comando;          // terminado em NUL
+    size_t tamanho;
+    Resposta resposta;
+    int fechar;             // o tratador pediu para encerrar a conexão
+    long long enfileirada;  // relogio_ns() ao entrar na fila
+} Tarefa;
+
+static ServidorTratador tratador = NULL;
+static ServidorAdotar adotar = NULL;
+static int somente_leitura = 0;     // ver servidor_somente_leitura
+
+// Fila dos trabalhadores e tarefas concluídas, protegidas por trava_tarefas
+static Trava trava_tarefas = TRAVA_INICIAL;
+static Condicao tem_tarefa = CONDICAO_INICIAL;
+static Tarefa* fila_inicio = NULL;
+static Tarefa* fila_fim = NULL;
+static Tarefa* concluidas_inicio = NULL;
+static Tarefa* concluidas_fim = NULL;
+static int despertador_tocado = 0;
+static int alteracoes_avisadas = 0;    // houve alteração desde a última retomada
+static int ha_aguardando = 0;          // há tarefas esperando alterações: avisar toca o despertador
+static int parar = 0;
+static int executando = 0;
+
+// Estado da thread de E/S
+static Conexao escuta;
+static Conexao despertador;
+static Soquete despertar_escrita = SOQUETE_INVALIDO;
+static Conexao* conexoes = NULL;    // abertas, duplamente encadeadas
+static Conexao* lixo = NULL;        // encerradas, liberadas no fim de cada rodada de eventos
+static Tarefa* aguardando = NULL;   // respostas esperando alterações (GET_CHANGES_SINCE)
+static int escuta_pausada = 0;
+
+static Tarefa* nova_tarefa(Conexao* c, const char* comando, size_t tamanho, int binario, unsigned id) {
+    Tarefa* t = (Tarefa*)calloc(1, sizeof(Tarefa));
+    if (!t) return NULL;
+    t->comando = (char*)malloc(tamanho + 1);
+    if (!t->comando) { free(t); return NULL; }
+    memcpy(t->comando, comando, tamanho);
+    t->comando[tamanho] = '\0';
+    t->tamanho = tamanho;
+    t->conexao = c;
+    t->sock = SOQUETE_INVALIDO;
+    t->binario = binario;
+    t->id = id;
+    return t;
+}
+
+static void liberar_tarefa(Tarefa* t) {
+    free(t->comando);
+    free(t->resposta.dados);
+    free(t);
+}
+
+static void enfileirar(Tarefa* t) {
+    t->enfileirada = relogio_ns();
+    travar(&trava_tarefas);
+    if (fila_fim) fila_fim->prox = t; else fila_inicio = t;
+    fila_fim = t;
+    sinalizar(&tem_tarefa);
+    destravar(&trava_tarefas);
+}
+
+// --- Despertador: os trabalhadores avisam a thread de E/S que há tarefas concluídas ---
+
+#ifdef _WIN32
+// Sem pipe que funcione com WSAPoll: um par de sockets TCP em loopback
+static int criar_despertador() {
+    Soquete l = socket(AF_INET, SOCK_STREAM, 0), c = SOQUETE_INVALIDO, a = SOQUETE_INVALIDO;
+    struct sockaddr_in end;
+    int tam = sizeof(end);
+    memset(&end, 0, sizeof(end));
+    end.sin_family = AF_INET;
+    end.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (l == SOQUETE_INVALIDO) return 0;
+    if (bind(l, (struct sockaddr*)&end, sizeof(end)) == 0 && listen(l, 1) == 0 &&
+        getsockname(l, (struct sockaddr*)&end, &tam) == 0 &&
+        (c = socket(AF_INET, SOCK_STREAM, 0)) != SOQUETE_INVALIDO &&
+        connect(c, (struct sockaddr*)&end, sizeof(end)) == 0)
+        a = accept(l, NULL, NULL);
+    fechar_soquete(l);
+    if (a == SOQUETE_INVALIDO) {
+        if (c != SOQUETE_INVALIDO) fechar_soquete(c);
+        return 0;
+    }
+    modo_bloqueante(a, 0);
+    modo_bloqueante(c, 0);
+    despertador.sock = a;
+    despertar_escrita = c;
+    return 1;
+}
+
+static void tocar_despertador() { char b = 1; send(despertar_escrita, &b, 1, 0); }
+static void esvaziar_despertador() { char b[64]; while (recv(despertador.sock, b, sizeof(b), 0) > 0) {} }
+#else
+static int criar_despertador() {
+    int p[2];
+    if (pipe(p) != 0) return 0;
+    modo_bloqueante(p[0], 0);
+    modo_bloqueante(p[1], 0);
+    despertador.sock = p[0];
+    despertar_escrita = p[1];
+    return 1;
+}
+
+static void tocar_despertador() { char b = 1; if (write(despertar_escrita, &b, 1) < 0) {} }
+static void esvaziar_despertador() { char b[64]; while (read(despertador.sock, b, sizeof(b)) > 0) {} }
+#endif
+
+static void fechar_despertador() {
+    if (despertador.sock != SOQUETE_INVALIDO) fechar_soquete(despertador.sock);
+    if (despertar_escrita != SOQUETE_INVALIDO) fechar_soquete(despertar_escrita);
+    despertador.sock = despertar_escrita = SOQUETE_INVALIDO;
+}
+
+// --- Poller: epoll, ou um array de pollfd para poll/WSAPoll ---
+
+typedef struct {
+    Conexao* dono;
+    int eventos;
+} Evento;
+
+#ifdef USAR_EPOLL
+static int epoll_fd = -1;
+static Evento eventos_prontos[MAX_EVENTOS];
+
+static int poller_criar() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return epoll_fd >= 0;
+}
+
+static void poller_destruir() {
+    if (epoll_fd >= 0) close(epoll_fd);
+    epoll_fd = -1;
+}
+
+static int poller_controlar(int operacao, Conexao* c, int interesse) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (interesse & EVENTO_LER) ev.events |= EPOLLIN;
+    if (interesse & EVENTO_ESCREVER) ev.events |= EPOLLOUT;
+    ev.data.ptr = c;
+    return epoll_ctl(epoll_fd, operacao, c->sock, &ev) == 0;
+}
+
+static int poller_adicionar(Conexao* c, int interesse) { return poller_controlar(EPOLL_CTL_ADD, c, interesse); }
+static int poller_alterar(Conexao* c, int interesse) { return poller_controlar(EPOLL_CTL_MOD, c, interesse); }
+static void poller_remover(Conexao* c) { poller_controlar(EPOLL_CTL_DEL, c, 0); }
+
+static int poller_esperar(Evento** eventos, int espera_ms) {
+    struct epoll_event ev[MAX_EVENTOS];
+    int n = epoll_wait(epoll_fd, ev, MAX_EVENTOS, espera_ms);
+    for (int i = 0; i < n; i++) {
+        int e = 0;
+        if (ev[i].events & EPOLLIN) e |= EVENTO_LER;
+        if (ev[i].events & EPOLLOUT) e |= EVENTO_ESCREVER;
+        if (ev[i].events & (EPOLLERR | EPOLLHUP)) e |= EVENTO_ERRO;
+        eventos_prontos[i].dono = (Conexao*)ev[i].data.ptr;
+        eventos_prontos[i].eventos = e;
+    }
+    *eventos = eventos_prontos;
+    return n < 0 ? 0 : n;
+}
+#else
+#ifdef _WIN32
+#define poll WSAPoll
+#endif
+static struct pollfd* pfds = NULL;
+static Conexao** donos = NULL;
+static Evento* eventos_prontos = NULL;
+static int num_pfds = 0;
+static int capacidade_pfds = 0;
+
+static int poller_criar() { return 1; }
+
+static void poller_destruir() {
+    free(pfds);
+    free(donos);
+    free(eventos_prontos);
+    pfds = NULL;
+    donos = NULL;
+    eventos_prontos = NULL;
+    num_pfds = capacidade_pfds = 0;
+}
+
+static short mascara_poll(int interesse) {
+    short m = 0;
+    if (interesse & EVENTO_LER) m |= POLLIN;
+    if (interesse & EVENTO_ESCREVER) m |= POLLOUT;
+    return m;
+}
+
+static int poller_adicionar(Conexao* c, int interesse) {
+    if (num_pfds == capacidade_pfds) {
+        int nova = capacidade_pfds ? capacidade_pfds * 2 : 64;
+        struct pollfd* p = (struct pollfd*)realloc(pfds, (size_t)nova * sizeof(struct pollfd));
+        if (!p) return 0;
+        pfds = p;
+        Conexao** d = (Conexao**)realloc(donos, (size_t)nova * sizeof(Conexao*));
+        if (!d) return 0;
+        donos = d;
+        Evento* e = (Evento*)realloc(eventos_prontos, (size_t)nova * sizeof(Evento));
+        if (!e) return 0;
+        eventos_prontos = e;
+        capacidade_pfds = nova;
+    }
+    pfds[num_pfds].fd = c->sock;
+    pfds[num_pfds].events = mascara_poll(interesse);
+    pfds[num_pfds].revents = 0;
+    donos[num_pfds] = c;
+    c->posicao = num_pfds++;
+    return 1;
+}
+
+static int poller_alterar(Conexao* c, int interesse) {
+    pfds[c->posicao].events = mascara_poll(interesse);
+    return 1;
+}
+
+// O último ocupa o lugar do removido
+static void poller_remover(Conexao* c) {
+    int i = c->posicao, ultimo = --num_pfds;
+    if (i != ultimo) {
+        pfds[i] = pfds[ultimo];
+        donos[i] = donos[ultimo];
+        donos[i]->posicao = i;
+    }
+}
+
+static int poller_esperar(Evento** eventos, int espera_ms) {
+    int n = 0;
+    if (poll(pfds, num_pfds, espera_ms) > 0) {
+        for (int i = 0; i < num_pfds; i++) {
+            short r = pfds[i].revents;
+            if (!r) continue;
+            int e = 0;
+            if (r & POLLIN) e |= EVENTO_LER;
+            if (r & POLLOUT) e |= EVENTO_ESCREVER;
+            if (r & (POLLERR | POLLHUP | POLLNVAL)) e |= EVENTO_ERRO;
+            eventos_prontos[n].dono = donos[i];
+            eventos_prontos[n].eventos = e;
+            n++;
+        }
+    }
+    *eventos = eventos_prontos;
+    return n;
+}
+#endif
+
+// --- Comandos executados na biblioteca ---
+
+// Mesmas regras do int() do Python para o que importa aqui (espaços nas pontas e sinal);
+// o resto (ex.: "1_000") não é aceito e o comando segue para o tratador
+static int ler_inteiro(const char* s, int* out) {
+    while (*s == ' ' || *s == '\t') s++;
+    int negativo = *s == '-';
+    if (*s == '-' || *s == '+') s++;
+    if (*s < '0' || *s > '9') return 0;
+    long long v = 0;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (*s++ - '0');
+        if (v > (long long)INT_MAX + 1) return 0;
+    }
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s) return 0;
+    if (negativo) v = -v;
+    if (v > INT_MAX || v < INT_MIN) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+// Número decimal simples (sem inf, nan ou hexadecimal, que o strtod também aceitaria)
+static int ler_real(const char* s, float* out) {
+    int digitos = 0;
+    for (const char* p = s; *p; p++) {
+        if (*p >= '0' && *p <= '9') digitos = 1;
+        else if (!strchr(" \t+-.eE", *p)) return 0;
+    }
+    if (!digitos) return 0;
+    char* fim;
+    double v = strtod(s, &fim);
+    while (*fim == ' ' || *fim == '\t') fim++;
+    if (fim == s || *fim) return 0;
+    *out = (float)v;
+    return 1;
+}
+
+// UTF-8 estrito, como o decode('utf-8') do servidor em Python
+static int utf8_valido(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        unsigned char c = s[i];
+        if (c < 0x80) { i++; continue; }
+        size_t extras;
+        unsigned minimo, cp;
+        if (c >= 0xC2 && c <= 0xDF) { extras = 1; minimo = 0x80; cp = c & 0x1F; }
+        else if (c >= 0xE0 && c <= 0xEF) { extras = 2; minimo = 0x800; cp = c & 0x0F; }
+        else if (c >= 0xF0 && c <= 0xF4) { extras = 3; minimo = 0x10000; cp = c & 0x07; }
+        else return 0;
+        if (n - i <= extras) return 0;
+        for (size_t k = 1; k <= extras; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) return 0;
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        if (cp < minimo || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+        i += extras + 1;
+    }
+    return 1;
+}
+
+// Cada comando retorna 1 se respondeu, ou 0 se os argumentos não são os esperados:
+// aí o comando vai para o tratador, que responde (ou falha) como sempre fez.
+// As mensagens são as mesmas do servidor em Python.
+typedef int (*Comando)(Resposta* r, char** campos, int n);
+
+static int cabe_em(const char* s, size_t tamanho) { return strlen(s) < tamanho; }
+
+static int cmd_listar_turmas_bin(Resposta* r, char** campos, int n) {
+    (void)campos; (void)n;
+    int capacidade = 256, count;
+    Turma* lista = NULL;
+    for (;;) {
+        Turma* p = (Turma*)realloc(lista, (size_t)capacidade * sizeof(Turma));
+        if (!p) { free(lista); r->falhou = 1; return 1; }
+        lista = p;
+        count = listar_turmas(lista, capacidade);
+        if (count < capacidade) break;
+        capacidade *= 2;
+    }
+    responder_bytes(r, lista, (size_t)count * sizeof(Turma), 1);
+    free(lista);
+    return 1;
+}
+
+static int cmd_listar_resumos_turma_bin(Resposta* r, char** campos, int n) {
+    int id_turma;
+    if (n < 2 || !ler_inteiro(campos[1], &id_turma)) return 0;
+    int total = contar_alunos_por_turma(id_turma);
+    AlunoResumo* lista = (AlunoResumo*)malloc((size_t)(total > 0 ? total : 1) * sizeof(AlunoResumo));
+    if (!lista) { r->falhou = 1; return 1; }
+    int count = listar_resumos_por_turma(id_turma, 0, lista, total);
+    responder_bytes(r, lista, count > 0 ? (size_t)count * sizeof(AlunoResumo) : 0, 1);
+    free(lista);
+    return 1;
+}
+
+static int cmd_add_turma(Resposta* r, char** campos, int n) {
+    int id;
+    Turma turma;
+    if (n < 4 || !ler_inteiro(campos[1], &id) || !cabe_em(campos[2], sizeof(turma.nome_disciplina)) ||
+        !cabe_em(campos[3], sizeof(turma.nome_professor))) return 0;
+    if (turma_existe(id)) return responder(r, "ERRO: ID de turma já existe.");
+    memset(&turma, 0, sizeof(turma));
+    turma.id = id;
+    strcpy(turma.nome_disciplina, campos[2]);
+    strcpy(turma.nome_professor, campos[3]);
+    return responder(r, salvar_turma(&turma) ? "SUCESSO: Turma adicionada." : "ERRO: Falha ao gravar a turma.");
+}
+
+// Limitado a 100 turmas, como no servidor em Python (a lista completa vem no LIST_TURMAS_BIN)
+static int cmd_listar_turmas(Resposta* r, char** campos, int n) {
+    (void)campos; (void)n;
+    Turma* lista = (Turma*)malloc(100 * sizeof(Turma));
+    if (!lista) { r->falhou = 1; return 1; }
+    int count = listar_turmas(lista, 100);
+    if (count == 0) responder(r, "Nenhuma turma cadastrada.");
+    for (int i = 0; i < count; i++)
+        responder_formato(r, "ID: %d, Disciplina: %.100s, Prof: %.100s\n",
+                          lista[i].id, lista[i].nome_disciplina, lista[i].nome_professor);
+    free(lista);
+    return 1;
+}
+
+// BUSCAR_ALUNOS|texto[|limite] e BUSCAR_TURMAS|texto[|limite]
+#define LIMITE_BUSCA_PADRAO 50
+#define LIMITE_BUSCA_MAXIMO 1000
+
+static int ler_limite_busca(char** campos, int n, int* limite) {
+    *limite = LIMITE_BUSCA_PADRAO;
+    if (n > 2 && campos[2][0] && !ler_inteiro(campos[2], limite)) return 0;
+    if (*limite < 1) *limite = 1;
+    if (*limite > LIMITE_BUSCA_MAXIMO) *limite = LIMITE_BUSCA_MAXIMO;
+    return 1;
+}
+
+static int cmd_buscar_turmas(Resposta* r, char** campos, int n) {
+    int limite;
+    if (n < 2 || !ler_limite_busca(campos, n, &limite)) return 0;
+    Turma* lista = (Turma*)malloc((size_t)limite * sizeof(Turma));
+    if (!lista) { r->falhou = 1; return 1; }
+    int count = buscar_turmas_por_texto(campos[1], lista, limite);
+    if (count == 0) responder(r, "Nenhuma turma encontrada.");
+    for (int i = 0; i < count; i++)
+        responder_formato(r, "ID: %d, Disciplina: %.100s, Prof: %.100s\n",
+                          lista[i].id, lista[i].nome_disciplina, lista[i].nome_professor);
+    free(lista);
+    return 1;
+}
+
+static int cmd_buscar_alunos(Resposta* r, char** campos, int n) {
+    int limite;
+    if (n < 2 || !ler_limite_busca(campos, n, &limite)) return 0;
+    AlunoResumo* lista = (AlunoResumo*)malloc((size_t)limite * sizeof(AlunoResumo));
+    if (!lista) { r->falhou = 1; return 1; }
+    int count = buscar_alunos_por_nome(campos[1], lista, limite);
+    if (count == 0) responder(r, "Nenhum aluno encontrado.");
+    for (int i = 0; i < count; i++) responder_formato(r, "Matrícula: %d, Nome: %.100s\n", lista[i].matricula, lista[i].nome);
+    free(lista);
+    return 1;
+}
+
+static int cmd_add_aluno(Resposta* r, char** campos, int n) {
+    int id_turma, matricula;
+    if (n < 4 || !ler_inteiro(campos[1], &id_turma) || !ler_inteiro(campos[2], &matricula)) return 0;
+    Aluno* aluno = (Aluno*)calloc(1, sizeof(Aluno));
+    if (!aluno) { r->falhou = 1; return 1; }
+    if (!cabe_em(campos[3], sizeof(aluno->nome))) { free(aluno); return 0; }
+    if (matricula_existe(matricula)) {
+        responder(r, "ERRO: Matrícula já cadastrada.");
+    } else {
+        aluno->id_turma = id_turma;
+        aluno->matricula = matricula;
+        strcpy(aluno->nome, campos[3]);
+        responder(r, salvar_aluno(aluno) ? "SUCESSO: Aluno adicionado." : "ERRO: Falha ao gravar o aluno.");
+    }
+    free(aluno);
+    return 1;
+}
+
+static int cmd_dados_turma(Resposta* r, char** campos, int n) {
+    int id;
+    Turma turma;
+    if (n < 2 || !ler_inteiro(campos[1], &id)) return 0;
+    if (!buscar_turma_por_id(id, &turma)) return responder(r, "ERRO: Turma não encontrada.");
+    return responder_formato(r, "%.100s|%.100s", turma.nome_disciplina, turma.nome_professor);
+}
+
+static int cmd_atualizar_turma(Resposta* r, char** campos, int n) {
+    int id;
+    if (n < 4 || !ler_inteiro(campos[1], &id)) return 0;
+    return responder(r, atualizar_turma(id, campos[2], campos[3]) ? "SUCESSO: Dados da turma atualizados." : "ERRO: Falha ao atualizar.");
+}
+
+static int cmd_deletar_turma(Resposta* r, char** campos, int n) {
+    int id;
+    if (n < 2 || !ler_inteiro(campos[1], &id)) return 0;
+    return responder(r, deletar_turma(id) ? "SUCESSO: Turma e alunos associados foram excluídos." : "ERRO: Turma não encontrada.");
+}
+
+static int cmd_alterar_id_turma(Resposta* r, char** campos, int n) {
+    int antigo, novo;
+    if (n < 3 || !ler_inteiro(campos[1], &antigo) || !ler_inteiro(campos[2], &novo)) return 0;
+    int ret = alterar_id_turma(antigo, novo);
+    if (ret == 1) return responder(r, "SUCESSO: ID da turma alterado.");
+    if (ret == -1) return responder_formato(r, "ERRO: O novo ID '%s' já está em uso.", campos[2]);
+    return responder(r, "ERRO: Turma com ID antigo não encontrada.");
+}
+
+static int cmd_dados_aluno(Resposta* r, char** campos, int n) {
+    int matricula;
+    AlunoResumo aluno;
+    if (n < 2 || !ler_inteiro(campos[1], &matricula)) return 0;
+    if (!buscar_resumo_aluno(matricula, &aluno)) return responder(r, "ERRO: Aluno não encontrado.");
+    return responder_formato(r, "%.100s", aluno.nome);
+}
+
+static int cmd_atualizar_aluno(Resposta* r, char** campos, int n) {
+    int matricula;
+    if (n < 3 || !ler_inteiro(campos[1], &matricula)) return 0;
+    return responder(r, atualizar_aluno(matricula, campos[2]) ? "SUCESSO: Dados do aluno atualizados." : "ERRO: Falha ao atualizar.");
+}
+
+static int cmd_deletar_aluno(Resposta* r, char** campos, int n) {
+    int matricula;
+    if (n < 2 || !ler_inteiro(campos[1], &matricula)) return 0;
+    return responder(r, deletar_aluno(matricula) ? "SUCESSO: Aluno excluído." : "ERRO: Falha ao excluir aluno (matrícula não encontrada).");
+}
+
+static int cmd_alterar_matricula(Resposta* r, char** campos, int n) {
+    int antiga, nova;
+    if (n < 3 || !ler_inteiro(campos[1], &antiga) || !ler_inteiro(campos[2], &nova)) return 0;
+    int ret = alterar_matricula_aluno(antiga, nova);
+    if (ret == 1) return responder(r, "SUCESSO: Matrícula alterada.");
+    if (ret == -1) return responder_formato(r, "ERRO: A nova matrícula '%s' já existe.", campos[2]);
+    return responder(r, "ERRO: Aluno com matrícula antiga não encontrado.");
+}
+
+static int cmd_atualizar_notas(Resposta* r, char** campos, int n) {
+    int matricula;
+    Notas notas;
+    if (n < 6 || !ler_inteiro(campos[1], &matricula) || !ler_real(campos[2], &notas.np1) ||
+        !ler_real(campos[3], &notas.np2) || !ler_real(campos[4], &notas.pim) || !ler_real(campos[5], &notas.media)) return 0;
+    return responder(r, salvar_notas(matricula, &notas) ? "SUCESSO: Notas atualizadas." : "ERRO: Falha ao atualizar notas via C lib.");
+}
+
+static int cmd_recalcular_medias(Resposta* r, char** campos, int n) {
+    int politica = 0;
+    if (n > 1 && campos[1][0] && !ler_inteiro(campos[1], &politica)) return 0;
+    int atualizados = recalcular_medias(politica);
+    if (atualizados < 0) return responder(r, "ERRO: Política de média inválida.");
+    return responder_formato(r, "SUCESSO: Média recalculada para %d alunos.", atualizados);
+}
+
+// GET_CHANGES_SINCE|instancia|seq[|espera_ms]: as alterações a partir de seq em
+// JSON, no formato do json.dumps(..., separators=(',', ':')) do servidor em
+// Python. instancia 0 (ou de outra carga) responde recarregar: o cliente relê
+// tudo e continua da seq recebida. Sem alterações, espera até espera_ms pela
+// próxima em vez de responder vazio.
+#define ALTERACOES_POR_RESPOSTA 1000
+#define ESPERA_ALTERACOES_MAXIMA 30000
+
+static const char* const nomes_entidades[] = { "", "turma", "aluno", "registro", "todos_alunos" };
+static const char* const nomes_acoes[] = { "", "inserir", "alterar", "remover", "nova_chave" };
+static const char* const nomes_tabelas[DB_NUM_TABELAS] = { "usuarios", "provas", "turnos", "exames", "anotacoes" };
+
+static int ler_sequencia(const char* s, unsigned long long* out) {
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s < '0' || *s > '9') return 0;
+    unsigned long long v = 0;
+    while (*s >= '0' && *s <= '9') {
+        unsigned d = (unsigned)(*s++ - '0');
+        if (v > (ULLONG_MAX - d) / 10) return 0;
+        v = v * 10 + d;
+    }
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s) return 0;
+    *out = v;
+    return 1;
+}
+
+// Texto JSON com ensure_ascii=False: só aspas, barra e controles são escapados
+static void responder_json_texto(Resposta* r, const char* s) {
+    responder_bytes(r, "\"", 1, 0);
+    const char* trecho = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        responder_bytes(r, trecho, (size_t)(s - trecho), 0);
+        trecho = s + 1;
+        switch (c) {
+        case '"': responder(r, "\\\""); break;
+        case '\\': responder(r, "\\\\"); break;
+        case '\n': responder(r, "\\n"); break;
+        case '\r': responder(r, "\\r"); break;
+        case '\t': responder(r, "\\t"); break;
+        case '\b': responder(r, "\\b"); break;
+        case '\f': responder(r, "\\f"); break;
+        default: responder_formato(r, "\\u%04x", c);
+        }
+    }
+    responder_bytes(r, trecho, (size_t)(s - trecho), 0);
+    responder_bytes(r, "\"", 1, 0);
+}
+
+static void responder_alteracao(Resposta* r, const DbAlteracao* a, int primeira) {
+    responder_formato(r, "%s{\"seq\":%llu,\"entidade\":\"%s\",\"acao\":\"%s\"", primeira ? "" : ",", a->seq,
+                      nomes_entidades[a->entidade], nomes_acoes[a->acao]);
+    if (a->entidade == DB_ALTERACAO_REGISTRO) {
+        responder_formato(r, ",\"tabela\":\"%s\",\"chave\":", nomes_tabelas[a->chave]);
+        responder_json_texto(r, a->registro);
+    } else if (a->entidade != DB_ALTERACAO_TODOS_ALUNOS) {
+        responder_formato(r, ",\"chave\":%d", a->chave);
+        if (a->entidade == DB_ALTERACAO_ALUNO) responder_formato(r, ",\"turma\":%d", a->turma);
+        if (a->acao == DB_ACAO_NOVA_CHAVE) responder_formato(r, ",\"valor\":%d", a->valor);
+    }
+    responder(r, "}");
+}
+
+// Contas de usuário não são publicadas
+static int alteracao_publica(const DbAlteracao* a) {
+    return a->entidade != DB_ALTERACAO_REGISTRO || (a->chave > DB_TABELA_USUARIOS && a->chave < DB_NUM_TABELAS);
+}
+
+static int cmd_alteracoes_desde(Resposta* r, char** campos, int n) {
+    unsigned long long instancia, seq, proxima = 0;
+    int espera = 0;
+    if (n < 3 || !ler_sequencia(campos[1], &instancia) || !ler_sequencia(campos[2], &seq) ||
+        (n > 3 && campos[3][0] && !ler_inteiro(campos[3], &espera))) return 0;
+    if (espera > ESPERA_ALTERACOES_MAXIMA) espera = ESPERA_ALTERACOES_MAXIMA;
+    DbAlteracao* lista = (DbAlteracao*)malloc(ALTERACOES_POR_RESPOSTA * sizeof(DbAlteracao));
+    if (!lista) { r->falhou = 1; return 1; }
+    int count = instancia ? db_alteracoes_desde(instancia, seq, lista, ALTERACOES_POR_RESPOSTA, &proxima) : -1;
+    if (count < 0) {
+        db_replicacao_estado(&instancia, &proxima);
+    } else if (count == 0 && espera > 0) {
+        long long agora = relogio_ns();
+        if (!r->prazo) r->prazo = agora + (long long)espera * 1000000;
+        if (agora < r->prazo) {
+            r->aguardar = 1;
+            free(lista);
+            return 1;
+        }
+    }
+    responder_formato(r, "{\"instancia\":%llu,\"seq\":%llu,\"recarregar\":%s,\"mais\":%s,\"alteracoes\":[", instancia,
+                      proxima, count < 0 ? "true" : "false", count == ALTERACOES_POR_RESPOSTA ? "true" : "false");
+    for (int i = 0, primeira = 1; i < count; i++) {
+        if (!alteracao_publica(&lista[i])) continue;
+        responder_alteracao(r, &lista[i], primeira);
+        primeira = 0;
+    }
+    responder(r, "]}");
+    free(lista);
+    return 1;
+}
+
+// LIST_ALUNOS_POR_TURMA, estatísticas e frequência (JSON) continuam no tratador:
+// dependem de dados do servidor (exames) ou da formatação do Python.
+// Os comandos com 'cache' só leem: a resposta pronta vale até db_geracao() mudar.
+// Os que alteram os dados ficam com o tratador numa réplica (servidor_somente_leitura).
+static const struct {
+    const char* nome;
+    Comando executar;
+    int so_binario;
+    int cache;
+    int altera;
+} comandos[] = {
+    { "LIST_TURMAS_BIN", cmd_listar_turmas_bin, 1, 1, 0 },
+    { "LIST_RESUMOS_TURMA_BIN", cmd_listar_resumos_turma_bin, 1, 1, 0 },
+    { "ADD_TURMA", cmd_add_turma, 0, 0, 1 },
+    { "LIST_TURMAS", cmd_listar_turmas, 0, 1, 0 },
+    { "BUSCAR_TURMAS", cmd_buscar_turmas, 0, 1, 0 },
+    { "BUSCAR_ALUNOS", cmd_buscar_alunos, 0, 1, 0 },
+    { "ADD_ALUNO", cmd_add_aluno, 0, 0, 1 },
+    { "GET_TURMA_DATA", cmd_dados_turma, 0, 1, 0 },
+    { "UPDATE_TURMA", cmd_atualizar_turma, 0, 0, 1 },
+    { "DELETE_TURMA", cmd_deletar_turma, 0, 0, 1 },
+    { "CHANGE_TURMA_ID", cmd_alterar_id_turma, 0, 0, 1 },
+    { "GET_ALUNO_DATA", cmd_dados_aluno, 0, 1, 0 },
+    { "UPDATE_ALUNO", cmd_atualizar_aluno, 0, 0, 1 },
+    { "DELETE_ALUNO", cmd_deletar_aluno, 0, 0, 1 },
+    { "CHANGE_ALUNO_ID", cmd_alterar_matricula, 0, 0, 1 },
+    { "UPDATE_NOTAS", cmd_atualizar_notas, 0, 0, 1 },
+    { "RECALCULAR_MEDIAS", cmd_recalcular_medias, 0, 0, 1 },
+    { "GET_CHANGES_SINCE", cmd_alteracoes_desde, 0, 0, 0 },
+};
+
+#define NUM_COMANDOS ((int)(sizeof(comandos) / sizeof(comandos[0])))
+
+// --- Métricas (ver servidor_metricas) ---
+
+static DbMetrica metricas_comandos[NUM_COMANDOS];
+static ServidorMetricas metricas_servidor;
+static Trava trava_metricas = TRAVA_INICIAL;
+
+// Mesmas faixas de db_metricas
+static int faixa_metrica(long long tempo_ns) {
+    long long us = tempo_ns / 1000;
+    int k = 0;
+    while (us > 0 && k < DB_METRICA_FAIXAS - 1) { us >>= 1; k++; }
+    return k;
+}
+
+static void medir_comando(int comando, long long espera_ns, long long tempo_ns, int acerto_cache, int falta_cache) {
+    DbMetrica* m = &metricas_comandos[comando];
+    travar(&trava_metricas);
+    m->chamadas++;
+    m->tempo_ns += tempo_ns;
+    m->espera_ns += espera_ns;
+    m->faixas[faixa_metrica(tempo_ns)]++;
+    metricas_servidor.acertos_cache += acerto_cache;
+    metricas_servidor.faltas_cache += falta_cache;
+    destravar(&trava_metricas);
+}
+
+static void contar(long long* contador) {
+    travar(&trava_metricas);
+    (*contador)++;
+    destravar(&trava_metricas);
+}
+
+EXPORT int servidor_metricas(DbMetrica* arr, int max_len, ServidorMetricas* out) {
+    travar(&trava_metricas);
+    for (int i = 0; i < NUM_COMANDOS && i < max_len; i++) {
+        arr[i] = metricas_comandos[i];
+        strncpy(arr[i].nome, comandos[i].nome, DB_METRICA_NOME - 1);
+        arr[i].nome[DB_METRICA_NOME - 1] = '\0';
+    }
+    if (out) *out = metricas_servidor;
+    destravar(&trava_metricas);
+    return NUM_COMANDOS;
+}
+
+// --- Cache de respostas ---
+
+// Mapeamento direto pelo hash do comando: uma colisão só substitui a entrada
+#define CACHE_ENTRADAS 256
+
+typedef struct {
+    char* comando;
+    size_t tamanho_comando;
+    unsigned geracao;
+    char* dados;        // corpo da resposta, sem o cabeçalho
+    size_t tamanho;
+    int binario;
+} ItemCache;
+
+static ItemCache cache[CACHE_ENTRADAS];
+static Trava trava_cache = TRAVA_INICIAL;
+
+// FNV-1a
+static unsigned posicao_cache(const char* comando, size_t tamanho) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < tamanho; i++) h = (h ^ (unsigned char)comando[i]) * 16777619u;
+    return h % CACHE_ENTRADAS;
+}
+
+static int cache_buscar(Tarefa* t, unsigned geracao) {
+    ItemCache* item = &cache[posicao_cache(t->comando, t->tamanho)];
+    int achou = 0;
+    travar(&trava_cache);
+    if (item->comando && item->geracao == geracao && item->tamanho_comando == t->tamanho &&
+        memcmp(item->comando, t->comando, t->tamanho) == 0) {
+        responder_bytes(&t->resposta, item->dados, item->tamanho, item->binario);
+        achou = !t->resposta.falhou;
+    }
+    destravar(&trava_cache);
+    return achou;
+}
+
+static void cache_guardar(const Tarefa* t, unsigned geracao) {
+    const Resposta* r = &t->resposta;
+    size_t tamanho = r->tamanho - QUADRO_CABECALHO;
+    char* comando = (char*)malloc(t->tamanho);
+    char* dados = (char*)malloc(tamanho ? tamanho : 1);
+    if (!comando || !dados) {
+        free(comando);
+        free(dados);
+        return;
+    }
+    memcpy(comando, t->comando, t->tamanho);
+    memcpy(dados, r->dados + QUADRO_CABECALHO, tamanho);
+    ItemCache* item = &cache[posicao_cache(t->comando, t->tamanho)];
+    travar(&trava_cache);
+    char* comando_antigo = item->comando;
+    char* dados_antigos = item->dados;
+    item->comando = comando;
+    item->tamanho_comando = t->tamanho;
+    item->geracao = geracao;
+    item->dados = dados;
+    item->tamanho = tamanho;
+    item->binario = r->binario;
+    destravar(&trava_cache);
+    free(comando_antigo);
+    free(dados_antigos);
+}
+
+static void cache_limpar() {
+    travar(&trava_cache);
+    for (int i = 0; i < CACHE_ENTRADAS; i++) {
+        free(cache[i].comando);
+        free(cache[i].dados);
+    }
+    memset(cache, 0, sizeof(cache));
+    destravar(&trava_cache);
+}
+
+// Retorna 1 se o comando foi respondido aqui
+static int executar_nativo(Tarefa* t) {
+    if (!utf8_valido((const unsigned char*)t->comando, t->tamanho) || memchr(t->comando, '\0', t->tamanho)) return 0;
+    // split('|'): todos os separadores viram NUL, os primeiros MAX_CAMPOS campos são guardados
+    char* copia = (char*)malloc(t->tamanho + 1);
+    if (!copia) return 0;
+    memcpy(copia, t->comando, t->tamanho + 1);
+    char* campos[MAX_CAMPOS];
+    int n = 0;
+    campos[n++] = copia;
+    for (char* p = copia; *p; p++) {
+        if (*p != '|') continue;
+        *p = '\0';
+        if (n < MAX_CAMPOS) campos[n++] = p + 1;
+    }
+    int tratado = 0;
+    for (int i = 0; i < NUM_COMANDOS; i++) {
+        if (strcmp(campos[0], comandos[i].nome) != 0) continue;
+        if (comandos[i].so_binario && !t->binario) break;
+        if (somente_leitura && comandos[i].altera) break;
+        long long inicio = relogio_ns();
+        // A geração é lida antes da consulta: uma escrita no meio deixa a entrada já vencida
+        unsigned geracao = comandos[i].cache ? db_geracao() : 0;
+        if (comandos[i].cache && cache_buscar(t, geracao)) {
+            medir_comando(i, inicio - t->enfileirada, relogio_ns() - inicio, 1, 0);
+            tratado = 1;
+            break;
+        }
+        tratado = comandos[i].executar(&t->resposta, campos, n);
+        if (!tratado) resposta_limpar(&t->resposta);
+        else if (comandos[i].cache && !t->resposta.falhou) cache_guardar(t, geracao);
+        // Estacionada: só a execução que enfim responde é medida
+        if (tratado && !t->resposta.aguardar)
+            medir_comando(i, inicio - t->enfileirada, relogio_ns() - inicio, 0, comandos[i].cache);
+        break;
+    }
+    free(copia);
+    return tratado;
+}
+
+static void executar_tarefa(Tarefa* t) {
+    resposta_limpar(&t->resposta);
+    if (executar_nativo(t)) return;
+    contar(&metricas_servidor.repassados);
+    if (!tratador) {
+        responder(&t->resposta, "ERRO: Comando não reconhecido.");
+    } else if (tratador(&t->resposta, t->comando, (int)t->tamanho, t->binario) < 0) {
+        t->fechar = 1;
+    }
+}
+
+EXPORT int servidor_responder(void* resposta, const char* dados, int tamanho, int binario) {
+    Resposta* r = (Resposta*)resposta;
+    if (!r || tamanho < 0) return 0;
+    resposta_limpar(r);
+    responder_bytes(r, dados, (size_t)tamanho, binario);
+    return !r->falhou;
+}
+
+// --- Trabalhadores ---
+
+static void laco_trabalhador() {
+    for (;;) {
+        travar(&trava_tarefas);
+        while (!fila_inicio && !parar) esperar(&tem_tarefa, &trava_tarefas);
+        if (parar) {
+            destravar(&trava_tarefas);
+            return;
+        }
+        Tarefa* t = fila_inicio;
+        fila_inicio = t->prox;
+        if (!fila_inicio) fila_fim = NULL;
+        t->prox = NULL;
+        destravar(&trava_tarefas);
+
+        if (t->tipo == TAREFA_ADOTAR) {
+            adotar((long long)t->sock, t->comando, (int)t->tamanho);
+            liberar_tarefa(t);
+            continue;
+        }
+        executar_tarefa(t);
+
+        travar(&trava_tarefas);
+        if (concluidas_fim) concluidas_fim->prox = t; else concluidas_inicio = t;
+        concluidas_fim = t;
+        int tocar = !despertador_tocado;
+        despertador_tocado = 1;
+        destravar(&trava_tarefas);
+        if (tocar) tocar_despertador();
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI rotina_trabalhador(LPVOID arg) { (void)arg; laco_trabalhador(); return 0; }
+#else
+static void* rotina_trabalhador(void* arg) { (void)arg; laco_trabalhador(); return NULL; }
+#endif
+
+// --- Laço de eventos ---
+
+static void encerrar(Conexao* c) {
+    if (c->encerrada) return;
+    poller_remover(c);
+    if (c->sock != SOQUETE_INVALIDO) fechar_soquete(c->sock);
+    c->sock = SOQUETE_INVALIDO;
+    c->encerrada = 1;
+    if (c->ant) c->ant->prox = c->prox; else conexoes = c->prox;
+    if (c->prox) c->prox->ant = c->ant;
+    // Com tarefa em andamento, vai para o lixo quando ela voltar
+    if (!c->ocupada) { c->prox_lixo = lixo; lixo = c; }
+    if (escuta_pausada) {
+        escuta_pausada = 0;
+        poller_alterar(&escuta, EVENTO_LER);
+    }
+}
+
+static void aceitar() {
+    for (;;) {
+        Soquete s = accept(escuta.sock, NULL, NULL);
+        if (s == SOQUETE_INVALIDO) {
+            // Sem descritores livres: para de aceitar até alguma conexão fechar
+            if (sem_descritores() && conexoes) {
+                escuta_pausada = 1;
+                poller_alterar(&escuta, 0);
+            }
+            return;
+        }
+        contar(&metricas_servidor.conexoes);
+        Conexao* c = (Conexao*)calloc(1, sizeof(Conexao));
+        if (c) c->sock = s;
+        if (!c || !modo_bloqueante(s, 0) || !poller_adicionar(c, EVENTO_LER)) {
+            free(c);
+            fechar_soquete(s);
+            continue;
+        }
+        c->estado = CONEXAO_NOVA;
+        c->interesse = EVENTO_LER;
+        c->prox = conexoes;
+        if (conexoes) conexoes->ant = c;
+        conexoes = c;
+    }
+}
+
+// Retorna 0 se a conexão fechou ou deu erro
+static int ler_entrada(Conexao* c) {
+    size_t maximo = c->estado == CONEXAO_BINARIO ? LEITURA_BINARIO : LEITURA_TEXTO;
+    if (!buffer_reservar(&c->entrada, maximo)) return 0;
+    int n = (int)recv(c->sock, c->entrada.dados + c->entrada.fim, (int)maximo, 0);
+    if (n > 0) {
+        c->entrada.fim += (size_t)n;
+        return 1;
+    }
+    return n < 0 && erro_temporario();
+}
+
+static int enviar_saida(Conexao* c) {
+    Buffer* b = &c->saida;
+    while (buffer_pendente(b)) {
+        size_t parte = buffer_pendente(b) < INT_MAX ? buffer_pendente(b) : INT_MAX;
+        int n = (int)send(c->sock, b->dados + b->inicio, (int)parte, FLAGS_ENVIO);
+        if (n > 0) b->inicio += (size_t)n;
+        else if (n < 0 && erro_temporario()) return 1;
+        else return 0;
+    }
+    // Devolve a memória de respostas grandes
+    if (b->capacidade > LIMITE_SAIDA) buffer_liberar(b);
+    else b->inicio = b->fim = 0;
+    return 1;
+}
+
+static unsigned ler_u32(const unsigned char* p) {
+    return (unsigned)p[0] | ((unsigned)p[1] << 8) | ((unsigned)p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static void escrever_u32(char* p, unsigned v) {
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)((v >> 8) & 0xFF);
+    p[2] = (char)((v >> 16) & 0xFF);
+    p[3] = (char)((v >> 24) & 0xFF);
+}
+
+static int quadro_completo(const Conexao* c) {
+    size_t pendente = buffer_pendente(&c->entrada);
+    if (pendente < QUADRO_CABECALHO) return 0;
+    return pendente - QUADRO_CABECALHO >= ler_u32((const unsigned char*)c->entrada.dados + c->entrada.inicio);
+}
+
+static int eh_transferencia(const char* dados, size_t tamanho) {
+    size_t fim = 0;
+    while (fim < tamanho && dados[fim] != '|') fim++;
+    for (size_t i = 0; i < sizeof(COMANDOS_DE_TRANSFERENCIA) / sizeof(COMANDOS_DE_TRANSFERENCIA[0]); i++) {
+        if (strlen(COMANDOS_DE_TRANSFERENCIA[i]) == fim && memcmp(dados, COMANDOS_DE_TRANSFERENCIA[i], fim) == 0) return 1;
+    }
+    return 0;
+}
+
+// A conexão de texto com o comando de transferência vai inteira para o adotar
+static void entregar_conexao(Conexao* c) {
+    Buffer* e = &c->entrada;
+    Tarefa* t = adotar ? nova_tarefa(NULL, e->dados + e->inicio, buffer_pendente(e), 0, 0) : NULL;
+    if (!t || enviar_saida(c) == 0 || buffer_pendente(&c->saida)) {
+        if (t) liberar_tarefa(t);
+        encerrar(c);
+        return;
+    }
+    t->tipo = TAREFA_ADOTAR;
+    t->sock = c->sock;
+    poller_remover(c);
+    modo_bloqueante(c->sock, 1);
+    c->sock = SOQUETE_INVALIDO;     // o socket agora é do adotar
+    c->encerrada = 1;
+    if (c->ant) c->ant->prox = c->prox; else conexoes = c->prox;
+    if (c->prox) c->prox->ant = c->ant;
+    c->prox_lixo = lixo;
+    lixo = c;
+    enfileirar(t);
+}
+
+// Entrega aos trabalhadores o próximo comando completo da conexão, se ela estiver livre.
+// Retorna 0 se a conexão foi encerrada ou entregue.
+static int despachar(Conexao* c) {
+    Buffer* e = &c->entrada;
+    if (c->ocupada) return 1;
+    if (c->estado == CONEXAO_NOVA) {
+        if (!buffer_pendente(e)) return 1;
+        if (e->dados[e->inicio] != PROTOCOLO_MAGIC[0]) {
+            c->estado = CONEXAO_TEXTO;
+        } else {
+            if (buffer_pendente(e) < sizeof(PROTOCOLO_MAGIC)) return 1;
+            if (memcmp(e->dados + e->inicio, PROTOCOLO_MAGIC, sizeof(PROTOCOLO_MAGIC)) != 0 ||
+                !buffer_acrescentar(&c->saida, PROTOCOLO_MAGIC, sizeof(PROTOCOLO_MAGIC))) {
+                encerrar(c);
+                return 0;
+            }
+            int um = 1;
+            setsockopt(c->sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&um, sizeof(um));
+            e->inicio += sizeof(PROTOCOLO_MAGIC);
+            c->estado = CONEXAO_BINARIO;
+        }
+    }
+    if (buffer_pendente(&c->saida) >= LIMITE_SAIDA) return 1;
+
+    Tarefa* t;
+    if (c->estado == CONEXAO_TEXTO) {
+        if (!buffer_pendente(e)) return 1;
+        if (eh_transferencia(e->dados + e->inicio, buffer_pendente(e))) {
+            entregar_conexao(c);
+            return 0;
+        }
+        t = nova_tarefa(c, e->dados + e->inicio, buffer_pendente(e), 0, 0);
+        e->inicio = e->fim;
+    } else {
+        if (buffer_pendente(e) < QUADRO_CABECALHO) return 1;
+        const unsigned char* p = (const unsigned char*)e->dados + e->inicio;
+        unsigned tamanho = ler_u32(p);
+        if (tamanho > QUADRO_MAXIMO) {
+            encerrar(c);
+            return 0;
+        }
+        if (!quadro_completo(c)) return 1;
+        t = nova_tarefa(c, (const char*)p + QUADRO_CABECALHO, tamanho, 1, ler_u32(p + 4));
+        e->inicio += QUADRO_CABECALHO + (size_t)tamanho;
+    }
+    if (!t) {
+        encerrar(c);
+        return 0;
+    }
+    c->ocupada = 1;
+    enfileirar(t);
+    return 1;
+}
+
+static void atualizar_interesse(Conexao* c) {
+    int quer = 0;
+    if (buffer_pendente(&c->saida)) quer |= EVENTO_ESCREVER;
+    if (buffer_pendente(&c->saida) < LIMITE_SAIDA) {
+        if (c->estado == CONEXAO_NOVA) quer |= EVENTO_LER;
+        else if (c->estado == CONEXAO_TEXTO) { if (!c->ocupada && !buffer_pendente(&c->entrada)) quer |= EVENTO_LER; }
+        else if (buffer_pendente(&c->entrada) < LIMITE_ENTRADA || !quadro_completo(c)) quer |= EVENTO_LER;
+    }
+    if (quer != c->interesse && poller_alterar(c, quer)) c->interesse = quer;
+}
+
+static void tratar_evento(Conexao* c, int eventos) {
+    // Erro sem nada para ler (ou sem interesse em ler): a conexão acabou
+    if ((eventos & EVENTO_ERRO) && (!(eventos & EVENTO_LER) || !(c->interesse & EVENTO_LER))) { encerrar(c); return; }
+    if ((eventos & EVENTO_ESCREVER) && !enviar_saida(c)) { encerrar(c); return; }
+    if ((eventos & EVENTO_LER) && !ler_entrada(c)) { encerrar(c); return; }
+    if (despachar(c)) atualizar_interesse(c);
+}
+
+// Coloca a resposta na saída: vira o próprio buffer de saída se ele estiver vazio
+static int enfileirar_resposta(Conexao* c, Tarefa* t) {
+    Resposta* r = &t->resposta;
+    if (r->falhou) return 0;
+    size_t inicio = QUADRO_CABECALHO;
+    if (c->estado == CONEXAO_BINARIO) {
+        escrever_u32(r->dados, (unsigned)(r->tamanho - QUADRO_CABECALHO));
+        escrever_u32(r->dados + 4, t->id);
+        r->dados[8] = (char)(r->binario ? QUADRO_BINARIO : QUADRO_TEXTO);
+        inicio = 0;
+    }
+    if (buffer_pendente(&c->saida)) return buffer_acrescentar(&c->saida, r->dados + inicio, r->tamanho - inicio);
+    free(c->saida.dados);
+    c->saida.dados = r->dados;
+    c->saida.capacidade = r->capacidade;
+    c->saida.inicio = inicio;
+    c->saida.fim = r->tamanho;
+    memset(r, 0, sizeof(*r));
+    return 1;
+}
+
+static void processar_concluidas() {
+    travar(&trava_tarefas);
+    Tarefa* t = concluidas_inicio;
+    concluidas_inicio = concluidas_fim = NULL;
+    despertador_tocado = 0;
+    destravar(&trava_tarefas);
+    while (t) {
+        Tarefa* prox = t->prox;
+        Conexao* c = t->conexao;
+        c->ocupada = 0;
+        if (c->encerrada) {
+            c->prox_lixo = lixo;
+            lixo = c;
+        } else if (t->resposta.aguardar && !t->fechar) {
+            // A conexão continua ocupada até a tarefa ser retomada
+            c->ocupada = 1;
+            t->prox = aguardando;
+            aguardando = t;
+            t = prox;
+            continue;
+        } else if (t->fechar || !enfileirar_resposta(c, t) || !enviar_saida(c)) {
+            encerrar(c);
+        } else if (despachar(c)) {
+            atualizar_interesse(c);
+        }
+        liberar_tarefa(t);
+        t = prox;
+    }
+}
+
+// GET_CHANGES_SINCE sem alterações: a tarefa fica aqui, com a conexão ocupada,
+// e volta para os trabalhadores na próxima alteração ou no prazo.
+
+// Chamado pela biblioteca, com a trava de escrita dos dados, a cada alteração
+static void avisar_alteracao() {
+    travar(&trava_tarefas);
+    alteracoes_avisadas = 1;
+    int tocar = ha_aguardando && !despertador_tocado;
+    if (tocar) despertador_tocado = 1;
+    destravar(&trava_tarefas);
+    if (tocar) tocar_despertador();
+}
+
+// Milissegundos até o prazo mais próximo (-1: nenhuma tarefa esperando)
+static int espera_aguardando() {
+    if (!aguardando) return -1;
+    long long menor = aguardando->resposta.prazo;
+    for (Tarefa* t = aguardando->prox; t; t = t->prox)
+        if (t->resposta.prazo < menor) menor = t->resposta.prazo;
+    long long ms = (menor - relogio_ns() + 999999) / 1000000;
+    return ms < 0 ? 0 : ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+static void retomar_aguardando() {
+    // Lido antes de percorrer: alteração a partir daqui toca o despertador
+    travar(&trava_tarefas);
+    int avisadas = alteracoes_avisadas;
+    alteracoes_avisadas = 0;
+    ha_aguardando = aguardando != NULL;
+    destravar(&trava_tarefas);
+    long long agora = relogio_ns();
+    Tarefa** p = &aguardando;
+    while (*p) {
+        Tarefa* t = *p;
+        Conexao* c = t->conexao;
+        if (!c->encerrada && !avisadas && agora < t->resposta.prazo) {
+            p = &t->prox;
+            continue;
+        }
+        *p = t->prox;
+        t->prox = NULL;
+        if (c->encerrada) {
+            c->ocupada = 0;
+            c->prox_lixo = lixo;
+            lixo = c;
+            liberar_tarefa(t);
+        } else {
+            enfileirar(t);
+        }
+    }
+}
+
+static void liberar_lixo() {
+    while (lixo) {
+        Conexao* c = lixo;
+        lixo = c->prox_lixo;
+        buffer_liberar(&c->entrada);
+        buffer_liberar(&c->saida);
+        free(c);
+    }
+}
+
+static void laco_eventos() {
+    for (;;) {
+        Evento* eventos;
+        int n = poller_esperar(&eventos, espera_aguardando());
+        for (int i = 0; i < n; i++) {
+            Conexao* c = eventos[i].dono;
+            if (c == &escuta) aceitar();
+            else if (c == &despertador) { esvaziar_despertador(); processar_concluidas(); }
+            else if (!c->encerrada) tratar_evento(c, eventos[i].eventos);
+        }
+        if (aguardando) retomar_aguardando();
+        liberar_lixo();
+        travar(&trava_tarefas);
+        int fim = parar;
+        destravar(&trava_tarefas);
+        if (fim) return;
+    }
+}
+
+static Soquete abrir_escuta(int porta) {
+    Soquete s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == SOQUETE_INVALIDO) return s;
+    int um = 1;
+    struct sockaddr_in end;
+    memset(&end, 0, sizeof(end));
+    end.sin_family = AF_INET;
+    end.sin_addr.s_addr = htonl(INADDR_ANY);
+    end.sin_port = htons((unsigned short)porta);
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&um, sizeof(um));
+    if (bind(s, (struct sockaddr*)&end, sizeof(end)) != 0 || listen(s, SOMAXCONN) != 0 || !modo_bloqueante(s, 0)) {
+        fechar_soquete(s);
+        return SOQUETE_INVALIDO;
+    }
+    return s;
+}
+
+static void descartar_tarefas(Tarefa* t) {
+    while (t) {
+        Tarefa* prox = t->prox;
+        if (t->tipo == TAREFA_ADOTAR) fechar_soquete(t->sock);
+        liberar_tarefa(t);
+        t = prox;
+    }
+}
+
+EXPORT int servidor_executar(int porta, int trabalhadores, ServidorTratador novo_tratador, ServidorAdotar novo_adotar) {
+    travar(&trava_tarefas);
+    int ocupado = executando;
+    executando = 1;
+    parar = 0;
+    destravar(&trava_tarefas);
+    if (ocupado) return 0;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        travar(&trava_tarefas);
+        executando = 0;
+        destravar(&trava_tarefas);
+        return 0;
+    }
+#endif
+    if (trabalhadores <= 0) trabalhadores = numero_processadores();
+    if (trabalhadores > MAX_TRABALHADORES) trabalhadores = MAX_TRABALHADORES;
+    tratador = novo_tratador;
+    adotar = novo_adotar;
+
+    Thread threads[MAX_TRABALHADORES];
+    int iniciadas = 0, ok = 0;
+    memset(&escuta, 0, sizeof(escuta));
+    memset(&despertador, 0, sizeof(despertador));
+    escuta.estado = CONEXAO_ESCUTA;
+    despertador.estado = CONEXAO_DESPERTADOR;
+    despertador.sock = SOQUETE_INVALIDO;
+    escuta.sock = abrir_escuta(porta);
+    if (escuta.sock != SOQUETE_INVALIDO && criar_despertador() && poller_criar() &&
+        poller_adicionar(&escuta, EVENTO_LER) && poller_adicionar(&despertador, EVENTO_LER)) {
+        while (iniciadas < trabalhadores && criar_thread(&threads[iniciadas])) iniciadas++;
+        ok = iniciadas > 0;
+    }
+    if (ok) {
+        db_avisar_alteracoes(avisar_alteracao);
+        laco_eventos();
+        db_avisar_alteracoes(NULL);
+    }
+
+    travar(&trava_tarefas);
+    parar = 1;
+    sinalizar_todos(&tem_tarefa);
+    destravar(&trava_tarefas);
+    for (int i = 0; i < iniciadas; i++) juntar_thread(threads[i]);
+
+    // Encerramento: fecha as conexões e descarta o que ficou nas filas
+    descartar_tarefas(fila_inicio);
+    descartar_tarefas(concluidas_inicio);
+    fila_inicio = fila_fim = concluidas_inicio = concluidas_fim = NULL;
+    while (aguardando) {
+        Tarefa* t = aguardando;
+        aguardando = t->prox;
+        if (t->conexao->encerrada) { t->conexao->prox_lixo = lixo; lixo = t->conexao; }
+        t->conexao->ocupada = 0;
+        liberar_tarefa(t);
+    }
+    while (conexoes) {
+        conexoes->ocupada = 0;
+        encerrar(conexoes);
+    }
+    liberar_lixo();
+    cache_limpar();
+    poller_destruir();
+    if (escuta.sock != SOQUETE_INVALIDO) fechar_soquete(escuta.sock);
+    escuta.sock = SOQUETE_INVALIDO;
+    fechar_despertador();
+    escuta_pausada = 0;
+    despertador_tocado = alteracoes_avisadas = ha_aguardando = 0;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    travar(&trava_tarefas);
+    executando = 0;
+    destravar(&trava_tarefas);
+    return ok;
+}
+
+EXPORT int servidor_parar() {
+    travar(&trava_tarefas);
+    int ativo = executando;
+    parar = 1;
+    sinalizar_todos(&tem_tarefa);
+    destravar(&trava_tarefas);
+    if (ativo && despertar_escrita != SOQUETE_INVALIDO) tocar_despertador();
+    return ativo;
+}
+
+EXPORT int servidor_somente_leitura(int ativo) {
+    int anterior = somente_leitura;
+    somente_leitura = ativo != 0;
+    return anterior;
+}
+
+// --- Transferência de arquivos ---
+
+// Transferências sem a cópia por um buffer do Python: sendfile (Linux) ou
+// TransmitFile (Windows) no envio, splice socket -> pipe -> arquivo (Linux)
+// no recebimento. O socket deve estar em modo bloqueante.
+
+#define BLOCO_TRANSFERENCIA 65536
+
+#ifdef _WIN32
+static HANDLE abrir_arquivo(const char* caminho, int escrita) {
+    wchar_t largo[MAX_PATH * 2];
+    if (!MultiByteToWideChar(CP_UTF8, 0, caminho, -1, largo, MAX_PATH * 2)) return INVALID_HANDLE_VALUE;
+    return CreateFileW(largo, escrita ? GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+                       escrita ? CREATE_ALWAYS : OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+}
+
+static int definir_tamanho(HANDLE f, long long tamanho) {
+    LARGE_INTEGER pos;
+    pos.QuadPart = tamanho;
+    return SetFilePointerEx(f, pos, NULL, FILE_BEGIN) && SetEndOfFile(f);
+}
+
+EXPORT long long servidor_enviar_arquivo(long long soquete, const char* caminho) {
+    HANDLE f = abrir_arquivo(caminho, 0);
+    if (f == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER tamanho;
+    long long enviados = -1;
+    // TransmitFile envia no máximo 2 GB - 1 por chamada
+    if (GetFileSizeEx(f, &tamanho)) {
+        enviados = 0;
+        while (enviados < tamanho.QuadPart) {
+            long long resto = tamanho.QuadPart - enviados;
+            DWORD parte = resto > 0x7FFFFFFE ? 0x7FFFFFFE : (DWORD)resto;
+            if (!TransmitFile((SOCKET)soquete, f, parte, 0, NULL, NULL, 0)) { enviados = -1; break; }
+            enviados += parte;
+        }
+    }
+    CloseHandle(f);
+    return enviados;
+}
+
+EXPORT long long servidor_receber_arquivo(long long soquete, const char* caminho, long long tamanho) {
+    HANDLE f = abrir_arquivo(caminho, 1);
+    if (f == INVALID_HANDLE_VALUE || tamanho < 0) {
+        if (f != INVALID_HANDLE_VALUE) CloseHandle(f);
+        return -1;
+    }
+    // Reserva o tamanho anunciado de uma vez (evita fragmentar o arquivo): o fim
+    // fica em 'tamanho' e a escrita começa do início; sem espaço, nem começa
+    LARGE_INTEGER inicio;
+    inicio.QuadPart = 0;
+    char* bloco = (char*)malloc(BLOCO_TRANSFERENCIA);
+    if (!bloco || !definir_tamanho(f, tamanho) || !SetFilePointerEx(f, inicio, NULL, FILE_BEGIN)) {
+        free(bloco);
+        CloseHandle(f);
+        return -1;
+    }
+    long long recebidos = 0;
+    while (recebidos < tamanho) {
+        long long resto = tamanho - recebidos;
+        int n = recv((SOCKET)soquete, bloco, resto < BLOCO_TRANSFERENCIA ? (int)resto : BLOCO_TRANSFERENCIA, 0);
+        if (n <= 0) break;
+        DWORD escritos;
+        if (!WriteFile(f, bloco, (DWORD)n, &escritos, NULL) || escritos != (DWORD)n) break;
+        recebidos += n;
+    }
+    definir_tamanho(f, recebidos);
+    free(bloco);
+    CloseHandle(f);
+    return recebidos;
+}
+#else
+EXPORT long long servidor_enviar_arquivo(long long soquete, const char* caminho) {
+    int f = open(caminho, O_RDONLY);
+    if (f < 0) return -1;
+    struct stat st;
+    long long enviados = -1;
+    if (fstat(f, &st) == 0) {
+        enviados = 0;
+#ifdef __linux__
+        off_t posicao = 0;
+        while (enviados < (long long)st.st_size) {
+            ssize_t n = sendfile((int)soquete, f, &posicao, (size_t)(st.st_size - enviados));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            enviados += n;
+        }
+        // sendfile pode não servir para este arquivo (ex.: sistema de arquivos sem suporte)
+        if (enviados == 0 && st.st_size > 0) lseek(f, 0, SEEK_SET);
+        else { close(f); return enviados < (long long)st.st_size ? -1 : enviados; }
+#endif
+        char* bloco = (char*)malloc(BLOCO_TRANSFERENCIA);
+        ssize_t lidos = 0;
+        while (bloco && (lidos = read(f, bloco, BLOCO_TRANSFERENCIA)) > 0) {
+            ssize_t feito = 0;
+            while (feito < lidos) {
+                ssize_t n = send((int)soquete, bloco + feito, (size_t)(lidos - feito), FLAGS_ENVIO);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) { lidos = -1; break; }
+                feito += n;
+            }
+            if (lidos < 0) break;
+            enviados += feito;
+        }
+        if (!bloco || lidos < 0) enviados = -1;
+        free(bloco);
+    }
+    close(f);
+    return enviados;
+}
+
+EXPORT long long servidor_receber_arquivo(long long soquete, const char* caminho, long long tamanho) {
+    int f = open(caminho, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (f < 0 || tamanho < 0) {
+        if (f >= 0) close(f);
+        return -1;
+    }
+    long long recebidos = 0;
+#ifdef __linux__
+    // Reserva o tamanho anunciado de uma vez (evita fragmentar o arquivo)
+    // Sem espaço, nem começa; sem suporte no sistema de arquivos, segue sem reservar
+    int reserva = tamanho > 0 ? posix_fallocate(f, 0, (off_t)tamanho) : 0;
+    if (reserva == ENOSPC || reserva == EFBIG) {
+        close(f);
+        return -1;
+    }
+    // Sem cópia para o espaço do usuário: socket -> pipe -> arquivo
+    int canal[2];
+    if (pipe(canal) == 0) {
+        int splice_ok = 1;
+        while (recebidos < tamanho) {
+            long long resto = tamanho - recebidos;
+            ssize_t n = splice((int)soquete, NULL, canal[1], NULL, resto < BLOCO_TRANSFERENCIA ? (size_t)resto : BLOCO_TRANSFERENCIA,
+                               SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && recebidos == 0 && errno == EINVAL) { splice_ok = 0; break; }  // cai na leitura comum
+            if (n <= 0) break;
+            ssize_t gravados = 0;
+            while (gravados < n) {
+                ssize_t g = splice(canal[0], NULL, f, NULL, (size_t)(n - gravados), SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (g < 0 && errno == EINTR) continue;
+                if (g <= 0) break;
+                gravados += g;
+            }
+            recebidos += gravados;
+            if (gravados < n) break;
+        }
+        close(canal[0]);
+        close(canal[1]);
+        if (splice_ok) {
+            if (ftruncate(f, (off_t)recebidos) != 0) recebidos = -1;
+            close(f);
+            return recebidos;
+        }
+    }
+#endif
+    char* bloco = (char*)malloc(BLOCO_TRANSFERENCIA);
+    while (bloco && recebidos < tamanho) {
+        long long resto = tamanho - recebidos;
+        ssize_t n = recv((int)soquete, bloco, resto < BLOCO_TRANSFERENCIA ? (size_t)resto : BLOCO_TRANSFERENCIA, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        ssize_t gravados = 0;
+        while (gravados < n) {
+            ssize_t g = write(f, bloco + gravados, (size_t)(n - gravados));
+            if (g < 0 && errno == EINTR) continue;
+            if (g <= 0) break;
+            gravados += g;
+        }
+        recebidos += gravados;
+        if (gravados < n) break;
+    }
+    free(bloco);
+    if (ftruncate(f, (off_t)recebidos) != 0) recebidos = -1;
+    close(f);
+    return recebidos;
+}
+#endif
\ No newline at end of file
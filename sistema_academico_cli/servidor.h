@@ -0,0 +1,49 @@
+#ifndef SERVIDOR_H
+#define SERVIDOR_H
+
+#include "database.h"
+
+// Servidor de comandos com laço de eventos (epoll no Linux, poll nos demais
+// sistemas POSIX, WSAPoll no Windows) e um grupo fixo de trabalhadores.
+// Fala o mesmo protocolo do servidor em Python: um comando de texto por
+// recv, ou quadros <tamanho, id, tipo> depois do PROTOCOLO_MAGIC "\0SAB".
+
+// Executa um comando que o servidor não conhece. Deve preencher a resposta com
+// servidor_responder e retornar 0, ou retornar < 0 para encerrar a conexão.
+typedef int (*ServidorTratador)(void* resposta, const char* comando, int tamanho, int binario);
+// Recebe uma conexão de texto que pediu transferência de arquivo (UPLOAD_FILE,
+// IMPORT_CSV, EXPORT_NOTAS, DOWNLOAD_FILE), já em modo bloqueante, junto com o
+// comando lido. A partir daí o socket é do chamador.
+typedef void (*ServidorAdotar)(long long soquete, const char* dados, int tamanho);
+
+// Escuta em 0.0.0.0:porta e só retorna depois de servidor_parar() (1) ou se não
+// conseguiu iniciar (0). trabalhadores <= 0 usa um por processador.
+EXPORT int servidor_executar(int porta, int trabalhadores, ServidorTratador tratador, ServidorAdotar adotar);
+// Define a resposta de um comando repassado ao tratador (binario = corpo empacotado)
+EXPORT int servidor_responder(void* resposta, const char* dados, int tamanho, int binario);
+EXPORT int servidor_parar();
+// Réplica de leitura: só os comandos que apenas consultam rodam em C; os que
+// alteram vão para o tratador, que os encaminha ao primário. Retorna o anterior.
+EXPORT int servidor_somente_leitura(int ativo);
+
+// Transferência de arquivos num socket bloqueante, sem passar os bytes pelo
+// chamador (sendfile/TransmitFile no envio, splice no recebimento no Linux).
+// O recebimento reserva 'tamanho' bytes no disco antes de começar (sem espaço,
+// retorna -1 sem ler nada) e, se a conexão cair no meio, deixa o arquivo com o
+// que chegou. Retornam os bytes transferidos ou -1.
+EXPORT long long servidor_enviar_arquivo(long long soquete, const char* caminho);
+EXPORT long long servidor_receber_arquivo(long long soquete, const char* caminho, long long tamanho);
+
+// Métricas do servidor nativo desde o início do processo. Os comandos atendidos
+// em C vêm no formato de db_metricas, com espera_ns = tempo na fila até um
+// trabalhador pegar; os repassados ao tratador são medidos por ele.
+typedef struct {
+    long long conexoes;         // aceitas
+    long long acertos_cache;
+    long long faltas_cache;
+    long long repassados;       // comandos entregues ao tratador
+} ServidorMetricas;
+// Retorna quantos comandos o servidor atende em C e copia até max_len
+EXPORT int servidor_metricas(DbMetrica* array_comandos, int max_len, ServidorMetricas* out);
+
+#endif // SERVIDOR_H
\ No newline at end of file